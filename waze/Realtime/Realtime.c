@@ -344,6 +344,12 @@ static RoadMapConfigDescriptor RT_CFG_PRM_WEBSRVV2CMD_Var =
                                     RT_CFG_TAB,
                                     RT_CFG_PRM_WEBSRVV2CMD_Name);
 
+//   Packed GPS path encoding
+static RoadMapConfigDescriptor RT_CFG_PRM_PACKEDPATH_Var =
+                           ROADMAP_CONFIG_ITEM(
+                                    RT_CFG_TAB,
+                                    RT_CFG_PRM_PACKEDPATH_Name);
+
 //   Random user
 static RoadMapConfigDescriptor RT_CFG_PRM_RANDOM_USER_Var =
                            ROADMAP_CONFIG_ITEM(
@@ -751,6 +757,16 @@ BOOL Realtime_Initialize()
                           RT_CFG_PRM_WEBSRVV2CMD_Default,
                           NULL);
 
+   //   Packed GPS path: 'auto' sends it to the servers which announce it in the login response,
+   //   'yes' also to the others, e.g. a test server
+   roadmap_config_declare_enumeration( RT_CFG_TYPE,
+                                      &RT_CFG_PRM_PACKEDPATH_Var,
+                                      NULL,
+                                      RT_CFG_PRM_PACKEDPATH_Auto,
+                                      RT_CFG_PRM_PACKEDPATH_No,
+                                      RT_CFG_PRM_PACKEDPATH_Yes,
+                                      NULL);
+
    // Visability group:
    roadmap_config_declare_enumeration( RT_USER_TYPE,
                                        &RT_CFG_PRM_VISGRP_Var,
@@ -1510,9 +1526,29 @@ BOOL HaveGPSPointsToSend()
    return (1 < gs_pPI->num_points);
 }
 
+// Offline dumps are sent later, maybe to another server, so they are never packed
+static BOOL UsePackedGPSPath()
+{
+   if( gs_bWritingOffline)
+      return FALSE;
+
+   if( roadmap_config_match( &RT_CFG_PRM_PACKEDPATH_Var, RT_CFG_PRM_PACKEDPATH_Yes))
+      return TRUE;
+
+   if( roadmap_config_match( &RT_CFG_PRM_PACKEDPATH_Var, RT_CFG_PRM_PACKEDPATH_No))
+      return FALSE;
+
+   return (RTNET_PROTOCOL_VERSION_PACKED_PATH <= gs_CI.iServerMaxProtocol);
+}
+
+static int GPSPathMaxPoints()
+{
+   return UsePackedGPSPath()? RTTRK_GPSPATH_PACKED_MAX_POINTS: RTTRK_GPSPATH_MAX_POINTS;
+}
+
 BOOL GPSPointsMultipleCycles()
 {
-   return (RTTRK_GPSPATH_MAX_POINTS < gs_pPI->num_points);
+   return (GPSPathMaxPoints() < gs_pPI->num_points);
 }
 
 BOOL SendMessage_GPSPath( char* packet_only)
@@ -1523,6 +1559,7 @@ BOOL SendMessage_GPSPath( char* packet_only)
                         gs_pPI->points[0].GPS_time,
                         gs_pPI->points,
                         gs_pPI->num_points,
+                        UsePackedGPSPath(),
                         OnAsyncOperationCompleted_GPSPath,
                         packet_only);
 
@@ -2447,10 +2484,10 @@ BOOL SendAllMessagesTogether_SendPart2( BOOL bFirstCycle)
       if (iPoint >= pOrigPI->num_points) {
          return FALSE;
       }
-      iPoint += RTTRK_GPSPATH_MAX_POINTS;
+      iPoint += GPSPathMaxPoints();
    }
 
-   if (iPoint + RTTRK_GPSPATH_MAX_POINTS >= pOrigPI->num_points) {
+   if (iPoint + GPSPathMaxPoints() >= pOrigPI->num_points) {
       pfnOnCompleted = OnAsyncOperationCompleted_AllTogether;
       bLastPacket = TRUE;
    } else {
@@ -2471,8 +2508,8 @@ BOOL SendAllMessagesTogether_SendPart2( BOOL bFirstCycle)
    pi = *pOrigPI;
 
    pi.num_points = pOrigPI->num_points - iPoint;
-   if( pi.num_points > RTTRK_GPSPATH_MAX_POINTS)
-      pi.num_points = RTTRK_GPSPATH_MAX_POINTS;
+   if( pi.num_points > GPSPathMaxPoints())
+      pi.num_points = GPSPathMaxPoints();
    pi.points = pOrigPI->points + iPoint;
 
    gs_pPI = &pi;
@@ -4721,6 +4758,8 @@ void Realtime_DumpOffline (void)
 
    ebuffer_init( &Packet);
 
+   gs_bWritingOffline = TRUE;
+
    pOrigPI = editor_track_report_begin_export (1);
 
    if (pOrigPI && pOrigPI->num_nodes + pOrigPI->num_points + pOrigPI->num_update_toggles > 0)
@@ -4784,7 +4823,6 @@ void Realtime_DumpOffline (void)
    }
    editor_track_report_conclude_export (1);
 
-   gs_bWritingOffline = TRUE;
    editor_report_markers ();
    editor_report_segments ();
    gs_bWritingOffline = FALSE;
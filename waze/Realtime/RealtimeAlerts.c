@@ -437,6 +437,9 @@ void RTAlerts_Init()
     for (i=0; i<RT_MAXIMUM_ALERT_COUNT; i++)
         gAlertsTable.alert[i] = NULL;
 
+    for (i=0; i<RT_ALERTS_INDEX_SIZE; i++)
+        gAlertsTable.byID[i] = NULL;
+
     gAlertsTable.iCount = 0;
     gAlertsTable.iGroupCount = 0;
     gAlertsTable.iArchiveCount = 0;
@@ -574,6 +577,68 @@ RTAlert * RTAlerts_Get(int record)
     return gAlertsTable.alert[record];
 }
 
+#define RT_ALERTS_INDEX_MASK (RT_ALERTS_INDEX_SIZE - 1)
+
+/**
+ * Home bucket of an alert ID in the index
+ * @param iID - the id of the alert
+ * @return the bucket
+ */
+static unsigned int RTAlerts_Index_Bucket(int iID)
+{
+    unsigned int h = (unsigned int)iID * 2654435761U;
+
+    return (h ^ (h >> 16)) & RT_ALERTS_INDEX_MASK;
+}
+
+/**
+ * Add an alert to the ID index
+ * @param pAlert - pointer to the alert
+ * @return None
+ */
+static void RTAlerts_Index_Add(RTAlert *pAlert)
+{
+    unsigned int b = RTAlerts_Index_Bucket(pAlert->iID);
+
+    while (gAlertsTable.byID[b] != NULL)
+        b = (b + 1) & RT_ALERTS_INDEX_MASK;
+
+    gAlertsTable.byID[b] = pAlert;
+}
+
+/**
+ * Remove an alert from the ID index. The following entries of the probe
+ * sequence are moved back, so lookups can stop at the first empty bucket.
+ * @param pAlert - pointer to the alert
+ * @return None
+ */
+static void RTAlerts_Index_Remove(RTAlert *pAlert)
+{
+    unsigned int hole = RTAlerts_Index_Bucket(pAlert->iID);
+    unsigned int next;
+
+    while (gAlertsTable.byID[hole] != NULL && gAlertsTable.byID[hole] != pAlert)
+        hole = (hole + 1) & RT_ALERTS_INDEX_MASK;
+
+    if (gAlertsTable.byID[hole] == NULL)
+        return;
+
+    for (next = (hole + 1) & RT_ALERTS_INDEX_MASK;
+         gAlertsTable.byID[next] != NULL;
+         next = (next + 1) & RT_ALERTS_INDEX_MASK)
+    {
+        unsigned int home = RTAlerts_Index_Bucket(gAlertsTable.byID[next]->iID);
+
+        if (((next - home) & RT_ALERTS_INDEX_MASK) >= ((next - hole) & RT_ALERTS_INDEX_MASK))
+        {
+            gAlertsTable.byID[hole] = gAlertsTable.byID[next];
+            hole = next;
+        }
+    }
+
+    gAlertsTable.byID[hole] = NULL;
+}
+
 /**
  * Retrieve an alert from table by alert ID
  * @param iID - The id of the alert to retrieve
@@ -581,14 +646,15 @@ RTAlert * RTAlerts_Get(int record)
  */
 RTAlert *RTAlerts_Get_By_ID(int iID)
 {
-    int i;
+    unsigned int b = RTAlerts_Index_Bucket(iID);
 
     //   Find alert:
-    for (i=0; i< gAlertsTable.iCount; i++)
-        if (gAlertsTable.alert[i]->iID == iID)
-        {
-            return (gAlertsTable.alert[i]);
-        }
+    while (gAlertsTable.byID[b] != NULL)
+    {
+        if (gAlertsTable.byID[b]->iID == iID)
+            return gAlertsTable.byID[b];
+        b = (b + 1) & RT_ALERTS_INDEX_MASK;
+    }
 
     return NULL;
 }
@@ -627,6 +693,8 @@ void RTAlerts_Clear_All()
         gAlertsTable.alert[i] = NULL;
     }
 
+    memset(gAlertsTable.byID, 0, sizeof(gAlertsTable.byID));
+
     OnAlertRemove();
 
     gAlertsTable.iCount = 0;
@@ -908,6 +976,7 @@ BOOL RTAlerts_Add(RTAlert *pAlert)
    if (pAlert->bArchive)
       gAlertsTable.iArchiveCount++;
 
+    RTAlerts_Index_Add(gAlertsTable.alert[gAlertsTable.iCount]);
     gAlertsTable.iCount++;
 
 #ifdef USE_QT
@@ -1067,6 +1136,7 @@ void RTAlerts_Delete_All_Comments(RTAlert *pAlert)
 BOOL RTAlerts_Remove(int iID)
 {
     BOOL bFound= FALSE;
+    RTAlert *pAlert;
 
     //   Are we empty?
     if ( 0 == gAlertsTable.iCount){
@@ -1074,6 +1144,14 @@ BOOL RTAlerts_Remove(int iID)
        return TRUE;
     }
 
+    // The table keeps its (sorted) order, only the lookup goes through the index
+    pAlert = RTAlerts_Get_By_ID(iID);
+    if (pAlert == NULL){
+       roadmap_log( ROADMAP_DEBUG, "RemoveAlert() - Failed. ID %d not found", iID);
+       return TRUE;
+    }
+    RTAlerts_Index_Remove(pAlert);
+
     if (gAlertsTable.alert[gAlertsTable.iCount-1]->iID == iID)
     {
       DeleteAlertObject(gAlertsTable.alert[gAlertsTable.iCount-1]);
@@ -92,6 +92,7 @@
 #define RT_ALERT_OPPSOITE_DIRECTION 		2
 
 #define	RT_MAXIMUM_ALERT_COUNT           500
+#define	RT_ALERTS_INDEX_SIZE             1024  // Power of 2, at least twice RT_MAXIMUM_ALERT_COUNT
 #define RT_ALERT_LOCATION_MAX_SIZE        150
 #define RT_ALERT_DESCRIPTION_MAXSIZE      400
 #define RT_ALERT_IMAGEID_MAXSIZE		      100
@@ -286,6 +287,7 @@ typedef struct
     int iCount;
     int iGroupCount;
     int iArchiveCount;
+    RTAlert *byID[RT_ALERTS_INDEX_SIZE];   // Hash of iID, NULL if empty. Not affected by sorting.
 } RTAlerts;
 
 void RTAlerts_Alert_Init(RTAlert *alert);
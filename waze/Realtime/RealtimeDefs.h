@@ -161,6 +161,13 @@
 #define  RT_CFG_PRM_WEBSRVV2CMD_Name      ("Web-Service V2 Commands")
 #define  RT_CFG_PRM_WEBSRVV2CMD_Default   ("RoutingRequest")
 
+//   Packed GPS path encoding
+#define  RT_CFG_PRM_PACKEDPATH_Var        RTPrm_PackedGPSPath
+#define  RT_CFG_PRM_PACKEDPATH_Name       ("Packed GPS Path")
+#define  RT_CFG_PRM_PACKEDPATH_Auto       ("auto")
+#define  RT_CFG_PRM_PACKEDPATH_Yes        ("yes")
+#define  RT_CFG_PRM_PACKEDPATH_No         ("no")
+
 const char*  RT_CFG_GetWebServiceAddress();
 
 //   Visability group:
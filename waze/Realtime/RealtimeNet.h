@@ -135,6 +135,7 @@ BOOL  RTNet_GPSPath(      LPRTConnectionInfo   pCI,
                            time_t               period_begin,
                            LPGPSPointInTime     points,
                            int                  count,
+                           BOOL                 bPacked,
                            CB_OnWSTCompleted pfnOnCompleted,
                            char*                packet_only);
 
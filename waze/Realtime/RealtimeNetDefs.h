@@ -36,12 +36,14 @@
 #define  RTNET_SERVERCOOKIE_MAXSIZE             (63)
 #define  RTNET_WEBSERVICE_ADDRESS               ("")
 #define  RTNET_PROTOCOL_VERSION                 (150)
+#define  RTNET_PROTOCOL_VERSION_PACKED_PATH     (151)   // First server protocol to accept 'GPSPathPacked'
 #define  RTNET_PACKET_MAXSIZE                   MESSAGE_MAX_SIZE__AllTogether
 #define  RTNET_PACKET_MAXSIZE__dynamic(_GPSPointsCount_,_NodesPointsCount_)      \
                MESSAGE_MAX_SIZE__AllTogether__dynamic(_GPSPointsCount_,_NodesPointsCount_)
 
 //efine  RTNET_HTTP_STATUS_STRING_MAXSIZE       (63)
 #define  RTTRK_GPSPATH_MAX_POINTS               (100)
+#define  RTTRK_GPSPATH_PACKED_MAX_POINTS        (2 * RTTRK_GPSPATH_MAX_POINTS)
 #define  RTTRK_NODEPATH_MAX_POINTS              (60)
 #define  RTTRK_CREATENEWROADS_MAX_TOGGLES       (40)
 #define  RTTRK_MIN_VARIANT_THRESHOLD            (5)
@@ -143,6 +145,10 @@
 #define  RTNET_GPSPATH_BUFFERSIZE_row_count              (11)
 #define  RTNET_GPSPATH_BUFFERSIZE_point_type             (11)
 #define  RTNET_GPSPATH_BUFFERSIZE_single_row             (46+4+15+22)
+//    A packed point (4 varints):                       == 20 bytes
+//    A packed range takes less than half the text size of its points, so
+//    RTTRK_GPSPATH_PACKED_MAX_POINTS points fit in the text buffer size.
+#define  RTNET_GPSPATH_PACKED_POINT_MAXSIZE              (20)
 #define  RTNET_GPSPATH_BUFFERSIZE_rows                                  \
                            (RTNET_GPSPATH_BUFFERSIZE_single_row * RTTRK_GPSPATH_MAX_POINTS)
 #define  RTNET_GPSPATH_BUFFERSIZE_rows__dynamic(_n_)                    \
@@ -0,0 +1,199 @@
+/* RealtimePackedPath.c - The packed encoding of the GPS path
+ *
+ * LICENSE:
+ *
+ *   Copyright 2012 Assaf Paz
+ *
+ *   This file is part of RoadMap.
+ *
+ *   RoadMap is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   RoadMap is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with RoadMap; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "roadmap.h"
+#include "roadmap_base64.h"
+#include "RealtimePackedPath.h"
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+static unsigned char* RTNet_PutVarint( unsigned char* p, unsigned int value)
+{
+   while( value >= 0x80)
+   {
+      *p++ = (unsigned char)(value | 0x80);
+      value >>= 7;
+   }
+   *p++ = (unsigned char)value;
+
+   return p;
+}
+
+// Zigzag encoding, so that small negative deltas are small too
+static unsigned char* RTNet_PutSignedVarint( unsigned char* p, int value)
+{
+   return RTNet_PutVarint( p, ((unsigned int)value << 1) ^ (unsigned int)(value >> 31));
+}
+
+// Returns NULL if the data ends in the middle of the value
+static const unsigned char* RTNet_GetSignedVarint( const unsigned char* p,
+                                                   const unsigned char* end,
+                                                   int*                 value)
+{
+   unsigned int   v     = 0;
+   int            shift = 0;
+
+   do
+   {
+      if( (p >= end) || (shift > 28))
+         return NULL;
+
+      v |= (unsigned int)(*p & 0x7F) << shift;
+      shift += 7;
+
+   }  while( *p++ & 0x80);
+
+   *value = (int)((v >> 1) ^ (0U - (v & 1)));
+   return p;
+}
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+char* RTNet_GPSPath_BuildPackedCommand( char*             Packet,
+                                        LPGPSPointInTime  points,
+                                        int               count,
+                                        BOOL              end_track)
+{
+   unsigned char  data[RTTRK_GPSPATH_PACKED_MAX_POINTS * RTNET_GPSPATH_PACKED_POINT_MAXSIZE];
+   unsigned char* d = data;
+   char*          p = Packet;
+   int            i;
+
+   if( (count >= 2) && (RTTRK_GPSPATH_PACKED_MAX_POINTS >= count))
+   {
+      int   size;
+
+      for( i=0; i<count; i++)
+      {
+         waze_assert( !GPSPOINTINTIME_IS_INVALID(points[i]));
+
+         if( i)
+         {
+            d = RTNet_PutSignedVarint( d, points[i].Position.longitude - points[i-1].Position.longitude);
+            d = RTNet_PutSignedVarint( d, points[i].Position.latitude - points[i-1].Position.latitude);
+            d = RTNet_PutSignedVarint( d, points[i].altitude - points[i-1].altitude);
+            d = RTNet_PutSignedVarint( d, (int)(points[i].GPS_time - points[i-1].GPS_time));
+         }
+         else
+         {
+            d = RTNet_PutSignedVarint( d, points[i].Position.longitude);
+            d = RTNet_PutSignedVarint( d, points[i].Position.latitude);
+            d = RTNet_PutSignedVarint( d, points[i].altitude);
+            d = RTNet_PutSignedVarint( d, 0);
+         }
+      }
+
+      p += sprintf( p, "GPSPathPacked,%u,%u,", (uint32_t)points->GPS_time, count);
+
+      size = roadmap_base64_get_buffer_size( (int)(d - data));
+      roadmap_base64_encode( data, (int)(d - data), &p, size);
+      p += size - 1;
+      *p++ = '\n';
+   }
+
+   if (end_track)
+   {
+      p += sprintf( p, "GPSDisconnect\n");
+   }
+
+   *p = '\0';
+   return p;
+}
+
+int RTNet_GPSPath_ParsePackedCommand( const char*       Command,
+                                      LPGPSPointInTime  points,
+                                      int               size)
+{
+   unsigned int         first_time;
+   unsigned int         count;
+   int                  offset = 0;
+   int                  length;
+   char*                text;
+   void*                data;
+   int                  data_size;
+   const unsigned char* d;
+   const unsigned char* end;
+   int                  i;
+
+   if( (2 != sscanf( Command, "GPSPathPacked,%u,%u,%n", &first_time, &count, &offset)) || !offset)
+      return -1;
+
+   if( (count < 2) || ((int)count > size))
+      return -1;
+
+   length = (int)strcspn( Command + offset, ",\r\n");
+   text   = malloc( length + 1);
+   roadmap_check_allocated( text);
+   memcpy( text, Command + offset, length);
+   text[length] = '\0';
+
+   data_size = roadmap_base64_decode( text, &data);
+   free( text);
+   if( data_size < 0)
+      return -1;
+
+   d   = (const unsigned char*)data;
+   end = d + data_size;
+
+   for( i=0; (i<(int)count) && d; i++)
+   {
+      int   longitude, latitude, altitude, seconds;
+
+      d = RTNet_GetSignedVarint( d, end, &longitude);
+      if( d) d = RTNet_GetSignedVarint( d, end, &latitude);
+      if( d) d = RTNet_GetSignedVarint( d, end, &altitude);
+      if( d) d = RTNet_GetSignedVarint( d, end, &seconds);
+      if( !d)
+         break;
+
+      if( i)
+      {
+         points[i].Position.longitude = points[i-1].Position.longitude + longitude;
+         points[i].Position.latitude  = points[i-1].Position.latitude + latitude;
+         points[i].altitude           = points[i-1].altitude + altitude;
+         points[i].GPS_time           = points[i-1].GPS_time + seconds;
+      }
+      else
+      {
+         points[i].Position.longitude = longitude;
+         points[i].Position.latitude  = latitude;
+         points[i].altitude           = altitude;
+         points[i].GPS_time           = first_time + seconds;
+      }
+   }
+
+   free( data);
+
+   // All the points, and nothing after them
+   if( !d || (d != end))
+      return -1;
+
+   return (int)count;
+}
+//////////////////////////////////////////////////////////////////////////////////////////////////
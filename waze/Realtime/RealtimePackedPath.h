@@ -0,0 +1,52 @@
+/* RealtimePackedPath.h - The packed encoding of the GPS path
+ *
+ * LICENSE:
+ *
+ *   Copyright 2012 Assaf Paz
+ *
+ *   This file is part of RoadMap.
+ *
+ *   RoadMap is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   RoadMap is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with RoadMap; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef	__FREEMAP_REALTIMEPACKEDPATH_H__
+#define	__FREEMAP_REALTIMEPACKEDPATH_H__
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "Realtime/RealtimeNetDefs.h"
+#include "editor/track/editor_track_report.h"
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//   Each point of a range is written as the zigzag varint deltas of its longitude, latitude,
+//   altitude and time, in base64:
+//      GPSPathPacked,<first time>,<points count>,<base64 data>
+
+//   Writes the command at 'Packet' and returns the end of the written text
+char* RTNet_GPSPath_BuildPackedCommand( char*             Packet,
+                                        LPGPSPointInTime  points,
+                                        int               count,
+                                        BOOL              end_track);
+
+//   Reads the points of a command, up to 'size' of them. Returns their count,
+//   or -1 if the command is not a valid packed path.
+int   RTNet_GPSPath_ParsePackedCommand( const char*       Command,
+                                        LPGPSPointInTime  points,
+                                        int               size);
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+#endif	//	__FREEMAP_REALTIMEPACKEDPATH_H__
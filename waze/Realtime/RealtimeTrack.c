@@ -308,6 +308,7 @@ void  RealtimePathTrack_Compress( LPRealtimePathTrack this)
 {
    int         i;
    int         iRangeBegin;
+   int         iKept;
    int         iGPSDisconnectionTagsCount = 0;
    LPTrackInfo pTI = &(this->points_track_info);
 
@@ -374,16 +375,18 @@ void  RealtimePathTrack_Compress( LPRealtimePathTrack this)
       }
    }
 
-   for( i=0; i<pTI->count; i++)
+   // Remove all the dropped points in one pass:
+   for( i=0, iKept=0; i<pTI->count; i++)
    {
-   
-      if( FALSE == this->points[i].ToBeSaved)
-      {
-         RealtimePathTrack_ErasePoint( this, i);
-         i--;
+      if( this->points[i].ToBeSaved)
+         this->points[iKept++] = this->points[i];
+      else
          this->debug_GPS_points_removed_variant_threshold++;
-      }
    }
+
+   for( i=iKept; i<pTI->count; i++)
+      GPSPointInTime_Init( &(this->points[i]));
+   pTI->count = iKept;
 }
 //////////////////////////////////////////////////////////////////////////////////////////////////
 
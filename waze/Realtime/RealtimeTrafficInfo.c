@@ -63,6 +63,7 @@
 
 static RTTrafficInfos gTrafficInfoTable;
 static RTTrafficLines gRTTrafficInfoLinesTable;
+static RoadMapHash *gRTTrafficInfoLinesHash = NULL;
 static RoadMapTileCallback 		TileCbNext = NULL;
 static RoadMapUnitChangeCallback sNextUnitChangeCb = NULL;
 
@@ -122,6 +123,8 @@ void RTTrafficInfo_Init()
    for (i=0;i <RT_TRAFFIC_INFO_MAX_LINES; i++){
 		gRTTrafficInfoLinesTable.pRTTrafficInfoLines[i] = NULL;
 	}
+   if (gRTTrafficInfoLinesHash == NULL)
+      gRTTrafficInfoLinesHash = roadmap_hash_new ("traffic_lines", RT_TRAFFIC_INFO_MAX_LINES);
 
    TileCbNext = roadmap_tile_register_callback( RTTrafficInfo_TileReceivedCb );
 
@@ -184,6 +187,8 @@ void RTTrafficInfo_ClearAll()
    	}
    	gRTTrafficInfoLinesTable.pRTTrafficInfoLines[i] = NULL;
    }
+   if (gRTTrafficInfoLinesHash)
+      roadmap_hash_clean (gRTTrafficInfoLinesHash);
 
 }
 
@@ -303,6 +308,17 @@ static BOOL RTTrafficInfo_DeleteAlert(int iID)
 
 
 
+/**
+ * Hash key of a segment in the lines table. Both directions of a line
+ * share the key, so lookups without direction use the same chain.
+ * @param iSquare - the square of the line
+ * @param iLine - line id
+ * @return the hash key
+ */
+static int RTTrafficInfo_LineKey(int iSquare, int iLine){
+	return (int)(((unsigned int)iSquare * 65599U + (unsigned int)iLine) & 0x7fffffff);
+}
+
 /**
  * Add a TrafficInfo Segment to list of segments
  * @param iTrafficInfoID - ID of the TrafficInfo
@@ -361,6 +377,7 @@ BOOL RTTrafficInfo_AddSegments( int iTrafficInfoID, int iSquare, int iVersion, i
 		pLine->iSpeed = pTrafficInfo->iSpeed;
 		pLine->iTrafficInfoId = iTrafficInfoID;
 		pLine->pTrafficInfo = pTrafficInfo;
+		roadmap_hash_add (gRTTrafficInfoLinesHash, RTTrafficInfo_LineKey (iSquare, pLine->iLine), index);
 
 		if (pTrafficInfo->bIsOnRoute && !pTrafficInfo->bUpdated &&
           roadmap_square_set_current (pLine->iSquare)){
@@ -425,6 +442,13 @@ static BOOL RTTraficInfo_DeleteSegments(int iTrafficInfoID){
     	if (gRTTrafficInfoLinesTable.pRTTrafficInfoLines[i]->iTrafficInfoId == iTrafficInfoID){
     		gRTTrafficInfoLinesTable.iCount--;
     		tmp = gRTTrafficInfoLinesTable.pRTTrafficInfoLines[i];
+    		roadmap_hash_remove (gRTTrafficInfoLinesHash, RTTrafficInfo_LineKey (tmp->iSquare, tmp->iLine), i);
+    		if (i != gRTTrafficInfoLinesTable.iCount){
+    			RTTrafficInfoLines *last = gRTTrafficInfoLinesTable.pRTTrafficInfoLines[gRTTrafficInfoLinesTable.iCount];
+    			int key = RTTrafficInfo_LineKey (last->iSquare, last->iLine);
+    			roadmap_hash_remove (gRTTrafficInfoLinesHash, key, gRTTrafficInfoLinesTable.iCount);
+    			roadmap_hash_add (gRTTrafficInfoLinesHash, key, i);
+    		}
     		gRTTrafficInfoLinesTable.pRTTrafficInfoLines[i] = gRTTrafficInfoLinesTable.pRTTrafficInfoLines[gRTTrafficInfoLinesTable.iCount];
     		gRTTrafficInfoLinesTable.pRTTrafficInfoLines[gRTTrafficInfoLinesTable.iCount] = tmp;
     		found = TRUE;
@@ -681,32 +705,47 @@ RTTrafficInfoLines *RTTrafficInfo_GetLine(int Record)
 }
 
 /**
- * Find a line from the lines table
-  * @param line - line id
+ * Find a line in the lines table through the lines hash. When several
+ * traffic infos cover the line, the first one in the table is returned.
+ * @param line - line id
  * @param square - the square of the line
- * @return Index of line in the LInes table, -1 if no lines is found
+ * @param direction - required direction, or -1 for any direction
+ * @return Index of line in the Lines table, -1 if no line is found
  */
- int RTTrafficInfo_Get_Line(int line, int square,  int against_dir){
+static int RTTrafficInfo_Find_Line(int line, int square, int direction){
 	int i;
-	int direction;
+	int found = -1;
 
 	if (gRTTrafficInfoLinesTable.iCount == 0)
 		return -1;
 
-	if (against_dir)
-		direction = ROUTE_DIRECTION_AGAINST_LINE;
-	else
-		direction = ROUTE_DIRECTION_WITH_LINE;
-
-	for (i = 0; i < gRTTrafficInfoLinesTable.iCount; i++){
-		if (gRTTrafficInfoLinesTable.pRTTrafficInfoLines[i]->isInstrumented &&
-			 gRTTrafficInfoLinesTable.pRTTrafficInfoLines[i]->iLine == line &&
-			 gRTTrafficInfoLinesTable.pRTTrafficInfoLines[i]->iDirection == direction &&
-			 gRTTrafficInfoLinesTable.pRTTrafficInfoLines[i]->iSquare == square)
-			return i;
+	for (i = roadmap_hash_get_first (gRTTrafficInfoLinesHash, RTTrafficInfo_LineKey (square, line));
+		  i >= 0;
+		  i = roadmap_hash_get_next (gRTTrafficInfoLinesHash, i)){
+		RTTrafficInfoLines *pLine = gRTTrafficInfoLinesTable.pRTTrafficInfoLines[i];
+		if (pLine->isInstrumented &&
+			 pLine->iLine == line &&
+			 pLine->iSquare == square &&
+			 (direction < 0 || pLine->iDirection == direction) &&
+			 (found < 0 || i < found))
+			found = i;
 	}
 
-	return -1;
+	return found;
+}
+
+/**
+ * Find a line from the lines table
+  * @param line - line id
+ * @param square - the square of the line
+ * @return Index of line in the LInes table, -1 if no lines is found
+ */
+ int RTTrafficInfo_Get_Line(int line, int square,  int against_dir){
+
+	if (against_dir)
+		return RTTrafficInfo_Find_Line (line, square, ROUTE_DIRECTION_AGAINST_LINE);
+	else
+		return RTTrafficInfo_Find_Line (line, square, ROUTE_DIRECTION_WITH_LINE);
 }
 
 /**
@@ -716,19 +755,8 @@ RTTrafficInfoLines *RTTrafficInfo_GetLine(int Record)
  * @return the line_id if line is found in the lines table, -1 otherwise
  */
 static int RTTrafficInfo_Get_LineNoDirection(int line, int square){
-	int i;
-
-	if (gRTTrafficInfoLinesTable.iCount == 0)
-		return -1;
-
-	for (i = 0; i < gRTTrafficInfoLinesTable.iCount; i++){
-		if (gRTTrafficInfoLinesTable.pRTTrafficInfoLines[i]->isInstrumented &&
-			 gRTTrafficInfoLinesTable.pRTTrafficInfoLines[i]->iLine == line &&
-			 gRTTrafficInfoLinesTable.pRTTrafficInfoLines[i]->iSquare == square)
-			return i;
-	}
 
-	return -1;
+	return RTTrafficInfo_Find_Line (line, square, -1);
 }
 
 /**
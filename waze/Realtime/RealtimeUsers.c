@@ -115,6 +115,100 @@ void RTUserLocation_CreateGUIID( LPRTUserLocation this)
 //////////////////////////////////////////////////////////////////////////////////////////////////
 
 
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//   Indexes
+//   Open addressing with linear probing. Removing an entry shifts back the entries of its probe
+//   sequence, so there are no tombstones and a lookup stops at the first empty bucket.
+#define  RT_USERS_INDEX_MASK  (RT_USERS_INDEX_SIZE - 1)
+
+static unsigned int RTUsers_IDBucket( int iUserID)
+{
+   unsigned int h = (unsigned int)iUserID * 2654435761U;
+
+   return (h ^ (h >> 16)) & RT_USERS_INDEX_MASK;
+}
+
+static unsigned int RTUsers_GUIIDBucket( const char* id)
+{
+   unsigned int h = 2166136261U;
+
+   while( *id)
+   {
+      h ^= (unsigned char)*id++;
+      h *= 16777619U;
+   }
+
+   return (h ^ (h >> 16)) & RT_USERS_INDEX_MASK;
+}
+
+static unsigned int RTUsers_HomeBucket( LPRTUsers this, const int* pIndex, int iUser)
+{
+   if( pIndex == this->iByID)
+      return RTUsers_IDBucket( this->Users[iUser].iID);
+
+   return RTUsers_GUIIDBucket( this->Users[iUser].sGUIID);
+}
+
+static void RTUsers_IndexClear( LPRTUsers this)
+{
+   memset( this->iByID,    -1, sizeof(this->iByID));
+   memset( this->iByGUIID, -1, sizeof(this->iByGUIID));
+}
+
+static void RTUsers_IndexAdd( LPRTUsers this, int* pIndex, int iUser)
+{
+   unsigned int b = RTUsers_HomeBucket( this, pIndex, iUser);
+
+   while( 0 <= pIndex[b])
+      b = (b + 1) & RT_USERS_INDEX_MASK;
+
+   pIndex[b] = iUser;
+}
+
+static unsigned int RTUsers_IndexBucketOf( LPRTUsers this, const int* pIndex, int iUser)
+{
+   unsigned int b = RTUsers_HomeBucket( this, pIndex, iUser);
+
+   while( (0 <= pIndex[b]) && (pIndex[b] != iUser))
+      b = (b + 1) & RT_USERS_INDEX_MASK;
+
+   return b;
+}
+
+static void RTUsers_IndexRemove( LPRTUsers this, int* pIndex, int iUser)
+{
+   unsigned int hole = RTUsers_IndexBucketOf( this, pIndex, iUser);
+   unsigned int next = (hole + 1) & RT_USERS_INDEX_MASK;
+
+   if( pIndex[hole] < 0)
+      return;
+
+   //   Move back every entry whose home bucket does not lie between the hole and itself
+   while( 0 <= pIndex[next])
+   {
+      unsigned int home = RTUsers_HomeBucket( this, pIndex, pIndex[next]);
+
+      if( ((next - home) & RT_USERS_INDEX_MASK) >= ((next - hole) & RT_USERS_INDEX_MASK))
+      {
+         pIndex[hole] = pIndex[next];
+         hole = next;
+      }
+      next = (next + 1) & RT_USERS_INDEX_MASK;
+   }
+
+   pIndex[hole] = -1;
+}
+
+static void RTUsers_IndexMove( LPRTUsers this, int* pIndex, int iFrom, int iTo)
+{
+   unsigned int b = RTUsers_IndexBucketOf( this, pIndex, iFrom);
+
+   if( 0 <= pIndex[b])
+      pIndex[b] = iTo;
+}
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+
 //////////////////////////////////////////////////////////////////////////////////////////////////
 void RTUsers_Init(LPRTUsers   this,
                   PFN_ONUSER  pfnOnAddUser,
@@ -129,6 +223,7 @@ void RTUsers_Init(LPRTUsers   this,
       RTUserLocation_Init( &(this->Users[i]));
 
    this->iCount      = 0;
+   RTUsers_IndexClear( this);
    gs_pfnOnAddUser   = pfnOnAddUser;
    gs_pfnOnMoveUser  = pfnOnMoveUser;
    gs_pfnOnRemoveUser= pfnOnRemoveUser;
@@ -142,6 +237,7 @@ void RTUsers_Reset(LPRTUsers   this)
       RTUserLocation_Init( &(this->Users[i]));
 
    this->iCount = 0;
+   RTUsers_IndexClear( this);
 }
 
 void RTUsers_Term( LPRTUsers this)
@@ -187,6 +283,8 @@ BOOL RTUsers_Add( LPRTUsers this, LPRTUserLocation pUser)
    }
    this->Users[this->iCount]   = (*pUser);
    this->Users[this->iCount].bWasUpdated= TRUE;
+   RTUsers_IndexAdd( this, this->iByID,    this->iCount);
+   RTUsers_IndexAdd( this, this->iByGUIID, this->iCount);
    this->iCount++;
    gs_pfnOnAddUser( pUser);
 
@@ -196,6 +294,7 @@ BOOL RTUsers_Add( LPRTUsers this, LPRTUserLocation pUser)
 BOOL RTUsers_Update( LPRTUsers this, LPRTUserLocation pUser)
 {
    LPRTUserLocation pUI = RTUsers_UserByID( this, pUser->iID);
+   BOOL             bNewGUIID;
 
   waze_assert(gs_pfnOnMoveUser);
 
@@ -208,7 +307,12 @@ BOOL RTUsers_Update( LPRTUsers this, LPRTUserLocation pUser)
        snprintf(temp, RT_USER_GROUP_ICON_MAXSIZE+10, "wazer_%s", pUser->sGroupIcon);
        strcpy(pUser->sGroupIcon, temp);
    }
+   bNewGUIID = (0 != strcmp( pUI->sGUIID, pUser->sGUIID));
+   if( bNewGUIID)
+      RTUsers_IndexRemove( this, this->iByGUIID, (int)(pUI - this->Users));
    (*pUI) = (*pUser);
+   if( bNewGUIID)
+      RTUsers_IndexAdd( this, this->iByGUIID, (int)(pUI - this->Users));
    gs_pfnOnMoveUser( pUser);
    pUI->bWasUpdated = TRUE;
    return TRUE;
@@ -225,7 +329,7 @@ BOOL RTUsers_UpdateOrAdd( LPRTUsers this, LPRTUserLocation pUser)
 
 BOOL  RTUsers_RemoveByIndex( LPRTUsers this, int iIndex)
 {
-   int i;
+   int iLast;
 
   waze_assert(gs_pfnOnRemoveUser);
 
@@ -235,8 +339,17 @@ BOOL  RTUsers_RemoveByIndex( LPRTUsers this, int iIndex)
 
    gs_pfnOnRemoveUser( &(this->Users[iIndex]));
 
-   for( i=iIndex; i<(this->iCount-1); i++)
-      this->Users[i] = this->Users[i+1];
+   RTUsers_IndexRemove( this, this->iByID,    iIndex);
+   RTUsers_IndexRemove( this, this->iByGUIID, iIndex);
+
+   //   Fill the hole with the last user
+   iLast = this->iCount - 1;
+   if( iIndex < iLast)
+   {
+      RTUsers_IndexMove( this, this->iByID,    iLast, iIndex);
+      RTUsers_IndexMove( this, this->iByGUIID, iLast, iIndex);
+      this->Users[iIndex] = this->Users[iLast];
+   }
 
    this->iCount--;
    RTUserLocation_Init( &(this->Users[this->iCount]));
@@ -246,20 +359,12 @@ BOOL  RTUsers_RemoveByIndex( LPRTUsers this, int iIndex)
 
 BOOL RTUsers_RemoveByID( LPRTUsers this, int iUserID)
 {
-   int   i;
+   LPRTUserLocation pUI = RTUsers_UserByID( this, iUserID);
 
-   //   Are we empty?
-   if( 0 == this->iCount)
+   if( !pUI)
       return FALSE;
 
-   for( i=0; i<this->iCount; i++)
-      if( this->Users[i].iID == iUserID)
-      {
-         RTUsers_RemoveByIndex( this, i);
-         return TRUE;
-      }
-
-   return FALSE;
+   return RTUsers_RemoveByIndex( this, (int)(pUI - this->Users));
 }
 
 BOOL RTUsers_Exists( LPRTUsers this, int iUserID)
@@ -286,6 +391,7 @@ void RTUsers_ClearAll( LPRTUsers this)
    }
 
    this->iCount = 0;
+   RTUsers_IndexClear( this);
 
 }
 
@@ -314,6 +420,8 @@ void RTUsers_RemoveUnupdatedUsers( LPRTUsers this, int* pUpdatedCount, int* pRem
    (*pUpdatedCount) = 0;
    (*pRemovedCount) = 0;
 
+   //   Removing moves the last user to 'i', which is then checked again
+
    for( i=0; i<this->iCount; i++)
       if( this->Users[i].bWasUpdated)
          (*pUpdatedCount)++;
@@ -335,12 +443,15 @@ LPRTUserLocation RTUsers_User( LPRTUsers this, int iIndex)
 
 LPRTUserLocation RTUsers_UserByID( LPRTUsers this, int iUserID)
 {
-   int i;
+   unsigned int b = RTUsers_IDBucket( iUserID);
 
    //   Find user:
-   for( i=0; i<this->iCount; i++)
-      if( this->Users[i].iID == iUserID)
-         return &(this->Users[i]);
+   while( 0 <= this->iByID[b])
+   {
+      if( this->Users[this->iByID[b]].iID == iUserID)
+         return &(this->Users[this->iByID[b]]);
+      b = (b + 1) & RT_USERS_INDEX_MASK;
+   }
 
    return NULL;
 }
@@ -348,12 +459,15 @@ LPRTUserLocation RTUsers_UserByID( LPRTUsers this, int iUserID)
 
 static LPRTUserLocation RTUsers_UserByGUIID( LPRTUsers this, const char *id)
 {
-   int i;
+   unsigned int b = RTUsers_GUIIDBucket( id);
 
    //   Find user:
-   for( i=0; i<this->iCount; i++)
-      if(strcmp(this->Users[i].sGUIID, id) == 0)
-         return &(this->Users[i]);
+   while( 0 <= this->iByGUIID[b])
+   {
+      if( strcmp( this->Users[this->iByGUIID[b]].sGUIID, id) == 0)
+         return &(this->Users[this->iByGUIID[b]]);
+      b = (b + 1) & RT_USERS_INDEX_MASK;
+   }
 
    return NULL;
 }
@@ -30,6 +30,7 @@
 #define  RT_USERID_MAXSIZE             (63)
 #define  RT_USERTTL_MAXSIZE            (63)
 #define  RL_MAXIMUM_USERS_COUNT        (50)
+#define  RT_USERS_INDEX_SIZE           (128)   // Power of 2, at least twice RL_MAXIMUM_USERS_COUNT
 #define  RT_USERFACEBOOK_MAXSIZE       (100)
 #define  RT_USER_GROUP_MAXSIZE         (200)
 #define  RT_USER_GROUP_ICON_MAXSIZE   (200)
@@ -87,6 +88,8 @@ typedef struct tagRTUsers
 {
    RTUserLocation Users[RL_MAXIMUM_USERS_COUNT];
    int            iCount;
+   int            iByID   [RT_USERS_INDEX_SIZE];  // Hash of iID to index in Users, -1 if empty
+   int            iByGUIID[RT_USERS_INDEX_SIZE];  // Hash of sGUIID to index in Users, -1 if empty
 
 }  RTUsers, *LPRTUsers;
 
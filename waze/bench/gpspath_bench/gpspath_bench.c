@@ -0,0 +1,286 @@
+/* gpspath_bench.c - Round trips the packed GPS path
+ *
+ * LICENSE:
+ *
+ *   Copyright 2012 Assaf Paz
+ *
+ *   This file is part of RoadMap.
+ *
+ *   RoadMap is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   RoadMap is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with RoadMap; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * DESCRIPTION:
+ *
+ *   Encodes generated tracks with RTNet_GPSPath_BuildPackedCommand(),
+ *   decodes them back with RTNet_GPSPath_ParsePackedCommand() and checks
+ *   that every point came back unchanged. The tracks are drives with one
+ *   fix per second or so, and worst cases: the largest moves, altitudes
+ *   and gaps between points, which must still fit the GPSPath buffer.
+ *   Reports the size of a packed point and the time of each direction.
+ *
+ * SYNOPSIS:
+ *
+ *   gpspath_bench [--tracks <n>] [--seed <n>]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "roadmap.h"
+#include "Realtime/RealtimePackedPath.h"
+
+int RoadMapLogLevel = ROADMAP_MESSAGE_WARNING;
+
+static char GPSPathPacket[RTNET_GPSPATH_BUFFERSIZE__dynamic(RTTRK_GPSPATH_MAX_POINTS) + 1];
+
+
+void roadmap_log_write (int level, const char *source, int line, const char *format, ...) {
+
+   va_list ap;
+
+   fprintf (stderr, "%s:%d ", source, line);
+
+   va_start (ap, format);
+   vfprintf (stderr, format, ap);
+   va_end (ap);
+
+   fprintf (stderr, "\n");
+
+   if (level >= ROADMAP_MESSAGE_FATAL) exit (1);
+}
+
+void roadmap_check_allocated_with_source_line
+                (const char *source, int line, const void *allocated) {
+
+   if (allocated == NULL) {
+      roadmap_log_write (ROADMAP_MESSAGE_FATAL, source, line, "no more memory");
+   }
+}
+
+
+static double gpspath_bench_now (void) {
+
+   struct timeval now;
+
+   gettimeofday (&now, NULL);
+   return now.tv_sec * 1000000.0 + now.tv_usec;
+}
+
+
+static int gpspath_bench_random (int range) {
+
+   return (int)(((double)rand () / ((double)RAND_MAX + 1.0)) * range);
+}
+
+
+/* A drive: a few meters per second, some stops and GPS gaps */
+static void gpspath_bench_drive (LPGPSPointInTime points, int count) {
+
+   int i;
+   int speed_x = gpspath_bench_random (400) - 200;
+   int speed_y = gpspath_bench_random (400) - 200;
+
+   points[0].Position.longitude = gpspath_bench_random (360000000) - 180000000;
+   points[0].Position.latitude = gpspath_bench_random (180000000) - 90000000;
+   points[0].altitude = gpspath_bench_random (1000) - 50;
+   points[0].GPS_time = 1300000000 + gpspath_bench_random (100000000);
+
+   for (i = 1; i < count; ++i) {
+
+      int seconds = (gpspath_bench_random (20) == 0) ? 1 + gpspath_bench_random (120) : 1;
+
+      if (gpspath_bench_random (10) == 0) {
+         speed_x += gpspath_bench_random (80) - 40;
+         speed_y += gpspath_bench_random (80) - 40;
+      }
+
+      points[i].Position.longitude = points[i-1].Position.longitude + speed_x * seconds;
+      points[i].Position.latitude = points[i-1].Position.latitude + speed_y * seconds;
+      points[i].altitude = points[i-1].altitude + gpspath_bench_random (5) - 2;
+      points[i].GPS_time = points[i-1].GPS_time + seconds;
+   }
+}
+
+
+/* The largest values of each field, alternating signs */
+static void gpspath_bench_worst (LPGPSPointInTime points, int count) {
+
+   int i;
+
+   for (i = 0; i < count; ++i) {
+
+      int sign = (i & 1) ? 1 : -1;
+
+      points[i].Position.longitude = sign * 179999999;
+      points[i].Position.latitude = -sign * 89999999;
+      points[i].altitude = sign * 99999;
+      points[i].GPS_time = (i == 0) ? 0x7FFFFFFF - (time_t)count * 100000 :
+                                      points[i-1].GPS_time + 99999;
+   }
+}
+
+
+static int gpspath_bench_same (LPGPSPointInTime a, LPGPSPointInTime b, int count) {
+
+   int i;
+
+   for (i = 0; i < count; ++i) {
+      if ((a[i].Position.longitude != b[i].Position.longitude) ||
+          (a[i].Position.latitude != b[i].Position.latitude) ||
+          (a[i].altitude != b[i].altitude) ||
+          (a[i].GPS_time != b[i].GPS_time)) {
+         fprintf (stderr, "point %d: sent %d,%d,%d,%ld received %d,%d,%d,%ld\n", i,
+                  a[i].Position.longitude, a[i].Position.latitude, a[i].altitude, (long)a[i].GPS_time,
+                  b[i].Position.longitude, b[i].Position.latitude, b[i].altitude, (long)b[i].GPS_time);
+         return 0;
+      }
+   }
+
+   return 1;
+}
+
+
+/* Returns the size of the command, or -1 if it did not round trip */
+static int gpspath_bench_round_trip (LPGPSPointInTime points, int count,
+                                     double *encode_time, double *decode_time) {
+
+   GPSPointInTime received[RTTRK_GPSPATH_PACKED_MAX_POINTS];
+   char *end;
+   double start;
+   int decoded;
+
+   start = gpspath_bench_now ();
+   end = RTNet_GPSPath_BuildPackedCommand (GPSPathPacket, points, count, FALSE);
+   *encode_time += gpspath_bench_now () - start;
+
+   if (end - GPSPathPacket >= (int) sizeof(GPSPathPacket)) {
+      fprintf (stderr, "%d points take %d bytes, more than the GPSPath buffer\n",
+               count, (int)(end - GPSPathPacket));
+      return -1;
+   }
+
+   start = gpspath_bench_now ();
+   decoded = RTNet_GPSPath_ParsePackedCommand (GPSPathPacket, received, RTTRK_GPSPATH_PACKED_MAX_POINTS);
+   *decode_time += gpspath_bench_now () - start;
+
+   if (decoded != count) {
+      fprintf (stderr, "%d points sent, %d received: %s", count, decoded, GPSPathPacket);
+      return -1;
+   }
+
+   if (!gpspath_bench_same (points, received, count)) return -1;
+
+   return (int)(end - GPSPathPacket);
+}
+
+
+/* The decoder must refuse the damaged commands, not read past them */
+static int gpspath_bench_damaged (LPGPSPointInTime points, int count) {
+
+   GPSPointInTime received[RTTRK_GPSPATH_PACKED_MAX_POINTS];
+   char *end;
+   int failed = 0;
+
+   end = RTNet_GPSPath_BuildPackedCommand (GPSPathPacket, points, count, FALSE);
+
+   /* cut in the middle of the data */
+   end[-9] = '\n';
+   end[-8] = '\0';
+   if (RTNet_GPSPath_ParsePackedCommand (GPSPathPacket, received, count) >= 0) {
+      fprintf (stderr, "a cut command was accepted\n");
+      failed++;
+   }
+
+   RTNet_GPSPath_BuildPackedCommand (GPSPathPacket, points, count, FALSE);
+   if (RTNet_GPSPath_ParsePackedCommand (GPSPathPacket, received, count - 1) >= 0) {
+      fprintf (stderr, "a command larger than the buffer was accepted\n");
+      failed++;
+   }
+
+   if (RTNet_GPSPath_ParsePackedCommand ("GPSPath,1300000000,6,1,2,3,4,5,6\n", received, count) >= 0) {
+      fprintf (stderr, "a text command was accepted\n");
+      failed++;
+   }
+
+   return failed;
+}
+
+
+int main (int argc, char **argv) {
+
+   GPSPointInTime points[RTTRK_GPSPATH_PACKED_MAX_POINTS];
+   double encode_time = 0;
+   double decode_time = 0;
+   long bytes = 0;
+   long total_points = 0;
+   int tracks = 10000;
+   int failed = 0;
+   int size;
+   int i;
+
+   srand (1);
+
+   for (i = 1; i < argc; ++i) {
+      if (!strcmp (argv[i], "--tracks") && (i + 1 < argc)) {
+         tracks = atoi (argv[++i]);
+      } else if (!strcmp (argv[i], "--seed") && (i + 1 < argc)) {
+         srand (atoi (argv[++i]));
+      } else {
+         fprintf (stderr, "usage: %s [--tracks <n>] [--seed <n>]\n", argv[0]);
+         return 1;
+      }
+   }
+
+   for (i = 0; i < tracks; ++i) {
+
+      int count = 2 + gpspath_bench_random (RTTRK_GPSPATH_PACKED_MAX_POINTS - 1);
+
+      gpspath_bench_drive (points, count);
+
+      size = gpspath_bench_round_trip (points, count, &encode_time, &decode_time);
+      if (size < 0) {
+         failed++;
+         continue;
+      }
+
+      bytes += size;
+      total_points += count;
+   }
+
+   gpspath_bench_worst (points, RTTRK_GPSPATH_PACKED_MAX_POINTS);
+   size = gpspath_bench_round_trip (points, RTTRK_GPSPATH_PACKED_MAX_POINTS, &encode_time, &decode_time);
+   if (size < 0) failed++;
+
+   gpspath_bench_drive (points, RTTRK_GPSPATH_MAX_POINTS);
+   failed += gpspath_bench_damaged (points, RTTRK_GPSPATH_MAX_POINTS);
+
+   if (total_points > 0) {
+      printf ("%d tracks, %ld points: %.2f bytes per point, encode %.3f us/point, decode %.3f us/point\n",
+              tracks, total_points, (double)bytes / total_points,
+              encode_time / total_points, decode_time / total_points);
+   }
+   printf ("worst case: %d points in %d of %d bytes\n",
+           RTTRK_GPSPATH_PACKED_MAX_POINTS, size, (int) sizeof(GPSPathPacket) - 1);
+
+   if (failed) {
+      printf ("%d failures\n", failed);
+      return 1;
+   }
+
+   printf ("all round trips passed\n");
+   return 0;
+}
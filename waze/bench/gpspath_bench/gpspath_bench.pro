@@ -0,0 +1,18 @@
+# Round trips generated GPS tracks through the packed GPSPath encoder and
+# decoder, checks the points that come back, and reports the size of a
+# packed point and the time of each direction:
+#
+#    gpspath_bench --tracks 10000
+#    gpspath_bench --seed 7
+
+QT       -= core gui
+TEMPLATE = app
+TARGET = gpspath_bench
+CONFIG += console
+CONFIG -= app_bundle qt
+
+INCLUDEPATH += ../..
+
+SOURCES += gpspath_bench.c \
+    ../../Realtime/RealtimePackedPath.c \
+    ../../roadmap_base64.c
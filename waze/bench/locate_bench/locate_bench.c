@@ -0,0 +1,407 @@
+/* locate_bench.c - Times the street search of the GPS map matching
+ *
+ * LICENSE:
+ *
+ *   Copyright 2012 Assaf Paz
+ *
+ *   This file is part of RoadMap.
+ *
+ *   RoadMap is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   RoadMap is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with RoadMap; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * DESCRIPTION:
+ *
+ *   Replays the fixes of a recorded NMEA drive ($GPRMC sentences) through
+ *   the street search that roadmap_navigate_locate() runs on each fix:
+ *   roadmap_street_get_closest() over all the road layers, within the
+ *   focus roadmap_navigate_get_neighbours() sets when the position is not
+ *   on the screen.
+ *
+ *   The tiles are read from the tiles database of the map (tiles_<fips>.db,
+ *   as written by roadmap_tile_storage_sqlite.c). The first round opens
+ *   them, so it is reported apart from the following rounds.
+ *
+ * SYNOPSIS:
+ *
+ *   locate_bench [--dir <maps dir>] [--rounds <n>] [--accuracy <n>] <fips> <nmea file>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+
+#include "roadmap.h"
+#include "roadmap_types.h"
+#include "roadmap_config.h"
+#include "roadmap_path.h"
+#include "roadmap_file.h"
+#include "roadmap_math.h"
+#include "roadmap_locator.h"
+#include "roadmap_street.h"
+#include "roadmap_main.h"
+#include "roadmap_state.h"
+#include "roadmap_tile_status.h"
+#include "roadmap_dbread.h"
+#include "roadmap_alert.h"
+
+#define LOCATE_BENCH_NEIGHBOURS  16   /* ROADMAP_NEIGHBOURHOUD */
+#define LOCATE_BENCH_MAX_SHAPES  3
+
+typedef struct {
+
+   double   total_ms;
+   double   max_ms;
+   int      fixes;
+   int      matched;
+   int      neighbours;
+} LocateBenchStats;
+
+int RoadMapLogLevel = ROADMAP_MESSAGE_WARNING;
+
+static RoadMapConfigDescriptor LocateBenchDecodeThreads =
+                        ROADMAP_CONFIG_ITEM("Map", "Decode threads");
+
+static RoadMapPosition *LocateBenchFixes;
+static int LocateBenchFixesCount;
+
+
+/* The parts of the application the street search reaches, without a screen */
+
+void roadmap_log_write (int level, const char *source, int line, const char *format, ...) {
+
+   va_list ap;
+
+   fprintf (stderr, "%s:%d ", source, line);
+
+   va_start (ap, format);
+   vfprintf (stderr, format, ap);
+   va_end (ap);
+
+   fprintf (stderr, "\n");
+
+   if (level >= ROADMAP_MESSAGE_FATAL) exit (1);
+}
+
+void roadmap_log_push (const char *description) {}
+void roadmap_log_pop (void) {}
+
+void roadmap_check_allocated_with_source_line
+                (const char *source, int line, const void *allocated) {
+
+   if (allocated == NULL) {
+      roadmap_log_write (ROADMAP_MESSAGE_FATAL, source, line, "no more memory");
+   }
+}
+
+void *roadmap_allocate_and_check_with_source_line
+                (const char *source, int line, const size_t alloc_size) {
+
+   void *allocated = malloc (alloc_size);
+
+   if (allocated == NULL) {
+      roadmap_log_write (ROADMAP_MESSAGE_FATAL, source, line, "no more memory");
+   }
+   return allocated;
+}
+
+/* qt/roadmap_file.cc, on stdio */
+RoadMapFile roadmap_file_open (const char *name, const char *mode) {
+
+   const char *stdio_mode = "rb";
+
+   if (!strcmp (mode, "rw")) {
+      stdio_mode = roadmap_file_exists (NULL, name) ? "r+b" : "w+b";
+   } else if (strchr (mode, 'w')) {
+      stdio_mode = "w+b";
+   } else if (strchr (mode, 'a')) {
+      stdio_mode = "a+b";
+   }
+
+   return (RoadMapFile)fopen (name, stdio_mode);
+}
+
+int roadmap_file_read (RoadMapFile file, void *data, int size) {
+
+   return (int)fread (data, 1, size, (FILE *)file);
+}
+
+int roadmap_file_write (RoadMapFile file, const void *data, int length) {
+
+   return (int)fwrite (data, 1, length, (FILE *)file);
+}
+
+int roadmap_file_seek (RoadMapFile file, int offset, RoadMapSeekWhence whence) {
+
+   static const int stdio_whence[] = { SEEK_SET, SEEK_CUR, SEEK_END };
+
+   return fseek ((FILE *)file, offset, stdio_whence[whence]);
+}
+
+void roadmap_file_close (RoadMapFile file) {
+
+   fclose ((FILE *)file);
+}
+
+FILE *roadmap_file_fopen (const char *path, const char *name, const char *mode) {
+
+   const char *full_name = roadmap_path_join (path, name);
+   FILE *file = fopen (full_name, mode);
+
+   roadmap_path_free (full_name);
+   return file;
+}
+
+void roadmap_file_remove (const char *path, const char *name) {
+
+   const char *full_name = roadmap_path_join (path, name);
+
+   remove (full_name);
+   roadmap_path_free (full_name);
+}
+
+int roadmap_file_exists (const char *path, const char *name) {
+
+   return roadmap_file_length (path, name) >= 0;
+}
+
+int roadmap_file_length (const char *path, const char *name) {
+
+   const char *full_name = roadmap_path_join (path, name);
+   struct stat stat_buffer;
+   int status = stat (full_name, &stat_buffer);
+
+   roadmap_path_free (full_name);
+   return status == 0 ? (int)stat_buffer.st_size : -1;
+}
+
+void roadmap_main_set_periodic (int interval, RoadMapCallback callback) {}
+void roadmap_main_remove_periodic (RoadMapCallback callback) {}
+void roadmap_state_add (const char *name, RoadMapStateFn state_fn) {}
+int roadmap_option_cache (void) { return 0; }
+int roadmap_screen_fast_refresh (void) { return 0; }
+int roadmap_screen_is_hd_screen (void) { return 0; }
+int roadmap_screen_get_screen_scale (void) { return 100; }
+void roadmap_screen_redraw (void) {}
+int roadmap_bar_top_height (void) { return 0; }
+int roadmap_bar_bottom_height (void) { return 0; }
+int roadmap_canvas_width (void) { return 320; }
+int *roadmap_tile_status_get (int index) { return NULL; }
+void roadmap_tile_request (int index, int priority, int force_update, RoadMapCallback on_loaded) {}
+void navigate_graph_square_loaded (int square, int version) {}
+void roadmap_tile_square_loaded (int tile_index, int version) {}
+
+/* The alerts of the tiles are not used by the street search */
+static void *locate_bench_alert_map (const roadmap_db_data_file *file) {
+
+   static int context;
+
+   return &context;
+}
+
+roadmap_db_handler RoadMapAlertHandler = {
+   "alert",
+   locate_bench_alert_map,
+   NULL,
+   NULL
+};
+
+
+static double now_ms (void) {
+
+   struct timeval tv;
+
+   gettimeofday (&tv, NULL);
+   return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+}
+
+
+/* ddmm.mmmm to millionths of a degree */
+static int nmea_coordinate (const char *value, const char *hemisphere) {
+
+   double minutes = atof (value);
+   int degrees = (int)(minutes / 100);
+   int coordinate;
+
+   minutes -= degrees * 100;
+   coordinate = (int)(degrees * 1000000 + minutes * 1000000 / 60 + 0.5);
+
+   if (*hemisphere == 'S' || *hemisphere == 'W') coordinate = -coordinate;
+
+   return coordinate;
+}
+
+
+static void read_fixes (const char *name) {
+
+   FILE *file = fopen (name, "r");
+   char line[512];
+   int capacity = 0;
+
+   if (!file) roadmap_log (ROADMAP_FATAL, "Cannot open %s", name);
+
+   while (fgets (line, sizeof (line), file)) {
+
+      char *fields[8];
+      char *next = line;
+      int count = 0;
+
+      if (strncmp (line + 3, "RMC,", 4) || line[0] != '$') continue;
+
+      while (count < 8 && next) {
+         fields[count++] = next;
+         next = strchr (next, ',');
+         if (next) *next++ = '\0';
+      }
+
+      /* $GPRMC,time,status,lat,N/S,lon,E/W,... */
+      if (count < 8 || *fields[2] != 'A') continue;
+
+      if (LocateBenchFixesCount == capacity) {
+         capacity = capacity ? capacity * 2 : 1024;
+         LocateBenchFixes = realloc (LocateBenchFixes, capacity * sizeof (RoadMapPosition));
+         roadmap_check_allocated (LocateBenchFixes);
+      }
+
+      LocateBenchFixes[LocateBenchFixesCount].latitude = nmea_coordinate (fields[3], fields[4]);
+      LocateBenchFixes[LocateBenchFixesCount].longitude = nmea_coordinate (fields[5], fields[6]);
+      LocateBenchFixesCount++;
+   }
+
+   fclose (file);
+}
+
+
+static void locate (const RoadMapPosition *position, int accuracy, LocateBenchStats *stats) {
+
+   static RoadMapNeighbour neighbours[LOCATE_BENCH_NEIGHBOURS];
+   int layers[ROADMAP_ROAD_LAST - ROADMAP_ROAD_FIRST + 1];
+   int layer_count = 0;
+   RoadMapArea focus;
+   double start;
+   double time;
+   int count;
+   int i;
+
+   /* roadmap_layer_all_roads () */
+   for (i = ROADMAP_ROAD_LAST; i >= ROADMAP_ROAD_FIRST; i--) {
+      layers[layer_count++] = i;
+   }
+
+   start = now_ms ();
+
+   focus.west = position->longitude - accuracy * 100;
+   focus.east = position->longitude + accuracy * 100;
+   focus.north = position->latitude + accuracy * 100;
+   focus.south = position->latitude - accuracy * 100;
+
+   roadmap_math_set_focus (&focus);
+
+   count = roadmap_street_get_closest
+              (position, 0, layers, layer_count, LOCATE_BENCH_MAX_SHAPES,
+               neighbours, LOCATE_BENCH_NEIGHBOURS);
+
+   roadmap_math_release_focus ();
+
+   time = now_ms () - start;
+
+   stats->total_ms += time;
+   if (time > stats->max_ms) stats->max_ms = time;
+   stats->fixes++;
+   stats->neighbours += count;
+   if (count > 0) stats->matched++;
+}
+
+
+static void report (const char *name, const LocateBenchStats *stats) {
+
+   if (!stats->fixes) return;
+
+   printf ("%-6s %8d fixes %8.1f us/fix %8.1f us max %6.1f%% matched %5.1f lines/fix\n",
+           name, stats->fixes,
+           stats->total_ms * 1000 / stats->fixes, stats->max_ms * 1000,
+           100.0 * stats->matched / stats->fixes,
+           (double)stats->neighbours / stats->fixes);
+}
+
+
+static void usage (const char *program) {
+
+   fprintf (stderr, "usage: %s [--dir <maps dir>] [--rounds <n>] [--accuracy <n>] <fips> <nmea file>\n",
+            program);
+   exit (1);
+}
+
+
+int main (int argc, char **argv) {
+
+   const char *dir = ".";
+   int rounds = 5;
+   int accuracy = 120;   /* the "Accuracy"/"Street" default */
+   LocateBenchStats cold;
+   LocateBenchStats warm;
+   int fips;
+   int round;
+   int i;
+
+   for (i = 1; i < argc - 2; i++) {
+      if (!strcmp (argv[i], "--dir")) {
+         dir = argv[++i];
+      } else if (!strcmp (argv[i], "--rounds")) {
+         rounds = atoi (argv[++i]);
+      } else if (!strcmp (argv[i], "--accuracy")) {
+         accuracy = atoi (argv[++i]);
+      } else {
+         usage (argv[0]);
+      }
+   }
+
+   if (i != argc - 2 || rounds < 1 || accuracy < 1) usage (argv[0]);
+
+   fips = atoi (argv[i]);
+   read_fixes (argv[i + 1]);
+
+   if (!LocateBenchFixesCount) {
+      roadmap_log (ROADMAP_ERROR, "No valid $GPRMC fix in %s", argv[i + 1]);
+      return 1;
+   }
+
+   /* open the tiles on the main thread, as if no decode worker was available */
+   roadmap_config_declare ("preferences", &LocateBenchDecodeThreads, "0", NULL);
+
+   roadmap_path_set ("maps", dir);
+   roadmap_math_initialize ();
+
+   if (roadmap_locator_activate (fips) != ROADMAP_US_OK) {
+      roadmap_log (ROADMAP_ERROR, "Cannot open the map %d in %s", fips, dir);
+      return 1;
+   }
+
+   memset (&cold, 0, sizeof (cold));
+   memset (&warm, 0, sizeof (warm));
+
+   for (round = 0; round < rounds; round++) {
+      for (i = 0; i < LocateBenchFixesCount; i++) {
+         locate (LocateBenchFixes + i, accuracy, round ? &warm : &cold);
+      }
+   }
+
+   printf ("%d fixes, %d rounds, focus of %d\n", LocateBenchFixesCount, rounds, accuracy * 100);
+   report ("cold", &cold);
+   report ("warm", &warm);
+
+   return 0;
+}
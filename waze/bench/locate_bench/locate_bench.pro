@@ -0,0 +1,44 @@
+# Replays the fixes of a recorded NMEA drive through the street search of
+# roadmap_navigate_locate(), on the tiles database of a map, and reports
+# the time per fix:
+#
+#    locate_bench --dir ~/.waze/maps 77001 drive.nmea
+#
+# Build it on the previous roadmap_street.c to compare the searches.
+
+QT       -= core gui
+TEMPLATE = app
+TARGET = locate_bench
+CONFIG += console
+CONFIG -= app_bundle qt
+
+INCLUDEPATH += ../..
+LIBS += -lsqlite3 -lz -lpthread -lm
+
+SOURCES += locate_bench.c \
+    ../../roadmap_street.c \
+    ../../roadmap_line.c \
+    ../../roadmap_line_route.c \
+    ../../roadmap_line_speed.c \
+    ../../roadmap_shape.c \
+    ../../roadmap_point.c \
+    ../../roadmap_square.c \
+    ../../roadmap_range.c \
+    ../../roadmap_polygon.c \
+    ../../roadmap_metadata.c \
+    ../../roadmap_dictionary.c \
+    ../../roadmap_city.c \
+    ../../roadmap_county.c \
+    ../../roadmap_locator.c \
+    ../../roadmap_plugin.c \
+    ../../roadmap_math.c \
+    ../../roadmap_hash.c \
+    ../../roadmap_list.c \
+    ../../roadmap_string.c \
+    ../../roadmap_config.c \
+    ../../roadmap_dbread.c \
+    ../../roadmap_gzm.c \
+    ../../roadmap_tile.c \
+    ../../roadmap_tile_decode.c \
+    ../../roadmap_tile_storage_sqlite.c \
+    ../../unix/roadmap_path.c
@@ -0,0 +1,466 @@
+/* parser_bench.c - Compares the web service response dispatch
+ *
+ * LICENSE:
+ *
+ *   Copyright 2012 Assaf Paz
+ *
+ *   This file is part of RoadMap.
+ *
+ *   RoadMap is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   RoadMap is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with RoadMap; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * DESCRIPTION:
+ *
+ *   Replays realtime responses through the dispatch loop of
+ *   OnCustomResponse() in websvc_trans.c, as they arrive in network sized
+ *   chunks, and reports the time of each version of the loop:
+ *
+ *      linear  the previous loop: looks for the end of the line from its
+ *              start after each chunk, copies the tag with
+ *              ExtractNetworkString() and compares it to every parser
+ *      table   the current loop: resumes the line scan where it stopped,
+ *              reads the tag in place and looks it up with
+ *              wst_parser_table_find()
+ *
+ *   Both use the parser set of RealtimeNet.c, with parsers which only skip
+ *   their line, so the time is that of the dispatch alone.
+ *
+ *   The responses are read from files, such as those logged by runParsers()
+ *   in qt_webaccessor.cc at the debug level, or generated.
+ *
+ * SYNOPSIS:
+ *
+ *   parser_bench [--rounds <n>] [--chunk <bytes>] [--lines <n>] [<response file> ...]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/time.h>
+
+#include "roadmap.h"
+#include "websvc_trans/websvc_trans_parsers.h"
+
+#define PARSER_BENCH_CHUNK    1460  /* one TCP segment */
+
+typedef struct {
+
+   char  *data;
+   int   size;
+} BenchResponse;
+
+/* The received part of a response, as kept in the cyclic buffer */
+typedef struct {
+
+   const char  *buffer;
+   int         read_size;
+   int         read_processed;
+   int         line_scanned;
+} BenchBuffer;
+
+typedef int (*BenchLoop) (BenchBuffer *buffer, const wst_parser *parsers, int parsers_count);
+
+int RoadMapLogLevel = ROADMAP_MESSAGE_WARNING;
+
+static int ParsedLines;
+
+
+void roadmap_log_write (int level, const char *source, int line, const char *format, ...) {
+
+   va_list ap;
+
+   fprintf (stderr, "%s:%d ", source, line);
+
+   va_start (ap, format);
+   vfprintf (stderr, format, ap);
+   va_end (ap);
+
+   fprintf (stderr, "\n");
+
+   if (level >= ROADMAP_MESSAGE_FATAL) exit (1);
+}
+
+
+static double now_ms (void) {
+
+   struct timeval tv;
+
+   gettimeofday (&tv, NULL);
+   return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+}
+
+
+static const char *skip_line (const char *data, void *context,
+                              BOOL *more_data_needed, roadmap_result *rc) {
+
+   ParsedLines++;
+
+   while (*data && *data != '\n') data++;
+
+   return data;
+}
+
+
+/* The tags of general_parser in Realtime/RealtimeNet.c */
+static wst_parser RealtimeParsers[] =
+{
+   { "RC",                       skip_line},
+   { "AddUser",                  skip_line},
+   { "AddAlert",                 skip_line},
+   { "AddAlertComment",          skip_line},
+   { "RmAlert",                  skip_line},
+   { "SystemMessage",            skip_line},
+   { "UpgradeClient",            skip_line},
+   { "AddRoadInfo",              skip_line},
+   { "RoadInfoGeom",             skip_line},
+   { "RoadInfoSegments",         skip_line},
+   { "RmRoadInfo",               skip_line},
+   { "BridgeToRes",              skip_line},
+   { "ReportAlertRes",           skip_line},
+   { "ReportTrafficRes",         skip_line},
+   { "PostAlertCommentRes",      skip_line},
+   { "MapUpdateTime",            skip_line},
+   { "GeoLocation",              skip_line},
+   { "UpdateUserPoints",         skip_line},
+   { "RoutingResponseCode",      skip_line},
+   { "RoutingResponse",          skip_line},
+   { "RoutePoints",              skip_line},
+   { "RouteSegments",            skip_line},
+   { "EventOnRoute",             skip_line},
+   { "SuggestReroute",           skip_line},
+   { "GeoServerConfig",          skip_line},
+   { "ServerConfig",             skip_line},
+   { "AddCustomBonus",           skip_line},
+   { "AddBonus",                 skip_line},
+   { "RmBonus",                  skip_line},
+   { "CollectBonusRes",          skip_line},
+   { "OpenMessageTicker",        skip_line},
+   { "UpdateConfig",             skip_line},
+   { "UserGroups",               skip_line},
+   { "OpenMoodSelection",        skip_line},
+   { "AddExternalPoiType",       skip_line},
+   { "AddExternalPoi",           skip_line},
+   { "RmExternalPoi",            skip_line},
+   { "SetExternalPoiDrawOrder",  skip_line},
+   { "ThumbsUpRes",              skip_line},
+   { "UpdateAlert",              skip_line},
+   { "UpdateInboxCount",         skip_line},
+   { "ThumbsUpReceived",         skip_line},
+   { "AddBonusTemplate",         skip_line},
+};
+
+
+/* cyclic_buffer_update_processed_data() */
+static void update_processed (BenchBuffer *buffer, const char *next, const char *skip) {
+
+   if (skip) next = EatChars (next, skip, TRIM_ALL_CHARS);
+
+   buffer->read_processed = (int)(next - buffer->buffer);
+}
+
+
+static int dispatch (BenchBuffer *buffer, const char *next, const char *last,
+                     CB_OnWSTResponse parser, CB_OnWSTResponse def_parser) {
+
+   BOOL more_data_needed = FALSE;
+   roadmap_result rc = succeeded;
+
+   if (parser) {
+      update_processed (buffer, next, NULL);
+   } else if (def_parser) {
+      update_processed (buffer, last, NULL);
+      parser = def_parser;
+   } else {
+      return -1;
+   }
+
+   next = parser (buffer->buffer + buffer->read_processed, NULL, &more_data_needed, &rc);
+   if (!next) next = SkipChars (last, "\r\n", TRIM_ALL_CHARS);
+
+   update_processed (buffer, next, " ,\t\r\n");
+   return 0;
+}
+
+
+static int linear_loop (BenchBuffer *buffer, const wst_parser *parsers, int parsers_count) {
+
+   char tag[WST_RESPONSE_TAG_MAXSIZE+1];
+   CB_OnWSTResponse def_parser = NULL;
+   BOOL have_tags = FALSE;
+   int i;
+
+   for (i = 0; i < parsers_count; i++) {
+      if (parsers[i].tag && parsers[i].tag[0]) {
+         have_tags = TRUE;
+      } else {
+         def_parser = parsers[i].parser;
+         break;
+      }
+   }
+
+   while (buffer->read_size > buffer->read_processed) {
+
+      const char *next = buffer->buffer + buffer->read_processed;
+      const char *last = next;
+      CB_OnWSTResponse parser = NULL;
+      int buffer_size;
+
+      if (NULL == strchr (next, '\n')) return 0;
+
+      if (have_tags) {
+
+         buffer_size = WST_RESPONSE_TAG_MAXSIZE;
+         next = ExtractNetworkString (next, tag, &buffer_size, ",\r\n", 1);
+         next = EatChars (next, "\r\n", TRIM_ALL_CHARS);
+         if (!next || !(*next)) return -1;
+
+         for (i = 0; i < parsers_count; i++) {
+            if (parsers[i].tag && !strcasecmp (tag, parsers[i].tag)) {
+               parser = parsers[i].parser;
+               break;
+            }
+         }
+      }
+
+      if (dispatch (buffer, next, last, parser, def_parser) < 0) return -1;
+   }
+
+   return 0;
+}
+
+
+static int table_loop (BenchBuffer *buffer, const wst_parser *parsers, int parsers_count) {
+
+   char tag_buffer[WST_RESPONSE_TAG_MAXSIZE+1];
+   const wst_parser_table *table =
+      wst_parser_table_get ((wst_parser_ptr)parsers, parsers_count);
+
+   if (!table) return -1;
+
+   while (buffer->read_size > buffer->read_processed) {
+
+      const char *next = buffer->buffer + buffer->read_processed;
+      const char *last = next;
+      const char *line_end;
+      const char *tag;
+      CB_OnWSTResponse parser = NULL;
+      int tag_size;
+
+      if (buffer->line_scanned < buffer->read_processed) {
+         buffer->line_scanned = buffer->read_processed;
+      }
+      line_end = memchr (buffer->buffer + buffer->line_scanned, '\n',
+                         buffer->read_size - buffer->line_scanned);
+      if (NULL == line_end) {
+         buffer->line_scanned = buffer->read_size;
+         return 0;
+      }
+      buffer->line_scanned = (int)(line_end - buffer->buffer);
+
+      if (table->have_tags) {
+
+         tag = next;
+         tag_size = strcspn (next, ",\r\n\\");
+
+         if (ESCAPE_SEQUENCE_TAG == next[tag_size]) {
+            int buffer_size = WST_RESPONSE_TAG_MAXSIZE;
+            next = ExtractNetworkString (next, tag_buffer, &buffer_size, ",\r\n", 1);
+            tag = tag_buffer;
+            tag_size = buffer_size;
+         } else if (tag_size >= WST_RESPONSE_TAG_MAXSIZE) {
+            next = NULL;
+         } else {
+            next = EatChars (next + tag_size, ",\r\n", 1);
+         }
+
+         next = EatChars (next, "\r\n", TRIM_ALL_CHARS);
+         if (!next || !(*next)) return -1;
+
+         parser = wst_parser_table_find (table, tag, tag_size);
+      }
+
+      if (dispatch (buffer, next, last, parser, table->def_parser) < 0) return -1;
+   }
+
+   return 0;
+}
+
+
+/* Feeds the response in chunks. The received data stays null terminated,
+ * as it is in the receive buffer.
+ */
+static int replay (BenchLoop loop, const BenchResponse *response, int chunk) {
+
+   char *received = malloc (response->size + 1);
+   BenchBuffer buffer;
+   int rc = 0;
+
+   if (!received) roadmap_log (ROADMAP_FATAL, "No memory for a response");
+
+   memset (&buffer, 0, sizeof (buffer));
+   buffer.buffer = received;
+
+   while (rc == 0 && buffer.read_size < response->size) {
+
+      int size = response->size - buffer.read_size;
+      if (size > chunk) size = chunk;
+
+      memcpy (received + buffer.read_size, response->data + buffer.read_size, size);
+      buffer.read_size += size;
+      received[buffer.read_size] = '\0';
+
+      rc = loop (&buffer, RealtimeParsers, sizeof (RealtimeParsers) / sizeof (wst_parser));
+   }
+
+   free (received);
+   return rc;
+}
+
+
+static int read_response (const char *name, BenchResponse *response) {
+
+   FILE *file = fopen (name, "rb");
+   long size;
+
+   if (!file) {
+      roadmap_log (ROADMAP_ERROR, "Cannot open %s", name);
+      return -1;
+   }
+
+   fseek (file, 0, SEEK_END);
+   size = ftell (file);
+   fseek (file, 0, SEEK_SET);
+
+   response->data = malloc (size + 1);
+   if (!response->data ||
+       fread (response->data, 1, size, file) != (size_t)size) {
+      roadmap_log (ROADMAP_ERROR, "Cannot read %s", name);
+      fclose (file);
+      return -1;
+   }
+
+   fclose (file);
+
+   response->data[size] = '\0';
+   response->size = (int)size;
+   return 0;
+}
+
+
+/* A response in the style of a realtime map refresh */
+static void generate_response (BenchResponse *response, int lines) {
+
+   static const char *samples[] = {
+      "AddUser,%d,user_%d,34.78%04d,32.08%04d,90,45,1,0,0,0,,0,0,0,1,1,0",
+      "AddAlert,%d,2,34.78%04d,32.08%04d,180,1287391010,0,Heavy traffic,nick_%d,0,0,0,0,0,0,1,0,,0,0,0",
+      "AddRoadInfo,%d,3,34.78%04d,32.08%04d,11,Highway %d,Slowing down,25,0",
+      "RoadInfoSegments,%d,1,1,%d,%d,%d,1,0",
+      "UpdateUserPoints,%d,%d,%d,%d",
+   };
+   int capacity = lines * 160 + 64;
+   int size = 0;
+   int i;
+
+   response->data = malloc (capacity);
+   if (!response->data) roadmap_log (ROADMAP_FATAL, "No memory for %d lines", lines);
+
+   size += sprintf (response->data, "RC,200\n");
+
+   for (i = 0; i < lines; i++) {
+      size += snprintf (response->data + size, capacity - size,
+                        samples[i % (sizeof (samples) / sizeof (samples[0]))],
+                        1000 + i, i, i % 10000, (i * 7) % 10000);
+      response->data[size++] = '\n';
+   }
+
+   response->data[size] = '\0';
+   response->size = size;
+}
+
+
+static void usage (const char *program) {
+
+   fprintf (stderr, "usage: %s [--rounds <n>] [--chunk <bytes>] [--lines <n>] [<response file> ...]\n",
+            program);
+   exit (1);
+}
+
+
+int main (int argc, char **argv) {
+
+   static const char *names[] = { "linear", "table" };
+   BenchLoop loops[2] = { linear_loop, table_loop };
+   BenchResponse *responses;
+   int count = 0;
+   int rounds = 20;
+   int chunk = PARSER_BENCH_CHUNK;
+   int lines = 2000;
+   long bytes = 0;
+   int i;
+
+   responses = calloc (argc, sizeof (BenchResponse));
+   if (!responses) return 1;
+
+   for (i = 1; i < argc; i++) {
+      if (!strncmp (argv[i], "--", 2) && i == argc - 1) usage (argv[0]);
+      if (!strcmp (argv[i], "--rounds")) {
+         rounds = atoi (argv[++i]);
+      } else if (!strcmp (argv[i], "--chunk")) {
+         chunk = atoi (argv[++i]);
+      } else if (!strcmp (argv[i], "--lines")) {
+         lines = atoi (argv[++i]);
+      } else if (!strncmp (argv[i], "--", 2)) {
+         usage (argv[0]);
+      } else if (read_response (argv[i], responses + count) == 0) {
+         count++;
+      } else {
+         return 1;
+      }
+   }
+
+   if (rounds < 1 || chunk < 1 || lines < 1) usage (argv[0]);
+
+   if (!count) generate_response (responses + count++, lines);
+
+   for (i = 0; i < count; i++) bytes += responses[i].size;
+   printf ("%d responses, %ld bytes, %d byte chunks, %d rounds\n", count, bytes, chunk, rounds);
+
+   for (i = 0; i < 2; i++) {
+
+      double start;
+      int round;
+      int r;
+
+      /* an untimed round, to build the table and warm the caches */
+      for (r = 0; r < count; r++) replay (loops[i], responses + r, chunk);
+
+      start = now_ms ();
+      ParsedLines = 0;
+
+      for (round = 0; round < rounds; round++) {
+         for (r = 0; r < count; r++) {
+            if (replay (loops[i], responses + r, chunk) < 0) {
+               printf ("%s: response %d failed\n", names[i], r + 1);
+            }
+         }
+      }
+
+      printf ("%-6s %10.2f ms/round %10d lines/round\n",
+              names[i], (now_ms () - start) / rounds, ParsedLines / rounds);
+   }
+
+   return 0;
+}
@@ -0,0 +1,17 @@
+# Replays realtime responses through the previous and the current dispatch
+# loop of the web service responses, and reports the time of each:
+#
+#    parser_bench --lines 5000
+#    parser_bench --chunk 512 response1.txt response2.txt
+
+QT       -= core gui
+TEMPLATE = app
+TARGET = parser_bench
+CONFIG += console
+CONFIG -= app_bundle qt
+
+INCLUDEPATH += ../..
+
+SOURCES += parser_bench.c \
+    ../../websvc_trans/websvc_trans_parsers.c \
+    ../../websvc_trans/string_parser.c
@@ -0,0 +1,538 @@
+/* route_bench.c - Compares the route search queues
+ *
+ * LICENSE:
+ *
+ *   Copyright 2012 Assaf Paz
+ *
+ *   This file is part of RoadMap.
+ *
+ *   RoadMap is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   RoadMap is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with RoadMap; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * DESCRIPTION:
+ *
+ *   Runs the same start / goal pairs through three searches over a grid
+ *   road network and reports the time, the number of expanded nodes and
+ *   the route costs of each:
+ *
+ *      fib     the previous engine: one way A* over fib-1.1, which gives
+ *              up after MAX_ASTAR_LINES visited lines
+ *      heap    one way A* over the 4-ary heap of navigate_heap.c
+ *      bidir   the bidirectional search of navigate_route_astar.c
+ *
+ *   The searches follow navigate_route_astar.c: an item is added to the
+ *   visited set when first reached, queue keys never decrease, and the
+ *   bidirectional search stops once either queue reaches the best meeting
+ *   cost. The grid has random segment costs and blocked segments, so
+ *   routes have to detour.
+ *
+ *   The pairs are random, or read from a file with one pair per line:
+ *
+ *      <start x> <start y> <goal x> <goal y>
+ *
+ * SYNOPSIS:
+ *
+ *   route_bench [--size <n>] [--pairs <count>] [--seed <seed>] [--file <pairs>]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "roadmap.h"
+#include "navigate/navigate_heap.h"
+#include "navigate/fib-1.1/fib.h"
+
+#define ROUTE_BENCH_UNIT         100   /* cost of the cheapest segment */
+#define ROUTE_BENCH_MAX_FACTOR   4
+#define ROUTE_BENCH_BLOCKED      8     /* percent of blocked segments */
+#define ROUTE_BENCH_MAX_PAIRS    4096
+
+/* the visited lines limit of the previous engine */
+#define MAX_ASTAR_LINES          (4096 * 40)
+
+#define NO_PREV   -1
+
+typedef struct {
+
+   int   x;
+   int   y;
+} BenchPoint;
+
+typedef struct {
+
+   BenchPoint  start;
+   BenchPoint  goal;
+} BenchPair;
+
+typedef struct {
+
+   int   cost;
+   int   prev;
+   int   stamp;
+} BenchNode;
+
+typedef struct {
+
+   const char  *name;
+   double      total_ms;
+   long        expanded;
+   long        cost;
+   int         found;
+   int         failed;
+} BenchResult;
+
+int RoadMapLogLevel = ROADMAP_MESSAGE_WARNING;
+
+static int        GridSize = 300;
+static int        *SegmentCost;         /* 4 per node, -1 when blocked */
+static BenchNode  *Forward;
+static BenchNode  *Backward;
+static int        Stamp;
+
+static const int  DeltaX[4] = { 1, 0, -1, 0 };
+static const int  DeltaY[4] = { 0, 1, 0, -1 };
+
+
+void roadmap_log_write (int level, const char *source, int line, const char *format, ...) {
+
+   va_list ap;
+
+   fprintf (stderr, "%s:%d ", source, line);
+
+   va_start (ap, format);
+   vfprintf (stderr, format, ap);
+   va_end (ap);
+
+   fprintf (stderr, "\n");
+
+   if (level >= ROADMAP_MESSAGE_FATAL) exit (1);
+}
+
+
+static double now_ms (void) {
+
+   struct timeval tv;
+
+   gettimeofday (&tv, NULL);
+   return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+}
+
+
+static int neighbour (int node, int direction) {
+
+   int x = node % GridSize + DeltaX[direction];
+   int y = node / GridSize + DeltaY[direction];
+
+   if (x < 0 || y < 0 || x >= GridSize || y >= GridSize) return -1;
+
+   return y * GridSize + x;
+}
+
+
+static int heuristic (int from, int to) {
+
+   return ROUTE_BENCH_UNIT * (abs (from % GridSize - to % GridSize) +
+                              abs (from / GridSize - to / GridSize));
+}
+
+
+static void build_grid (void) {
+
+   int count = GridSize * GridSize;
+   int node;
+   int direction;
+
+   SegmentCost = (int *)malloc (count * 4 * sizeof (int));
+   Forward = (BenchNode *)calloc (count, sizeof (BenchNode));
+   Backward = (BenchNode *)calloc (count, sizeof (BenchNode));
+
+   if (!SegmentCost || !Forward || !Backward) {
+      roadmap_log (ROADMAP_FATAL, "No memory for a grid of %d nodes", count);
+   }
+
+   for (node = 0; node < count; node++) {
+
+      for (direction = 0; direction < 2; direction++) {
+
+         int next = neighbour (node, direction);
+         int cost = -1;
+
+         if (next < 0) {
+            SegmentCost[node * 4 + direction] = -1;
+            continue;
+         }
+
+         if (rand () % 100 >= ROUTE_BENCH_BLOCKED) {
+            cost = ROUTE_BENCH_UNIT * (1 + rand () % ROUTE_BENCH_MAX_FACTOR);
+         }
+
+         /* both directions of a segment have the same cost */
+         SegmentCost[node * 4 + direction] = cost;
+         SegmentCost[next * 4 + direction + 2] = cost;
+      }
+
+      for (direction = 2; direction < 4; direction++) {
+         if (neighbour (node, direction) < 0) SegmentCost[node * 4 + direction] = -1;
+      }
+   }
+}
+
+
+static int visited (BenchNode *set, int node) {
+
+   return set[node].stamp == Stamp;
+}
+
+
+static void visit (BenchNode *set, int node, int cost, int prev) {
+
+   set[node].stamp = Stamp;
+   set[node].cost = cost;
+   set[node].prev = prev;
+}
+
+
+/* The previous engine: one way A* over a Fibonacci heap. The heap holds
+ * node + 1, as fh_min() returns NULL for an empty heap.
+ */
+static int search_fib (int start, int goal, long *expanded) {
+
+   struct fibheap *queue = fh_makekeyheap ();
+   int visited_count = 1;
+   int cost = -1;
+
+   Stamp++;
+   visit (Forward, start, 0, NO_PREV);
+   fh_insertkey (queue, 0, (void *)(long)(start + 1));
+
+   while (fh_min (queue) != NULL) {
+
+      int key = fh_minkey (queue);
+      int node = (int)(long)fh_extractmin (queue) - 1;
+      int direction;
+
+      (*expanded)++;
+
+      if (node == goal) {
+         cost = Forward[node].cost;
+         break;
+      }
+
+      for (direction = 0; direction < 4; direction++) {
+
+         int next = neighbour (node, direction);
+         int segment_cost = SegmentCost[node * 4 + direction];
+         int total_cost;
+
+         if (segment_cost < 0 || visited (Forward, next)) continue;
+
+         if (visited_count >= MAX_ASTAR_LINES) {
+            fh_deleteheap (queue);
+            return -1;
+         }
+
+         visit (Forward, next, Forward[node].cost + segment_cost, node);
+         visited_count++;
+
+         total_cost = Forward[next].cost + heuristic (next, goal) + 1;
+         if (total_cost < key) total_cost = key;
+
+         fh_insertkey (queue, total_cost, (void *)(long)(next + 1));
+      }
+   }
+
+   fh_deleteheap (queue);
+   return cost;
+}
+
+
+/* One way A* over the 4-ary heap */
+static int search_heap (NavigateHeap *queue, int start, int goal, long *expanded) {
+
+   Stamp++;
+   visit (Forward, start, 0, NO_PREV);
+
+   navigate_heap_clear (queue);
+   navigate_heap_insert (queue, 0, (void *)(long)start);
+
+   while (!navigate_heap_empty (queue)) {
+
+      int key = navigate_heap_min_key (queue);
+      int node = (int)(long)navigate_heap_extract_min (queue);
+      int direction;
+
+      (*expanded)++;
+
+      if (node == goal) return Forward[node].cost;
+
+      for (direction = 0; direction < 4; direction++) {
+
+         int next = neighbour (node, direction);
+         int segment_cost = SegmentCost[node * 4 + direction];
+         int total_cost;
+
+         if (segment_cost < 0 || visited (Forward, next)) continue;
+
+         visit (Forward, next, Forward[node].cost + segment_cost, node);
+
+         total_cost = Forward[next].cost + heuristic (next, goal) + 1;
+         if (total_cost < key) total_cost = key;
+
+         if (navigate_heap_insert (queue, total_cost, (void *)(long)next) < 0) return -1;
+      }
+   }
+
+   return -1;
+}
+
+
+static int expand (NavigateHeap *queue, BenchNode *set, BenchNode *other,
+                   int target, int *meet_cost) {
+
+   int key = navigate_heap_min_key (queue);
+   int node = (int)(long)navigate_heap_extract_min (queue);
+   int direction;
+
+   for (direction = 0; direction < 4; direction++) {
+
+      int next = neighbour (node, direction);
+      int segment_cost = SegmentCost[node * 4 + direction];
+      int total_cost;
+
+      if (segment_cost < 0 || visited (set, next)) continue;
+
+      visit (set, next, set[node].cost + segment_cost, node);
+
+      total_cost = set[next].cost + heuristic (next, target) + 1;
+      if (total_cost < key) total_cost = key;
+
+      if (navigate_heap_insert (queue, total_cost, (void *)(long)next) < 0) return -1;
+
+      if (visited (other, next) &&
+          (*meet_cost < 0 || set[next].cost + other[next].cost < *meet_cost)) {
+         *meet_cost = set[next].cost + other[next].cost;
+      }
+   }
+
+   return 0;
+}
+
+
+/* The bidirectional search, expanding the side with the smaller queue */
+static int search_bidir (NavigateHeap *forward, NavigateHeap *backward,
+                         int start, int goal, long *expanded) {
+
+   int meet_cost = start == goal ? 0 : -1;
+
+   Stamp++;
+   visit (Forward, start, 0, NO_PREV);
+   visit (Backward, goal, 0, NO_PREV);
+
+   navigate_heap_clear (forward);
+   navigate_heap_clear (backward);
+   navigate_heap_insert (forward, 0, (void *)(long)start);
+   navigate_heap_insert (backward, 0, (void *)(long)goal);
+
+   while (!navigate_heap_empty (forward) && !navigate_heap_empty (backward)) {
+
+      int rc;
+
+      if (meet_cost >= 0 &&
+          (navigate_heap_min_key (forward) >= meet_cost ||
+           navigate_heap_min_key (backward) >= meet_cost)) {
+         break;
+      }
+
+      (*expanded)++;
+
+      if (forward->count <= backward->count) {
+         rc = expand (forward, Forward, Backward, goal, &meet_cost);
+      } else {
+         rc = expand (backward, Backward, Forward, start, &meet_cost);
+      }
+
+      if (rc < 0) return -1;
+   }
+
+   return meet_cost;
+}
+
+
+static int point_node (const BenchPoint *point) {
+
+   if (point->x < 0 || point->y < 0 || point->x >= GridSize || point->y >= GridSize) return -1;
+
+   return point->y * GridSize + point->x;
+}
+
+
+static int read_pairs (const char *name, BenchPair *pairs) {
+
+   FILE *file = fopen (name, "r");
+   char line[256];
+   int count = 0;
+
+   if (!file) {
+      roadmap_log (ROADMAP_ERROR, "Cannot open %s", name);
+      return -1;
+   }
+
+   while (count < ROUTE_BENCH_MAX_PAIRS && fgets (line, sizeof (line), file)) {
+
+      BenchPair *pair = pairs + count;
+
+      if (line[0] == '#') continue;
+
+      if (sscanf (line, "%d %d %d %d", &pair->start.x, &pair->start.y,
+                  &pair->goal.x, &pair->goal.y) != 4) {
+         continue;
+      }
+
+      if (point_node (&pair->start) < 0 || point_node (&pair->goal) < 0) {
+         roadmap_log (ROADMAP_WARNING, "Pair %d is outside the %dx%d grid", count + 1,
+                      GridSize, GridSize);
+         continue;
+      }
+
+      count++;
+   }
+
+   fclose (file);
+   return count;
+}
+
+
+static void random_pairs (BenchPair *pairs, int count) {
+
+   int i;
+
+   for (i = 0; i < count; i++) {
+      pairs[i].start.x = rand () % GridSize;
+      pairs[i].start.y = rand () % GridSize;
+      pairs[i].goal.x = rand () % GridSize;
+      pairs[i].goal.y = rand () % GridSize;
+   }
+}
+
+
+static void report (const BenchResult *result, int pairs) {
+
+   printf ("%-6s %10.1f ms %10.3f ms/route %12ld nodes/route %6d found %6d failed %12ld cost\n",
+           result->name, result->total_ms, result->total_ms / pairs,
+           result->expanded / (pairs ? pairs : 1), result->found, result->failed,
+           result->cost);
+}
+
+
+static void usage (const char *program) {
+
+   fprintf (stderr, "usage: %s [--size <n>] [--pairs <count>] [--seed <seed>] [--file <pairs>]\n",
+            program);
+   exit (1);
+}
+
+
+int main (int argc, char **argv) {
+
+   static BenchPair pairs[ROUTE_BENCH_MAX_PAIRS];
+   BenchResult results[3];
+   NavigateHeap forward;
+   NavigateHeap backward;
+   const char *file = NULL;
+   int count = 100;
+   unsigned int seed = 1;
+   int i;
+
+   for (i = 1; i < argc; i++) {
+      if (i == argc - 1) usage (argv[0]);
+      if (!strcmp (argv[i], "--size")) {
+         GridSize = atoi (argv[++i]);
+      } else if (!strcmp (argv[i], "--pairs")) {
+         count = atoi (argv[++i]);
+      } else if (!strcmp (argv[i], "--seed")) {
+         seed = (unsigned int)atol (argv[++i]);
+      } else if (!strcmp (argv[i], "--file")) {
+         file = argv[++i];
+      } else {
+         usage (argv[0]);
+      }
+   }
+
+   if (GridSize < 2 || count < 1) usage (argv[0]);
+   if (count > ROUTE_BENCH_MAX_PAIRS) count = ROUTE_BENCH_MAX_PAIRS;
+
+   srand (seed);
+   build_grid ();
+
+   if (file) {
+      count = read_pairs (file, pairs);
+      if (count <= 0) return 1;
+   } else {
+      random_pairs (pairs, count);
+   }
+
+   navigate_heap_init (&forward);
+   navigate_heap_init (&backward);
+
+   memset (results, 0, sizeof (results));
+   results[0].name = "fib";
+   results[1].name = "heap";
+   results[2].name = "bidir";
+
+   for (i = 0; i < count; i++) {
+
+      int start = point_node (&pairs[i].start);
+      int goal = point_node (&pairs[i].goal);
+      int costs[3];
+      int engine;
+
+      for (engine = 0; engine < 3; engine++) {
+
+         BenchResult *result = results + engine;
+         double start_time = now_ms ();
+
+         switch (engine) {
+         case 0:
+            costs[engine] = search_fib (start, goal, &result->expanded);
+            break;
+         case 1:
+            costs[engine] = search_heap (&forward, start, goal, &result->expanded);
+            break;
+         default:
+            costs[engine] = search_bidir (&forward, &backward, start, goal, &result->expanded);
+            break;
+         }
+
+         result->total_ms += now_ms () - start_time;
+
+         if (costs[engine] < 0) {
+            result->failed++;
+         } else {
+            result->found++;
+            result->cost += costs[engine];
+         }
+      }
+   }
+
+   printf ("%d routes on a %dx%d grid\n", count, GridSize, GridSize);
+   for (i = 0; i < 3; i++) report (results + i, count);
+
+   navigate_heap_free (&forward);
+   navigate_heap_free (&backward);
+
+   return 0;
+}
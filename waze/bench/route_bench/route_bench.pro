@@ -0,0 +1,18 @@
+# Runs the same start / goal pairs through the previous fib-1.1 route
+# search, the 4-ary heap search and the bidirectional search, and reports
+# the time and expanded nodes of each:
+#
+#    route_bench --size 400 --pairs 200
+#    route_bench --file pairs.txt
+
+QT       -= core gui
+TEMPLATE = app
+TARGET = route_bench
+CONFIG += console
+CONFIG -= app_bundle qt
+
+INCLUDEPATH += ../..
+
+SOURCES += route_bench.c \
+    ../../navigate/navigate_heap.c \
+    ../../navigate/fib-1.1/fib.c
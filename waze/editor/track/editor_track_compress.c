@@ -19,12 +19,22 @@
  *   You should have received a copy of the GNU General Public License
  *   along with RoadMap; if not, write to the Free Software
  *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * NOTES:
+ *
+ *   The track is simplified while it is recorded, with an opening window:
+ *   the segment from the last kept point (the anchor) to the new point
+ *   must pass close enough to every point in between, otherwise the
+ *   previous point is kept and becomes the anchor. The window is bounded,
+ *   so each new point costs at most TRACK_COMPRESS_MAX_WINDOW distances,
+ *   and compressing a range only has to fix its two ends.
  */
 
 #include "editor_track_compress.h"
 #include "roadmap_math.h"
 
 #define  TRACK_MIN_VARIANT_THRESHOLD            (5)
+#define  TRACK_COMPRESS_MAX_WINDOW              (32)
 
 #define	COMPRESSION_STATS 0
 
@@ -122,54 +132,127 @@ static int point_distance_from_expected_position(int   range_begin,
 
 
 
-static void  editor_track_compress_range (int from, int to)
+static int TrackCompressAnchor = -1;   // Last point kept while recording
+
+
+/* Checks that all the points between from and to are close to the segment */
+static int editor_track_compress_fits (int from, int to)
 {
    int               i;
-   int               distance    =  0;
-   int               farest      = -1;    // Index of the most distanced point
-   
-   *track_point_status (from) = POINT_STATUS_SAVE;
-   *track_point_status (to) = POINT_STATUS_SAVE;
-   
-   if( (to - from) < 2)
-      return;
 
    for( i=(from+1); i<to; i++)
    {
-      int               cur_distance= point_distance_from_expected_position( 
-                                                         from,   // Range begin
-                                                         to,     // Range end
-                                                         i);        // Point to test
+      if (point_distance_from_expected_position (from, to, i) >= TRACK_MIN_VARIANT_THRESHOLD)
+         return 0;
+   }
+
+   return 1;
+}
+
+
+/* Returns the number of points kept between from and to, both excluded.
+ * They are marked only if mark is set.
+ */
+static int  editor_track_compress_window (int from, int to, int mark)
+{
+   int               i;
+   int               anchor = from;
+   int               count = 0;
 
-      if(distance < cur_distance)
+   for( i=(from+2); i<=to; i++)
+   {
+      if (((i - anchor) > TRACK_COMPRESS_MAX_WINDOW) ||
+          !editor_track_compress_fits (anchor, i))
       {
-         distance = cur_distance;
-         farest   = i;
+         anchor = i - 1;
+         if (mark) *track_point_status (anchor) = POINT_STATUS_SAVE;
+         count++;
       }
    }
-   
-   if( (-1 == farest) || (distance < TRACK_MIN_VARIANT_THRESHOLD))
+
+   return count;
+}
+
+
+/* Returns the number of points kept between from and to, both included.
+ * The points kept while recording are kept, but the points next to the
+ * ends of the range were checked against anchors outside of it.
+ */
+static int  editor_track_compress_range (int from, int to, int mark)
+{
+   int               first;
+   int               last;
+   int               count;
+
+   if (from >= to) return 1;
+
+   for (first = from + 1; first < to; first++) {
+      if (POINT_STATUS_SAVE == *track_point_status (first)) break;
+   }
+   count = 2 + editor_track_compress_window (from, first, mark);
+
+   if (first < to) {
+      for (last = to - 1; last > first; last--) {
+         if (POINT_STATUS_SAVE == *track_point_status (last)) count++;
+      }
+      count++;
+
+      for (last = to - 1; last > first; last--) {
+         if (POINT_STATUS_SAVE == *track_point_status (last)) break;
+      }
+      count += editor_track_compress_window (last, to, mark);
+   }
+
+   return count;
+}
+
+
+void  editor_track_compress_reset (void)
+{
+   TrackCompressAnchor = -1;
+}
+
+
+void  editor_track_compress_shift (int count)
+{
+   TrackCompressAnchor -= count;
+
+   /* the points left before the next anchor are handled by compress_track */
+   if (TrackCompressAnchor < 0)
+      TrackCompressAnchor = -1;
+}
+
+
+void  editor_track_compress_add (int point)
+{
+   if ((TrackCompressAnchor < 0) || (point <= TrackCompressAnchor))
+   {
+      TrackCompressAnchor = point;
+      *track_point_status (point) = POINT_STATUS_SAVE;
       return;
+   }
 
-   editor_track_compress_range(from, farest);
-   editor_track_compress_range(farest, to);
+   if (((point - TrackCompressAnchor) > TRACK_COMPRESS_MAX_WINDOW) ||
+       !editor_track_compress_fits (TrackCompressAnchor, point))
+   {
+      TrackCompressAnchor = point - 1;
+      *track_point_status (TrackCompressAnchor) = POINT_STATUS_SAVE;
+   }
 }
 
 
 void  editor_track_compress_track (int from, int to)
 {
-   int               i;
 #if COMPRESSION_STATS
+   int               i;
    static int total_points_before = 0;
    static int total_points_after = 0;
 #endif
-   
-   for (i = from; i <= to; i++) {
-   
-   	*track_point_status (i) = POINT_STATUS_IGNORE;
-   }	
-   
-   editor_track_compress_range (from, to);
+
+   *track_point_status (from) = POINT_STATUS_SAVE;
+   *track_point_status (to) = POINT_STATUS_SAVE;
+
+   editor_track_compress_range (from, to, 1);
    
 #if COMPRESSION_STATS
 	for (i = from; i <= to; i++) {
@@ -183,3 +266,9 @@ void  editor_track_compress_track (int from, int to)
 #endif
    
 }
+
+
+int  editor_track_compress_count (int from, int to)
+{
+   return editor_track_compress_range (from, to, 0);
+}
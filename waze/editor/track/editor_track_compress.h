@@ -27,7 +27,19 @@
 #include "roadmap_navigate.h"
 #include "editor_track_main.h"
 
+void  editor_track_compress_reset (void);
+
+/* The first count points were removed from the track */
+void  editor_track_compress_shift (int count);
+
+/* Simplifies the track as the point is added */
+void  editor_track_compress_add (int point);
+
+/* Marks the points to keep between from and to, which are kept */
 void  editor_track_compress_track (int from, int to);
 
+/* Returns the number of points compress_track would keep, marks nothing */
+int   editor_track_compress_count (int from, int to);
+
 #endif // INCLUDE__EDITOR_TRACK_COMPRESS__H
 
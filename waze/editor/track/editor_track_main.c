@@ -214,6 +214,7 @@ waze_assert (editor_track_known_num_candidates() <= 1);
    if (last_point_id == -1) {
       points_count = 0;
       points_start = 0;
+      editor_track_compress_reset ();
       return;
    }
 
@@ -232,6 +233,8 @@ waze_assert (editor_track_known_num_candidates() <= 1);
 
    points_start -= last_point_id;
    if (points_start < 0) points_start = 0;
+
+   editor_track_compress_shift (last_point_id);
 }
 
 
@@ -1009,6 +1012,8 @@ static int editor_track_add_point(RoadMapGpsPosition *point, time_t time) {
    TrackPoints[points_count].status = POINT_STATUS_IGNORE;
    TrackPoints[points_count].ordinal = cur_ordinal++;
 
+   editor_track_compress_add (points_count);
+
    return points_count++;
 }
 
@@ -1371,18 +1376,10 @@ int editor_track_draw_new_direction_roads () {
 
 int editor_track_deflate (void) {
 
-	int i;
-	int j;
-
 	if (points_count <= points_start) return 0;
 
-	editor_track_compress_track (points_start, points_count - 1);
-
-	for (i = points_start, j = 0; i < points_count; i++) {
-		if (TrackPoints[i].status == POINT_STATUS_SAVE) j++;
-	}
-
-	return j;
+	/* only counts: the track is still being recorded */
+	return editor_track_compress_count (points_start, points_count - 1);
 }
 
 int editor_track_is_new_direction_roads (){
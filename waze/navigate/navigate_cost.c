@@ -413,6 +413,18 @@ NavigateCostFn navigate_cost_get (void) {
    }
 }
 
+/* Whether the cost of a segment depends on the map and the routing
+ * preferences alone, and not on traffic reports or on the time it is
+ * reached. Costs computed ahead, such as the routing overlay shortcuts,
+ * are only valid for such a cost function.
+ */
+int navigate_cost_is_static (void) {
+
+   NavigateCostFn cost_fn = navigate_cost_get ();
+
+   return cost_fn == &cost_shortest || cost_fn == &cost_fastest;
+}
+
 int navigate_cost_time (int line_id, int is_revesred, int cur_cost,
                         int prev_line_id, int is_prev_reversed) {
 
@@ -50,6 +50,7 @@ typedef int (*NavigateCostFn) (int line_id, int is_reversed, int cur_cost,
 
 void navigate_cost_reset (void);
 NavigateCostFn navigate_cost_get (void);
+int navigate_cost_is_static (void);
 
 int navigate_cost_time (int line_id, int is_reversed, int cur_cost,
                         int prev_line_id, int is_prev_reversed);
@@ -32,6 +32,8 @@
 #include <assert.h>
 
 #include "roadmap.h"
+#include "roadmap_config.h"
+#include "roadmap_hash.h"
 #include "roadmap_point.h"
 #include "roadmap_line.h"
 #include "roadmap_locator.h"
@@ -47,148 +49,216 @@
 
 #include "navigate_graph.h"
 
+/* The budget counts the node offsets as ints and the header of each square,
+ * so it is a quarter above the old limits to hold about as many squares.
+ */
 #ifdef J2ME
-#define MAX_GRAPH_CACHE 75
-#define MAX_MEM_CACHE 150000
+#define DEFAULT_GRAPH_CACHE_BYTES "187500"
 #else
-#define MAX_GRAPH_CACHE 256
-#define MAX_MEM_CACHE 500000
+#define DEFAULT_GRAPH_CACHE_BYTES "625000"
 #endif
 
+#define NO_SLOT -1
+
+/* The graph of a square is kept in compressed sparse row form: the lines
+ * of node n are lines[nodes_index[n]] .. lines[nodes_index[n + 1] - 1].
+ * The header, the node index and the lines share a single allocation.
+ */
 struct SquareGraphItem {
    int square_id;
-   unsigned short lines_count;
-   unsigned short nodes_count;
-   unsigned short *nodes_index;
+   int version;
+   int lines_count;
+   int nodes_count;
+   int *nodes_index;
    int *lines;
-   unsigned short *lines_index;
    int mem_size;
+   int lru_prev;
+   int lru_next;
 };
 
-static struct SquareGraphItem *SquareGraphCache[MAX_GRAPH_CACHE];
-static int SquareCacheSize = 0;
+static RoadMapConfigDescriptor GraphCacheBytesCfg =
+                        ROADMAP_CONFIG_ITEM("Routing", "Graph cache bytes");
+
+static RoadMapHash *SquareGraphHash;
+static struct SquareGraphItem **SquareGraphCache;
+static int *SquareGraphFreeSlots;
+static int SquareGraphFreeCount = 0;
+static int SquareGraphCacheAlloc = 0;
+static int SquareGraphMRU = NO_SLOT;
+static int SquareGraphLRU = NO_SLOT;
 static int cache_total_mem;
 
-static inline void add_graph_node(struct SquareGraphItem *cache,
-                                  int line,
-                                  int point_id,
-                                  int cur_line,
-                                  int reversed) {
-
-   unsigned int l;
-
-   l = cache->nodes_index[point_id];
-	cache->nodes_index[point_id] = cur_line + 1;
-	cache->lines_index[cur_line] = l;
-/*
-   if (l) {
-      l--;
-      while (cache->lines_index[l]) {
-         l=cache->lines_index[l];
-      }
+static NavigateGraphStats GraphStats;
+
+
+static void lru_unlink (int slot) {
+
+   struct SquareGraphItem *item = SquareGraphCache[slot];
 
-      cache->lines_index[l] = cur_line;
+   if (item->lru_prev != NO_SLOT) {
+      SquareGraphCache[item->lru_prev]->lru_next = item->lru_next;
    } else {
-      cache->nodes_index[point_id] = cur_line + 1;
+      SquareGraphMRU = item->lru_next;
+   }
+
+   if (item->lru_next != NO_SLOT) {
+      SquareGraphCache[item->lru_next]->lru_prev = item->lru_prev;
+   } else {
+      SquareGraphLRU = item->lru_prev;
    }
-*/
-   cache->lines[cur_line] = line|reversed;
+}
+
+
+static void lru_push_front (int slot) {
+
+   struct SquareGraphItem *item = SquareGraphCache[slot];
+
+   item->lru_prev = NO_SLOT;
+   item->lru_next = SquareGraphMRU;
+
+   if (SquareGraphMRU != NO_SLOT) {
+      SquareGraphCache[SquareGraphMRU]->lru_prev = slot;
+   } else {
+      SquareGraphLRU = slot;
+   }
+   SquareGraphMRU = slot;
+}
+
+
+static int alloc_cache_slot (void) {
+
+   if (!SquareGraphFreeCount) {
+
+      int size = SquareGraphCacheAlloc ? SquareGraphCacheAlloc * 2 : 64;
+      struct SquareGraphItem **cache;
+      int *free_slots;
+      int slot;
+
+      cache = realloc (SquareGraphCache, size * sizeof (struct SquareGraphItem *));
+      if (!cache) return NO_SLOT;
+      SquareGraphCache = cache;
+
+      free_slots = realloc (SquareGraphFreeSlots, size * sizeof (int));
+      if (!free_slots) return NO_SLOT;
+      SquareGraphFreeSlots = free_slots;
+
+      if (!SquareGraphHash) {
+         SquareGraphHash = roadmap_hash_new ("graph", size);
+      } else {
+         roadmap_hash_resize (SquareGraphHash, size);
+      }
+
+      for (slot = size - 1; slot >= SquareGraphCacheAlloc; slot--) {
+         SquareGraphCache[slot] = NULL;
+         SquareGraphFreeSlots[SquareGraphFreeCount++] = slot;
+      }
+      SquareGraphCacheAlloc = size;
+   }
+
+   return SquareGraphFreeSlots[--SquareGraphFreeCount];
 }
 
 
 static void free_cache_slot (int slot) {
-   free (SquareGraphCache[slot]->nodes_index);
-   free (SquareGraphCache[slot]->lines);
-   free (SquareGraphCache[slot]->lines_index);
-   cache_total_mem -= SquareGraphCache[slot]->mem_size;
+
+   struct SquareGraphItem *item = SquareGraphCache[slot];
+
+   lru_unlink (slot);
+   roadmap_hash_remove (SquareGraphHash, item->square_id, slot);
+
+   cache_total_mem -= item->mem_size;
+   free (item);
+
+   SquareGraphCache[slot] = NULL;
+   SquareGraphFreeSlots[SquareGraphFreeCount++] = slot;
 }
 
 
-//TODO arrange as LRU list
-static struct SquareGraphItem *get_square_graph (int square_id) {
+static int find_cache_slot (int square_id) {
 
-   int i;
    int slot;
-   int line;
-   int lines1_count;
-   int lines2_count;
-   struct SquareGraphItem *cache;
-   int cur_line = 0;
-   int found = 0;
-
-   for (slot = 0; slot < SquareCacheSize; slot++) {
-     	if (SquareGraphCache[slot]->square_id == square_id) {
-     		found = 1;
-     		//printf ("get_square_graph: found square %d in slot %d\n", square_id, slot);
-     		break;
-     	}
+
+   if (!SquareGraphHash) return NO_SLOT;
+
+   for (slot = roadmap_hash_get_first (SquareGraphHash, square_id);
+        slot >= 0;
+        slot = roadmap_hash_get_next (SquareGraphHash, slot)) {
+
+      if (SquareGraphCache[slot]->square_id == square_id) return slot;
    }
 
-	if (!found) {
-		if (SquareCacheSize == MAX_GRAPH_CACHE) {
-			slot--;
-			free_cache_slot (slot);
-			cache = SquareGraphCache[slot];
-		} else {
-			cache = (struct SquareGraphItem *)malloc(sizeof(struct SquareGraphItem));
-			SquareCacheSize++;
-		}
-	} else {
-		cache = SquareGraphCache[slot];
-	}
+   return NO_SLOT;
+}
 
-	for (i = slot; i > 0; i--) {
-		SquareGraphCache[i] = SquareGraphCache[i - 1];
-	}
-	SquareGraphCache[0] = cache;
 
-	if (found) return cache;
+/* Lines are listed for each node by ascending road class and line id,
+ * the line leaving the node through its to point first. Turn restriction
+ * bits are indexed in this order.
+ */
+static void build_square_graph (struct SquareGraphItem *cache, int do_fill) {
 
-	//printf ("get_square_graph: adding square %d to slot %d\n", square_id, slot);
-	
-   cache->square_id = square_id;
-   lines1_count = 0;
-   lines2_count = 0;
+   int i;
+   int line;
 
-   /* Count total lines */
    for (i = ROADMAP_ROAD_FIRST; i <= ROADMAP_ROAD_LAST; ++i) {
 
       int first_line;
       int last_line;
 
       if (roadmap_line_in_square
-            (square_id, i, &first_line, &last_line) > 0) {
+            (cache->square_id, i, &first_line, &last_line) > 0) {
 
-         lines1_count += (last_line - first_line + 1);
+         for (line = first_line; line <= last_line; line++) {
+
+            int from_point_id;
+            int to_point_id;
+
+            roadmap_line_points (line, &from_point_id, &to_point_id);
+            from_point_id &= 0xffff;
+            to_point_id &= 0xffff;
+
+            if (do_fill) {
+               cache->lines[cache->nodes_index[to_point_id]++] = line | REVERSED;
+               cache->lines[cache->nodes_index[from_point_id]++] = line;
+            } else {
+               cache->nodes_index[to_point_id + 1]++;
+               cache->nodes_index[from_point_id + 1]++;
+            }
+         }
       }
    }
+}
 
-   cache->lines_count = lines1_count * 2 + lines2_count;
 
-   /* assume that the number of nodes equals the number of lines */
-   cache->nodes_count = roadmap_square_points_count (square_id);
+static struct SquareGraphItem *get_square_graph (int square_id) {
 
-   cache->mem_size = cache->lines_count * sizeof(int) +
-                     cache->lines_count * sizeof(unsigned short) +
-                     cache->nodes_count * sizeof(unsigned short);
+   int i;
+   int slot;
+   int lines_count;
+   int nodes_count;
+   int mem_size;
+   int max_mem;
+   struct SquareGraphItem *cache;
 
-   while (cache_total_mem &&
-          ((cache_total_mem + cache->mem_size) > MAX_MEM_CACHE) &&
-          SquareCacheSize > 1) {
+   /* graphs of an older version of the square are dropped when it is
+    * loaded, see navigate_graph_square_loaded()
+    */
+   slot = find_cache_slot (square_id);
+   if (slot != NO_SLOT) {
 
-		SquareCacheSize--;
-      free_cache_slot(SquareCacheSize);
-      free (SquareGraphCache[SquareCacheSize]);
-      SquareGraphCache[SquareCacheSize] = NULL;
+      GraphStats.hits++;
+      if (slot != SquareGraphMRU) {
+         lru_unlink (slot);
+         lru_push_front (slot);
+      }
+      return SquareGraphCache[slot];
    }
 
-   cache->lines = malloc(cache->lines_count * sizeof(int));
-   cache->lines_index = calloc(cache->lines_count, sizeof(unsigned short));
-   cache->nodes_index = calloc(cache->nodes_count, sizeof(unsigned short));
-
-   cache_total_mem += cache->mem_size;
+   GraphStats.misses++;
 
-   for (i = ROADMAP_ROAD_LAST; i >= ROADMAP_ROAD_FIRST; --i) {
+   /* Count total lines */
+   lines_count = 0;
+   for (i = ROADMAP_ROAD_FIRST; i <= ROADMAP_ROAD_LAST; ++i) {
 
       int first_line;
       int last_line;
@@ -196,30 +266,58 @@ static struct SquareGraphItem *get_square_graph (int square_id) {
       if (roadmap_line_in_square
             (square_id, i, &first_line, &last_line) > 0) {
 
-         for (line = last_line; line >= first_line; line--) {
-
-            int from_point_id;
-            int to_point_id;
+         lines_count += (last_line - first_line + 1);
+      }
+   }
+   lines_count *= 2;
 
-            roadmap_line_points (line, &from_point_id, &to_point_id);
-            from_point_id &= 0xffff;
+   nodes_count = roadmap_square_points_count (square_id);
 
-            add_graph_node(cache, line, from_point_id, cur_line, 0);
-            cur_line++;
+   mem_size = sizeof (struct SquareGraphItem) +
+              (nodes_count + 1) * sizeof (int) +
+              lines_count * sizeof (int);
 
-            //if (roadmap_point_square(to_point_id) == square_id) {
+   max_mem = roadmap_config_get_integer (&GraphCacheBytesCfg);
+   while (SquareGraphLRU != NO_SLOT &&
+          cache_total_mem + mem_size > max_mem) {
 
-               to_point_id &= 0xffff;
+      GraphStats.evictions++;
+      free_cache_slot (SquareGraphLRU);
+   }
 
-               add_graph_node(cache, line, to_point_id, cur_line, REVERSED);
+   slot = alloc_cache_slot ();
+   cache = slot == NO_SLOT ? NULL : (struct SquareGraphItem *)calloc (1, mem_size);
+   if (!cache) {
+      roadmap_log (ROADMAP_FATAL, "No memory for routing graph of square %d", square_id);
+   }
 
-               cur_line++;
-            //}
-         }
-      }
+   cache->square_id = square_id;
+   cache->version = roadmap_square_version (square_id);
+   cache->lines_count = lines_count;
+   cache->nodes_count = nodes_count;
+   cache->nodes_index = (int *)(cache + 1);
+   cache->lines = cache->nodes_index + nodes_count + 1;
+   cache->mem_size = mem_size;
+
+   /* Count the lines of each node, then turn the counts into offsets
+    * which are advanced while filling, and shift them back.
+    */
+   build_square_graph (cache, 0);
+   for (i = 1; i <= nodes_count; i++) {
+      cache->nodes_index[i] += cache->nodes_index[i - 1];
+   }
+   build_square_graph (cache, 1);
+   for (i = nodes_count; i > 0; i--) {
+      cache->nodes_index[i] = cache->nodes_index[i - 1];
    }
+   cache->nodes_index[0] = 0;
 
-  waze_assert(cur_line <= cache->lines_count);
+  waze_assert(cache->nodes_index[nodes_count] == lines_count);
+
+   SquareGraphCache[slot] = cache;
+   roadmap_hash_add (SquareGraphHash, square_id, slot);
+   lru_push_front (slot);
+   cache_total_mem += mem_size;
 
    return cache;
 }
@@ -271,6 +369,7 @@ int get_connected_segments (int square,
    int count = 0;
    //int index = 0;
    int res_index = 0;
+   int end;
    int line;
    int line_reversed;
    int seg_res_bits = 0;
@@ -292,10 +391,11 @@ int get_connected_segments (int square,
    node_id &= 0xffff;
 
    i = cache->nodes_index[node_id];
-   if (i <= 0) {
+   end = cache->nodes_index[node_id + 1];
+   if (i >= end) {
    	roadmap_log (ROADMAP_ERROR, "cannot find data for node %d square %d", node_id, square);
    }
-  waze_assert (i > 0);
+  waze_assert (i < end);
 
    if (use_restrictions) {
       if (is_seg_reversed) {
@@ -305,13 +405,12 @@ int get_connected_segments (int square,
       }
    }
 
-   while (i && count < max) {
+   for (; i < end && count < max; i++) {
 
       int to_point_id = -1;
       int line_direction_allowed;
 
-      line = cache->lines[i - 1];
-      i = cache->lines_index[i - 1];
+      line = cache->lines[i];
       line_reversed = line & REVERSED;
       if (line_reversed) line = line & ~REVERSED;
 
@@ -362,56 +461,63 @@ int navigate_graph_get_line (int node, int line_no) {
    int square = roadmap_square_active (); //roadmap_point_square (node);
    struct SquareGraphItem *cache = get_square_graph (square);
    int i;
-   int skip;
 
    node &= 0xffff;
 
-   i = cache->nodes_index[node];
-  waze_assert (i > 0);
-   i--;
-
-   skip = line_no;
-   while (skip) {
-      i = cache->lines_index[i];
-	  waze_assert (i > 0);
-	   i--;
-      skip--;
-   }
+   i = cache->nodes_index[node] + line_no;
+  waze_assert (i < cache->nodes_index[node + 1]);
 
    return cache->lines[i];
 }
 
 
 static void navigate_graph_clear_all (void) {
-	
-	int slot;
-	for (slot = SquareCacheSize - 1; slot >= 0; slot--) {
-		
-		free_cache_slot (slot);
+
+	while (SquareGraphLRU != NO_SLOT) {
+
+		free_cache_slot (SquareGraphLRU);
 	}
-	SquareCacheSize = 0;	
 }
 
 void navigate_graph_clear (int square) {
 
 	int slot;
-	
+
 	if (square == -1) {
 		navigate_graph_clear_all ();
 		return;
 	}
-	
-	for (slot = SquareCacheSize - 1; slot >= 0 && SquareGraphCache[slot]->square_id != square; slot--)
-		;
-	
-	if (slot >= 0) {
-		
-		SquareCacheSize--;
+
+	slot = find_cache_slot (square);
+	if (slot != NO_SLOT) {
+
 		free_cache_slot (slot);
-		
-		while (slot < SquareCacheSize) {
-			SquareGraphCache[slot] = SquareGraphCache[slot + 1];
-			slot++;	
-		}
-	}	
+	}
+}
+
+
+/* Called when a square is loaded into the square cache. */
+void navigate_graph_square_loaded (int square, int version) {
+
+	int slot = find_cache_slot (square);
+
+	if (slot != NO_SLOT && SquareGraphCache[slot]->version != version) {
+
+		GraphStats.rebuilds++;
+		free_cache_slot (slot);
+	}
+}
+
+
+void navigate_graph_get_stats (NavigateGraphStats *stats) {
+
+	*stats = GraphStats;
+	stats->squares = SquareGraphCacheAlloc - SquareGraphFreeCount;
+	stats->bytes = cache_total_mem;
+}
+
+
+void navigate_graph_initialize (void) {
+
+	roadmap_config_declare ("preferences", &GraphCacheBytesCfg, DEFAULT_GRAPH_CACHE_BYTES, NULL);
 }
@@ -39,8 +39,21 @@ int get_connected_segments (int square,
                             int node_id, struct successor *successors,
                             int max, int use_restrictions, int use_directions);
 
+typedef struct {
+	int hits;
+	int misses;
+	int rebuilds;		/* cached graph of an older tile version */
+	int evictions;
+	int squares;
+	int bytes;
+} NavigateGraphStats;
+
 int navigate_graph_get_line (int node, int line_no);
 void navigate_graph_clear (int square);
+void navigate_graph_square_loaded (int square, int version);
+
+void navigate_graph_initialize (void);
+void navigate_graph_get_stats (NavigateGraphStats *stats);
 
 #endif /* _NAVIGATE_GRAPH_H_ */
 
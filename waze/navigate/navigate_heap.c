@@ -0,0 +1,129 @@
+/* navigate_heap.c - d-ary min heap used by the route search
+ *
+ * LICENSE:
+ *
+ *   Copyright 2012 Assaf Paz
+ *
+ *   This file is part of RoadMap.
+ *
+ *   RoadMap is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   RoadMap is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with RoadMap; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * SYNOPSYS:
+ *
+ *   See navigate_heap.h
+ */
+
+#include <stdlib.h>
+
+#include "roadmap.h"
+
+#include "navigate_heap.h"
+
+#define HEAP_INITIAL_SIZE 1024
+
+
+void navigate_heap_init (NavigateHeap *heap) {
+
+   heap->items = NULL;
+   heap->count = 0;
+   heap->size = 0;
+}
+
+
+void navigate_heap_clear (NavigateHeap *heap) {
+
+   heap->count = 0;
+}
+
+
+void navigate_heap_free (NavigateHeap *heap) {
+
+   free (heap->items);
+   navigate_heap_init (heap);
+}
+
+
+int navigate_heap_insert (NavigateHeap *heap, int key, void *data) {
+
+   int i;
+   int parent;
+
+   if (heap->count == heap->size) {
+
+      int new_size = heap->size ? heap->size * 2 : HEAP_INITIAL_SIZE;
+      NavigateHeapItem *items =
+         (NavigateHeapItem *)realloc (heap->items, new_size * sizeof (NavigateHeapItem));
+
+      if (!items) {
+         roadmap_log (ROADMAP_ERROR, "Can't grow route heap to %d items", new_size);
+         return -1;
+      }
+      heap->items = items;
+      heap->size = new_size;
+   }
+
+   /* sift up */
+   i = heap->count++;
+   while (i > 0) {
+      parent = (i - 1) / NAVIGATE_HEAP_ARITY;
+      if (heap->items[parent].key <= key) break;
+      heap->items[i] = heap->items[parent];
+      i = parent;
+   }
+
+   heap->items[i].key = key;
+   heap->items[i].data = data;
+
+   return 0;
+}
+
+
+void *navigate_heap_extract_min (NavigateHeap *heap) {
+
+   void *min;
+   NavigateHeapItem last;
+   int i;
+
+   if (heap->count == 0) return NULL;
+
+   min = heap->items[0].data;
+   last = heap->items[--heap->count];
+
+   /* sift down */
+   i = 0;
+   while (1) {
+      int first = i * NAVIGATE_HEAP_ARITY + 1;
+      int end = first + NAVIGATE_HEAP_ARITY;
+      int best;
+      int child;
+
+      if (first >= heap->count) break;
+      if (end > heap->count) end = heap->count;
+
+      best = first;
+      for (child = first + 1; child < end; child++) {
+         if (heap->items[child].key < heap->items[best].key) best = child;
+      }
+
+      if (heap->items[best].key >= last.key) break;
+
+      heap->items[i] = heap->items[best];
+      i = best;
+   }
+
+   if (heap->count) heap->items[i] = last;
+
+   return min;
+}
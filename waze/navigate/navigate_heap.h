@@ -0,0 +1,55 @@
+/* navigate_heap.h - d-ary min heap used by the route search
+ *
+ * LICENSE:
+ *
+ *   Copyright 2012 Assaf Paz
+ *
+ *   This file is part of RoadMap.
+ *
+ *   RoadMap is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   RoadMap is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with RoadMap; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef _NAVIGATE_HEAP_H_
+#define _NAVIGATE_HEAP_H_
+
+/* Each node has NAVIGATE_HEAP_ARITY children. A 4-ary heap keeps a node
+ * and all its children within one or two cache lines, which makes
+ * extract_min much cheaper than a pointer based heap.
+ */
+#define NAVIGATE_HEAP_ARITY 4
+
+typedef struct {
+   int   key;
+   void *data;
+} NavigateHeapItem;
+
+typedef struct {
+   NavigateHeapItem *items;
+   int               count;
+   int               size;
+} NavigateHeap;
+
+void  navigate_heap_init        (NavigateHeap *heap);
+void  navigate_heap_clear       (NavigateHeap *heap);
+void  navigate_heap_free        (NavigateHeap *heap);
+
+int   navigate_heap_insert      (NavigateHeap *heap, int key, void *data);
+void *navigate_heap_extract_min (NavigateHeap *heap);
+
+#define navigate_heap_empty(heap)   ((heap)->count == 0)
+#define navigate_heap_min_key(heap) ((heap)->items[0].key)
+
+#endif /* _NAVIGATE_HEAP_H_ */
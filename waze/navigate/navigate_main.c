@@ -96,6 +96,7 @@
 #include "navigate_instr.h"
 #include "navigate_traffic.h"
 #include "navigate_cost.h"
+#include "navigate_graph.h"
 #include "navigate_route.h"
 #include "navigate_zoom.h"
 #include "navigate_route_trans.h"
@@ -1251,6 +1252,7 @@ void navigate_main_on_route (int flags, int length, int track_time,
 	NavigateDetourEnd = 0;
    NavigateCurrentSegment = 0;
    NavigateCurrentRequestSegment = 0;
+   roadmap_tile_route_changed ();
    if (description){
       strncpy_safe (NavigateDescription, description, sizeof(NavigateDescription));
    }
@@ -1554,6 +1556,7 @@ static int navigate_main_recalc_route (int delay_message) {
    navigate_bar_set_mode (NavigateTrackEnabled);
    NavigateCurrentSegment = 0;
    NavigateCurrentRequestSegment = 0;
+   roadmap_tile_route_changed ();
 	roadmap_log (ROADMAP_DEBUG, "NavigateCurrentSegment = %d", NavigateCurrentSegment);
    return 0;
 }
@@ -2304,6 +2307,7 @@ void navigate_main_stop_navigation(void)
    roadmap_message_unset('@');
    roadmap_message_unset('T');
    navigate_main_suspend_navigation ();
+   roadmap_tile_route_changed ();
    roadmap_trip_remove_point ("Destination");
    roadmap_config_set_integer (&NavigateConfigNavigating, 0);
    roadmap_config_save(1);
@@ -2907,6 +2911,8 @@ void navigate_main_initialize (void) {
    navigate_main_init_pens ();
 
    navigate_cost_initialize ();
+   navigate_graph_initialize ();
+   navigate_route_initialize ();
 
    NavigatePluginID = navigate_plugin_register ();
    navigate_traffic_initialize ();
@@ -0,0 +1,750 @@
+/* navigate_overlay.c - shortcut overlay over residential squares
+ *
+ * LICENSE:
+ *
+ *   Copyright 2012 Assaf Paz
+ *
+ *   This file is part of RoadMap.
+ *
+ *   RoadMap is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   RoadMap is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with RoadMap; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * SYNOPSYS:
+ *
+ *   See navigate_overlay.h
+ *
+ *   For every square which has no road above ROADMAP_ROAD_STREET, the
+ *   overlay holds the cheapest path cost from each segment entering the
+ *   square to each segment leaving it. The route search uses it to jump
+ *   over such squares instead of expanding all of their lines.
+ *
+ *   The overlay is built in the background from the tiles found in the
+ *   tile storage, and is saved next to the tiles database. A square is
+ *   rebuilt when its tile version changes, and the whole overlay is
+ *   dropped when the routing preferences change.
+ *
+ *   The shortcut costs are computed ahead, so they do not follow traffic
+ *   reports or the time of day. The overlay is therefore only used while
+ *   the routing cost function is static (navigate_cost_is_static), and
+ *   is not built otherwise. Only the forward search uses the shortcuts;
+ *   the backward search of the bidirectional mode expands residential
+ *   squares as usual.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "roadmap.h"
+#include "roadmap_config.h"
+#include "roadmap_line.h"
+#include "roadmap_line_route.h"
+#include "roadmap_square.h"
+#include "roadmap_hash.h"
+#include "roadmap_file.h"
+#include "roadmap_path.h"
+#include "roadmap_main.h"
+#include "roadmap_time.h"
+#include "roadmap_tile.h"
+#include "roadmap_tile_storage.h"
+
+#include "navigate_graph.h"
+#include "navigate_cost.h"
+#include "navigate_heap.h"
+#include "navigate_overlay.h"
+
+#define OVERLAY_FILE_PREFIX    "overlay_"
+#define OVERLAY_FILE_SUFFIX    ".dat"
+#define OVERLAY_MAGIC          0x564F5A57
+#define OVERLAY_FORMAT         1
+
+#define OVERLAY_BUILD_PERIOD   200   /* msec */
+#define OVERLAY_BUILD_PER_STEP 2
+#define OVERLAY_BUILD_MSEC     20    /* time for one step */
+#define OVERLAY_SAVE_EVERY     32
+
+/* Larger squares are expanded as usual */
+#define OVERLAY_MAX_SEGMENTS   8192
+
+#define MAX_SUCCESSORS 100
+
+#define SEGMENT(line, reversed) ((line) * 2 + ((reversed) != 0))
+
+typedef struct {
+   int square;
+   int version;
+   int count;
+   NavigateShortcut *shortcuts;
+} OverlaySquare;
+
+typedef struct {
+   int          segments;
+   int         *cost;
+   int         *prev;
+   NavigateHeap queue;
+} LocalSearch;
+
+static RoadMapConfigDescriptor OverlayCfg =
+                  ROADMAP_CONFIG_ITEM("Routing", "Shortcut overlay");
+
+static int OverlayFips = -1;
+static int OverlaySignature;
+static int OverlayDirty;
+
+static OverlaySquare *OverlaySquares;
+static int OverlayCount;
+static int OverlaySize;
+static RoadMapHash *OverlayIndex;
+
+static int *PendingTiles;
+static int PendingCount;
+static int PendingSize;
+static int BuildActive;
+static int BuildPaused;
+
+
+static int cost_signature (void) {
+
+   return navigate_cost_type () |
+          (navigate_cost_avoid_primaries () << 2) |
+          (navigate_cost_avoid_trails () << 3) |
+          (navigate_cost_prefer_same_street () << 5);
+}
+
+
+static const char *overlay_file (int fips) {
+
+   static char full_path[512];
+   char name[64];
+
+   snprintf (name, sizeof (name), "%s%d%s", OVERLAY_FILE_PREFIX, fips, OVERLAY_FILE_SUFFIX);
+   roadmap_path_format (full_path, sizeof (full_path), roadmap_db_map_path (), name);
+
+   return full_path;
+}
+
+
+static OverlaySquare *find_square (int square) {
+
+   int i;
+
+   if (!OverlayIndex) return NULL;
+
+   for (i = roadmap_hash_get_first (OverlayIndex, square);
+        i >= 0;
+        i = roadmap_hash_get_next (OverlayIndex, i)) {
+
+      if (OverlaySquares[i].square == square) return OverlaySquares + i;
+   }
+
+   return NULL;
+}
+
+
+/* The last square is moved into the freed slot, so the table stays dense */
+static void remove_square (int square) {
+
+   OverlaySquare *item = find_square (square);
+   int index;
+   int last;
+
+   if (!item) return;
+
+   index = item - OverlaySquares;
+   last = OverlayCount - 1;
+
+   roadmap_hash_remove (OverlayIndex, square, index);
+   free (item->shortcuts);
+
+   if (index != last) {
+      roadmap_hash_remove (OverlayIndex, OverlaySquares[last].square, last);
+      *item = OverlaySquares[last];
+      roadmap_hash_add (OverlayIndex, item->square, index);
+   }
+
+   OverlayCount--;
+}
+
+
+static void add_square (int square, int version, NavigateShortcut *shortcuts, int count) {
+
+   OverlaySquare *item;
+
+   remove_square (square);
+
+   if (OverlayCount == OverlaySize) {
+      OverlaySize = OverlaySize ? OverlaySize * 2 : 256;
+      OverlaySquares = (OverlaySquare *)realloc (OverlaySquares, OverlaySize * sizeof (OverlaySquare));
+      roadmap_check_allocated (OverlaySquares);
+
+      if (OverlayIndex) {
+         roadmap_hash_resize (OverlayIndex, OverlaySize);
+      } else {
+         OverlayIndex = roadmap_hash_new ("overlay", OverlaySize);
+      }
+   }
+
+   item = OverlaySquares + OverlayCount;
+   item->square = square;
+   item->version = version;
+   item->count = count;
+   item->shortcuts = shortcuts;
+
+   roadmap_hash_add (OverlayIndex, square, OverlayCount);
+   OverlayCount++;
+}
+
+
+static void clear_all (void) {
+
+   int i;
+
+   for (i = 0; i < OverlayCount; i++) {
+      free (OverlaySquares[i].shortcuts);
+   }
+   free (OverlaySquares);
+   OverlaySquares = NULL;
+   OverlayCount = 0;
+   OverlaySize = 0;
+
+   if (OverlayIndex) {
+      roadmap_hash_free (OverlayIndex);
+      OverlayIndex = NULL;
+   }
+
+   PendingCount = 0;
+   OverlayDirty = 0;
+}
+
+
+static void save_file (void) {
+
+   RoadMapFile file;
+   int header[4];
+   int i;
+
+   file = roadmap_file_open (overlay_file (OverlayFips), "w");
+   if (!ROADMAP_FILE_IS_VALID (file)) {
+      roadmap_log (ROADMAP_ERROR, "Can't write routing overlay for %d", OverlayFips);
+      return;
+   }
+
+   header[0] = OVERLAY_MAGIC;
+   header[1] = OVERLAY_FORMAT;
+   header[2] = OverlaySignature;
+   header[3] = OverlayCount;
+   roadmap_file_write (file, header, sizeof (header));
+
+   for (i = 0; i < OverlayCount; i++) {
+
+      OverlaySquare *item = OverlaySquares + i;
+
+      roadmap_file_write (file, &item->square, sizeof (int));
+      roadmap_file_write (file, &item->version, sizeof (int));
+      roadmap_file_write (file, &item->count, sizeof (int));
+      if (item->count) {
+         roadmap_file_write (file, item->shortcuts, item->count * sizeof (NavigateShortcut));
+      }
+   }
+
+   roadmap_file_close (file);
+   OverlayDirty = 0;
+}
+
+
+static void load_file (void) {
+
+   RoadMapFile file;
+   int header[4];
+   int i;
+
+   file = roadmap_file_open (overlay_file (OverlayFips), "r");
+   if (!ROADMAP_FILE_IS_VALID (file)) return;
+
+   if (roadmap_file_read (file, header, sizeof (header)) != sizeof (header) ||
+       header[0] != OVERLAY_MAGIC ||
+       header[1] != OVERLAY_FORMAT ||
+       header[2] != OverlaySignature) {
+
+      roadmap_log (ROADMAP_INFO, "Routing overlay for %d is out of date", OverlayFips);
+      roadmap_file_close (file);
+      return;
+   }
+
+   for (i = 0; i < header[3]; i++) {
+
+      int item[3];
+      NavigateShortcut *shortcuts = NULL;
+
+      if (roadmap_file_read (file, item, sizeof (item)) != sizeof (item) ||
+          item[2] < 0) {
+         break;
+      }
+
+      if (item[2]) {
+         int size = item[2] * sizeof (NavigateShortcut);
+
+         shortcuts = (NavigateShortcut *)malloc (size);
+         roadmap_check_allocated (shortcuts);
+         if (roadmap_file_read (file, shortcuts, size) != size) {
+            free (shortcuts);
+            break;
+         }
+      }
+
+      add_square (item[0], item[1], shortcuts, item[2]);
+   }
+
+   roadmap_file_close (file);
+
+   roadmap_log (ROADMAP_INFO, "Loaded routing overlay for %d: %d squares", OverlayFips, OverlayCount);
+}
+
+
+static int is_entry (int line, int reversed) {
+
+   int fake = reversed ? roadmap_line_to_is_fake (line) : roadmap_line_from_is_fake (line);
+
+   return fake &&
+          (roadmap_line_route_get_direction (line, ROUTE_CAR_ALLOWED) &
+           (reversed ? ROUTE_DIRECTION_AGAINST_LINE : ROUTE_DIRECTION_WITH_LINE));
+}
+
+
+static int is_exit (int line, int reversed) {
+
+   return reversed ? roadmap_line_from_is_fake (line) : roadmap_line_to_is_fake (line);
+}
+
+
+/* Returns the number of road lines in the square, and whether all of
+ * them are residential.
+ */
+static int square_lines_count (int square, int *residential) {
+
+   int cfcc;
+   int count = 0;
+
+   *residential = 1;
+
+   for (cfcc = ROADMAP_ROAD_FIRST; cfcc <= ROADMAP_ROAD_LAST; cfcc++) {
+
+      int first_line;
+      int last_line;
+
+      if (roadmap_line_in_square (square, cfcc, &first_line, &last_line) > 0) {
+
+         if (cfcc < ROADMAP_ROAD_STREET) *residential = 0;
+         if (last_line + 1 > count) count = last_line + 1;
+      }
+   }
+
+   return count;
+}
+
+
+static int local_search_init (LocalSearch *search, int lines_count) {
+
+   search->segments = lines_count * 2;
+   search->cost = (int *)malloc (search->segments * sizeof (int));
+   search->prev = (int *)malloc (search->segments * sizeof (int));
+   navigate_heap_init (&search->queue);
+
+   if (!search->cost || !search->prev) {
+      free (search->cost);
+      free (search->prev);
+      return -1;
+   }
+
+   return 0;
+}
+
+
+static void local_search_free (LocalSearch *search) {
+
+   free (search->cost);
+   free (search->prev);
+   navigate_heap_free (&search->queue);
+}
+
+
+/* Dijkstra within one square, which stops at the segments leaving it */
+static void local_search_run (LocalSearch *search, int square,
+                              int line_id, int reversed, NavigateCostFn cost_fn) {
+
+   struct successor successors[MAX_SUCCESSORS];
+   int segment = SEGMENT (line_id, reversed);
+   int i;
+
+   for (i = 0; i < search->segments; i++) {
+      search->cost[i] = -1;
+      search->prev[i] = -1;
+   }
+
+   navigate_heap_clear (&search->queue);
+   search->cost[segment] = 0;
+   if (navigate_heap_insert (&search->queue, 0, (void *)(long)segment) < 0) return;
+
+   while (!navigate_heap_empty (&search->queue)) {
+
+      int key = navigate_heap_min_key (&search->queue);
+      int node;
+      int count;
+
+      segment = (int)(long)navigate_heap_extract_min (&search->queue);
+      if (key > search->cost[segment]) continue;
+
+      line_id = segment / 2;
+      reversed = segment & 1;
+
+      roadmap_square_set_current (square);
+      if (is_exit (line_id, reversed)) continue;
+
+      if (reversed) {
+         roadmap_line_from_point (line_id, &node);
+      } else {
+         roadmap_line_to_point (line_id, &node);
+      }
+
+      count = get_connected_segments (square, line_id, reversed, node,
+                                      successors, MAX_SUCCESSORS, 1, 1);
+
+      for (i = 0; i < count; i++) {
+
+         int next;
+         int cost;
+
+         if (successors[i].square_id != square) continue;
+
+         next = SEGMENT (successors[i].line_id, successors[i].reversed);
+         if (next >= search->segments) continue;
+
+         roadmap_square_set_current (square);
+         cost = cost_fn (successors[i].line_id, successors[i].reversed, 0,
+                         line_id, reversed, node);
+         if (cost < 0) continue;
+
+         cost += key;
+         if (search->cost[next] >= 0 && search->cost[next] <= cost) continue;
+
+         search->cost[next] = cost;
+         search->prev[next] = segment;
+         if (navigate_heap_insert (&search->queue, cost, (void *)(long)next) < 0) return;
+      }
+   }
+}
+
+
+static int compare_shortcuts (const void *s1, const void *s2) {
+
+   const NavigateShortcut *a = (const NavigateShortcut *)s1;
+   const NavigateShortcut *b = (const NavigateShortcut *)s2;
+
+   return SEGMENT (a->entry_line, a->entry_reversed) -
+          SEGMENT (b->entry_line, b->entry_reversed);
+}
+
+
+static void build_square (int square) {
+
+   NavigateCostFn cost_fn = navigate_cost_get ();
+   NavigateShortcut *shortcuts = NULL;
+   LocalSearch search;
+   int count = 0;
+   int size = 0;
+   int residential;
+   int lines_count;
+   int version;
+   int line;
+   int reversed;
+
+   if (!roadmap_square_set_current (square)) return;
+
+   version = roadmap_square_version (square);
+   lines_count = square_lines_count (square, &residential);
+
+   if (residential &&
+       lines_count > 0 &&
+       lines_count * 2 <= OVERLAY_MAX_SEGMENTS &&
+       local_search_init (&search, lines_count) == 0) {
+
+      for (line = 0; line < lines_count; line++) {
+         for (reversed = 0; reversed <= 1; reversed++) {
+
+            int segment;
+
+            roadmap_square_set_current (square);
+            if (!is_entry (line, reversed)) continue;
+
+            local_search_run (&search, square, line, reversed, cost_fn);
+
+            roadmap_square_set_current (square);
+            for (segment = 0; segment < search.segments; segment++) {
+
+               if (search.cost[segment] < 0 ||
+                   segment == SEGMENT (line, reversed) ||
+                   !is_exit (segment / 2, segment & 1)) {
+                  continue;
+               }
+
+               if (count == size) {
+                  size = size ? size * 2 : 64;
+                  shortcuts = (NavigateShortcut *)realloc (shortcuts, size * sizeof (NavigateShortcut));
+                  roadmap_check_allocated (shortcuts);
+               }
+
+               shortcuts[count].entry_line = line;
+               shortcuts[count].entry_reversed = reversed;
+               shortcuts[count].exit_line = segment / 2;
+               shortcuts[count].exit_reversed = segment & 1;
+               shortcuts[count].cost = search.cost[segment];
+               count++;
+            }
+         }
+      }
+
+      local_search_free (&search);
+   }
+
+   if (count) {
+      qsort (shortcuts, count, sizeof (NavigateShortcut), compare_shortcuts);
+   }
+
+   /* squares without shortcuts are kept too, so they are not rebuilt */
+   add_square (square, version, shortcuts, count);
+   OverlayDirty++;
+}
+
+
+/* Squares which were not in the cache are released once built, so the
+ * build recycles its own cache slot instead of unloading the squares in use.
+ */
+static void build_step (void) {
+
+   int prev_square = roadmap_square_active ();
+   uint32_t start = roadmap_time_get_millis ();
+   int built = 0;
+
+   if (BuildPaused || !navigate_cost_is_static ()) return;
+
+   while (PendingCount > 0 &&
+          built < OVERLAY_BUILD_PER_STEP &&
+          roadmap_time_get_millis () - start < OVERLAY_BUILD_MSEC) {
+
+      int square = PendingTiles[--PendingCount];
+      int cached;
+
+      if (find_square (square)) continue;
+
+      cached = roadmap_square_is_cached (square);
+      build_square (square);
+      roadmap_square_set_current (prev_square);
+      if (!cached) roadmap_square_release (square);
+      built++;
+   }
+
+   roadmap_square_set_current (prev_square);
+
+   if (OverlayDirty >= OVERLAY_SAVE_EVERY ||
+       (PendingCount == 0 && OverlayDirty)) {
+      save_file ();
+   }
+
+   if (PendingCount == 0) {
+      roadmap_main_remove_periodic (build_step);
+      BuildActive = 0;
+      roadmap_log (ROADMAP_DEBUG, "Routing overlay for %d is complete", OverlayFips);
+   }
+}
+
+
+static void queue_tile (int tile_index) {
+
+   if (roadmap_tile_get_scale (tile_index) != 0) return;
+
+   if (PendingCount == PendingSize) {
+      PendingSize = PendingSize ? PendingSize * 2 : 1024;
+      PendingTiles = (int *)realloc (PendingTiles, PendingSize * sizeof (int));
+      roadmap_check_allocated (PendingTiles);
+   }
+
+   PendingTiles[PendingCount++] = tile_index;
+}
+
+
+static void start_build (void) {
+
+   if (PendingCount == 0 || BuildActive) return;
+
+   BuildActive = 1;
+   roadmap_main_set_periodic (OVERLAY_BUILD_PERIOD, build_step);
+}
+
+
+void navigate_overlay_initialize (void) {
+
+   roadmap_config_declare_enumeration
+      ("preferences", &OverlayCfg, NULL, "no", "yes", NULL);
+}
+
+
+int navigate_overlay_enabled (void) {
+
+   return roadmap_config_match (&OverlayCfg, "yes") &&
+          navigate_cost_is_static ();
+}
+
+
+void navigate_overlay_load (int fips) {
+
+   int signature;
+
+   if (!navigate_overlay_enabled ()) {
+
+      if (OverlayFips >= 0) {
+         if (OverlayDirty) save_file ();
+         clear_all ();
+         OverlayFips = -1;
+      }
+      return;
+   }
+
+   signature = cost_signature ();
+   if (fips == OverlayFips && signature == OverlaySignature) return;
+
+   if (OverlayFips >= 0 && OverlayDirty) {
+      save_file ();
+   }
+   clear_all ();
+
+   OverlayFips = fips;
+   OverlaySignature = signature;
+   load_file ();
+
+   roadmap_tile_enumerate (fips, queue_tile);
+   start_build ();
+}
+
+
+void navigate_overlay_pause (int pause) {
+
+   BuildPaused = pause;
+}
+
+
+void navigate_overlay_tile_changed (int square) {
+
+   if (OverlayFips < 0) return;
+
+   remove_square (square);
+   queue_tile (square);
+   start_build ();
+}
+
+
+int navigate_overlay_get (int square, int line_id, int reversed,
+                          const NavigateShortcut **shortcuts) {
+
+   OverlaySquare *item;
+   int segment = SEGMENT (line_id, reversed);
+   int low;
+   int high;
+   int count;
+
+   if (OverlayFips < 0) return 0;
+
+   item = find_square (square);
+   if (!item || !item->count) return 0;
+
+   if (item->version != roadmap_square_version (square)) {
+      navigate_overlay_tile_changed (square);
+      return 0;
+   }
+
+   /* find the first shortcut of this entry */
+   low = 0;
+   high = item->count;
+   while (low < high) {
+      int mid = (low + high) / 2;
+      if (SEGMENT (item->shortcuts[mid].entry_line, item->shortcuts[mid].entry_reversed) < segment) {
+         low = mid + 1;
+      } else {
+         high = mid;
+      }
+   }
+
+   for (count = 0;
+        low + count < item->count &&
+        SEGMENT (item->shortcuts[low + count].entry_line,
+                 item->shortcuts[low + count].entry_reversed) == segment;
+        count++)
+      ;
+
+   *shortcuts = item->shortcuts + low;
+   return count;
+}
+
+
+int navigate_overlay_unpack (int square,
+                             int entry_line, int entry_reversed,
+                             int exit_line, int exit_reversed,
+                             int *lines, int *reversed, int max) {
+
+   LocalSearch search;
+   int residential;
+   int segment;
+   int count = 0;
+   int i;
+
+   if (!roadmap_square_set_current (square)) return -1;
+
+   if (local_search_init (&search, square_lines_count (square, &residential)) < 0) {
+      return -1;
+   }
+
+   local_search_run (&search, square, entry_line, entry_reversed, navigate_cost_get ());
+
+   segment = SEGMENT (exit_line, exit_reversed);
+   if (segment >= search.segments || search.cost[segment] < 0) {
+      local_search_free (&search);
+      return -1;
+   }
+
+   for (segment = search.prev[segment];
+        segment >= 0 && segment != SEGMENT (entry_line, entry_reversed);
+        segment = search.prev[segment]) {
+
+      if (count == max) {
+         local_search_free (&search);
+         return -1;
+      }
+      lines[count] = segment / 2;
+      reversed[count] = segment & 1;
+      count++;
+   }
+
+   local_search_free (&search);
+
+   /* the path was collected backwards */
+   for (i = 0; i < count / 2; i++) {
+      int tmp = lines[i];
+      lines[i] = lines[count - 1 - i];
+      lines[count - 1 - i] = tmp;
+      tmp = reversed[i];
+      reversed[i] = reversed[count - 1 - i];
+      reversed[count - 1 - i] = tmp;
+   }
+
+   return count;
+}
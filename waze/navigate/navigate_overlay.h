@@ -0,0 +1,57 @@
+/* navigate_overlay.h - shortcut overlay over residential squares
+ *
+ * LICENSE:
+ *
+ *   Copyright 2012 Assaf Paz
+ *
+ *   This file is part of RoadMap.
+ *
+ *   RoadMap is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   RoadMap is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with RoadMap; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef _NAVIGATE_OVERLAY_H_
+#define _NAVIGATE_OVERLAY_H_
+
+/* A shortcut crosses a square which has only residential roads, from a
+ * segment entering the square at its border to a segment leaving it.
+ * The cost is that of all the segments after the entry, including the
+ * exit, as computed by the routing cost function.
+ */
+typedef struct {
+   unsigned short entry_line;
+   unsigned char  entry_reversed;
+   unsigned char  exit_reversed;
+   unsigned short exit_line;
+   int            cost;
+} NavigateShortcut;
+
+void navigate_overlay_initialize (void);
+
+int  navigate_overlay_enabled (void);
+
+void navigate_overlay_load (int fips);
+void navigate_overlay_pause (int pause);
+void navigate_overlay_tile_changed (int square);
+
+int  navigate_overlay_get (int square, int line_id, int reversed,
+                           const NavigateShortcut **shortcuts);
+
+int  navigate_overlay_unpack (int square,
+                              int entry_line, int entry_reversed,
+                              int exit_line, int exit_reversed,
+                              int *lines, int *reversed, int max);
+
+#endif /* _NAVIGATE_OVERLAY_H_ */
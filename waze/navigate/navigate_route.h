@@ -45,6 +45,7 @@
 
 int navigate_route_reload_data (void);
 int navigate_route_load_data   (void);
+void navigate_route_initialize (void);
 
 int navigate_route_get_segments (PluginLine *from_line,
                                  int from_point,
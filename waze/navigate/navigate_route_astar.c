@@ -33,6 +33,8 @@
 #include <math.h>
 
 #include "roadmap.h"
+#include "roadmap_config.h"
+#include "roadmap_time.h"
 #include "roadmap_point.h"
 #include "roadmap_line.h"
 #include "roadmap_locator.h"
@@ -56,7 +58,8 @@
 #include "navigate_graph.h"
 #include "navigate_cost.h"
 
-#include "fib-1.1/fib.h"
+#include "navigate_heap.h"
+#include "navigate_overlay.h"
 #include "navigate_route.h"
 
 #define LOCKED_ROUTE (1 << 7)
@@ -72,22 +75,57 @@
 #define COST_FACTOR_UPDATE 0.98
 
 #define HASH_BLOCK_SIZE 4096
-#define HASH_MAX_BLOCKS 40
-#define MAX_ASTAR_LINES (HASH_BLOCK_SIZE * HASH_MAX_BLOCKS)
-static int RouteNumNodes = 0;
 
 #define MAX_REROUTE_ATTEMPS	100
 
-static RoadMapHash *RouteGraph;
+#define MAX_SHORTCUT_LINES 1024
+
+/* prev_square value of items which have no predecessor in the set:
+ * segments of the previous route, and the goal seeds of a backward search.
+ */
+#define NO_PREV_SQUARE -1
+
 static RoadMapPosition GoalPos;
 
+static RoadMapConfigDescriptor BidirectionalCfg =
+                  ROADMAP_CONFIG_ITEM("Routing", "Bidirectional search");
+
 typedef struct {
 	int					line_square;
 	int					prev_square;
 	unsigned short		line_id;
 	unsigned short		prev_id;
+	int					cost;
+	unsigned char		flags;
 } NavItem;
-static NavItem *NavNode[HASH_MAX_BLOCKS];
+
+/* NavItem flags */
+#define NAV_ITEM_SHORTCUT 1	/* reached from prev through the routing overlay */
+
+/* The segments reached by one search direction. Items are allocated in
+ * blocks so their address never changes, and are indexed by an open
+ * addressing hash table. Both the blocks and the index grow on demand.
+ */
+typedef struct {
+	NavItem	**blocks;
+	int		  blocks_size;
+	int		  count;
+	int		 *index;
+	int		  index_size;
+} NavItemSet;
+
+static NavItemSet ForwardSet;
+static NavItemSet BackwardSet;
+
+static NavigateHeap ForwardQueue;
+static NavigateHeap BackwardQueue;
+
+/* Overlay use in the current search - squares of the start and goal are
+ * always expanded.
+ */
+static int UseOverlay;
+static int OverlayStartSquare;
+static int OverlayGoalSquare;
 
 typedef struct {
 	int square;
@@ -115,65 +153,152 @@ int navigate_route_reload_data (void) {
 }
 
 int navigate_route_load_data (void) {
+
+   navigate_overlay_load (roadmap_locator_active ());
    return 0;
 }
 
+void navigate_route_initialize (void) {
 
-static int hash_key (int square, int line, int reversed) {
+   navigate_overlay_initialize ();
 
-	return (square << 16) + line * 2 + (reversed != 0);
+   roadmap_config_declare_enumeration
+      ("preferences", &BidirectionalCfg, NULL, "no", "yes", NULL);
 }
 
 
-static NavItem *make_path (int square_id, int line_id, int line_reversed,
-							  		int prev_square, int prev_line, int prev_reversed) {
+static unsigned int hash_key (int square, int line, int reversed) {
 
-   NavItem *item;
+	unsigned int key = (square << 16) + line * 2 + (reversed != 0);
 
-	if (RouteNumNodes >= MAX_ASTAR_LINES) {
-		roadmap_log (ROADMAP_ERROR, "Too many nodes in route calculation");
-		return NULL;
+	return key * 2654435761U;
+}
+
+
+static NavItem *set_item (NavItemSet *set, int index) {
+
+	return set->blocks[index / HASH_BLOCK_SIZE] + (index % HASH_BLOCK_SIZE);
+}
+
+
+static void set_index_add (NavItemSet *set, int index) {
+
+	NavItem *item = set_item (set, index);
+	int mask = set->index_size - 1;
+	int slot = hash_key (item->line_square & ~REVERSED, item->line_id,
+								item->line_square & REVERSED) & mask;
+
+	while (set->index[slot]) slot = (slot + 1) & mask;
+	set->index[slot] = index + 1;
+}
+
+
+static int set_grow (NavItemSet *set) {
+
+	if (set->count % HASH_BLOCK_SIZE == 0) {
+
+		int block = set->count / HASH_BLOCK_SIZE;
+
+		if (block == set->blocks_size) {
+			int new_size = set->blocks_size ? set->blocks_size * 2 : 16;
+			NavItem **blocks = (NavItem **)realloc (set->blocks, new_size * sizeof (NavItem *));
+
+			if (!blocks) return -1;
+			set->blocks = blocks;
+			set->blocks_size = new_size;
+		}
+
+		set->blocks[block] = (NavItem *)malloc (HASH_BLOCK_SIZE * sizeof (NavItem));
+		if (!set->blocks[block]) return -1;
 	}
 
-	if (RouteNumNodes % HASH_BLOCK_SIZE == 0) {
-		if (RouteNumNodes) roadmap_hash_resize (RouteGraph, RouteNumNodes + HASH_BLOCK_SIZE);
-		NavNode[RouteNumNodes / HASH_BLOCK_SIZE] = (NavItem *)malloc (HASH_BLOCK_SIZE * sizeof (NavItem));
+	/* keep the index at most half full */
+	if ((set->count + 1) * 2 > set->index_size) {
+
+		int new_size = set->index_size ? set->index_size * 2 : HASH_BLOCK_SIZE * 2;
+		int *index = (int *)calloc (new_size, sizeof (int));
+		int i;
+
+		if (!index) return -1;
+		free (set->index);
+		set->index = index;
+		set->index_size = new_size;
+
+		for (i = 0; i < set->count; i++) {
+			set_index_add (set, i);
+		}
 	}
 
-	item = NavNode[RouteNumNodes / HASH_BLOCK_SIZE] + (RouteNumNodes % HASH_BLOCK_SIZE);
+	return 0;
+}
+
+
+static void set_free (NavItemSet *set) {
+
+	int i;
+
+	for (i = (set->count - 1) / HASH_BLOCK_SIZE; set->count && i >= 0; i--) {
+		free (set->blocks[i]);
+	}
+	free (set->blocks);
+	free (set->index);
+
+	memset (set, 0, sizeof (NavItemSet));
+}
+
+
+static NavItem *make_path (NavItemSet *set,
+									int square_id, int line_id, int line_reversed,
+							  		int prev_square, int prev_line, int prev_reversed,
+							  		int cost) {
+
+   NavItem *item;
+
+	if (set_grow (set) < 0) {
+		roadmap_log (ROADMAP_ERROR, "Too many nodes in route calculation (%d)", set->count);
+		return NULL;
+	}
+
+	item = set_item (set, set->count);
 	item->prev_square = prev_square | (prev_reversed ? REVERSED : 0);
 	item->prev_id = prev_line;
 	item->line_square = square_id | (line_reversed ? REVERSED : 0);
 	item->line_id = line_id;
+	item->cost = cost;
+	item->flags = 0;
 
 	//printf ("Adding path (%d/%d)%s -> (%d/%d)%s\n",
 	//			item->prev_square & ~REVERSED, item->prev_id, item->prev_square & REVERSED ? "'" : "",
 	//			item->line_square & ~REVERSED, item->line_id, item->line_square & REVERSED ? "'" : "");
 
-	roadmap_hash_add (RouteGraph, hash_key (square_id, line_id, line_reversed), RouteNumNodes);
-	RouteNumNodes++;
+	set_index_add (set, set->count);
+	set->count++;
 
 	return item;
 }
 
 
-static NavItem *find_prev (int square_id, int line_id, int line_reversed) {
+static NavItem *find_prev (NavItemSet *set, int square_id, int line_id, int line_reversed) {
+
+	int mask = set->index_size - 1;
+	int slot;
+
+	if (!set->count) return NULL;
 
-	int key = hash_key (square_id, line_id, line_reversed);
-	int index = roadmap_hash_get_first (RouteGraph, key);
+	slot = hash_key (square_id, line_id, line_reversed) & mask;
 
 	if (line_reversed) {
 		square_id = square_id | REVERSED;
 	}
 
-	while (index >= 0) {
-		NavItem *item = NavNode[index / HASH_BLOCK_SIZE] + (index % HASH_BLOCK_SIZE);
+	while (set->index[slot]) {
+		NavItem *item = set_item (set, set->index[slot] - 1);
 		if (item->line_square == square_id &&
 			 item->line_id == line_id) {
 
 			return item;
 		}
-		index = roadmap_hash_get_next (RouteGraph, index);
+		slot = (slot + 1) & mask;
 	}
 
 	return NULL;
@@ -192,16 +317,24 @@ static void get_to_node (int square, int line_id, int reversed, int *node, RoadM
 }
 
 
+static int heuristic_cost (const RoadMapPosition *from, const RoadMapPosition *to, int navigate_type) {
 
-struct fibheap * make_queue (int square, int line_id, int reversed) {
+	int dis = roadmap_math_distance (from, to);
 
-   struct fibheap *fh;
-   NavItem *item = make_path (square, line_id, reversed, square, line_id, reversed);
-   fh = fh_makekeyheap();
+	if (navigate_type == COST_FASTEST) dis = (dis / HU_SPEED);
 
-   fh_insertkey (fh, 0, item);
+	return dis;
+}
+
+
+static int make_queue (NavigateHeap *queue, NavItemSet *set, int square, int line_id, int reversed) {
+
+   NavItem *item = make_path (set, square, line_id, reversed, square, line_id, reversed, 0);
 
-   return fh;
+   navigate_heap_clear (queue);
+   if (!item) return -1;
+
+   return navigate_heap_insert (queue, 0, item);
 }
 
 static void update_progress (int progress) {
@@ -227,19 +360,23 @@ static int prepare_prev_list (const NavigateSegment *prev_route, int num_prev) {
 
    int i;
 
-   RouteGraph = roadmap_hash_new ("astar", HASH_BLOCK_SIZE);
-   RouteNumNodes = 0;
+   set_free (&ForwardSet);
+   set_free (&BackwardSet);
 
    for (i = 0; i < num_prev; i++) {
    	if (prev_route[i].context != SEG_ROUNDABOUT &&
    		 (i == 0 || prev_route[i - 1].context != SEG_ROUNDABOUT)) {
    		// making sure roundabout is not split between old and new route segments
-	   	make_path (prev_route[i].square,
-	   				  prev_route[i].line,
-	   				  prev_route[i].line_direction != ROUTE_DIRECTION_WITH_LINE,
-	   				  -1,
-	   				  i,
-	   				  0);
+	   	if (!make_path (&ForwardSet,
+	   						 prev_route[i].square,
+	   				  		 prev_route[i].line,
+	   				  		 prev_route[i].line_direction != ROUTE_DIRECTION_WITH_LINE,
+	   				  		 NO_PREV_SQUARE,
+	   				  		 i,
+	   				  		 0,
+	   				  		 0)) {
+	   		return -1;
+	   	}
    	}
    }
 
@@ -248,18 +385,443 @@ static int prepare_prev_list (const NavigateSegment *prev_route, int num_prev) {
 
 static void free_prev_list(void) {
 
-   int i;
+   set_free (&ForwardSet);
+   set_free (&BackwardSet);
+   navigate_heap_free (&ForwardQueue);
+   navigate_heap_free (&BackwardQueue);
+}
 
-   if (RouteGraph) {
-	   roadmap_hash_free (RouteGraph);
-	   RouteGraph = NULL;
-   }
-   if (RouteNumNodes) {
-   	for (i = (RouteNumNodes - 1) / HASH_BLOCK_SIZE; i >= 0; i--) {
-   		free (NavNode[i]);
-   	}
-   	RouteNumNodes = 0;
-   }
+
+/* Bidirectional search
+ *
+ * A forward search from the start and a backward search from the goal
+ * run in turns, each expanding the side with the smaller queue. The
+ * backward set stores in prev_square / prev_id the segment that follows
+ * the item on the way to the goal, and item->cost is the cost of the
+ * segments after it. The search ends once the cheapest queue key is no
+ * better than the best path found through a segment reached by both.
+ */
+
+typedef struct {
+	NavigateCostFn		cost_fn;
+	int					navigate_type;
+	RoadMapPosition	start_pos;
+	float					goal_distance;
+	int					max_progress;
+	int					recalc;
+	int					meet_cost;
+	int					meet_square;
+	int					meet_line;
+	int					meet_reversed;
+} BidirectionalSearch;
+
+
+static void check_meeting (BidirectionalSearch *search,
+									int square, int line_id, int reversed,
+									int forward_cost, int backward_cost) {
+
+	if (search->meet_cost < 0 ||
+		 forward_cost + backward_cost < search->meet_cost) {
+
+		search->meet_cost = forward_cost + backward_cost;
+		search->meet_square = square;
+		search->meet_line = line_id;
+		search->meet_reversed = reversed != 0;
+	}
+}
+
+
+/* Pushes the exits of a residential square entered by item, as found in
+ * the routing overlay, instead of expanding the lines of the square.
+ * Returns the number of shortcuts, 0 if the square should be expanded
+ * as usual, or -1 when out of memory. When search is given, exits already
+ * reached by the backward search are checked as meeting points.
+ */
+static int push_shortcuts (NavItem *item, int cur_cost, int min_key, int navigate_type,
+							  BidirectionalSearch *search) {
+
+	const NavigateShortcut *shortcuts;
+	int square = item->line_square & ~REVERSED;
+	int line_id = item->line_id;
+	int reversed = (item->line_square & REVERSED) != 0;
+	int count;
+	int i;
+
+	if (!UseOverlay ||
+		 (item->flags & NAV_ITEM_SHORTCUT) ||
+		 square == OverlayStartSquare ||
+		 square == OverlayGoalSquare) {
+		return 0;
+	}
+
+	count = navigate_overlay_get (square, line_id, reversed, &shortcuts);
+
+	for (i = 0; i < count; i++) {
+
+		const NavigateShortcut *shortcut = shortcuts + i;
+		RoadMapPosition position;
+		NavItem *next;
+		int node;
+		int path_cost;
+		int total_cost;
+
+		if (find_prev (&ForwardSet, square, shortcut->exit_line, shortcut->exit_reversed)) continue;
+
+		get_to_node (square, shortcut->exit_line, shortcut->exit_reversed, &node, &position);
+
+		path_cost = cur_cost + shortcut->cost;
+		total_cost = path_cost + heuristic_cost (&position, &GoalPos, navigate_type) + 1;
+		if (total_cost < min_key) total_cost = min_key;
+
+		next = make_path (&ForwardSet, square, shortcut->exit_line, shortcut->exit_reversed,
+								square, line_id, reversed, path_cost);
+		if (!next ||
+			 navigate_heap_insert (&ForwardQueue, total_cost, next) < 0) {
+			return -1;
+		}
+		next->flags |= NAV_ITEM_SHORTCUT;
+
+		if (search) {
+			NavItem *other = find_prev (&BackwardSet, square,
+												 shortcut->exit_line, shortcut->exit_reversed);
+			if (other) {
+				check_meeting (search, square, shortcut->exit_line,
+									shortcut->exit_reversed, path_cost, other->cost);
+			}
+		}
+	}
+
+	return count;
+}
+
+
+static int is_turn_allowed (int square, int line_id, int reversed,
+									 int next_square, int next_line, int next_reversed) {
+
+	struct successor successors[MAX_SUCCESSORS];
+	RoadMapPosition position;
+	int node;
+	int count;
+	int i;
+
+	get_to_node (square, line_id, reversed, &node, &position);
+	count = get_connected_segments (square, line_id, reversed, node,
+											  successors, MAX_SUCCESSORS, 1, 1);
+
+	for (i = 0; i < count; i++) {
+		if (successors[i].square_id == next_square &&
+			 successors[i].line_id == next_line &&
+			 successors[i].reversed == (next_reversed != 0)) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+
+static int seed_backward (BidirectionalSearch *search, int goal_square, int goal_line) {
+
+	int reversed;
+	int direction;
+	int count = 0;
+
+	navigate_heap_clear (&BackwardQueue);
+
+	roadmap_square_set_current (goal_square);
+	direction = roadmap_line_route_get_direction (goal_line, ROUTE_CAR_ALLOWED);
+
+	for (reversed = 0; reversed <= 1; reversed++) {
+
+		NavItem *item;
+		NavItem *other;
+		RoadMapPosition position;
+		int node;
+
+		if (!(direction &
+				(reversed ? ROUTE_DIRECTION_AGAINST_LINE : ROUTE_DIRECTION_WITH_LINE))) {
+			continue;
+		}
+
+		item = make_path (&BackwardSet, goal_square, goal_line, reversed,
+								NO_PREV_SQUARE, goal_line, 0, 0);
+		if (!item) return -1;
+
+		get_to_node (goal_square, goal_line, reversed, &node, &position);
+		if (navigate_heap_insert (&BackwardQueue,
+										  heuristic_cost (&search->start_pos, &position, search->navigate_type),
+										  item) < 0) {
+			return -1;
+		}
+
+		other = find_prev (&ForwardSet, goal_square, goal_line, reversed);
+		if (other) {
+			check_meeting (search, goal_square, goal_line, reversed, other->cost, 0);
+		}
+
+		count++;
+	}
+
+	return count;
+}
+
+
+static int expand_forward (BidirectionalSearch *search) {
+
+	struct successor successors[MAX_SUCCESSORS];
+	int key = navigate_heap_min_key (&ForwardQueue);
+	NavItem *item = (NavItem *)navigate_heap_extract_min (&ForwardQueue);
+	int square = item->line_square & ~REVERSED;
+	int line_id = item->line_id;
+	int reversed = item->line_square & REVERSED;
+	int cur_cost = item->cost;
+	RoadMapPosition position;
+	int node;
+	int count;
+	int i;
+
+	count = push_shortcuts (item, cur_cost, key, search->navigate_type, search);
+	if (count < 0) return -1;
+	if (count > 0) return 0;
+
+	get_to_node (square, line_id, reversed, &node, &position);
+	count = get_connected_segments (square, line_id, reversed, node,
+											  successors, MAX_SUCCESSORS, 1, 1);
+
+	for (i = 0; i < count; i++) {
+
+		struct successor *next = successors + i;
+		RoadMapPosition to_pos;
+		NavItem *other;
+		int segment_cost;
+		int path_cost;
+		int distance_to_goal;
+		int total_cost;
+		int progress;
+
+		if (find_prev (&ForwardSet, next->square_id, next->line_id, next->reversed)) continue;
+
+		roadmap_square_set_current (next->square_id);
+		segment_cost = search->cost_fn (next->line_id, next->reversed, cur_cost,
+												  line_id, reversed,
+												  next->square_id == square ? node : -1);
+		if (segment_cost < 0) continue;
+
+		path_cost = cur_cost + segment_cost;
+		roadmap_point_position (next->to_point, &to_pos);
+		distance_to_goal = roadmap_math_distance (&to_pos, &GoalPos);
+
+		total_cost = path_cost + heuristic_cost (&to_pos, &GoalPos, search->navigate_type) + 1;
+		if (total_cost < key) total_cost = key;
+
+		item = make_path (&ForwardSet, next->square_id, next->line_id, next->reversed,
+								square, line_id, reversed, path_cost);
+		if (!item ||
+			 navigate_heap_insert (&ForwardQueue, total_cost, item) < 0) {
+			return -1;
+		}
+
+		other = find_prev (&BackwardSet, next->square_id, next->line_id, next->reversed);
+		if (other) {
+			check_meeting (search, next->square_id, next->line_id, next->reversed,
+								path_cost, other->cost);
+		}
+
+		progress = (int)(100 * (1 - sqrt ((float)distance_to_goal / search->goal_distance)));
+		if ((progress >> 2 ) > (search->max_progress >> 2)) {
+			search->max_progress = progress;
+			if (!search->recalc) update_progress (search->max_progress);
+		}
+	}
+
+	return 0;
+}
+
+
+static int expand_backward (BidirectionalSearch *search) {
+
+	struct successor successors[MAX_SUCCESSORS];
+	int key = navigate_heap_min_key (&BackwardQueue);
+	NavItem *item = (NavItem *)navigate_heap_extract_min (&BackwardQueue);
+	int square = item->line_square & ~REVERSED;
+	int line_id = item->line_id;
+	int reversed = (item->line_square & REVERSED) != 0;
+	int cur_cost = item->cost;
+	RoadMapPosition position;
+	int node;
+	int count;
+	int i;
+
+	/* The predecessors of a segment are the segments leaving its start
+	 * node, travelled in the opposite direction.
+	 */
+	get_to_node (square, line_id, !reversed, &node, &position);
+	count = get_connected_segments (square, line_id, !reversed, node,
+											  successors, MAX_SUCCESSORS, 0, 0);
+
+	for (i = 0; i < count; i++) {
+
+		int prev_square = successors[i].square_id;
+		int prev_line = successors[i].line_id;
+		int prev_reversed = !successors[i].reversed;
+		NavItem *other;
+		int segment_cost;
+		int path_cost;
+		int total_cost;
+
+		if (find_prev (&BackwardSet, prev_square, prev_line, prev_reversed)) continue;
+
+		roadmap_square_set_current (prev_square);
+		if (!(roadmap_line_route_get_direction (prev_line, ROUTE_CAR_ALLOWED) &
+				(prev_reversed ? ROUTE_DIRECTION_AGAINST_LINE : ROUTE_DIRECTION_WITH_LINE))) {
+			continue;
+		}
+
+		if (!is_turn_allowed (prev_square, prev_line, prev_reversed,
+									 square, line_id, reversed)) {
+			continue;
+		}
+
+		roadmap_square_set_current (square);
+		segment_cost = search->cost_fn (line_id, reversed, 0,
+												  prev_line, prev_reversed,
+												  prev_square == square ? node : -1);
+		if (segment_cost < 0) continue;
+
+		path_cost = cur_cost + segment_cost;
+		total_cost = path_cost + heuristic_cost (&search->start_pos, &position, search->navigate_type) + 1;
+		if (total_cost < key) total_cost = key;
+
+		item = make_path (&BackwardSet, prev_square, prev_line, prev_reversed,
+								square, line_id, reversed, path_cost);
+		if (!item ||
+			 navigate_heap_insert (&BackwardQueue, total_cost, item) < 0) {
+			return -1;
+		}
+
+		other = find_prev (&ForwardSet, prev_square, prev_line, prev_reversed);
+		if (other) {
+			check_meeting (search, prev_square, prev_line, prev_reversed,
+								other->cost, path_cost);
+		}
+	}
+
+	return 0;
+}
+
+
+/* Append the backward path from the meeting segment to the goal to the
+ * forward set, so the route can be read back from the goal as usual.
+ * The meeting point is first moved to the last segment of the backward
+ * path which the forward search has also reached, so the spliced path
+ * has no loops.
+ */
+static int splice_backward_path (BidirectionalSearch *search, int *total_cost, int *last_is_reversed) {
+
+	int square = search->meet_square;
+	int line_id = search->meet_line;
+	int reversed = search->meet_reversed;
+	NavItem *forward = NULL;
+	NavItem *backward;
+
+	while (1) {
+
+		NavItem *item = find_prev (&ForwardSet, square, line_id, reversed);
+
+		backward = find_prev (&BackwardSet, square, line_id, reversed);
+		if (!backward) return -1;
+
+		if (item) {
+			forward = item;
+			search->meet_square = square;
+			search->meet_line = line_id;
+			search->meet_reversed = reversed;
+		}
+
+		if (backward->prev_square == NO_PREV_SQUARE) break;
+
+		square = backward->prev_square & ~REVERSED;
+		line_id = backward->prev_id;
+		reversed = (backward->prev_square & REVERSED) != 0;
+	}
+
+	square = search->meet_square;
+	line_id = search->meet_line;
+	reversed = search->meet_reversed;
+	backward = find_prev (&BackwardSet, square, line_id, reversed);
+	*total_cost = forward->cost + backward->cost;
+
+	while (backward->prev_square != NO_PREV_SQUARE) {
+
+		int next_square = backward->prev_square & ~REVERSED;
+		int next_line = backward->prev_id;
+		int next_reversed = (backward->prev_square & REVERSED) != 0;
+		NavItem *next = find_prev (&BackwardSet, next_square, next_line, next_reversed);
+
+		if (!make_path (&ForwardSet, next_square, next_line, next_reversed,
+							 square, line_id, reversed,
+							 *total_cost - next->cost)) {
+			return -1;
+		}
+
+		square = next_square;
+		line_id = next_line;
+		reversed = next_reversed;
+		backward = next;
+	}
+
+	*last_is_reversed = reversed ? REVERSED : 0;
+
+	return 0;
+}
+
+
+static int astar_bidirectional (int start_square, int start_node, int start_segment, int start_reversed,
+										  PluginLine *goal, int *route_total_cost, int recalc,
+										  int *last_is_reversed) {
+
+	BidirectionalSearch search;
+
+	search.cost_fn = navigate_cost_get ();
+	search.navigate_type = navigate_cost_type ();
+	search.max_progress = 0;
+	search.recalc = recalc;
+	search.meet_cost = -1;
+
+	OverlayStartSquare = start_square;
+
+	roadmap_square_set_current (start_square);
+	roadmap_point_position (start_node, &search.start_pos);
+	search.goal_distance = (float)roadmap_math_distance (&search.start_pos, &GoalPos);
+
+	if (make_queue (&ForwardQueue, &ForwardSet, start_square, start_segment, start_reversed) < 0 ||
+		 seed_backward (&search, goal->square, goal->line_id) <= 0) {
+		return -1;
+	}
+
+	while (!navigate_heap_empty (&ForwardQueue) &&
+			 !navigate_heap_empty (&BackwardQueue)) {
+
+		int rc;
+
+		if (search.meet_cost >= 0 &&
+			 (navigate_heap_min_key (&ForwardQueue) >= search.meet_cost ||
+			  navigate_heap_min_key (&BackwardQueue) >= search.meet_cost)) {
+			break;
+		}
+
+		if (ForwardQueue.count <= BackwardQueue.count) {
+			rc = expand_forward (&search);
+		} else {
+			rc = expand_backward (&search);
+		}
+
+		if (rc < 0) return -1;
+	}
+
+	if (search.meet_cost < 0) return -1;
+
+	return splice_backward_path (&search, route_total_cost, last_is_reversed);
 }
 
 
@@ -301,13 +863,31 @@ static int astar(int *start_square, int start_node, int *start_segment, int *sta
    RoadMapPosition start_position;
    int out_of_memory;
 
-   struct fibheap *q;
    NavigateCostFn cost_fn = navigate_cost_get ();
    int navigate_type = navigate_cost_type ();
 
 	*first_prev_segment = -1;
 	roadmap_square_set_current (goal_square);
    roadmap_point_position (*goal_node, &GoalPos);
+
+   UseOverlay = !((*flags) & USE_LAST_RESULTS) && navigate_overlay_enabled ();
+   OverlayGoalSquare = goal_square;
+
+   if (!((*flags) & USE_LAST_RESULTS) &&
+   	 roadmap_config_match (&BidirectionalCfg, "yes")) {
+
+   	if (astar_bidirectional (*start_square, start_node, *start_segment, *start_reversed,
+   									 goal, route_total_cost, recalc, last_is_reversed) == 0) {
+   		return 0;
+   	}
+
+   	/* no route or out of memory - retry with the one way search, which
+   	 * can also pick an alternate source or destination.
+   	 */
+   	set_free (&ForwardSet);
+   	set_free (&BackwardSet);
+   }
+
    roadmap_square_set_current (*start_square);
    roadmap_point_position (start_node, &position);
    goal_distance = (float)roadmap_math_distance (&position, &GoalPos);
@@ -361,12 +941,13 @@ static int astar(int *start_square, int start_node, int *start_segment, int *sta
 	   last_square = *start_square;
 	   last_line = *start_segment;
 	   last_line_reversed = *start_reversed;
+	   OverlayStartSquare = last_square;
 
-	   q = make_queue (last_square, last_line, last_line_reversed);
 		num_heap_gets = 0;
 
-		out_of_memory = 0;
-	   while (fh_min(q) != NULL && !out_of_memory) {
+		out_of_memory = make_queue (&ForwardQueue, &ForwardSet,
+											 last_square, last_line, last_line_reversed) < 0;
+	   while (!navigate_heap_empty (&ForwardQueue) && !out_of_memory) {
 
 			if (((*flags) & USE_LAST_RESULTS) &&
 				 num_heap_gets >= MAX_REROUTE_ATTEMPS) {
@@ -375,8 +956,8 @@ static int astar(int *start_square, int start_node, int *start_segment, int *sta
 			}
 	      num_heap_gets++;
 
-	      cur_cost = fh_minkey(q);
-	      item = (NavItem *)fh_extractmin(q);
+	      cur_cost = navigate_heap_min_key (&ForwardQueue);
+	      item = (NavItem *)navigate_heap_extract_min (&ForwardQueue);
 	      last_square = item->line_square & ~REVERSED;
 	      last_line = item->line_id;
 	      last_line_reversed = item->line_square & REVERSED;
@@ -393,7 +974,6 @@ static int astar(int *start_square, int start_node, int *start_segment, int *sta
 	      if (last_square == goal_square &&
 	      	 last_line == goal_line) {
 	         *route_total_cost = cur_cost;
-	         fh_deleteheap(q);
 	         //printf("Total no. of heap gets in this search: %d\n", num_heap_gets);
 	         //printf ("Final cost for track is %d\n", cur_cost);
 	         *last_is_reversed = last_line_reversed;
@@ -414,6 +994,15 @@ static int astar(int *start_square, int start_node, int *start_segment, int *sta
 				}
 			}
 
+	      no_successors = push_shortcuts (item, item->cost, prev_cost, navigate_type, NULL);
+	      if (no_successors < 0) {
+	         out_of_memory = 1;
+	         break;
+	      }
+	      if (no_successors > 0) {
+	         continue;
+	      }
+
 	      no_successors = get_connected_segments (last_square, last_line, last_line_reversed, node,
 	                                    			 successors, MAX_SUCCESSORS, 1, 1);
 	      if (!no_successors) {
@@ -436,13 +1025,12 @@ static int astar(int *start_square, int start_node, int *start_segment, int *sta
 	         segment = successors[i].line_id;
 	         is_reversed = successors[i].reversed;
 
-				prev_ptr = find_prev (square, segment, is_reversed);
+				prev_ptr = find_prev (&ForwardSet, square, segment, is_reversed);
 				if (prev_ptr != NULL) {
-					if (prev_ptr->prev_square == -1) {
+					if (prev_ptr->prev_square == NO_PREV_SQUARE) {
 						*first_prev_segment = prev_ptr->prev_id;
 						prev_ptr->prev_square = last_square | (last_line_reversed ? REVERSED : 0);
 						prev_ptr->prev_id = last_line;
-						fh_deleteheap(q);
 						return 0;
 					}
 					continue;
@@ -484,17 +1072,16 @@ static int astar(int *start_square, int start_node, int *start_segment, int *sta
 	            total_cost = prev_cost;
 	         }
 
-	         prev_ptr = make_path (square, segment, is_reversed,
-	         				  	   	 last_square, last_line, last_line_reversed);
+	         prev_ptr = make_path (&ForwardSet, square, segment, is_reversed,
+	         				  	   	 last_square, last_line, last_line_reversed, path_cost);
 
-				if (!prev_ptr) {
+				if (!prev_ptr ||
+					 navigate_heap_insert (&ForwardQueue, total_cost, prev_ptr) < 0) {
 
 					out_of_memory = 1;
 					break;
 				}
 
-	         fh_insertkey(q, total_cost, prev_ptr);
-
 				progress = (int)(100 * (1 - sqrt ((float)distance_to_goal / goal_distance)));
 	         if ((progress >> 2 ) > (cur_max_progress >> 2)) {
 	            cur_max_progress = progress;
@@ -503,7 +1090,6 @@ static int astar(int *start_square, int start_node, int *start_segment, int *sta
 
 	      }
 	   }
-	   fh_deleteheap(q);
 	}
 
 	if (((*flags) & ALLOW_DESTINATION_CHANGE) &&
@@ -521,6 +1107,18 @@ static int astar(int *start_square, int start_node, int *start_segment, int *sta
 }
 
 
+static void fill_segment (NavigateSegment *segment, int square, int line, int line_reversed) {
+
+	roadmap_square_set_current (square);
+	segment->is_instrumented = 0;
+   segment->dest_name = NULL;
+   segment->square = square;
+   segment->line = line;
+   segment->cfcc = roadmap_line_cfcc (line);
+   segment->line_direction = line_reversed ? ROUTE_DIRECTION_AGAINST_LINE : ROUTE_DIRECTION_WITH_LINE;
+}
+
+
 static int navigate_route_calc_segments (PluginLine *from_line,
                                          int from_point,
                                          PluginLine *to_line,
@@ -573,7 +1171,8 @@ static int navigate_route_calc_segments (PluginLine *from_line,
 
    	const NavigateSegment *prev_segment = prev_segments + first_prev_segment;
 
-		prev_item = find_prev (prev_segment->square,
+		prev_item = find_prev (&ForwardSet,
+									  prev_segment->square,
 									  prev_segment->line,
 									  prev_segment->line_direction != ROUTE_DIRECTION_WITH_LINE);
 		if (!prev_item) {
@@ -592,14 +1191,7 @@ static int navigate_route_calc_segments (PluginLine *from_line,
       i++;
       curr_segment--;
 
-		roadmap_square_set_current (square);
-		curr_segment->is_instrumented = 0;
-      curr_segment->dest_name = NULL;
-      curr_segment->square = square;
-      curr_segment->line = line;
-      //printf("%d, ", line);
-      curr_segment->cfcc = roadmap_line_cfcc (line);
-      curr_segment->line_direction = line_reversed ? ROUTE_DIRECTION_AGAINST_LINE : ROUTE_DIRECTION_WITH_LINE;
+      fill_segment (curr_segment, square, line, line_reversed);
       //printf ("Segment %d: (%d/%d)%s\n", i,
       //			segments[*size - i].line.square,
       //			segments[*size - i].line.line_id,
@@ -616,12 +1208,36 @@ static int navigate_route_calc_segments (PluginLine *from_line,
       	 (square == start_square) &&
           (line_reversed == start_line_reversed)) break;
 
-		prev_item = find_prev (square, line, line_reversed);
+		prev_item = find_prev (&ForwardSet, square, line, line_reversed);
 		if (!prev_item) {
 			roadmap_log (ROADMAP_ERROR, "Inconsistency in route calculation");
 			return -1;
 		}
 
+		if (prev_item->flags & NAV_ITEM_SHORTCUT) {
+
+			/* add the lines crossed by the shortcut, from its exit backwards */
+			int lines[MAX_SHORTCUT_LINES];
+			int reversed[MAX_SHORTCUT_LINES];
+			int count = navigate_overlay_unpack (square,
+															 prev_item->prev_id,
+															 (prev_item->prev_square & REVERSED) != 0,
+															 line, line_reversed != 0,
+															 lines, reversed, MAX_SHORTCUT_LINES);
+			if (count < 0) {
+				roadmap_log (ROADMAP_ERROR, "Inconsistency in route calculation");
+				return -1;
+			}
+
+			if (i + count >= MAX_NAV_SEGEMENTS) return -1;
+
+			while (count-- > 0) {
+				i++;
+				curr_segment--;
+				fill_segment (curr_segment, square, lines[count], reversed[count]);
+			}
+		}
+
 		square = prev_item->prev_square & ~REVERSED;
 		line = prev_item->prev_id;
 		line_reversed = prev_item->prev_square & REVERSED;
@@ -695,6 +1311,8 @@ int navigate_route_get_segments (PluginLine *from_line,
    int reuse = (*flags & USE_LAST_RESULTS);
    int rc;
    int prev_scale = roadmap_square_get_screen_scale ();
+   uint32_t start_time;
+   NavigateGraphStats graph_stats;
 
    if (inside_route) {
       roadmap_log (ROADMAP_ERROR, "re-entering navigate_route_get_segments");
@@ -703,17 +1321,30 @@ int navigate_route_get_segments (PluginLine *from_line,
    inside_route = 1;
 
    if (prepare_prev_list (prev_segments, reuse ? num_prev_segments : 0)) {
+      free_prev_list();
       inside_route = 0;
       return -1;
    }
 
 	roadmap_square_set_screen_scale (0);
+	navigate_overlay_pause (1);
+   start_time = roadmap_time_get_millis ();
    rc = navigate_route_calc_segments(from_line, from_point, to_line, to_point, segments,
    											 num_total, num_new, flags,
    											 prev_segments, num_prev_segments);
    if (rc > 0)
    	roadmap_log (ROADMAP_INFO, "Found route: %d segments (%d new)", *num_total, *num_new);
 
+   roadmap_log (ROADMAP_INFO, "Route search took %d ms: %d forward, %d backward nodes",
+   				 (int)(roadmap_time_get_millis () - start_time),
+   				 ForwardSet.count, BackwardSet.count);
+
+   navigate_graph_get_stats (&graph_stats);
+   roadmap_log (ROADMAP_DEBUG, "Graph cache: %d hits, %d misses, %d rebuilds, %d evictions, %d squares in %d bytes",
+   				 graph_stats.hits, graph_stats.misses, graph_stats.rebuilds, graph_stats.evictions,
+   				 graph_stats.squares, graph_stats.bytes);
+
+   navigate_overlay_pause (0);
    roadmap_square_set_screen_scale (prev_scale);
 
    free_prev_list();
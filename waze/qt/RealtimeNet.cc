@@ -25,6 +25,7 @@
 
 extern "C" {
 #include "../Realtime/RealtimeNet.h"
+#include "../Realtime/RealtimePackedPath.h"
 #include "../Realtime/RealtimeAlerts.h"
 #include "../Realtime/RealtimeOffline.h"
 #include "../Realtime/Realtime.h"
@@ -896,17 +897,18 @@ BOOL RTNet_CreateNewRoads( LPRTConnectionInfo   pCI,
 }
 
 
-void RTNet_GPSPath_BuildCommand( char*             Packet,
-                                 LPGPSPointInTime  points,
-                                 int               count,
-                                 BOOL					end_track)
+// Writes the command at 'Packet' and returns the end of the written text
+char* RTNet_GPSPath_BuildCommand( char*             Packet,
+                                  LPGPSPointInTime  points,
+                                  int               count,
+                                  BOOL                    end_track)
 {
    int      i;
-   char     temp[RTNET_GPSPATH_BUFFERSIZE_single_row+1];
+   char*    p = Packet;
 
    if( (count >= 2) && (RTTRK_GPSPATH_MAX_POINTS >= count))
    {
-       sprintf( Packet, "GPSPath,%u,%u", (uint32_t)points->GPS_time, (3 * count));
+       p += sprintf( p, "GPSPath,%u,%u", (uint32_t)points->GPS_time, (3 * count));
 
        for( i=0; i<count; i++)
        {
@@ -916,44 +918,36 @@ void RTNet_GPSPath_BuildCommand( char*             Packet,
           if( i)
              seconds_gap = (int)(points[i].GPS_time - points[i-1].GPS_time);
 
-         waze_assert( !GPSPOINTINTIME_IS_INVALID(points[i]));
-/*
-          if (points[i].Position.longitude < 20000000 ||
-             points[i].Position.longitude > 40000000 ||
-             points[i].Position.latitude < 20000000 ||
-             points[i].Position.latitude > 40000000 ||
-             seconds_gap < 0 ||
-             seconds_gap > 1000) {
-
-            roadmap_log (ROADMAP_ERROR, "Invalid GPS sequence: %d,%d,%d",
-                             points[i].Position.longitude,
-                             points[i].Position.latitude,
-                             seconds_gap);
-          }
-*/
+          waze_assert( !GPSPOINTINTIME_IS_INVALID(points[i]));
+
           format_RoadMapPosition_string( gps_point, &(points[i].Position));
-          sprintf( temp, ",%s,%d,%d", gps_point, points[i].altitude, seconds_gap);
-          strcat( Packet, temp);
+          p += sprintf( p, ",%s,%d,%d", gps_point, points[i].altitude, seconds_gap);
        }
-       strcat( Packet, "\n");
+       *p++ = '\n';
    }
 
    if (end_track)
    {
-    strcat( Packet, "GPSDisconnect\n");
+       p += sprintf( p, "GPSDisconnect\n");
    }
+
+   *p = '\0';
+   return p;
 }
 
 BOOL RTNet_GPSPath(  LPRTConnectionInfo   pCI,
                      time_t               period_begin,
                      LPGPSPointInTime     points,
                      int                  count,
+                     BOOL                 bPacked,
                      CB_OnWSTCompleted    pfnOnCompleted,
                      char*                packet_only)
 {
    ebuffer Packet;
    char*    GPSPathBuffer = NULL;
+   char*    Buffer;
    int      iRangeBegin;
+   int      iMaxPoints = bPacked? RTTRK_GPSPATH_PACKED_MAX_POINTS: RTTRK_GPSPATH_MAX_POINTS;
    BOOL     bRes;
    int      i;
 
@@ -962,17 +956,22 @@ BOOL RTNet_GPSPath(  LPRTConnectionInfo   pCI,
 
    ebuffer_init( &Packet);
 
-   if( RTTRK_GPSPATH_MAX_POINTS < count) {
-      roadmap_log (ROADMAP_ERROR, "GPSPath too long, dropping first %d points", count - RTTRK_GPSPATH_MAX_POINTS);
-      points += count - RTTRK_GPSPATH_MAX_POINTS;
-    points[0].Position.longitude = INVALID_COORDINATE;
-    points[0].Position.latitude = INVALID_COORDINATE;
-    points[0].GPS_time = 0;
-      count = RTTRK_GPSPATH_MAX_POINTS;
+   if( iMaxPoints < count) {
+      roadmap_log (ROADMAP_ERROR, "GPSPath too long, dropping first %d points", count - iMaxPoints);
+      points += count - iMaxPoints;
+       points[0].Position.longitude = INVALID_COORDINATE;
+       points[0].Position.latitude = INVALID_COORDINATE;
+       points[0].GPS_time = 0;
+      count = iMaxPoints;
    }
 
-   GPSPathBuffer = ebuffer_alloc( &Packet, RTNET_GPSPATH_BUFFERSIZE__dynamic(count));
-   memset( GPSPathBuffer, 0, RTNET_GPSPATH_BUFFERSIZE__dynamic(count));
+   // The commands are written in place when only the packet is needed
+   if( packet_only)
+      GPSPathBuffer = packet_only;
+   else
+      GPSPathBuffer = ebuffer_alloc( &Packet, RTNET_GPSPATH_BUFFERSIZE__dynamic(count));
+   *GPSPathBuffer = '\0';
+   Buffer = GPSPathBuffer;
 
    iRangeBegin = 0;
    for( i=0; i<count; i++)
@@ -981,12 +980,14 @@ BOOL RTNet_GPSPath(  LPRTConnectionInfo   pCI,
       {
          int               iPointsCount= i - iRangeBegin;
          LPGPSPointInTime  FirstPoint  = points + iRangeBegin;
-         char* Buffer = GPSPathBuffer + strlen(GPSPathBuffer);
 
          roadmap_log(ROADMAP_DEBUG,
                      "RTNet_GPSPath(GPS-DISCONNECTION TAG) - Adding %d points to packet. Range offset: %d",
                      iPointsCount, iRangeBegin);
-         RTNet_GPSPath_BuildCommand( Buffer, FirstPoint, iPointsCount, TRUE);
+         if( bPacked)
+            Buffer = RTNet_GPSPath_BuildPackedCommand( Buffer, FirstPoint, iPointsCount, TRUE);
+         else
+            Buffer = RTNet_GPSPath_BuildCommand( Buffer, FirstPoint, iPointsCount, TRUE);
          iRangeBegin = i+1;
       }
    }
@@ -995,22 +996,21 @@ BOOL RTNet_GPSPath(  LPRTConnectionInfo   pCI,
    {
       LPGPSPointInTime  FirstPoint  = points + iRangeBegin;
       int               iPointsCount= count - iRangeBegin;
-      char*             Buffer      = GPSPathBuffer + strlen(GPSPathBuffer);
 
       roadmap_log(ROADMAP_DEBUG,
                   "RTNet_GPSPath() - Adding range to packet. Range begin: %d; Range end: %d (count-1)",
                   iRangeBegin, (count - 1));
-      RTNet_GPSPath_BuildCommand( Buffer, FirstPoint, iPointsCount, FALSE);
+      if( bPacked)
+         Buffer = RTNet_GPSPath_BuildPackedCommand( Buffer, FirstPoint, iPointsCount, FALSE);
+      else
+         Buffer = RTNet_GPSPath_BuildCommand( Buffer, FirstPoint, iPointsCount, FALSE);
    }
 
-  waze_assert(*GPSPathBuffer);
+   waze_assert(*GPSPathBuffer);
    roadmap_log(ROADMAP_DEBUG, "RTNet_GPSPath() - Output command: '%s'", GPSPathBuffer);
 
    if( packet_only)
-   {
-      sprintf( packet_only, "%s", GPSPathBuffer);
       bRes = TRUE;
-   }
    else
       bRes = wst_start_session_trans(
                               general_parser,
@@ -1035,8 +1035,8 @@ BOOL RTNet_NodePath( LPRTConnectionInfo   pCI,
 {
    ebuffer Packet;
    char*    NodePathBuffer = NULL;
+   char*    p;
    int      i;
-   char     temp[RTNET_NODEPATH_BUFFERSIZE_temp+1];
    BOOL     bRes;
    BOOL     bAddUserPoints = FALSE;
 
@@ -1066,9 +1066,8 @@ BOOL RTNet_NodePath( LPRTConnectionInfo   pCI,
 
    NodePathBuffer = ebuffer_alloc( &Packet, RTNET_GPSPATH_BUFFERSIZE__dynamic(count));
 
-   sprintf( NodePathBuffer, "NodePath,%d,", (unsigned int)period_begin);//(period_end-period_begin));
-   sprintf( temp, "%d", 2 * count);
-   strcat( NodePathBuffer, temp);
+   p = NodePathBuffer;
+   p += sprintf( p, "NodePath,%d,%d", (unsigned int)period_begin, 2 * count);//(period_end-period_begin));
 
    for( i=0; i<count; i++)
    {
@@ -1077,13 +1076,11 @@ BOOL RTNet_NodePath( LPRTConnectionInfo   pCI,
       if( i)
          seconds_gap = (int)(nodes[i].GPS_time - nodes[i-1].GPS_time);
 
-      sprintf( temp, ",%d,%d", nodes[i].node, seconds_gap);
-      strcat( NodePathBuffer, temp);
+      p += sprintf( p, ",%d,%d", nodes[i].node, seconds_gap);
    }
 
    if (bAddUserPoints) {
-      sprintf( temp, ",%d", EDITOR_POINT_TYPE_MUNCHING);
-      strcat( NodePathBuffer, temp);
+      p += sprintf( p, ",%d", EDITOR_POINT_TYPE_MUNCHING);
 
       for( i=0; i<count; i++)
       {
@@ -1092,8 +1089,7 @@ BOOL RTNet_NodePath( LPRTConnectionInfo   pCI,
          if( i)
             version_gap = user_points[i].version - user_points[i-1].version;
 
-         sprintf( temp, ",%d,%d", user_points[i].points, version_gap);
-         strcat( NodePathBuffer, temp);
+         p += sprintf( p, ",%d,%d", user_points[i].points, version_gap);
       }
    }
 
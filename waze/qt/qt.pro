@@ -39,7 +39,6 @@ SOURCES += \
     qt_dialog.cc \
     qt_canvas.cc \
     roadmap_device.cc \
-    roadmap_tile_storage_qtsql.cc \
     roadmap_native_keyboard.cc \
     roadmap_gpsqtm.cc \
     qt/qt_gpsaccessor.cc \
@@ -67,6 +66,11 @@ SOURCES += \
     qt/qt_datamodels.cc \
     qt/navigate_bar.cc
 
+# CONFIG+=tile_pack stores the tiles in memory mapped pack files instead
+!tile_pack {
+    SOURCES += roadmap_tile_storage_qtsql.cc
+}
+
 HEADERS += \
     qt_progress.h \
     qt_main.h \
@@ -37,6 +37,7 @@
 #include <QPinchGesture>
 #include <QFont>
 #include <QPainterPath>
+#include <QFontMetrics>
 
 extern "C" {
 #include "roadmap_view.h"
@@ -53,15 +54,26 @@ RoadMapCanvasMouseHandler mhandler = 0;
 RoadMapCanvasMouseHandler whandler = 0;
 RoadMapCanvasConfigureHandler chandler = 0;
 
+#define FRAME_STATS_INTERVAL 100
+#define TEXT_LAYOUT_CACHE_SIZE 1024
+
+/* RoadMapGuiPoint is passed to QPainter as QPoint where the layouts match */
+#ifndef Q_OS_MAC
+typedef char RoadMapGuiPointMatchesQPoint[sizeof(RoadMapGuiPoint) == sizeof(QPoint) ? 1 : -1];
+#endif
+
 // Implementation of RMapCanvas class
 RMapCanvas::RMapCanvas( QDeclarativeItem* parent )
-    : QDeclarativeItem(parent), _isDialogActive(false) {
+    : QDeclarativeItem(parent), _isDialogActive(false), painterAntialiasing(false),
+      textLayoutsHead(0), textLayoutsTail(0),
+      frameNumber(0), frameCount(0), frameTotalTime(0), frameMaxTime(0) {
 
     setFlag(QGraphicsItem::ItemHasNoContents, false);
     setAcceptedMouseButtons(Qt::LeftButton);
     pixmap = new QPixmap(0, 0);
     ignoreClicks = false;
     currentPen = 0;
+    frameTimer.invalidate();
     roadMapCanvas = this;
     basePen = createPen("stubPen");
     setPenThickness(2);
@@ -81,6 +93,9 @@ RMapCanvas::RMapCanvas( QDeclarativeItem* parent )
 }
 
 RMapCanvas::~RMapCanvas() {
+   endFrame();
+   trimTextLayouts(true);
+
    if (pixmap != 0) {
       delete pixmap;
       pixmap = 0;
@@ -257,40 +272,205 @@ void RMapCanvas::verifyActiveDialog()
     }
 }
 
+QPainter* RMapCanvas::activePainter() {
+   if (!pixmap || pixmap->isNull()) {
+      return 0;
+   }
+
+   if (!framePainter.isActive()) {
+      if (!framePainter.begin(pixmap)) {
+         return 0;
+      }
+      painterPen = framePainter.pen();
+      painterBrush = framePainter.brush();
+      painterFont = framePainter.font();
+      painterAntialiasing = framePainter.testRenderHint(QPainter::Antialiasing);
+   }
+
+   return &framePainter;
+}
+
+void RMapCanvas::beginFrame() {
+   frameNumber++;
+   frameTimer.start();
+   activePainter();
+}
+
+void RMapCanvas::endFrame() {
+   if (framePainter.isActive()) {
+      framePainter.end();
+   }
+
+   if (frameTimer.isValid()) {
+      qint64 elapsed = frameTimer.elapsed();
+
+      frameTimer.invalidate();
+      frameTotalTime += elapsed;
+      if (elapsed > frameMaxTime) {
+         frameMaxTime = elapsed;
+      }
+
+      if (++frameCount == FRAME_STATS_INTERVAL) {
+         roadmap_log (ROADMAP_DEBUG, "Canvas frame time: average %d ms, max %d ms over %d frames",
+                      (int) (frameTotalTime / frameCount), (int) frameMaxTime, frameCount);
+         frameCount = 0;
+         frameTotalTime = 0;
+         frameMaxTime = 0;
+      }
+   }
+}
+
+void RMapCanvas::applyPen(const QPen &pen) {
+   if (pen != painterPen) {
+      painterPen = pen;
+      framePainter.setPen(pen);
+   }
+}
+
+void RMapCanvas::applyBrush(const QBrush &brush) {
+   if (brush != painterBrush) {
+      painterBrush = brush;
+      framePainter.setBrush(brush);
+   }
+}
+
+void RMapCanvas::applyFont(const QFont &font) {
+   if (font != painterFont) {
+      painterFont = font;
+      framePainter.setFont(font);
+   }
+}
+
+void RMapCanvas::applyAntialiasing(bool antialiasing) {
+   if (antialiasing != painterAntialiasing) {
+      painterAntialiasing = antialiasing;
+      framePainter.setRenderHint(QPainter::Antialiasing, antialiasing);
+   }
+}
+
+const QPoint* RMapCanvas::toQPoints(const RoadMapGuiPoint* points, int count) {
+#ifndef Q_OS_MAC
+   return reinterpret_cast<const QPoint*>(points);
+#else
+   if (pointBuffer.size() < count) {
+      pointBuffer.resize(count);
+   }
+   for (int n = 0; n < count; n++) {
+      pointBuffer[n] = QPoint(points[n].x, points[n].y);
+   }
+   return pointBuffer.constData();
+#endif
+}
+
 void RMapCanvas::clearArea(const RoadMapGuiRect *rect) {
-    if (pixmap) {
+    QPainter *p = activePainter();
+
+    if (p) {
         verifyActiveDialog();
 
         QRect visualRectangle(rect->minx, rect->miny, rect->maxx - rect->minx, rect->maxy - rect->miny);
-        QPainter p(pixmap);
-        p.setBackgroundMode(Qt::OpaqueMode);
-        p.setPen(*currentPen->pen);
-        p.setBrush(QBrush(currentPen->pen->color()));
-        p.drawRect(visualRectangle);
+        p->setBackgroundMode(Qt::OpaqueMode);
+        applyPen(*currentPen->pen);
+        applyBrush(QBrush(currentPen->pen->color()));
+        p->drawRect(visualRectangle);
+        p->setBackgroundMode(Qt::TransparentMode);
     }
 }
 
 void RMapCanvas::erase() {
-   if (pixmap) {
+   QPainter *p = activePainter();
+
+   if (p) {
       verifyActiveDialog();
 
-      pixmap->fill(QColor(currentPen->pen->color().rgb()));
+      p->fillRect(pixmap->rect(), QColor(currentPen->pen->color().rgb()));
    }
 }
 
-void RMapCanvas::setupPainterPen(QPainter &p) {
-    p.setFont(*currentPen->font);
-    p.setPen(*currentPen->pen);
+void RMapCanvas::setupPainterPen() {
+    applyFont(*currentPen->font);
+    applyPen(*currentPen->pen);
 }
 
 
+RMapCanvas::TextLayout* RMapCanvas::textLayout(const char* text) {
+    QFont* font = currentPen->font;
+    TextLayoutKey key;
+
+    key.text = QByteArray::fromRawData(text, strlen(text));
+    key.size = font->pointSize();
+    key.flags = (font->bold() ? TEXT_LAYOUT_BOLD : 0) |
+                (currentPen->isOutlined ? TEXT_LAYOUT_OUTLINED : 0);
+
+    TextLayout* layout = textLayouts.value(key, 0);
+
+    if (layout) {
+        unlinkTextLayout(layout);
+    } else {
+        if (textLayouts.size() >= TEXT_LAYOUT_CACHE_SIZE) {
+            removeTextLayout(textLayoutsTail);
+        }
+
+        layout = new TextLayout;
+        key.text = QByteArray(text);
+        layout->key = key;
+        layout->text = QString::fromUtf8(text);
+        layout->prepared = false;
+
+        QFontMetrics fm(*font);
+        layout->width = fm.boundingRect(layout->text).width();
+        layout->ascent = fm.ascent();
+        layout->descent = fm.descent();
+
+        textLayouts.insert(layout->key, layout);
+    }
+
+    /* most recently used first */
+    layout->prev = 0;
+    layout->next = textLayoutsHead;
+    if (textLayoutsHead) {
+        textLayoutsHead->prev = layout;
+    } else {
+        textLayoutsTail = layout;
+    }
+    textLayoutsHead = layout;
+    layout->frame = frameNumber;
+
+    return layout;
+}
+
+void RMapCanvas::unlinkTextLayout(TextLayout* layout) {
+    if (layout->prev) {
+        layout->prev->next = layout->next;
+    } else {
+        textLayoutsHead = layout->next;
+    }
+    if (layout->next) {
+        layout->next->prev = layout->prev;
+    } else {
+        textLayoutsTail = layout->prev;
+    }
+}
+
+void RMapCanvas::removeTextLayout(TextLayout* layout) {
+    unlinkTextLayout(layout);
+    textLayouts.remove(layout->key);
+    delete layout;
+}
+
+void RMapCanvas::trimTextLayouts(bool all) {
+    while (textLayoutsTail &&
+           (all || textLayoutsTail->frame < frameNumber - 1)) {
+        removeTextLayout(textLayoutsTail);
+    }
+}
+
 void RMapCanvas::getTextExtents(const char* text, int* w, int* ascent,
    int* descent, int *can_tilt) {
-    QFontMetrics fm(*currentPen->font);
-    QRect r = fm.boundingRect(QString::fromUtf8(text));
-    *w = r.width();
-    *ascent = fm.ascent();
-    *descent = fm.descent();
+    TextLayout* layout = textLayout(text);
+    *w = layout->width;
+    *ascent = layout->ascent;
+    *descent = layout->descent;
 #ifdef QT_NO_ROTATE
     if (can_tilt) *can_tilt = 0;
 #else
@@ -299,131 +479,132 @@ void RMapCanvas::getTextExtents(const char* text, int* w, int* ascent,
 
 }
 
+void RMapCanvas::drawTextLayout(int x, int y, TextLayout* layout) {
+   if (!layout->prepared)
+   {
+       /* shape the text once, on its first draw */
+       if (layout->key.flags & TEXT_LAYOUT_OUTLINED)
+       {
+           QFont font(*currentPen->font);
+           font.setStyleStrategy(QFont::ForceOutline);
+           layout->path.addText(0, 0, font, layout->text);
+       }
+       else
+       {
+           layout->staticText.setTextFormat(Qt::PlainText);
+           layout->staticText.setText(layout->text);
+           layout->staticText.prepare(QTransform(), *currentPen->font);
+       }
+       layout->prepared = true;
+   }
+
+   if (!(layout->key.flags & TEXT_LAYOUT_OUTLINED))
+   {
+       /* static text is positioned by its top left corner, not the baseline */
+       framePainter.drawStaticText(x, y - layout->ascent, layout->staticText);
+   }
+   else
+   {
+       QPen* pen = currentPen->pen;
+       applyBrush(pen->color());
+       applyPen(pen->color());
+       framePainter.translate(x, y);
+       framePainter.drawPath(layout->path);
+       framePainter.translate(-x, -y);
+   }
+}
+
 void RMapCanvas::drawString(RoadMapGuiPoint* position, 
       int corner, const char* text) {
-   if (!pixmap) {
+   if (!activePainter()) {
       return;
    }
 
-   QPainter p(pixmap);
-   p.setRenderHint(QPainter::Antialiasing);
+   applyAntialiasing(true);
    if (currentPen != 0) {
-     setupPainterPen(p);
+     setupPainterPen();
    }
                 
-   int text_width;
-   int text_ascent;
-   int text_descent;
+   TextLayout* layout = textLayout(text);
    int x, y;
 
-   getTextExtents(text, &text_width, &text_ascent, &text_descent, NULL);
-
    x = position->x;
    y = position->y;
    if (corner & ROADMAP_CANVAS_RIGHT)
-      x -= text_width;
+      x -= layout->width;
    else if (corner & ROADMAP_CANVAS_CENTER)
-      x -= text_width / 2;
+      x -= layout->width / 2;
  
    if (corner & ROADMAP_CANVAS_BOTTOM)
-      y -= text_descent;
+      y -= layout->descent;
    else if (corner & ROADMAP_CANVAS_MIDDLE)
-      y = y - text_descent + ((text_descent + text_ascent) / 2);
+      y = y - layout->descent + ((layout->descent + layout->ascent) / 2);
    else /* TOP */
-      y += text_ascent;
+      y += layout->ascent;
 
-   if (!currentPen->isOutlined)
-   {
-       p.drawText(x, y, QString::fromUtf8(text));
-   }
-   else
-   {
-       QFont* font = currentPen->font;
-       QPen* pen = currentPen->pen;
-       font->setStyleStrategy(QFont::ForceOutline);
-       p.setBrush(pen->color());
-       p.setPen(pen->color());
-       QPainterPath path;
-       path.addText(x, y, *font, QString::fromUtf8(text));
-       p.drawPath(path);
-   }
+   drawTextLayout(x, y, layout);
 }
 
 void RMapCanvas::drawStringAngle(const RoadMapGuiPoint* position,
                                  RoadMapGuiPoint* center, const char* text, int angle) {
 #ifndef QT_NO_ROTATE
-    if (!pixmap) {
+    QPainter *p = activePainter();
+    if (!p) {
        return;
     }
 
-    QPainter p(pixmap);
-    p.setRenderHint(QPainter::Antialiasing);
+    applyAntialiasing(true);
     if (currentPen != 0) {
-       setupPainterPen(p);
+       setupPainterPen();
     }
 
-    int text_width;
-    int text_ascent;
-    int text_descent;
-    getTextExtents(text, &text_width, &text_ascent, &text_descent, NULL);
+    TextLayout* layout = textLayout(text);
 
     int x = 0;
-    int y = (center)? -text_descent : 0;
+    int y = (center)? -layout->descent : 0;
 
-    p.translate(position->x,position->y);
-    p.rotate((double)angle);
-    if (!currentPen->isOutlined)
-    {
-        p.drawText(x, y, QString::fromUtf8(text));
-    }
-    else
-    {
-        QFont* font = currentPen->font;
-        QPen* pen = currentPen->pen;
-        font->setStyleStrategy(QFont::ForceOutline);
-        p.setBrush(pen->color());
-        p.setPen(pen->color());
-        QPainterPath path;
-        path.addText(x, y, *font, QString::fromUtf8(text));
-        p.drawPath(path);
-    }
+    p->translate(position->x,position->y);
+    p->rotate((double)angle);
+    drawTextLayout(x, y, layout);
+    p->resetTransform();
 #endif
 }
 
 void RMapCanvas::drawMultiplePoints(int count, RoadMapGuiPoint* points) {
-   QPainter p(pixmap);
-   if (currentPen != 0) {
-     setupPainterPen(p);
+   QPainter *p = activePainter();
+   if (!p) {
+      return;
    }
 
-   QPolygon pa(count);
-   for(int n = 0; n < count; n++) {
-      pa.setPoint(n, points[n].x, points[n].y);
+   applyAntialiasing(false);
+   if (currentPen != 0) {
+     setupPainterPen();
    }
 
-   p.drawPoints(pa);
+   p->drawPoints(toQPoints(points, count), count);
 }
 
 void RMapCanvas::drawMultipleLines(int count, int* lines, 
       RoadMapGuiPoint* points, int fast_draw) {
-   QPainter p(pixmap);
+   QPainter *p = activePainter();
+   if (!p) {
+      return;
+   }
+
+   applyAntialiasing(false);
    if (currentPen != 0) {
      if (fast_draw) {
        basePen->pen->setColor(currentPen->pen->color());
-       p.setPen(*basePen->pen);
+       applyPen(*basePen->pen);
      } else {
-       setupPainterPen(p);
+       setupPainterPen();
      }
    }
 
    for(int i = 0; i < count; i++) {
       int count_of_points = *lines;
-      QPolygon pa(count_of_points);
-      for(int n = 0; n < count_of_points; n++) {
-         pa.setPoint(n, points[n].x, points[n].y);
-      }
 
-      p.drawPolyline(pa);
+      p->drawPolyline(toQPoints(points, count_of_points), count_of_points);
 
       lines++;
       points += count_of_points;
@@ -433,25 +614,25 @@ void RMapCanvas::drawMultipleLines(int count, int* lines,
 void RMapCanvas::drawMultiplePolygons(int count, int* polygons, 
       RoadMapGuiPoint* points, int filled, int fast_draw) {
 
-   QPainter p(pixmap);
+   QPainter *p = activePainter();
+   if (!p) {
+      return;
+   }
+
+   applyAntialiasing(false);
    if (currentPen != 0) {
+      applyPen(*currentPen->pen);
       if (filled && !fast_draw) {
-        p.setPen(*currentPen->pen);
-        p.setBrush(QBrush(currentPen->pen->color()));
+        applyBrush(QBrush(currentPen->pen->color()));
       } else {
-        p.setPen(*currentPen->pen);
+        applyBrush(Qt::NoBrush);
       }
    }
 
    for(int i = 0; i < count; i++) {
       int count_of_points = *polygons;
 
-      QPolygon pa(count_of_points);
-      for(int n = 0; n < count_of_points; n++) {
-         pa.setPoint(n, points[n].x, points[n].y);
-      }
-
-      p.drawPolygon(pa);
+      p->drawPolygon(toQPoints(points, count_of_points), count_of_points);
 
       polygons++;
       points += count_of_points;
@@ -461,13 +642,18 @@ void RMapCanvas::drawMultiplePolygons(int count, int* polygons,
 void RMapCanvas::drawMultipleCircles(int count, RoadMapGuiPoint* centers,
       int* radius, int filled, int fast_draw) {
 
-   QPainter p(pixmap);
+   QPainter *p = activePainter();
+   if (!p) {
+      return;
+   }
+
+   applyAntialiasing(false);
    if (currentPen != 0) {
+      applyPen(*currentPen->pen);
       if (filled) {
-         p.setPen(*currentPen->pen);
-         p.setBrush(QBrush(currentPen->pen->color()));
+         applyBrush(QBrush(currentPen->pen->color()));
       } else {
-         p.setPen(*currentPen->pen);
+         applyBrush(Qt::NoBrush);
       }
 
    }
@@ -475,9 +661,9 @@ void RMapCanvas::drawMultipleCircles(int count, RoadMapGuiPoint* centers,
    for(int i = 0; i < count; i++) {
       int r = radius[i];
 
-      p.drawEllipse(centers[i].x - r, centers[i].y - r, 2*r, 2*r);
+      p->drawEllipse(centers[i].x - r, centers[i].y - r, 2*r, 2*r);
       if (filled) {
-         p.drawChord(centers[i].x - r + 1,
+         p->drawChord(centers[i].x - r + 1,
             centers[i].y - r + 1,
             2 * r, 2 * r, 0, 16*360);
       }
@@ -514,6 +700,7 @@ int RMapCanvas::getWidth() {
 }
 
 void RMapCanvas::refresh(void) {
+   endFrame();
    update();
 }
 
@@ -592,6 +779,8 @@ void RMapCanvas::resizeEvent(QGraphicsSceneResizeEvent *ev) {
 
 void RMapCanvas::paint( QPainter * painter, const QStyleOptionGraphicsItem * option, QWidget * widget) {
   
+    endFrame();
+
     QRect target(0, 0, pixmap->width(), pixmap->height());
     QRect source(0, 0, pixmap->width(), pixmap->height());
     painter->drawPixmap( target, *pixmap, source);
@@ -611,6 +800,8 @@ void RMapCanvas::repaintAfterResize(void)
 }
 
 void RMapCanvas::configure() {
+   endFrame();
+
    if (pixmap != 0) {
       delete pixmap;
    }
@@ -661,8 +852,18 @@ void RMapCanvas::initColors() {
 
 void RMapCanvas::drawImage(const RoadMapGuiPoint* pos, const RoadMapImage image, int opacity)
 {
-    QPainter p(pixmap);
-    setupPainterPen(p);
-    p.setOpacity(opacity/255);
-    p.drawImage(pos->x, pos->y, *(image->image));
+    QPainter *p = activePainter();
+    if (!p) {
+       return;
+    }
+
+    if (!RMapImageLoader::ready(image)) {
+       /* still being decoded */
+       return;
+    }
+
+    setupPainterPen();
+    p->setOpacity(opacity/255);
+    p->drawImage(pos->x, pos->y, *(image->image));
+    p->setOpacity(1.0);
 }
@@ -37,6 +37,14 @@
 #include <QImage>
 #include <QGestureEvent>
 #include <QPinchGesture>
+#include <QElapsedTimer>
+#include <QVector>
+#include <QHash>
+#include <QByteArray>
+#include <QStaticText>
+#include <QPainterPath>
+#include <QMutex>
+#include <QWaitCondition>
 
 extern "C" {
 
@@ -55,9 +63,54 @@ extern "C" {
    struct roadmap_canvas_image {
        QImage* image;
        QString full_path;
+       struct RMapImageJob* job;  /* decoding in the background, or NULL */
+       QSize size;                /* of an unloaded image */
    };
 };
 
+struct RMapImageJob {
+   RoadMapImage image;   /* NULL once the image was freed */
+   QString path;
+   QMutex lock;
+   QWaitCondition decodedCondition;
+   QImage decoded;
+   bool done;
+};
+
+/* Hands over the images decoded by the worker threads to the main thread */
+class RMapImageLoader : public QObject {
+
+Q_OBJECT
+
+public:
+   explicit RMapImageLoader(QObject *parent = 0);
+
+   void load(RoadMapImage image);
+   static void complete(RoadMapImage image);
+   static void cancel(RoadMapImage image);
+   static bool ready(RoadMapImage image);
+
+public slots:
+   void imageDecoded(void *job);
+};
+
+#define TEXT_LAYOUT_BOLD      1
+#define TEXT_LAYOUT_OUTLINED  2
+
+struct TextLayoutKey {
+   QByteArray text;  /* UTF-8 */
+   int size;
+   int flags;
+
+   bool operator==(const TextLayoutKey &other) const {
+      return size == other.size && flags == other.flags && text == other.text;
+   }
+};
+
+inline uint qHash(const TextLayoutKey &key) {
+   return qHash(key.text) ^ (key.size << 2) ^ key.flags;
+}
+
 class RMapCanvas : public QDeclarativeItem {
 
 Q_OBJECT
@@ -89,7 +142,8 @@ public:
    void setFontOutlined(int outlined);
    void clearArea(const RoadMapGuiRect *rect);
    void erase(void);
-   void setupPainterPen(QPainter &p);
+   void setupPainterPen();
+   void beginFrame();
    void drawString(RoadMapGuiPoint* position, int corner,
       const char* text);
    void drawStringAngle(const RoadMapGuiPoint* position,
@@ -110,6 +164,7 @@ public:
    void registerConfigureHandler(RoadMapCanvasConfigureHandler handler);
    void getTextExtents(const char* text, int* width, int* ascent,
       int* descent, int *can_tilt);
+   void trimTextLayouts(bool all);
 
    int getHeight();
    int getWidth();
@@ -140,6 +195,55 @@ protected:
 
    bool _isDialogActive;
 
+   /* The painter lives for a whole frame, until refresh(). The state last
+    * set on it is kept so that unchanged pens and brushes are not set again.
+    */
+   QPainter framePainter;
+   QPen painterPen;
+   QBrush painterBrush;
+   QFont painterFont;
+   bool painterAntialiasing;
+   QVector<QPoint> pointBuffer;
+
+   /* Measured and shaped text, kept in LRU order. Entries that were not
+    * used in the last frame are dropped by trimTextLayouts().
+    */
+   struct TextLayout {
+      TextLayoutKey key;
+      QString text;
+      int width;
+      int ascent;
+      int descent;
+      bool prepared;
+      QStaticText staticText;
+      QPainterPath path;
+      int frame;
+      TextLayout* prev;
+      TextLayout* next;
+   };
+
+   QHash<TextLayoutKey, TextLayout*> textLayouts;
+   TextLayout* textLayoutsHead;
+   TextLayout* textLayoutsTail;
+
+   int frameNumber;
+   QElapsedTimer frameTimer;
+   int frameCount;
+   qint64 frameTotalTime;
+   qint64 frameMaxTime;
+
+   QPainter* activePainter();
+   void endFrame();
+   void applyPen(const QPen &pen);
+   void applyBrush(const QBrush &brush);
+   void applyFont(const QFont &font);
+   void applyAntialiasing(bool antialiasing);
+   const QPoint* toQPoints(const RoadMapGuiPoint* points, int count);
+   TextLayout* textLayout(const char* text);
+   void unlinkTextLayout(TextLayout* layout);
+   void removeTextLayout(TextLayout* layout);
+   void drawTextLayout(int x, int y, TextLayout* layout);
+
 
    void initColors();
 
@@ -7,6 +7,9 @@ extern "C" {
 #include "roadmap_path.h"
 }
 
+// the settings are written this long after the last change
+#define CONFIG_FLUSH_DELAY 2000
+
 RMapConfig::RMapConfig(QObject *parent) :
     QObject(parent)
 {
@@ -23,10 +26,16 @@ RMapConfig::RMapConfig(QObject *parent) :
     _settings.insert(PreferencesStr, new QSettings(QSettings::IniFormat, QSettings::UserScope, DataStr, PreferencesStr));
     _settings.insert(SessionStr, new QSettings(QSettings::IniFormat, QSettings::UserScope, DataStr, SessionStr));
     reloadConfig(SchemaStr);
+
+    _flushTimer.setSingleShot(true);
+    _flushTimer.setInterval(CONFIG_FLUSH_DELAY);
+    connect(&_flushTimer, SIGNAL(timeout()), this, SLOT(flushDirtyItems()));
 }
 
 RMapConfig::~RMapConfig()
 {
+    flushDirtyItems();
+
     QHash<QString, QSettings*>::iterator fileIt = _settings.begin();
     for (; fileIt != _settings.end(); fileIt++)
     {
@@ -47,6 +56,8 @@ RMapConfig::~RMapConfig()
 
 void RMapConfig::saveAllSettings()
 {
+    flushDirtyItems();
+
     QHash<QString, QSettings*>::iterator it = _settings.begin();
     for (; it != _settings.end(); it++)
     {
@@ -135,8 +146,104 @@ RMapConfig::ItemsHash::const_iterator RMapConfig::getItemsConstEnd(QString& file
     return items->constEnd();
 }
 
+void RMapConfig::loadItem(RoadMapConfigItem* item)
+{
+    QSettings* settings = getSettings(item->file);
+    QVariant value;
+
+    if (settings != NULL)
+    {
+        settings->beginGroup(item->category);
+        value = settings->value(item->name);
+        settings->endGroup();
+    }
+
+    item->stored = !value.isNull();
+    if (!item->stored)
+    {
+        value = item->default_value;
+    }
+
+    bool isOk;
+    item->value = value;
+    item->text = value.toString();
+    item->strValue = item->text;
+    item->intValue = value.toInt(&isOk);
+    if (!isOk)
+    {
+        item->intValue = 0;
+    }
+    item->cached = true;
+}
+
+void RMapConfig::setItem(RoadMapConfigItem* item, const QVariant& value)
+{
+    bool isOk;
+
+    item->value = value;
+    item->text = value.toString();
+    item->strValue = item->text;
+    item->intValue = value.toInt(&isOk);
+    if (!isOk)
+    {
+        item->intValue = 0;
+    }
+    item->cached = true;
+    item->stored = true;
+
+    if (!item->dirty)
+    {
+        item->dirty = true;
+        _dirtyItems.append(item);
+    }
+    _flushTimer.start();
+}
+
+void RMapConfig::flushDirtyItems()
+{
+    _flushTimer.stop();
+
+    QList<RoadMapConfigItem*>::iterator it = _dirtyItems.begin();
+    for (; it != _dirtyItems.end(); it++)
+    {
+        RoadMapConfigItem* item = *it;
+        QSettings* settings = getSettings(item->file);
+
+        item->dirty = false;
+        if (settings == NULL)
+        {
+            continue;
+        }
+
+        settings->beginGroup(item->category);
+        settings->setValue(item->name, item->value);
+        settings->endGroup();
+    }
+    _dirtyItems.clear();
+}
+
+void RMapConfig::invalidateItems(QString& file)
+{
+    ItemsHash* items = _configItems.value(file, NULL);
+
+    if (items == NULL)
+    {
+        return;
+    }
+
+    ItemsHash::iterator it = items->begin();
+    for (; it != items->end(); it++)
+    {
+        it.value()->cached = false;
+    }
+}
+
 void RMapConfig::reloadConfig(QString& file)
 {
+    // the pending changes are kept, the other values are read again
+    flushDirtyItems();
+    invalidateItems(file);
+
     // schema is a special case as it is composed with more than user & system scopes (themes)
     if (file != SchemaStr)
     {
@@ -4,7 +4,9 @@
 #include <QObject>
 #include <QSettings>
 #include <QHash>
+#include <QList>
 #include <QString>
+#include <QTimer>
 #include "qt_global.h"
 
 extern "C" {
@@ -28,6 +30,14 @@ struct RoadMapConfigItemRecord {
     QList<WazeString>::const_iterator enum_iter;
 
     QHash<QString, RoadMapConfigItem* >::const_iterator items_iter;
+
+    // the current value, valid until the item is set or its file reloaded
+    bool cached;
+    bool stored;    // the value is in the settings, not the default
+    bool dirty;     // set, but not written to the settings yet
+    QVariant value;
+    QString text;
+    int intValue;
 };
 
 class RMapConfig : public QObject
@@ -51,7 +61,14 @@ public:
     ItemsHash::const_iterator getItemsConstBegin(QString& file);
     ItemsHash::const_iterator getItemsConstEnd(QString& file);
 
+    void loadItem(RoadMapConfigItem* item);
+    void setItem(RoadMapConfigItem* item, const QVariant& value);
+
+private slots:
+    void flushDirtyItems();
+
 private:
+    void invalidateItems(QString& file);
 
     QString DataStr;
     QString UserStr;
@@ -61,6 +78,9 @@ private:
 
     QHash<QString, QSettings*> _settings;
     QHash<QString, ItemsHash*> _configItems;
+
+    QList<RoadMapConfigItem*> _dirtyItems;
+    QTimer _flushTimer;
 };
 
 #endif // QT_RCONFIG_H
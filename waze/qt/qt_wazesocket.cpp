@@ -12,6 +12,11 @@ WazeSocket::WazeSocket(QObject *parent) :
 {
 }
 
+void WazeSocket::startResponse()
+{
+    _firstRead = true;
+    _hSent = false;
+}
 
 qint64 WazeSocket::readData(char * data, qint64 maxSize)
 {
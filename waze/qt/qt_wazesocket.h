@@ -11,6 +11,9 @@ public:
 
     qint64 readData(char * data, qint64 maxSize);
 
+    // The next read is the start of a response on a kept alive connection
+    void startResponse();
+
     static const QString ACK;
     static const int ACK_LENGTH;
     static const QString HTTP;
@@ -14,13 +14,21 @@ extern "C" {
 #include "roadmap_http_comp.h"
 #include "roadmap_start.h"
 #include "websvc_trans/string_parser.h"
+#include "websvc_trans/websvc_trans_parsers.h"
 #include "websvc_trans/web_date_format.h"
 #include "roadmap_net_mon.h"
+#include "roadmap_config.h"
 }
 
 #define UNCOMPRESSED_BLOCK_LENGTH 4096
 
 #define MAX_CONNECTIONS 16
+#define MAX_HOST_CONNECTIONS 4
+#define KEEP_ALIVE_MSEC 30000
+#define IDLE_CHECK_MSEC 10000
+
+static RoadMapConfigDescriptor RoadMapConfigPipelineDepth =
+                        ROADMAP_CONFIG_ITEM("Network", "Pipeline depth");
 
 WazeWebAccessor& WazeWebAccessor::getInstance()
 {
@@ -32,42 +40,189 @@ WazeWebAccessor& WazeWebAccessor::getInstance()
 WazeWebAccessor::WazeWebAccessor(QObject *parent) :
     QObject(parent)
 {
-    connect(this, SIGNAL(requestDone()), this, SLOT(invokeNextRequest()));
+    roadmap_config_declare("preferences", &RoadMapConfigPipelineDepth, "1", NULL);
+
+    // Queued, as callbacks may add requests while a response is being handled
+    connect(this, SIGNAL(requestDone()), this, SLOT(invokeNextRequest()), Qt::QueuedConnection);
 
-    connect(&_timer, SIGNAL(timeout()), this, SLOT(invokeNextRequest()));
-    _timer.start(10000);
+    connect(&_timer, SIGNAL(timeout()), this, SLOT(closeIdleConnections()));
+    _timer.start(IDLE_CHECK_MSEC);
 }
 
+/*
+ * Requests go out as soon as a connection can take them. A request prefers an
+ * idle connection to its host, then a new one, then queueing behind a busy one
+ * (up to "Pipeline depth" requests per connection). QHttp keeps the connection
+ * alive between its requests, and reconnects if the server closed it.
+ */
 void WazeWebAccessor::invokeNextRequest()
 {
-    int requestNum = _requestQueue.length();
-    if (0 < requestNum && requestNum <= MAX_CONNECTIONS)
+    QQueue<HttpAsyncContext>::iterator it = _requestQueue.begin();
+
+    while (it != _requestQueue.end())
     {
-        HttpAsyncContext request = _requestQueue.front();
-        _requestQueue.pop_front();
-        QHttp* http = new QHttp(this);
-        connect(http, SIGNAL(done(bool)), this, SLOT(oldStyleFinished(bool)));
-        connect(http, SIGNAL(dataSendProgress(int,int)), this, SLOT(requestBytesWrittenOld(int,int)));
-        connect(http, SIGNAL(dataReadProgress(int,int)), this, SLOT(responseBytesReadOld(int,int)));
-        connect(http, SIGNAL(responseHeaderReceived(QHttpResponseHeader)), this, SLOT(responseHeaderReceived(QHttpResponseHeader)));
-        request.http = http;
+        QHttp* http = getConnection(*it);
 
-        _oldStyleConnectionDataHash[http] = request;
+        if (http == NULL)
+        {
+            ++it;
+            continue;
+        }
 
-        QSslSocket* socket = new WazeSocket();
-        connect(http, SIGNAL(sslErrors(QList<QSslError>)), this, SLOT(onIgnoreSSLErrors(QList<QSslError>)));
-        socket->setPeerVerifyMode(QSslSocket::VerifyNone);
-        http->setSocket(socket);
+        HttpAsyncContext request = *it;
+        it = _requestQueue.erase(it);
+        sendRequest(http, request);
+    }
+}
 
-        http->setHost(request.url.host());
+QHttp* WazeWebAccessor::getConnection(const HttpAsyncContext& request)
+{
+    QString key = QString("%1://%2:%3")
+            .arg(QString::fromAscii((request.isSecured)? "https" : "http"))
+            .arg(request.url.host())
+            .arg(request.url.port());
+    int depth = roadmap_config_get_integer(&RoadMapConfigPipelineDepth);
+    int hostConnections = 0;
+    QHttp* best = NULL;
+
+    if (depth < 1) depth = 1;
 
-        roadmap_net_mon_connect();
-        http->setHost(request.url.host(), (request.isSecured)? QHttp::ConnectionModeHttps : QHttp::ConnectionModeHttp, request.url.port());
+    foreach (const WazeConnection& connection, _connections)
+    {
+        if (connection.key != key || connection.broken) continue;
 
-        http->request(request.requestHeader, *request.requestData, request.buffer);
+        hostConnections++;
+        if (connection.pending < depth &&
+            (best == NULL || connection.pending < _connections.value(best).pending))
+        {
+            best = connection.http;
+        }
     }
+
+    if (best != NULL && _connections.value(best).pending == 0)
+    {
+        return best;
+    }
+
+    if (hostConnections < MAX_HOST_CONNECTIONS)
+    {
+        if (_connections.size() >= MAX_CONNECTIONS)
+        {
+            // Make room by dropping the connection that was idle the longest
+            QHttp* oldest = NULL;
+
+            foreach (const WazeConnection& connection, _connections)
+            {
+                if (connection.pending == 0 &&
+                    (oldest == NULL || connection.idle.elapsed() > _connections.value(oldest).idle.elapsed()))
+                {
+                    oldest = connection.http;
+                }
+            }
+
+            if (oldest != NULL)
+            {
+                closeConnection(oldest);
+            }
+        }
+
+        if (_connections.size() < MAX_CONNECTIONS)
+        {
+            return openConnection(request, key);
+        }
+    }
+
+    return best;
+}
+
+QHttp* WazeWebAccessor::openConnection(const HttpAsyncContext& request, const QString& key)
+{
+    QHttp* http = new QHttp(this);
+    connect(http, SIGNAL(requestStarted(int)), this, SLOT(requestStarted(int)));
+    connect(http, SIGNAL(requestFinished(int,bool)), this, SLOT(requestFinished(int,bool)));
+    connect(http, SIGNAL(done(bool)), this, SLOT(connectionDone(bool)));
+    connect(http, SIGNAL(dataSendProgress(int,int)), this, SLOT(requestBytesWrittenOld(int,int)));
+    connect(http, SIGNAL(dataReadProgress(int,int)), this, SLOT(responseBytesReadOld(int,int)));
+    connect(http, SIGNAL(responseHeaderReceived(QHttpResponseHeader)), this, SLOT(responseHeaderReceived(QHttpResponseHeader)));
+    connect(http, SIGNAL(readyRead(QHttpResponseHeader)), this, SLOT(responseDataReady(QHttpResponseHeader)));
+
+    WazeSocket* socket = new WazeSocket(http);
+    connect(http, SIGNAL(sslErrors(QList<QSslError>)), this, SLOT(onIgnoreSSLErrors(QList<QSslError>)));
+    socket->setPeerVerifyMode(QSslSocket::VerifyNone);
+    http->setSocket(socket);
+
+    http->setHost(request.url.host(), (request.isSecured)? QHttp::ConnectionModeHttps : QHttp::ConnectionModeHttp, request.url.port());
+
+    WazeConnection connection;
+    connection.http = http;
+    connection.socket = socket;
+    connection.key = key;
+    connection.pending = 0;
+    connection.broken = false;
+    connection.idle.start();
+    _connections[http] = connection;
+
+    roadmap_log(ROADMAP_DEBUG, "Opened connection to %s (%d open)", qPrintable(key), _connections.size());
+
+    return http;
+}
+
+void WazeWebAccessor::closeConnection(QHttp* http)
+{
+    if (!_connections.contains(http)) return;
+
+    roadmap_log(ROADMAP_DEBUG, "Closing connection to %s", qPrintable(_connections[http].key));
+
+    _connections.remove(http);
+    http->disconnect(this);
+    http->close();
+    http->deleteLater();
 }
 
+void WazeWebAccessor::closeIdleConnections()
+{
+    QList<QHttp*> idle;
+
+    foreach (const WazeConnection& connection, _connections)
+    {
+        if (connection.pending == 0 && connection.idle.elapsed() > KEEP_ALIVE_MSEC)
+        {
+            idle.append(connection.http);
+        }
+    }
+
+    foreach (QHttp* http, idle)
+    {
+        closeConnection(http);
+    }
+}
+
+void WazeWebAccessor::sendRequest(QHttp* http, HttpAsyncContext& request)
+{
+    WazeConnection& connection = _connections[http];
+
+    request.http = http;
+    request.reused = connection.pending > 0 || http->state() == QHttp::Connected;
+    request.firstByteMsec = -1;
+    request.started.start();
+
+    roadmap_net_mon_connect();
+
+    // No output device, the response is read as it arrives
+    int id = http->request(request.requestHeader, *request.requestData);
+    connection.pending++;
+
+    _activeRequests[qMakePair(http, id)] = request;
+}
+
+HttpAsyncContext* WazeWebAccessor::currentRequest(QHttp* http)
+{
+    WazeRequestKey key = qMakePair(http, http->currentId());
+
+    if (!_activeRequests.contains(key)) return NULL;
+
+    return &_activeRequests[key];
+}
 
 QString WazeWebAccessor::buildHeader(RequestType type, QUrl url, QString additional)
 {
@@ -158,23 +313,22 @@ void WazeWebAccessor::postRequestParser(
     cd.receivedBytes = 0;
     cd.sentBytes = 0;
     cd.ignoreContentLength = false;
+    cd.stream = false;
     cd.statusCode = 0;
-    cd.bytes = new QByteArray();
-    cd.buffer = new QBuffer(cd.bytes);
-    cd.buffer->open(QIODevice::WriteOnly);
+    cd.bytes = NULL;
     cd.url = url;
     cd.decompress = false;
     cd.requestHeader = header;
-    cd.responseHeader = NULL;
     cd.requestData = new QByteArray(ba);
+    cd.inflater = NULL;
+    cd.headerSkip = 0;
+    cd.pending = new QByteArray();
+    cd.escape = false;
+    cd.parseResult = succeeded;
 
     _requestQueue.push_back(cd);
 
-    int requestNum = _requestQueue.length();
-    if (0 < requestNum && requestNum <= MAX_CONNECTIONS)
-    {
-        emit requestDone();
-    }
+    emit requestDone();
 }
 
 void WazeWebAccessor::setV2Suffix(QString suffix)
@@ -192,96 +346,209 @@ void WazeWebAccessor::setSecuredResolvedAddress(QString securedAddress)
     _securedAddress = securedAddress;
 }
 
-void WazeWebAccessor::runParsersAndCallback(HttpAsyncContext& cd, QByteArray& response, roadmap_result result)
+/*
+ * Runs the parsers on the complete lines at data, which ends with a NUL.
+ * Returns how much was parsed. A statement asking for more data is parsed
+ * again with the next lines, unless this is the final part of the response.
+ */
+int WazeWebAccessor::runParsers(HttpAsyncContext& cd, char* data, bool final)
 {
-    QString              tag;
-    wst_parser_ptr       parsers           = cd.callback.parsers;
-    int                  parsers_count     = cd.callback.parser_count;
-    const char*          next              = NULL;  //   For logging
+    const char*          next              = data;
+    const char*          last;
     CB_OnWSTResponse     parser            = NULL;
-    CB_OnWSTResponse     def_parser        = NULL;
-    BOOL                 have_tags         = FALSE;
     BOOL                 more_data_needed  = FALSE;
-    int                  buffer_size;
-    int                  i;
     roadmap_result		 rc						= succeeded;
+    const wst_parser_table* table;
 
-   waze_assert(parsers);
-   waze_assert(parsers_count);
+    waze_assert(cd.callback.parsers);
+    waze_assert(cd.callback.parser_count);
 
-    // Select default parser:
-    for( i=0; i<parsers_count; i++)
+    // Looked up on each call: the tables are shared, and another set may
+    // replace this one while the rest of the response is awaited
+    table = wst_parser_table_get(cd.callback.parsers, cd.callback.parser_count);
+    if (!table)
     {
-       if( parsers[i].tag && parsers[i].tag[0])
-          have_tags = TRUE;
-       else
-       {
-          def_parser= parsers[i].parser;
-          break;
-       }
+        cd.parseResult = err_no_memory;
+        return 0;
     }
 
-    //   As long as we have data - keep on parsing:
-
-    QString data = QString::fromUtf8(response);
-    data.replace(QString("\\n"), QString("\n"), Qt::CaseInsensitive)
-        .replace(QString("\\r"), QString("\r"), Qt::CaseInsensitive)
-        .replace(QString("\\t"), QString("\t"), Qt::CaseInsensitive);
+    roadmap_log(ROADMAP_DEBUG, "Response:\n%s\n", data);
 
-    std::string dataStr = data.toUtf8().constData();
-    next = dataStr.c_str();
-    roadmap_log(ROADMAP_INFO, "Response:\n%s\n", qPrintable(data));
+    //   As long as we have data - keep on parsing:
     while(next != NULL && next[0] != '\0')
     {
         uint tagEndIndex = 0;
 
-       if( have_tags)
+        last = next;
+
+       if( table->have_tags)
        {
           //   Read next tag:
-          buffer_size = WST_RESPONSE_TAG_MAXSIZE;
-          while (next[tagEndIndex] != ',' && next[tagEndIndex] != '\r' && next[tagEndIndex] != '\n')
+          while (next[tagEndIndex] != ',' && next[tagEndIndex] != '\r' && next[tagEndIndex] != '\n' && next[tagEndIndex] != '\0')
           {
               tagEndIndex++;
           }
 
           //   Find parser:
-          parser = NULL;
-          for( i=0; i<parsers_count; i++)
-          {
-              if (parsers[i].tag != NULL && qstrlen(parsers[i].tag) == tagEndIndex && !qstrnicmp(parsers[i].tag, next, tagEndIndex))
-              {
-                parser = parsers[i].parser;
-                break;
-              }
-          }
+          parser = wst_parser_table_find(table, next, tagEndIndex);
        }
 
        if (parser)
        {
-           next = next + tagEndIndex + 1;
+           next = next + tagEndIndex;
+           if (next[0] != '\0') next++;
        }
        else
        {
-          if( def_parser)
+          if( table->def_parser)
           {
-             parser = def_parser;
+             parser = table->def_parser;
           }
           else
           {
-              roadmap_log( ROADMAP_ERROR, "runParsersAndCallback() - Did not find parser for tag '%s'", tag.toAscii().data());
-//             rc = trans_failed;   //   Quit the 'receive' loop
-             break;
+              roadmap_log( ROADMAP_ERROR, "runParsers() - Did not find parser for tag '%.*s'", tagEndIndex, next);
+              cd.parseResult = err_parser_missing_tag_handler;
+              return next - data;
           }
        }
 
        //   Activate the appropriate server-request handler function:
+       more_data_needed = FALSE;
        next = parser(next, cd.context, &more_data_needed, &rc);
-       while (next != NULL && (next[0] == '\r' || next[0] == '\n')) next++;
+       if (next == NULL)
+       {
+           cd.parseResult = (rc == succeeded)? err_failed : rc;
+           return last - data;
+       }
+       if (more_data_needed && !final)
+       {
+           return last - data;
+       }
+       while (next[0] == '\r' || next[0] == '\n') next++;
      }
 
-     cd.callback.callback(cd.context, result);
-     roadmap_log( ROADMAP_INFO, "runParsersAndCallback() - succeeded");
-     return;
+     return next - data;
+}
+
+/*
+ * Takes the response body as it is inflated. Parsed responses are unescaped
+ * in place and handed to the parsers one complete line at a time, so only
+ * the current line is kept.
+ */
+void WazeWebAccessor::consumeData(HttpAsyncContext& cd, const char* data, int length)
+{
+    if (cd.type == ProgressBased)
+    {
+        if (cd.stream && cd.statusCode == 200)
+        {
+            if (length > 0)
+            {
+                cd.callback.callbacks->progress(cd.context, data, length);
+            }
+        }
+        else
+        {
+            cd.bytes->append(data, length);
+        }
+        return;
+    }
+
+    // After a parser failed, the rest of the response is ignored
+    if (cd.parseResult != succeeded || length <= 0) return;
+
+    int from = cd.pending->length() - ((cd.escape)? 1 : 0);
+    cd.pending->append(data, length);
+
+    //   Replace the "\n", "\r" and "\t" escapes:
+    char* buffer = cd.pending->data();
+    int size = cd.pending->length();
+    int out = from;
+    int in = from;
+    while (in < size)
+    {
+        if (buffer[in] == '\\' && in + 1 < size)
+        {
+            char c = buffer[in + 1] | 0x20;
+            if (c == 'n' || c == 'r' || c == 't')
+            {
+                buffer[out++] = (c == 'n')? '\n' : (c == 'r')? '\r' : '\t';
+                in += 2;
+                continue;
+            }
+        }
+        buffer[out++] = buffer[in++];
+    }
+    cd.pending->truncate(out);
+    cd.escape = (out > 0 && out > from && cd.pending->at(out - 1) == '\\');
+
+    //   Parse up to the last complete line:
+    int end = cd.pending->lastIndexOf('\n');
+    if (end < from) return;
+    end++;
+
+    buffer = cd.pending->data();
+    char saved = buffer[end];
+    buffer[end] = '\0';
+    int parsed = runParsers(cd, buffer, false);
+    buffer[end] = saved;
+
+    cd.pending->remove(0, parsed);
+}
+
+/*
+ * Takes the response body as it arrives, inflating it if needed.
+ */
+void WazeWebAccessor::receiveData(HttpAsyncContext& cd, const char* data, int length)
+{
+    if (!cd.inflater)
+    {
+        consumeData(cd, data, length);
+        return;
+    }
+
+    char uncompressedBlock[UNCOMPRESSED_BLOCK_LENGTH];
+
+    while (cd.inflater)
+    {
+        int compressedDataSize;
+        void* compressedData = NULL;
+        int received;
+
+        roadmap_http_comp_get_buffer(cd.inflater, &compressedData, &compressedDataSize);
+        if (compressedDataSize > length)
+        {
+            compressedDataSize = length;
+        }
+        qMemCopy(compressedData, data, compressedDataSize);
+        roadmap_http_comp_add_data(cd.inflater, compressedDataSize);
+        data += compressedDataSize;
+        length -= compressedDataSize;
+
+        while ((received = roadmap_http_comp_read(cd.inflater, uncompressedBlock, UNCOMPRESSED_BLOCK_LENGTH)) != 0)
+        {
+            if (received < 0)
+            {
+                roadmap_log (ROADMAP_DEBUG, "Error in recv. - comp returned %d", received);
+                roadmap_http_comp_close(cd.inflater);
+                cd.inflater = NULL;
+                break;
+            }
+
+            // The inflater repeats the http header first
+            int skip = (received < cd.headerSkip)? received : cd.headerSkip;
+            cd.headerSkip -= skip;
+            consumeData(cd, uncompressedBlock + skip, received - skip);
+        }
+
+        if (length == 0) break;
+
+        if (cd.inflater && compressedDataSize == 0)
+        {
+            roadmap_log (ROADMAP_ERROR, "Response header does not fit the inflate buffer");
+            roadmap_http_comp_close(cd.inflater);
+            cd.inflater = NULL;
+        }
+    }
 }
 
 HttpAsyncContext* WazeWebAccessor::getRequest(QString url, int flags, RoadMapHttpAsyncCallbacks *callbacks, time_t update_time, void* context)
@@ -316,23 +583,22 @@ HttpAsyncContext* WazeWebAccessor::getRequest(QString url, int flags, RoadMapHtt
     cd->receivedBytes = 0;
     cd->sentBytes = 0;
     cd->ignoreContentLength = flags & HTTPCOPY_FLAG_IGNORE_CONTENT_LEN;
+    cd->stream = flags & HTTPCOPY_FLAG_STREAM;
     cd->statusCode = 0;
     cd->bytes = new QByteArray();
-    cd->buffer = new QBuffer(cd->bytes);
-    cd->buffer->open(QIODevice::WriteOnly);
     cd->url = encodedUrl;
     cd->decompress = false;
     cd->requestHeader = header;
-    cd->responseHeader = NULL;
     cd->requestData = new QByteArray();
+    cd->inflater = NULL;
+    cd->headerSkip = 0;
+    cd->pending = NULL;
+    cd->escape = false;
+    cd->parseResult = succeeded;
 
     _requestQueue.push_back(*cd);
 
-    int requestNum = _requestQueue.length();
-    if (0 < requestNum && requestNum <= MAX_CONNECTIONS)
-    {
-        emit requestDone();
-    }
+    emit requestDone();
 
     return cd;
 }
@@ -377,96 +643,98 @@ bool WazeWebAccessor::postRequestProgress(QString url, int flags, RoadMapHttpAsy
     cd.receivedBytes = 0;
     cd.sentBytes = 0;
     cd.ignoreContentLength = flags & HTTPCOPY_FLAG_IGNORE_CONTENT_LEN;
+    cd.stream = flags & HTTPCOPY_FLAG_STREAM;
     cd.statusCode = 0;
     cd.bytes = new QByteArray();
-    cd.buffer = new QBuffer(cd.bytes);
-    cd.buffer->open(QIODevice::WriteOnly);
     cd.url = encodedUrl;
     cd.decompress = false;
     cd.requestHeader = header;
-    cd.responseHeader = NULL;
     cd.requestData = new QByteArray(ba);
+    cd.inflater = NULL;
+    cd.headerSkip = 0;
+    cd.pending = NULL;
+    cd.escape = false;
+    cd.parseResult = succeeded;
 
     _requestQueue.push_back(cd);
 
-    int requestNum = _requestQueue.length();
-    if (0 < requestNum && requestNum <= MAX_CONNECTIONS)
+    emit requestDone();
+
+    return true;
+}
+
+void WazeWebAccessor::requestStarted(int id)
+{
+    QHttp* http = static_cast<QHttp*>(sender());
+
+    if (!_activeRequests.contains(qMakePair(http, id))) return;
+
+    // Requests of a connection run one after the other, so this is the next response
+    _connections[http].socket->startResponse();
+}
+
+void WazeWebAccessor::requestFinished(int id, bool isError)
+{
+    QHttp* http = static_cast<QHttp*>(sender());
+    WazeRequestKey key = qMakePair(http, id);
+
+    // setHost() is a request too
+    if (!_activeRequests.contains(key)) return;
+
+    HttpAsyncContext cd = _activeRequests.take(key);
+
+    WazeConnection& connection = _connections[http];
+    connection.pending--;
+    connection.idle.start();
+    if (isError)
     {
-        emit requestDone();
-        return true;
+        connection.broken = true;
     }
 
-    return false;
+    finishRequest(http, cd, isError);
+
+    emit requestDone();
 }
 
-void WazeWebAccessor::oldStyleFinished(bool isError)
+void WazeWebAccessor::connectionDone(bool isError)
 {
     QHttp* http = static_cast<QHttp*>(sender());
-    disconnect(http, SIGNAL(done(bool)), this, SLOT(oldStyleFinished(bool)));
-    disconnect(http, SIGNAL(dataSendProgress(int,int)), this, SLOT(requestBytesWrittenOld(int,int)));
-    disconnect(http, SIGNAL(dataReadProgress(int,int)), this, SLOT(responseBytesReadOld(int,int)));
-    disconnect(http, SIGNAL(sslErrors(QList<QSslError>)), this, SLOT(onIgnoreSSLErrors(QList<QSslError>)));
-    disconnect(http, SIGNAL(responseHeaderReceived(QHttpResponseHeader)), this, SLOT(responseHeaderReceived(QHttpResponseHeader)));
 
-    if (!_oldStyleConnectionDataHash.contains(http))
+    if (!isError || !_connections.contains(http)) return;
+
+    // QHttp drops the requests queued behind a failed one, send them again
+    QList<int> dropped;
+    foreach (const WazeRequestKey& key, _activeRequests.keys())
+    {
+        if (key.first == http) dropped.append(key.second);
+    }
+    qSort(dropped);
+
+    for (int i = dropped.size() - 1; i >= 0; i--)
     {
-        roadmap_log(ROADMAP_ERROR, "Bad http request index in the queue, ignoring this request");
-        http->close();
-        http->deleteLater();
+        HttpAsyncContext cd = _activeRequests.take(qMakePair(http, dropped[i]));
+        cd.http = NULL;
+        cd.receivedBytes = 0;
+        cd.sentBytes = 0;
+        _requestQueue.prepend(cd);
         roadmap_net_mon_disconnect();
-        return;
     }
 
-    HttpAsyncContext& cd = _oldStyleConnectionDataHash[http];
+    closeConnection(http);
+
+    emit requestDone();
+}
 
+void WazeWebAccessor::finishRequest(QHttp* http, HttpAsyncContext& cd, bool isError)
+{
     int statusCode = cd.statusCode;
 
     roadmap_log(ROADMAP_INFO, "Response receive finished for (%s)", cd.url.toString().toAscii().constData());
 
-    QByteArray response;
-
-    if (cd.decompress)
-    {
-        char uncompressedBlock[UNCOMPRESSED_BLOCK_LENGTH];
-        QByteArray compressedResponse = *cd.bytes;
-        compressedResponse.prepend(*cd.responseHeader);
-        RoadMapHttpCompCtx compressContext = roadmap_http_comp_init();
-        int length = compressedResponse.length();
-        int blockRead = 0;
-        do
-        {
-            int compressedDataSize;
-            void* compressedData = NULL;
-            roadmap_http_comp_get_buffer(compressContext, &compressedData, &compressedDataSize);
-            qMemCopy(compressedData, compressedResponse.constData() + blockRead, compressedDataSize);
-            roadmap_http_comp_add_data(compressContext, compressedDataSize);
-            blockRead += compressedDataSize;
-
-            int received = 0;
-            while ((received = roadmap_http_comp_read(compressContext, uncompressedBlock, UNCOMPRESSED_BLOCK_LENGTH))
-                   != 0) {
-                if (received < 0) {
-                    roadmap_log (ROADMAP_DEBUG, "Error in recv. - comp returned %d", received);
-                    break;
-                }
-                else
-                {
-                    response.append(uncompressedBlock, received);
-                }
-            }
-        } while (blockRead < length);
-
-        roadmap_http_comp_close(compressContext);
-
-        if (response.startsWith(WazeSocket::HTTP.toAscii()))
-        {
-            int index = response.indexOf(WazeSocket::DATA_DELIMITER);
-            response.remove(0, index + WazeSocket::DATA_DELIMITER_LENGTH);
-        }
-    }
-    else
+    if (http->bytesAvailable() > 0)
     {
-        response = *cd.bytes;
+        QByteArray data = http->readAll();
+        receiveData(cd, data.constData(), data.length());
     }
 
     switch (cd.type)
@@ -477,14 +745,31 @@ void WazeWebAccessor::oldStyleFinished(bool isError)
             roadmap_log(ROADMAP_ERROR ,"Error during request (HTTP StatusCode: %d, Qt Error String: %s)", statusCode, http->errorString().toAscii().constData());
         }
 
-        runParsersAndCallback(cd, response, (isError)? err_net_failed : succeeded);
+        //   Parse what is left, which may be a last line without a newline:
+        if (cd.parseResult == succeeded && !cd.pending->isEmpty())
+        {
+            runParsers(cd, cd.pending->data(), true);
+        }
+
+        if (cd.parseResult == err_no_memory)
+        {
+            cd.callback.callback(cd.context, err_no_memory);
+        }
+        else
+        {
+            cd.callback.callback(cd.context, (isError)? err_net_failed : succeeded);
+            roadmap_log( ROADMAP_INFO, "runParsers() - succeeded");
+        }
         break;
     case ProgressBased:
         if (!isError && statusCode == 200)
         {
-            cd.callback.callbacks->progress(cd.context, NULL, 0);
-            cd.callback.callbacks->size(cd.context, response.length());
-            cd.callback.callbacks->progress(cd.context, response.constData(), response.length() );
+            if (!cd.stream)
+            {
+                cd.callback.callbacks->progress(cd.context, NULL, 0);
+                cd.callback.callbacks->size(cd.context, cd.bytes->length());
+                cd.callback.callbacks->progress(cd.context, cd.bytes->constData(), cd.bytes->length() );
+            }
             cd.callback.callbacks->done(cd.context, getTimeStr(QDateTime::currentDateTime()), NULL);
         }
         else
@@ -495,45 +780,43 @@ void WazeWebAccessor::oldStyleFinished(bool isError)
         break;
     }
 
-    delete cd.responseHeader;
+    roadmap_net_mon_request_done(cd.reused, cd.firstByteMsec, cd.started.elapsed());
+
+    if (cd.inflater)
+    {
+        roadmap_http_comp_close(cd.inflater);
+    }
+    delete cd.pending;
     delete cd.bytes;
-    cd.buffer->deleteLater();
     delete cd.requestData;
-    _oldStyleConnectionDataHash.remove(http);
-    http->close();
-    http->deleteLater();
 
     roadmap_net_mon_disconnect();
-
-    emit requestDone();
 }
 
 void WazeWebAccessor::requestBytesWrittenOld(int bytesSent, int bytesTotal)
 {
-    QHttp* http = static_cast<QHttp*>(sender());
+    HttpAsyncContext* cd = currentRequest(static_cast<QHttp*>(sender()));
 
-    if (!_oldStyleConnectionDataHash.contains(http)) return;
+    if (cd == NULL) return;
 
-    HttpAsyncContext& cd = _oldStyleConnectionDataHash[http];
-    int bytes = bytesSent - cd.sentBytes;
+    int bytes = bytesSent - cd->sentBytes;
     if (bytes <= 0)
         return;
     roadmap_net_mon_send(bytes);
-    cd.sentBytes = bytesSent;
+    cd->sentBytes = bytesSent;
 }
 
 void WazeWebAccessor::responseBytesReadOld(int bytesReceived, int bytesTotal)
 {
-    QHttp* http = static_cast<QHttp*>(sender());
+    HttpAsyncContext* cd = currentRequest(static_cast<QHttp*>(sender()));
 
-    if (!_oldStyleConnectionDataHash.contains(http)) return;
+    if (cd == NULL) return;
 
-    HttpAsyncContext& cd = _oldStyleConnectionDataHash[http];
-    int bytes = bytesReceived - cd.receivedBytes;
+    int bytes = bytesReceived - cd->receivedBytes;
     if (bytes <= 0)
         return;
     roadmap_net_mon_recv(bytes);
-    cd.receivedBytes = bytesReceived;
+    cd->receivedBytes = bytesReceived;
 }
 
 void WazeWebAccessor::onIgnoreSSLErrors(QList<QSslError> errorList)
@@ -550,14 +833,34 @@ char* WazeWebAccessor::getTimeStr(QDateTime time)
 }
 
 void WazeWebAccessor::responseHeaderReceived(const QHttpResponseHeader &resp)
+{
+    HttpAsyncContext* cd = currentRequest(static_cast<QHttp*>(sender()));
+
+    if (cd == NULL) return;
+
+    cd->statusCode = resp.statusCode();
+    cd->decompress = resp.value("Content-Encoding").compare("gzip") == 0;
+    cd->firstByteMsec = cd->started.elapsed();
+
+    if (cd->decompress && !cd->inflater)
+    {
+        // The inflater reads the gzip flag from the header, and repeats it
+        QByteArray header = resp.toString().toAscii();
+
+        cd->inflater = roadmap_http_comp_init();
+        cd->headerSkip = header.indexOf(WazeSocket::DATA_DELIMITER.toAscii()) + WazeSocket::DATA_DELIMITER_LENGTH;
+        receiveData(*cd, header.constData(), header.length());
+    }
+    roadmap_log(ROADMAP_INFO, "Received status code %d for (%s)", cd->statusCode, cd->url.toString().toAscii().constData());
+}
+
+void WazeWebAccessor::responseDataReady(const QHttpResponseHeader &resp)
 {
     QHttp* http = static_cast<QHttp*>(sender());
+    HttpAsyncContext* cd = currentRequest(http);
+    QByteArray data = http->readAll();
 
-    if (!_oldStyleConnectionDataHash.contains(http)) return;
+    if (cd == NULL) return;
 
-    HttpAsyncContext& cd = _oldStyleConnectionDataHash[http];
-    cd.statusCode = resp.statusCode();
-    cd.decompress = resp.value("Content-Encoding").compare("gzip") == 0;
-    cd.responseHeader = new QByteArray(resp.toString().toAscii());
-    roadmap_log(ROADMAP_INFO, "Received status code %d for (%s)", cd.statusCode, cd.url.toString().toAscii().constData());
+    receiveData(*cd, data.constData(), data.length());
 }
@@ -7,12 +7,17 @@
 #include <QBuffer>
 #include <QQueue>
 #include <QTimer>
+#include <QTime>
+#include <QPair>
 #include <QUrl>
 
+class WazeSocket;
+
 extern "C" {
 #include "Realtime/RealtimeNetDefs.h"
 #include "websvc_trans/websvc_trans_defs.h"
 #include "roadmap_httpcopy_async.h"
+#include "roadmap_http_comp.h"
 }
 
 enum CallbackType { ParserBased, ProgressBased };
@@ -26,17 +31,27 @@ struct HttpAsyncContext_st
     bool isSecured;
     bool isPost;
     bool ignoreContentLength;
+    bool stream;            // ProgressBased: the body goes to the progress callback as it arrives
     qint64 sentBytes;
     qint64 receivedBytes;
-    QBuffer* buffer;
     int statusCode;
-    QByteArray* bytes;
+    QByteArray* bytes;      // the whole response, for ProgressBased requests that do not stream
     QUrl url;
     bool decompress;
     QHttpRequestHeader requestHeader;
-    QByteArray* responseHeader;
     QByteArray* requestData;
 
+    // Response stream: inflated, then unescaped and parsed line by line
+    RoadMapHttpCompCtx inflater;
+    int headerSkip;         // inflater output that is still the http header
+    QByteArray* pending;    // unparsed data, at most a line and a chunk
+    bool escape;            // pending ends with a backslash
+    roadmap_result parseResult;
+
+    bool reused;            // sent on a connection that was already open
+    QTime started;
+    int firstByteMsec;
+
     union {
         struct {
             CB_OnWSTCompleted callback;
@@ -47,6 +62,19 @@ struct HttpAsyncContext_st
     } callback;
 };
 
+// A request is known by its connection and its QHttp id
+typedef QPair<QHttp*, int> WazeRequestKey;
+
+struct WazeConnection
+{
+    QHttp* http;
+    WazeSocket* socket;
+    QString key;            // scheme, host and port
+    int pending;            // requests queued on the connection
+    bool broken;
+    QTime idle;             // since the last request finished
+};
+
 class WazeWebAccessor : public QObject
 {
 Q_OBJECT
@@ -86,22 +114,36 @@ signals:
 
 private slots:
     void responseHeaderReceived(const QHttpResponseHeader &resp);
+    void responseDataReady(const QHttpResponseHeader &resp);
     void onIgnoreSSLErrors(QList<QSslError> errorList);
-    void oldStyleFinished(bool isError);
+    void requestStarted(int id);
+    void requestFinished(int id, bool isError);
+    void connectionDone(bool isError);
     void requestBytesWrittenOld(int bytesSent, int bytesTotal);
     void responseBytesReadOld(int bytesReceived, int bytesTotal);
     void invokeNextRequest();
+    void closeIdleConnections();
 
 private:
     explicit WazeWebAccessor(QObject* parent = 0);
 
     QString buildHeader(RequestType type, QUrl url, QString additional = QString());
 
-    void runParsersAndCallback(HttpAsyncContext& cd, QByteArray &response, roadmap_result result);
+    void receiveData(HttpAsyncContext& cd, const char* data, int length);
+    void consumeData(HttpAsyncContext& cd, const char* data, int length);
+    int runParsers(HttpAsyncContext& cd, char* data, bool final);
+
+    QHttp* getConnection(const HttpAsyncContext& request);
+    QHttp* openConnection(const HttpAsyncContext& request, const QString& key);
+    void closeConnection(QHttp* http);
+    void sendRequest(QHttp* http, HttpAsyncContext& request);
+    void finishRequest(QHttp* http, HttpAsyncContext& cd, bool isError);
+    HttpAsyncContext* currentRequest(QHttp* http);
 
     char* getTimeStr(QDateTime time);
 
-    QHash<QHttp*, HttpAsyncContext> _oldStyleConnectionDataHash;
+    QHash<QHttp*, WazeConnection> _connections;
+    QHash<WazeRequestKey, HttpAsyncContext> _activeRequests;
     QQueue<HttpAsyncContext> _requestQueue;
     QString _address;
     QString _securedAddress;
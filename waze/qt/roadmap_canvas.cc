@@ -31,11 +31,15 @@ extern "C" {
 #include "roadmap_gui.h"
 
 #include "roadmap_canvas.h"
+#include "roadmap_screen.h"
 }
 
 #include <QImage>
+#include <QImageReader>
 #include <QGraphicsScene>
 #include <QFile>
+#include <QRunnable>
+#include <QThreadPool>
 #include "qt_canvas.h"
 
 
@@ -100,6 +104,12 @@ void roadmap_canvas_get_formated_text_extents
     roadMapCanvas->getTextExtents(text, width, ascent, descent, can_tilt);
 }
 
+void roadmap_canvas_trim_text_cache (int all) {
+    if (roadMapCanvas) {
+       roadMapCanvas->trimTextLayouts(all);
+    }
+}
+
 RoadMapPen roadmap_canvas_create_pen (const char *name) {
    return roadMapCanvas->createPen(name);
 }
@@ -220,6 +230,11 @@ int roadmap_canvas_height (void) {
 }
 
 
+void roadmap_canvas_begin_frame (void) {
+   roadMapCanvas->beginFrame();
+}
+
+
 void roadmap_canvas_refresh (void) {
    roadMapCanvas->refresh();
 }
@@ -240,6 +255,10 @@ int  roadmap_canvas_image_width  (const RoadMapImage image) {
         return 0;
     }
 
+    if (image->size.isValid()) {
+        return image->size.width();
+    }
+
     return (image->image->width())? image->image->width() : 1;
 }
 
@@ -248,9 +267,137 @@ int  roadmap_canvas_image_height (const RoadMapImage image) {
         return 0;
     }
 
+    if (image->size.isValid()) {
+        return image->size.height();
+    }
+
     return (image->image->height())? image->image->height() : 1;
 }
 
+class RMapImageTask : public QRunnable {
+public:
+    RMapImageTask(RMapImageLoader *loader, RMapImageJob *job) :
+        _loader(loader), _job(job), _path(job->path) {}
+
+    void run() {
+        QImage decoded(_path);
+
+        _job->lock.lock();
+        _job->decoded = decoded;
+        _job->done = true;
+        _job->decodedCondition.wakeAll();
+        _job->lock.unlock();
+
+        QMetaObject::invokeMethod(_loader, "imageDecoded", Qt::QueuedConnection,
+                                  Q_ARG(void*, _job));
+    }
+
+private:
+    RMapImageLoader *_loader;
+    RMapImageJob *_job;
+    QString _path;
+};
+
+static RMapImageLoader *imageLoader = NULL;
+
+/* The pixels were released, see roadmap_canvas_image_unload() */
+static bool isUnloaded(RoadMapImage image)
+{
+    return image->size.isValid();
+}
+
+RMapImageLoader::RMapImageLoader(QObject *parent) :
+    QObject(parent)
+{
+}
+
+void RMapImageLoader::load(RoadMapImage image)
+{
+    RMapImageJob *job = new RMapImageJob;
+    job->image = image;
+    job->path = image->full_path;
+    job->done = false;
+    image->job = job;
+
+    QThreadPool::globalInstance()->start(new RMapImageTask(this, job));
+}
+
+void RMapImageLoader::complete(RoadMapImage image)
+{
+    RMapImageJob *job = image->job;
+
+    if (job == NULL) {
+        if (isUnloaded(image)) {
+            *(image->image) = QImage(image->full_path);
+            image->size = QSize();
+        }
+        return;
+    }
+
+    /* wait for the worker rather than decoding the file again */
+    job->lock.lock();
+    while (!job->done) {
+        job->decodedCondition.wait(&job->lock);
+    }
+    QImage decoded = job->decoded;
+    job->lock.unlock();
+
+    cancel(image);
+    if (!decoded.isNull()) {
+        *(image->image) = decoded;
+        image->size = QSize();
+    }
+}
+
+bool RMapImageLoader::ready(RoadMapImage image)
+{
+    if (image->job != NULL) {
+        return false;
+    }
+
+    if (isUnloaded(image)) {
+        if (imageLoader == NULL) {
+            imageLoader = new RMapImageLoader();
+        }
+        imageLoader->load(image);
+        return false;
+    }
+
+    return true;
+}
+
+void RMapImageLoader::cancel(RoadMapImage image)
+{
+    if (image->job != NULL) {
+        /* the job is deleted when the worker is done with it */
+        image->job->image = NULL;
+        image->job = NULL;
+    }
+}
+
+void RMapImageLoader::imageDecoded(void *p)
+{
+    RMapImageJob *job = (RMapImageJob *) p;
+    RoadMapImage image = job->image;
+    QImage decoded = job->decoded;
+
+    delete job;
+
+    if (image == NULL) {
+        return;
+    }
+
+    image->job = NULL;
+    image->size = QSize();
+    if (decoded.isNull()) {
+        roadmap_log (ROADMAP_ERROR, "Cannot decode image %s", image->full_path.toLocal8Bit().data());
+        return;
+    }
+
+    *(image->image) = decoded;
+    roadmap_screen_redraw ();
+}
+
 RoadMapImage roadmap_canvas_load_image (const char *path,
                                         const char* file_name) {
     QString qPath = QString(path).append("/").append(file_name);
@@ -262,8 +409,41 @@ RoadMapImage roadmap_canvas_load_image (const char *path,
         image = new roadmap_canvas_image;
         image->full_path = file.fileName();
         image->image = new QImage(image->full_path);
+        image->job = NULL;
+    }
+
+    return image;
+}
+
+RoadMapImage roadmap_canvas_load_image_async (const char *path,
+                                              const char* file_name) {
+    QString qPath = QString(path).append("/").append(file_name);
+    QFile file(qPath);
+
+    if (!file.exists())
+    {
+        return NULL;
+    }
+
+    /* the header gives the size of the placeholder */
+    QSize size = QImageReader(file.fileName()).size();
+    if (!size.isValid())
+    {
+        return roadmap_canvas_load_image (path, file_name);
     }
 
+    RoadMapImage image = new roadmap_canvas_image;
+    image->full_path = file.fileName();
+    image->image = new QImage(size, QImage::Format_ARGB32_Premultiplied);
+    image->image->fill(0);
+    image->job = NULL;
+
+    if (imageLoader == NULL)
+    {
+        imageLoader = new RMapImageLoader();
+    }
+    imageLoader->load(image);
+
     return image;
 }
 
@@ -318,6 +498,7 @@ RoadMapImage roadmap_canvas_new_image (int width, int height) {
     RoadMapImage image = new roadmap_canvas_image;
     image->full_path = QString("");
     image->image = new QImage(width, height, QImage::Format_ARGB32);
+    image->job = NULL;
     return image;
 }
 
@@ -331,6 +512,8 @@ void roadmap_canvas_copy_image (RoadMapImage dst_image,
         return;
     }
 
+    RMapImageLoader::complete(src_image);
+
     QRect copyRect(0, 0, src_image->image->width(), src_image->image->height());
 
     if (pos) {
@@ -368,10 +551,12 @@ RoadMapImage roadmap_canvas_image_from_buf( unsigned char* buf, int width, int h
     RoadMapImage image = new roadmap_canvas_image;
     image->full_path = QString("");
     image->image = new QImage(buf, width, height, QImage::Format_ARGB32);
+    image->job = NULL;
     return image;
 }
 
 void roadmap_canvas_free_image (RoadMapImage image) {
+    RMapImageLoader::cancel(image);
     delete image->image;
     delete image;
 }
@@ -385,6 +570,20 @@ void roadmap_canvas_image_invalidate( RoadMapImage image ) {
     /* TODO */
 }
 
+int roadmap_canvas_image_unload( RoadMapImage image ) {
+
+    if (image == NULL || image->full_path.isEmpty() || isUnloaded(image) ||
+        image->image->isNull()) {
+        return 0;
+    }
+
+    RMapImageLoader::cancel(image);
+
+    image->size = image->image->size();
+    *(image->image) = QImage();
+    return 1;
+}
+
 void roadmap_canvas_unmanaged_list_add( RoadMapImage image ) {
     /* TODO */
 }
@@ -50,60 +50,54 @@ static QString roadmap_config_property_name(RoadMapConfigDescriptor *descriptor)
     return QString("%1/%2").arg(qCategory).arg(qName);
 }
 
-static QVariant roadmap_config_get_variant(RoadMapConfigDescriptor* descriptor)
+static RoadMapConfigItem* roadmap_config_get_item(RoadMapConfigDescriptor* descriptor)
 {
-    QString itemName = roadmap_config_property_name(descriptor);
-    RoadMapConfigItem* item = config->getConfigItem(itemName);
-
-    if (item == NULL)
+    if (descriptor->reference == NULL)
     {
-        return QVariant();
+        QString itemName = roadmap_config_property_name(descriptor);
+        descriptor->reference = config->getConfigItem(itemName);
+
+        if (descriptor->reference == NULL)
+        {
+            return NULL;
+        }
     }
-    descriptor->reference = item;
 
-    QSettings* settings = config->getSettings(descriptor->reference->file);
-    if (settings == NULL)
+    if (!descriptor->reference->cached)
     {
-        return QVariant();
+        config->loadItem(descriptor->reference);
     }
+    return descriptor->reference;
+}
 
-    settings->beginGroup(descriptor->category);
-    QVariant value = settings->value(descriptor->name);
-    settings->endGroup();
+static QVariant roadmap_config_get_variant(RoadMapConfigDescriptor* descriptor)
+{
+    RoadMapConfigItem* item = roadmap_config_get_item(descriptor);
 
-    if (value.isNull())
+    if (item == NULL)
     {
-//        qDebug("Config not found, will use default: %s, %s/%s",
-//               descriptor->reference->file.toLocal8Bit().data(),
-//               descriptor->category,
-//               descriptor->name);
-        value = descriptor->reference->default_value;
+        return QVariant();
     }
-    return value;
+    return item->value;
 }
 
 void  roadmap_config_set_variant (RoadMapConfigDescriptor *descriptor, QVariant value)
 {
-    QString itemName = roadmap_config_property_name(descriptor);
-    descriptor->reference = config->getConfigItem(itemName);
+    RoadMapConfigItem* item = roadmap_config_get_item(descriptor);
 
-    if (descriptor->reference == NULL)
+    if (item == NULL)
     {
         return;
     }
 
-    QSettings* settings = config->getSettings(descriptor->reference->file);
-    settings->beginGroup(descriptor->category);
-    bool changed = (value != settings->value(descriptor->name));
+    bool changed = !item->stored || (value != item->value);
     if (changed)
     {
-        settings->setValue(descriptor->name, value);
+        config->setItem(item, value);
     }
-    settings->endGroup();
-    descriptor->reference->strValue = value.toString();
-    if (changed && descriptor->reference->callback != NULL)
+    if (changed && item->callback != NULL)
     {
-        descriptor->reference->callback();
+        item->callback();
     }
 }
 
@@ -122,6 +116,9 @@ void roadmap_config_declare
         item->name = descriptor->name;
         item->category = descriptor->category;
         item->callback = NULL;
+        item->cached = false;
+        item->stored = false;
+        item->dirty = false;
         config->addConfigItem(qFile, configName, item);
     }
     descriptor->reference = item;
@@ -130,6 +127,7 @@ void roadmap_config_declare
     if (descriptor->reference->default_value.isNull())
     {
         descriptor->reference->default_value = QVariant(QString::fromLocal8Bit(default_value));
+        descriptor->reference->cached = false;
     }
     descriptor->reference->file = qFile;
 }
@@ -305,14 +303,13 @@ int   roadmap_config_get_type (RoadMapConfigDescriptor *descriptor)
 
 const char *roadmap_config_get (RoadMapConfigDescriptor *descriptor)
 {
-    QVariant value = roadmap_config_get_variant(descriptor);
-    if (value.isNull())
+    RoadMapConfigItem* item = roadmap_config_get_item(descriptor);
+    if (item == NULL || item->value.isNull())
     {
         return "";
     }
 
-    descriptor->reference->strValue = value.toString();
-    return descriptor->reference->strValue.getStr();
+    return item->strValue.getStr();
 }
 
 void roadmap_config_set
@@ -343,17 +340,13 @@ int roadmap_config_get_list (RoadMapConfigDescriptor *descriptor, const char* de
 
 int   roadmap_config_get_integer (RoadMapConfigDescriptor *descriptor)
 {
-    QVariant value = roadmap_config_get_variant(descriptor);
-    bool isOk;
-
-    int intValue = value.toInt(&isOk);
-
-    if (!isOk)
+    RoadMapConfigItem* item = roadmap_config_get_item(descriptor);
+    if (item == NULL)
     {
         return 0;
     }
 
-    return intValue;
+    return item->intValue;
 }
 
 void  roadmap_config_set_integer (RoadMapConfigDescriptor *descriptor, int x)
@@ -364,8 +357,9 @@ void  roadmap_config_set_integer (RoadMapConfigDescriptor *descriptor, int x)
 int   roadmap_config_match
         (RoadMapConfigDescriptor *descriptor, const char *text)
 {
-    QVariant value = roadmap_config_get_variant(descriptor);
-    return value.toString().compare(QString::fromLocal8Bit(text), Qt::CaseInsensitive) == 0;
+    RoadMapConfigItem* item = roadmap_config_get_item(descriptor);
+    QString itemText = (item == NULL) ? QString() : item->text;
+    return itemText.compare(QString::fromLocal8Bit(text), Qt::CaseInsensitive) == 0;
 }
 
 BOOL  roadmap_config_get_position
@@ -378,10 +372,7 @@ BOOL  roadmap_config_get_position
         roadmap_config_declare("session", descriptor, "", NULL);
     }
 
-    QSettings* settings = config->getSettings(descriptor->reference->file);
-    settings->beginGroup(descriptor->category);
-    QString strPosition = settings->value(descriptor->name).toString();
-    settings->endGroup();
+    QString strPosition = roadmap_config_get_variant(descriptor).toString();
 
     if (strPosition.isEmpty() && !descriptor->reference->default_value.toString().isEmpty())
     {
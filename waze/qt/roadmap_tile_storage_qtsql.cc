@@ -56,9 +56,16 @@ typedef enum
 #define   RM_TILE_STORAGE_TILES_TABLE_DATA		"data"
 
 #define   RM_TILE_STORAGE_STMT_CREATE_TABLE		"CREATE TABLE IF NOT EXISTS tiles_table(id INTEGER PRIMARY KEY, data BLOB)"
-#define   RM_TILE_STORAGE_STMT_STORE		    "INSERT OR REPLACE INTO tiles_table values (%d,?);"
+#define   RM_TILE_STORAGE_STMT_STORE		    "INSERT OR REPLACE INTO tiles_table values (?,?);"
 #define   RM_TILE_STORAGE_STMT_LOAD		        "SELECT data FROM tiles_table WHERE id=?;"
 #define   RM_TILE_STORAGE_STMT_REMOVE	        "DELETE FROM tiles_table WHERE id=?;"
+#define   RM_TILE_STORAGE_STMT_ENUMERATE	    "SELECT id FROM tiles_table;"
+#define   RM_TILE_STORAGE_STMT_LOAD_BATCH	    "SELECT id, data FROM tiles_table WHERE id IN (%s);"
+#define   RM_TILE_STORAGE_STMT_CREATE_VERSIONS	"CREATE TABLE IF NOT EXISTS tiles_version(id INTEGER PRIMARY KEY, version INTEGER)"
+#define   RM_TILE_STORAGE_STMT_SET_VERSION	    "INSERT OR REPLACE INTO tiles_version values (?,?);"
+#define   RM_TILE_STORAGE_STMT_REMOVE_VERSION	"DELETE FROM tiles_version WHERE id=?;"
+#define   RM_TILE_STORAGE_STMT_ENUM_VERSIONS	"SELECT id, version FROM tiles_version;"
+#define   RM_TILE_STORAGE_BATCH_SIZE			32			// Tile ids bound to the batch load statement
 #define   RM_TILE_STORAGE_STMT_SYNC_OFF 		"PRAGMA synchronous = OFF"
 #define   RM_TILE_STORAGE_STMT_CNT_OFF			"PRAGMA count_changes = OFF"
 #define   RM_TILE_STORAGE_STMT_TMP_STORE_MEM	"PRAGMA temp_store = MEMORY"
@@ -68,16 +75,28 @@ typedef enum
 static int sgCurrentFips	= -1;			// Current fips - used to avoid database
 static BOOL sgTableExists   = FALSE;		// Indicates if the table exits ( in order to avoid unnecessary queries)
 static QSqlDatabase* sgSQLiteDb  = NULL;			// The current db handle
-static RMTileStorageConLifetime sgConLifetime = _con_lifetime_session;		// The type of connection lifetime
+static RMTileStorageConLifetime sgConLifetime = _con_lifetime_application;		// The type of connection lifetime
+static int sgDbFips = -1;				// The fips of the open connection
 
 static BOOL sgIsInTransaction = FALSE;
 static int  sgTransStmtsCount = 0;
 
+/*
+ * Prepared queries are kept while the connection is open
+ */
+static QSqlQuery* sgQueryStore = NULL;
+static QSqlQuery* sgQueryRemove = NULL;
+static QSqlQuery* sgQueryLoad = NULL;
+static QSqlQuery* sgQueryLoadBatch = NULL;
+static QSqlQuery* sgQuerySetVersion = NULL;
+static QSqlQuery* sgQueryRemoveVersion = NULL;
+
 #define check_sqlite_error( errstr, code ) \
 	check_sqlite_error_line( errstr, code, __LINE__ )
 
 static void trans_timeout( void );
 static void trans_commit( void );
+static void close_db( void );
 
 /***********************************************************/
 /*  Name        : roadmap_camera_image_capture()
@@ -163,6 +182,14 @@ static QSqlDatabase* get_db( int fips )
 
 	sgCurrentFips = fips;
 
+	/*
+	 * The connection is kept open, until the fips changes or the storage is shut down
+	 */
+	if ( sgSQLiteDb && sgDbFips != fips && !sgIsInTransaction )
+	{
+		close_db();
+		sgTableExists = FALSE;
+	}
 
 	if ( ( sgConLifetime == _con_lifetime_application || sgIsInTransaction ) && sgSQLiteDb )
 		return sgSQLiteDb;
@@ -175,6 +202,7 @@ static QSqlDatabase* get_db( int fips )
 
     sgSQLiteDb = new QSqlDatabase(QSqlDatabase::addDatabase("QSQLITE", "tiles"));
         sgSQLiteDb->setDatabaseName(full_path);
+        sgDbFips = fips;
 
         check_sqlite_error( "opening database", sgSQLiteDb->open());
 
@@ -190,7 +218,8 @@ static QSqlDatabase* get_db( int fips )
         {
                 check_sqlite_error( "pragma page size", sgSQLiteDb->exec(RM_TILE_STORAGE_STMT_PAGE_SIZE).lastError().type() == QSqlError::NoError );
 
-                if ( check_sqlite_error( "creating table", sgSQLiteDb->exec(RM_TILE_STORAGE_STMT_CREATE_TABLE).lastError().type() == QSqlError::NoError) )
+                if ( check_sqlite_error( "creating table", sgSQLiteDb->exec(RM_TILE_STORAGE_STMT_CREATE_TABLE).lastError().type() == QSqlError::NoError) &&
+                     check_sqlite_error( "creating the versions table", sgSQLiteDb->exec(RM_TILE_STORAGE_STMT_CREATE_VERSIONS).lastError().type() == QSqlError::NoError) )
 		{
 			sgTableExists = TRUE;
 		}
@@ -199,6 +228,76 @@ static QSqlDatabase* get_db( int fips )
         return sgSQLiteDb;
 }
 
+/***********************************************************/
+/*  Name        : get_query()
+ *  Purpose     : Auxiliary function. Returns the cached prepared query.
+ *                  The query is prepared on the first use of the connection
+ *  Params		: [in] db
+ *  			: [in/out] query - the query cache
+ *  			: [in] sql - the statement string
+ */
+static QSqlQuery* get_query( QSqlDatabase* db, QSqlQuery** query, const char* sql )
+{
+        if ( !*query )
+        {
+                *query = new QSqlQuery( *db );
+                (*query)->setForwardOnly( true );
+                if ( !check_sqlite_error( "preparing the SQLITE statement", (*query)->prepare( sql ) ) )
+                {
+                        delete *query;
+                        *query = NULL;
+                }
+        }
+        return *query;
+}
+
+/***********************************************************/
+/*  Name        : finalize_queries()
+ *  Purpose     : Auxiliary function. Releases the cached queries.
+ *                  Must be called before closing the connection
+ *  Params		: void
+ */
+static void finalize_queries( void )
+{
+        delete sgQueryStore;
+        delete sgQueryRemove;
+        delete sgQueryLoad;
+        delete sgQueryLoadBatch;
+        delete sgQuerySetVersion;
+        delete sgQueryRemoveVersion;
+        sgQueryStore = NULL;
+        sgQueryRemove = NULL;
+        sgQueryLoad = NULL;
+        sgQueryLoadBatch = NULL;
+        sgQuerySetVersion = NULL;
+        sgQueryRemoveVersion = NULL;
+}
+
+/***********************************************************/
+/*  Name        : get_batch_stmt_string()
+ *  Purpose     : Auxiliary function. Returns the batch load statement with
+ *                  RM_TILE_STORAGE_BATCH_SIZE parameters
+ *  Params		: void
+ */
+static const char* get_batch_stmt_string( void )
+{
+        static char stmt_string[RM_TILE_STORAGE_QUERY_MAXSIZE] = {0};
+
+        if ( !stmt_string[0] )
+        {
+                char params[RM_TILE_STORAGE_BATCH_SIZE * 2];
+
+                for ( int i = 0; i < RM_TILE_STORAGE_BATCH_SIZE; i++ )
+                {
+                        params[i*2] = '?';
+                        params[i*2+1] = ',';
+                }
+                params[RM_TILE_STORAGE_BATCH_SIZE * 2 - 1] = '\0';
+                snprintf( stmt_string, sizeof( stmt_string ), RM_TILE_STORAGE_STMT_LOAD_BATCH, params );
+        }
+        return stmt_string;
+}
+
 /***********************************************************/
 /*  Name        : close_db()
  *  Purpose     : Auxiliary function. Closes the database
@@ -210,9 +309,12 @@ static void close_db( void )
 {
 	if ( sgSQLiteDb )
 	{
+            finalize_queries();
             sgSQLiteDb->close();
             delete sgSQLiteDb;
             sgSQLiteDb = NULL;
+            sgDbFips = -1;
+            QSqlDatabase::removeDatabase("tiles");
 	}
 }
 /***********************************************************/
@@ -344,7 +446,7 @@ int roadmap_tile_store (int fips, int tile_index, void *data, size_t size)
 {
 	int res = 0;
         QSqlDatabase* db = NULL;
-	char stmt_string[RM_TILE_STORAGE_QUERY_MAXSIZE];
+        QSqlQuery* query = NULL;
 
 	// db = get_db( fips );
 	db = trans_open( fips );
@@ -354,44 +456,36 @@ int roadmap_tile_store (int fips, int tile_index, void *data, size_t size)
 		roadmap_log( ROADMAP_ERROR, "Tile storage failed - cannot open database" );
 		return -1;
 	}
-	/*
-	 * Prepare the string
-	 */
-	sprintf( stmt_string, RM_TILE_STORAGE_STMT_STORE, tile_index );
 
 	/*
-	 * Prepare the sqlite statement
+	 * Get the prepared sqlite statement
 	 */
-        QSqlQuery query = db->exec();
-        if ( !check_sqlite_error( "preparing the SQLITE statement", query.prepare(stmt_string) ) )
+        query = get_query( db, &sgQueryStore, RM_TILE_STORAGE_STMT_STORE );
+        if ( !query )
 	{
 		return -1;
 	}
 	/*
-	 * Binding the data
+	 * Binding the data - the blob is not copied
          */
-        QVariant dataVar(QByteArray((char*)data,size));
-        query.bindValue(0, dataVar);
-        if ( !check_sqlite_error( "binding the blob statement", query.lastError().type() == QSqlError::NoError ) )
-	{
-		return -1;
-	}
+        query->bindValue( 0, QVariant( tile_index ) );
+        query->bindValue( 1, QVariant( QByteArray::fromRawData( (const char*)data, size ) ) );
 	/*
 	 * Evaluate
 	 */
-        if ( !check_sqlite_error( "finishing", query.exec() ) )
+        if ( !check_sqlite_error( "finishing", query->exec() ) )
 	{
-		return -1;
+		res = -1;
 	}
 
-        query.finish();
+        query->finish();
 
 	/*
 	 * Close the database
 	 */
 	if ( sgConLifetime == _con_lifetime_session && !sgIsInTransaction )
 	{
-                db->close();
+                close_db();
 	}
 
 	return res;
@@ -409,6 +503,7 @@ int roadmap_tile_store (int fips, int tile_index, void *data, size_t size)
 void roadmap_tile_remove (int fips, int tile_index)
 {
         QSqlDatabase* db = NULL;
+        QSqlQuery* query = NULL;
 
 //	db = get_db( fips );
 	db = trans_open( fips );
@@ -416,38 +511,85 @@ void roadmap_tile_remove (int fips, int tile_index)
 	if ( !db )
 	{
 		roadmap_log( ROADMAP_ERROR, "Tile remove failed - cannot open database" );
+		return;
 	}
 
 	/*
-	 * Prepare the sqlite statement
+	 * Get the prepared sqlite statement
 	 */
-        QSqlQuery query = db->exec();
-        if ( !check_sqlite_error( "preparing the SQLITE statement", query.prepare(RM_TILE_STORAGE_STMT_REMOVE) ) )
+        query = get_query( db, &sgQueryRemove, RM_TILE_STORAGE_STMT_REMOVE );
+        if ( !query )
 	{
 		return;
 	}
 	/*
 	 * Binding the parameter
 	 */
-        QVariant tileIndexVar(tile_index);
-        query.bindValue(0, tileIndexVar);
-        if ( !check_sqlite_error( "binding int parameter", query.lastError().type() == QSqlError::NoError ) )
-	{
-		return;
-	}
+        query->bindValue( 0, QVariant( tile_index ) );
 
         /*
          * Finalize
          */
-        check_sqlite_error( "finishing", query.exec() );
-        query.finish();
+        check_sqlite_error( "finishing", query->exec() );
+        query->finish();
 
 	/*
 	 * Close the database
 	 */
 	if ( sgConLifetime == _con_lifetime_session  && !sgIsInTransaction )
 	{
-                db->close();
+                close_db();
+	}
+
+        roadmap_tile_set_version( fips, tile_index, 0 );
+}
+
+
+/***********************************************************/
+/*  Name        : roadmap_tile_set_version
+ *  Purpose     : Interface function. Records the version of the tile in the versions table.
+ *                 The record is removed when the version is 0
+ *  Params		: [in] fips
+ *  			: [in] tile_index - primary key
+ *  			: [in] version - the timestamp of the tile square
+ */
+void roadmap_tile_set_version (int fips, int tile_index, int version)
+{
+        QSqlDatabase* db = NULL;
+        QSqlQuery* query = NULL;
+
+	db = trans_open( fips );
+
+	if ( !db )
+	{
+		roadmap_log( ROADMAP_ERROR, "Tile version update failed - cannot open database" );
+		return;
+	}
+
+        if ( version )
+                query = get_query( db, &sgQuerySetVersion, RM_TILE_STORAGE_STMT_SET_VERSION );
+        else
+                query = get_query( db, &sgQueryRemoveVersion, RM_TILE_STORAGE_STMT_REMOVE_VERSION );
+        if ( !query )
+	{
+		return;
+	}
+
+        query->bindValue( 0, QVariant( tile_index ) );
+        if ( version )
+        {
+                query->bindValue( 1, QVariant( version ) );
+        }
+
+        check_sqlite_error( "finishing", query->exec() );
+        query->finish();
+
+	/*
+	 * Close the database
+	 */
+	if ( sgConLifetime == _con_lifetime_session  && !sgIsInTransaction )
+	{
+                close_db();
 	}
 }
 
@@ -491,23 +633,46 @@ static int roadmap_tile_file_load ( const char *name, void **base, size_t *size)
 }
 
 /***********************************************************/
-/*  Name        : roadmap_tile_load
- *  Purpose     : Interface function. Loads the tile data from the database.
- *                 Allocates the necessar heap space
+/*  Name        : roadmap_tile_map
+ *  Purpose     : Interface function. The database is not mapped -
+ *                 the tiles are loaded by roadmap_tile_load_buffer
  *  Params		: [in] fips
  *  			: [in] tile_index - primary key
- *  			: [out] base - the data storage address
+ *  			: [out] data - the mapped data
  *				: [out] size - the size of the data block
  */
-int roadmap_tile_load (int fips, int tile_index, void **data, size_t *size)
+int roadmap_tile_map (int fips, int tile_index, const void **data, size_t *size)
+{
+	return -1;
+}
+
+/***********************************************************/
+/*  Name        : roadmap_tile_load_buffer
+ *  Purpose     : Interface function. Loads the tile data from the database
+ *                 into the buffer kept by the caller. Reallocates the buffer if too small
+ *  Params		: [in] fips
+ *  			: [in] tile_index - primary key
+ *  			: [in/out] buffer - the data storage address
+ *  			: [in/out] capacity - the allocated size of the buffer
+ *				: [out] size - the size of the data block
+ */
+int roadmap_tile_load_buffer (int fips, int tile_index, void **buffer, size_t *capacity, size_t *size)
 {
 	int res = -1;
         QSqlDatabase* db = NULL;
+        QSqlQuery* query = NULL;
 
 	if ( tile_index == -1 )
 	{
+		void *base;
 		const char* file_name = get_global_filename( fips );
-        res = roadmap_tile_file_load( file_name, data, size );
+		res = roadmap_tile_file_load( file_name, &base, size );
+		if ( res == 0 )
+		{
+			free( *buffer );
+			*buffer = base;
+			*capacity = *size;
+		}
 		return res;
 	}
 
@@ -521,56 +686,156 @@ int roadmap_tile_load (int fips, int tile_index, void **data, size_t *size)
 	}
 
 	/*
-	 * Prepare the sqlite statement
+	 * Get the prepared sqlite statement
 	 */
-        QSqlQuery query = db->exec();
-        if ( !check_sqlite_error( "preparing the SQLITE statement", query.prepare(RM_TILE_STORAGE_STMT_LOAD) ) )
+        query = get_query( db, &sgQueryLoad, RM_TILE_STORAGE_STMT_LOAD );
+        if ( !query )
 	{
 		return -1;
 	}
 	/*
 	 * Binding the parameter
          */
-        QVariant tileIndexVar(tile_index);
-        query.bindValue(0, tileIndexVar);
-        if ( !check_sqlite_error( "binding int parameter", query.lastError().type() == QSqlError::NoError ) )
-	{
-		return -1;
-	}
+        query->bindValue( 0, QVariant( tile_index ) );
 
 	/*
 	 * Evaluate
          */
-        if ( query.exec() && query.next())
+        if ( query->exec() && query->next() )
 	{
-                QByteArray dataVar = query.value(0).toByteArray();
+                QByteArray dataVar = query->value(0).toByteArray();
                 *size = dataVar.length();
-                *data = roadmap_allocate_and_check( *size );
-                memcpy( *data, dataVar.data(), *size );
+                if ( *capacity < *size || !*buffer )
+                {
+                        free( *buffer );
+                        *buffer = roadmap_allocate_and_check( *size ? *size : 1 );
+                        *capacity = *size;
+                }
+                memcpy( *buffer, dataVar.constData(), *size );
 		res = 0;
 	}
 	else
 	{
 		res = -1;
-                check_sqlite_error( "Error while running query", query.lastError().type() == QSqlError::NoError );
+                check_sqlite_error( "Error while running query", query->lastError().type() == QSqlError::NoError );
 	}
 
 	/*
 	 * Finalize
          */
-        query.finish();
+        query->finish();
 
 	/*
 	 * Close the database
 	 */
 	if ( sgConLifetime == _con_lifetime_session && !sgIsInTransaction )
 	{
-                db->close();
+                close_db();
 	}
 
    return res;
 }
 
+/***********************************************************/
+/*  Name        : roadmap_tile_load
+ *  Purpose     : Interface function. Loads the tile data from the database.
+ *                 Allocates the necessar heap space
+ *  Params		: [in] fips
+ *  			: [in] tile_index - primary key
+ *  			: [out] base - the data storage address
+ *				: [out] size - the size of the data block
+ */
+int roadmap_tile_load (int fips, int tile_index, void **data, size_t *size)
+{
+        size_t capacity = 0;
+
+        *data = NULL;
+        if ( roadmap_tile_load_buffer( fips, tile_index, data, &capacity, size ) != 0 )
+        {
+                free( *data );
+                *data = NULL;
+                return -1;
+        }
+
+        return 0;
+}
+
+
+/***********************************************************/
+/*  Name        : roadmap_tile_load_batch
+ *  Purpose     : Interface function. Loads several tiles in one query per
+ *                 RM_TILE_STORAGE_BATCH_SIZE ids
+ *  Params		: [in] fips
+ *  			: [in] tile_indexes - primary keys
+ *  			: [in] count - number of tiles
+ *				: [in] cb - called for each tile found
+ *				: [in] context - passed to the callback
+ *				: Returns the number of tiles found or -1 on failure
+ */
+int roadmap_tile_load_batch (int fips, const int *tile_indexes, int count,
+                             roadmap_tile_load_cb cb, void *context)
+{
+        QSqlDatabase* db = NULL;
+        QSqlQuery* query = NULL;
+        int found = 0;
+
+        if ( count <= 0 )
+                return 0;
+
+	db = trans_open( fips );
+
+	if ( !db )
+	{
+		roadmap_log( ROADMAP_ERROR, "Tile batch loading failed - cannot open database" );
+		return -1;
+	}
+
+        query = get_query( db, &sgQueryLoadBatch, get_batch_stmt_string() );
+        if ( !query )
+	{
+		return -1;
+	}
+
+        for ( int first = 0; first < count && found >= 0; first += RM_TILE_STORAGE_BATCH_SIZE )
+        {
+                int num = count - first;
+                if ( num > RM_TILE_STORAGE_BATCH_SIZE )
+                        num = RM_TILE_STORAGE_BATCH_SIZE;
+
+                /*
+                 * Unused parameters repeat the last id
+                 */
+                for ( int i = 0; i < RM_TILE_STORAGE_BATCH_SIZE; i++ )
+                {
+                        query->bindValue( i, QVariant( tile_indexes[first + ( i < num ? i : num - 1 )] ) );
+                }
+
+                if ( !check_sqlite_error( "batch load", query->exec() ) )
+                {
+                        found = -1;
+                        break;
+                }
+
+                while ( query->next() )
+                {
+                        QByteArray dataVar = query->value(1).toByteArray();
+                        cb( query->value(0).toInt(), dataVar.constData(), dataVar.length(), context );
+                        found++;
+                }
+                query->finish();
+        }
+
+	/*
+	 * Close the database
+	 */
+	if ( sgConLifetime == _con_lifetime_session && !sgIsInTransaction )
+	{
+                close_db();
+	}
+
+   return found;
+}
+
 
 /***********************************************************/
 /*  Name        : roadmap_tile_remove_all
@@ -590,10 +855,7 @@ void roadmap_tile_remove_all( int fips )
    {
       trans_rollback();
    }
-   else
-   {
-      close_db();
-   }
+   close_db();
 
 
    // Reset state
@@ -606,5 +868,111 @@ void roadmap_tile_remove_all( int fips )
 }
 
 
+/***********************************************************/
+/*  Name        : roadmap_tile_storage_shutdown
+ *  Purpose     : Interface function. Commits the open transaction and closes the database
+ *  Params		: void
+ */
+void roadmap_tile_storage_shutdown( void )
+{
+	if ( sgIsInTransaction )
+	{
+		roadmap_main_remove_periodic( trans_timeout );
+		trans_commit();
+	}
+	close_db();
+}
+
+
+/***********************************************************/
+/*  Name        : roadmap_tile_enumerate
+ *  Purpose     : Interface function. Calls the callback for each tile stored in the database
+ *  Params		: [in] fips
+ *  			: [in] cb - called with the id of each tile
+ *				: Returns the number of tiles or -1 on failure
+ */
+int roadmap_tile_enumerate (int fips, roadmap_tile_enum_cb cb)
+{
+        QSqlDatabase* db = NULL;
+        int count = 0;
+
+	db = trans_open( fips );
+
+	if ( !db )
+	{
+		roadmap_log( ROADMAP_ERROR, "Tile enumeration failed - cannot open database" );
+		return -1;
+	}
+
+        QSqlQuery query = db->exec();
+        query.setForwardOnly(true);
+        if ( !check_sqlite_error( "enumerating tiles", query.exec(RM_TILE_STORAGE_STMT_ENUMERATE) ) )
+	{
+		return -1;
+	}
+
+        while ( query.next() )
+        {
+                cb( query.value(0).toInt() );
+                count++;
+        }
+
+        query.finish();
+
+	/*
+	 * Close the database
+	 */
+	if ( sgConLifetime == _con_lifetime_session && !sgIsInTransaction )
+	{
+                close_db();
+	}
+
+   return count;
+}
+
+
+/***********************************************************/
+/*  Name        : roadmap_tile_enumerate_versions
+ *  Purpose     : Interface function. Calls the callback for each tile in the versions table
+ *  Params		: [in] fips
+ *  			: [in] cb - called with the id and the version of each tile
+ *				: Returns the number of tiles or -1 on failure
+ */
+int roadmap_tile_enumerate_versions (int fips, roadmap_tile_version_cb cb)
+{
+        QSqlDatabase* db = NULL;
+        int count = 0;
+
+	db = trans_open( fips );
+
+	if ( !db )
+	{
+		roadmap_log( ROADMAP_ERROR, "Tile versions enumeration failed - cannot open database" );
+		return -1;
+	}
+
+        QSqlQuery query( *db );
+        query.setForwardOnly(true);
+        if ( !check_sqlite_error( "enumerating tile versions", query.exec(RM_TILE_STORAGE_STMT_ENUM_VERSIONS) ) )
+	{
+		return -1;
+	}
+
+        while ( query.next() )
+        {
+                cb( query.value(0).toInt(), query.value(1).toInt() );
+                count++;
+        }
 
- 
+        query.finish();
+
+	/*
+	 * Close the database
+	 */
+	if ( sgConLifetime == _con_lifetime_session && !sgIsInTransaction )
+	{
+                close_db();
+	}
+
+   return count;
+}
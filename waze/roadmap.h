@@ -192,7 +192,21 @@ void roadmap_log_pop         (void);
 #endif
 void roadmap_log_reset_stack (void);
 
-void roadmap_log (int level, const char *source, int line, const char *format, ...);
+/* The lowest level logged by any module. roadmap_log() checks it before
+ * calling roadmap_log_write(), so a disabled level only costs a test.
+ */
+extern int RoadMapLogLevel;
+
+void roadmap_log_write (int level, const char *source, int line, const char *format, ...);
+
+#define roadmap_log(...) ROADMAP_LOG_FILTER(__VA_ARGS__)
+#define ROADMAP_LOG_FILTER(level, ...) \
+            (((level) < RoadMapLogLevel) ? (void)0 : roadmap_log_write ((level), __VA_ARGS__))
+
+void roadmap_log_set_level (int level);
+void roadmap_log_set_module_level (const char *source, int level);
+void roadmap_log_flush (void);
+
 BOOL roadmap_log_raw_data ( const char* data );
 BOOL roadmap_log_raw_data_fmt( const char *format, ... );
 
@@ -207,6 +221,9 @@ void roadmap_log_register_msgbox (roadmap_log_msgbox_handler handler);
 const char *roadmap_log_path     (void);
 const char *roadmap_log_filename (void);
 
+/* The older logs are kept as <filename>.1 to <filename>.3 */
+#define ROADMAP_LOG_ROTATE_COUNT 3
+
 
 #define roadmap_check_allocated(p) \
             roadmap_check_allocated_with_source_line(__FILE__,__LINE__,p)
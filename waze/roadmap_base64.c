@@ -77,19 +77,19 @@ int roadmap_base64_encode (const void* inData, int inLength, char** outText, int
 }
 
 int roadmap_base64_decode (char* inText, void** outData) {
-//AR: Decoding code untested
    size_t i;
-   int inputLength = strlen(inText) -1;
+   int inputLength;
    static int initialized = 0;
    
-   if ((inText== NULL) || (inputLength % 4 != 0)) {
+   if ((inText== NULL) || (strlen(inText) % 4 != 0)) {
       return -1;
    }
+   inputLength = strlen(inText);
    
    if (!initialized) {
       memset(decodingTable, 0, 128);
       for (i = 0; i < strlen(encodingTable); i++) {
-         decodingTable[encodingTable[i]] = i;
+         decodingTable[(unsigned char)encodingTable[i]] = i;
       }
       initialized = 1;
    }
@@ -105,10 +105,10 @@ int roadmap_base64_decode (char* inText, void** outData) {
    int inputPoint = 0;
    int outputPoint = 0;
    while (inputPoint < inputLength) {
-      char i0 = inText[inputPoint++];
-      char i1 = inText[inputPoint++];
-      char i2 = inputPoint < inputLength ? inText[inputPoint++] : 'A'; /* 'A' will decode to \0 */
-      char i3 = inputPoint < inputLength ? inText[inputPoint++] : 'A';
+      unsigned char i0 = inText[inputPoint++] & 0x7F;
+      unsigned char i1 = inText[inputPoint++] & 0x7F;
+      unsigned char i2 = inputPoint < inputLength ? inText[inputPoint++] & 0x7F : 'A'; /* 'A' will decode to \0 */
+      unsigned char i3 = inputPoint < inputLength ? inText[inputPoint++] & 0x7F : 'A';
       
       output[outputPoint++] = (decodingTable[i0] << 2) | (decodingTable[i1] >> 4);
       if (outputPoint < outputLength) {
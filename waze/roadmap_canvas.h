@@ -143,6 +143,12 @@ void roadmap_canvas_erase_area (const RoadMapGuiRect *rect);
 #define FONT_TYPE_BOLD     0x2
 #define FONT_TYPE_OUTLINE  0x4
 
+/* The canvas may keep the measured and shaped text of the strings it draws.
+ * This drops the strings that were not drawn in the last frame, or all of
+ * them.
+ */
+void roadmap_canvas_trim_text_cache (int all);
+
 void roadmap_canvas_draw_string  (RoadMapGuiPoint *position,
                                   int corner,
                                   const char *text);
@@ -190,8 +196,11 @@ int roadmap_canvas_height (void);
 
 int roadmap_canvas_is_landscape();
 
-/* This primitive causes the "exposed" drawing buffer to appear on the screen.
+/* Drawing between these two calls belongs to one frame.
+ * roadmap_canvas_refresh ends the frame and causes the "exposed" drawing
+ * buffer to appear on the screen.
  */
+void roadmap_canvas_begin_frame (void);
 void roadmap_canvas_refresh (void);
 
 void roadmap_canvas_save_screenshot (const char* filename);
@@ -202,6 +211,12 @@ int  roadmap_canvas_image_height (const RoadMapImage image);
 RoadMapImage roadmap_canvas_load_image (const char *path,
                                         const char* file_name);
 
+/* Same as roadmap_canvas_load_image(), but the image may be decoded in the
+ * background. Until then it has its final size and is drawn empty.
+ */
+RoadMapImage roadmap_canvas_load_image_async (const char *path,
+                                              const char* file_name);
+
 void roadmap_canvas_image_set_mutable (RoadMapImage src);
 
 void roadmap_canvas_draw_image (RoadMapImage image, const RoadMapGuiPoint *pos,
@@ -241,6 +256,12 @@ void roadmap_canvas_free_image (RoadMapImage image);
 
 int roadmap_canvas_get_generic_screen_type( int width, int height );
 void roadmap_canvas_image_invalidate( RoadMapImage image );
+
+/* Releases the pixels of an image loaded from a file. The image keeps its
+ * size and is loaded again the next time it is used. Returns 0 if the image
+ * cannot be unloaded.
+ */
+int roadmap_canvas_image_unload( RoadMapImage image );
 void roadmap_canvas_unmanaged_list_add( RoadMapImage image );
 void roadmap_canvas_shutdown();
 void roadmap_canvas_begin_draw_to_image (RoadMapImage image);
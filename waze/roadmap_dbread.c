@@ -66,6 +66,7 @@
 #include "roadmap_path.h"
 #include "roadmap_data_format.h"
 #include "roadmap_tile_storage.h"
+#include "roadmap_tile_decode.h"
 #include "roadmap_dbread.h"
 
 #ifdef IPHONE
@@ -271,22 +272,23 @@ roadmap_db_database *roadmap_db_find (int fips, int tile_index) {
 }
 
 
-static int roadmap_db_fill_data (roadmap_db_database *database, void *base, unsigned int size) {
+int roadmap_db_uncompress (const void *base, size_t size, void **raw, size_t *raw_size,
+                           char *error, size_t error_size) {
 
-	roadmap_tile_file_header *tile_header = (roadmap_tile_file_header *) base;
-	roadmap_data_file_header *file_header = (roadmap_data_file_header *) tile_header;
-	unsigned char *compressed_data = (unsigned char *)(tile_header + 1);
+	const roadmap_tile_file_header *tile_header = (const roadmap_tile_file_header *) base;
+	const roadmap_data_file_header *file_header = (const roadmap_data_file_header *) tile_header;
+	const unsigned char *compressed_data = (const unsigned char *)(tile_header + 1);
 	unsigned char *raw_data;
 	unsigned long raw_data_size;
 	int status;
 	
 	if (size < sizeof (roadmap_tile_file_header)) {
-	   roadmap_log (ROADMAP_ERROR, "data file open: header size %u too small", size);
+	   snprintf (error, error_size, "header size %u too small", (unsigned int) size);
 	   return 0;
 	}
 	
 	if (memcmp (file_header->signature, ROADMAP_DATA_SIGNATURE, sizeof (file_header->signature))) {
-	   roadmap_log (ROADMAP_ERROR, "data file open: invalid signature %c%c%c%c",
+	   snprintf (error, error_size, "invalid signature %c%c%c%c",
 	   					file_header->signature[0],
 	   					file_header->signature[1],
 	   					file_header->signature[2],
@@ -295,17 +297,17 @@ static int roadmap_db_fill_data (roadmap_db_database *database, void *base, unsi
 	}
 	
 	if (file_header->endianness != ROADMAP_DATA_ENDIAN_CORRECT) {
-	   roadmap_log (ROADMAP_ERROR, "data file open: invalid endianness value %08ux", file_header->endianness);
+	   snprintf (error, error_size, "invalid endianness value %08ux", file_header->endianness);
 	   return 0;
 	}
 	if (file_header->version != ROADMAP_DATA_CURRENT_VERSION) {
-	   roadmap_log (ROADMAP_ERROR, "data file open: invalid version 0x%x != 0x%x", file_header->version, ROADMAP_DATA_CURRENT_VERSION);
+	   snprintf (error, error_size, "invalid version 0x%x != 0x%x", file_header->version, ROADMAP_DATA_CURRENT_VERSION);
 	   return 0;
 	}
 	if (tile_header->compressed_data_size != size - sizeof (roadmap_tile_file_header)) {
-	   roadmap_log (ROADMAP_ERROR, "data file size mismatch: expecting %d found %d", 
-	   				 sizeof (roadmap_tile_file_header) + tile_header->compressed_data_size,
-	   				 size);
+	   snprintf (error, error_size, "size mismatch: expecting %u found %u", 
+	   				 (unsigned int) (sizeof (roadmap_tile_file_header) + tile_header->compressed_data_size),
+	   				 (unsigned int) size);
 	   return 0;
 		
 	}
@@ -317,6 +319,10 @@ static int roadmap_db_fill_data (roadmap_db_database *database, void *base, unsi
 	raw_data = (unsigned char *) compressed_data;
 #else
 	raw_data = malloc (raw_data_size);
+	if (raw_data == NULL) {
+	   snprintf (error, error_size, "cannot allocate %lu bytes", raw_data_size);
+	   return 0;
+	}
 
 #ifdef RIMAPI
 	status = RIMAPI_ZLib_uncompress (raw_data, &raw_data_size, compressed_data, tile_header->compressed_data_size);
@@ -325,26 +331,35 @@ static int roadmap_db_fill_data (roadmap_db_database *database, void *base, unsi
 #endif
 
 	if (!status) {
-	   roadmap_log (ROADMAP_ERROR, "data file open: uncompress failed");
+	   snprintf (error, error_size, "uncompress failed");
 		free (raw_data);
 		return 0;
 	}
 	if (raw_data_size != tile_header->raw_data_size) {
-	   roadmap_log (ROADMAP_ERROR, "uncompressed data size mismatch: expecting %d found %d", 
-	   				 tile_header->raw_data_size, raw_data_size);
+	   snprintf (error, error_size, "uncompressed data size mismatch: expecting %u found %lu", 
+	   				 (unsigned int) tile_header->raw_data_size, raw_data_size);
 		free (raw_data);
 		return 0;
 	}
 #endif
 
-	database->data.header = (roadmap_data_header *) raw_data;
+	*raw = raw_data;
+	*raw_size = raw_data_size;
+
+	return 1;
+}
+
+
+static int roadmap_db_fill_raw (roadmap_db_database *database, void *raw, size_t raw_data_size) {
+
+	database->data.header = (roadmap_data_header *) raw;
 		
 	database->data.byte_alignment_add = (1 << database->data.header->byte_alignment_bits) - 1;
 	database->data.byte_alignment_mask = ~database->data.byte_alignment_add;
 	
 	if (raw_data_size < sizeof (roadmap_data_header) + 
 				  database->data.header->num_sections * sizeof (roadmap_data_entry)) {
-	   roadmap_log (ROADMAP_ERROR, "data file open: size %lu cannot contain index", raw_data_size);
+	   roadmap_log (ROADMAP_ERROR, "data file open: size %lu cannot contain index", (unsigned long) raw_data_size);
 	   return 0;
 	}
 	database->data.index = (roadmap_data_entry *)(database->data.header + 1);
@@ -354,7 +369,7 @@ static int roadmap_db_fill_data (roadmap_db_database *database, void *base, unsi
 				  database->data.header->num_sections * sizeof (roadmap_data_entry) +
 				  database->data.index[database->data.header->num_sections - 1].end_offset) {
 				  	
-	   roadmap_log (ROADMAP_ERROR, "data file open: size %lu cannot contain data", raw_data_size);
+	   roadmap_log (ROADMAP_ERROR, "data file open: size %lu cannot contain data", (unsigned long) raw_data_size);
 	   return 0;
 	}
 	database->data.data = (unsigned char *)(database->data.index + database->data.header->num_sections);
@@ -363,6 +378,28 @@ static int roadmap_db_fill_data (roadmap_db_database *database, void *base, unsi
 }
 
 
+static int roadmap_db_fill_data (roadmap_db_database *database, void *base, unsigned int size) {
+
+	void *raw;
+	size_t raw_size;
+	char error[128];
+
+	if (!roadmap_db_uncompress (base, size, &raw, &raw_size, error, sizeof (error))) {
+	   roadmap_log (ROADMAP_ERROR, "data file open: %s", error);
+	   return 0;
+	}
+
+	if (!roadmap_db_fill_raw (database, raw, raw_size)) {
+#ifndef NO_MAP_COMPRESSION
+	   free (raw);
+#endif
+	   return 0;
+	}
+
+	return 1;
+}
+
+
 static int add_db_and_map (roadmap_db_database *database) {
 
    if (RoadmapDatabaseFirst != NULL) {
@@ -388,6 +425,16 @@ int roadmap_db_open (int fips, int tile_index, roadmap_db_model *model,
 
    void *base = NULL;
    size_t size = 0;
+#ifndef NO_MAP_COMPRESSION
+   /* the compressed data is only needed until it is uncompressed,
+    * so one buffer is kept for all the tiles.
+    */
+   static void *load_buffer = NULL;
+   static size_t load_buffer_size = 0;
+   const void *mapped;
+   void *raw;
+   size_t raw_size;
+#endif
 
    roadmap_db_database *database = roadmap_db_find (fips, tile_index);
 
@@ -397,10 +444,49 @@ int roadmap_db_open (int fips, int tile_index, roadmap_db_model *model,
       return 1; /* Already open. */
    }
 
+#ifndef NO_MAP_COMPRESSION
+   if (roadmap_tile_decode_take (fips, tile_index, &raw, &raw_size)) {
+
+      /* already uncompressed by a decode worker */
+      roadmap_log (ROADMAP_INFO, "Opening decoded database fips:%d, index:%d", fips, tile_index);
+      database = malloc(sizeof(*database));
+      roadmap_check_allocated(database);
+
+      database->fips = fips;
+      database->tile_index = tile_index;
+
+      if (!roadmap_db_fill_raw (database, raw, raw_size)) {
+
+         roadmap_log (ROADMAP_INFO, "tile %d (fips %d) has invalid format", tile_index, fips);
+         free (raw);
+         free (database);
+         roadmap_tile_remove (fips, tile_index);
+         return 0;
+      }
+
+      database->model = model;
+      database->context = NULL;
+
+      return add_db_and_map(database);
+   }
+
+   if (roadmap_tile_map(fips, tile_index, &mapped, &size) == 0) {
+
+      /* uncompress straight from the storage mapping */
+      base = (void *) mapped;
+   } else if (roadmap_tile_load_buffer(fips, tile_index, &load_buffer, &load_buffer_size, &size) == 0) {
+
+      base = load_buffer;
+   } else {
+
+	  return 0;
+   }
+#else
    if (roadmap_tile_load(fips, tile_index, &base, &size) != 0) {
    
 	  return 0;
    }
+#endif
 
    roadmap_log (ROADMAP_INFO, "Opening database file fips:%d, index:%d", fips, tile_index);
    database = malloc(sizeof(*database));
@@ -412,16 +498,15 @@ int roadmap_db_open (int fips, int tile_index, roadmap_db_model *model,
 	if (!roadmap_db_fill_data (database, base, (unsigned int) size)) {
 	      
 	   roadmap_log (ROADMAP_INFO, "tile %d (fips %d) has invalid format", tile_index, fips);
+#ifdef NO_MAP_COMPRESSION
 	   free (base);
+#endif
       free (database);
+      roadmap_tile_decode_cancel (fips, tile_index);
       roadmap_tile_remove (fips, tile_index);
       return 0;
 	}
 	
-#ifndef NO_MAP_COMPRESSION
-   // we use the base pointer as there's no compression.
-   free(base);
-#endif
 
    database->model = model;
    database->context = NULL;
@@ -535,6 +620,7 @@ int roadmap_db_close (int fips, int tile_index) {
 void roadmap_db_remove (int fips, int tile_index) {
 
 	roadmap_db_close (fips, tile_index);
+	roadmap_tile_decode_cancel (fips, tile_index);
 	roadmap_tile_remove (fips, tile_index);	
 }
 
@@ -544,6 +630,8 @@ void roadmap_db_end (void) {
    roadmap_db_database *database;
    roadmap_db_database *next;
 
+   roadmap_tile_decode_shutdown ();
+
    for (database = RoadmapDatabaseFirst; database != NULL; ) {
 
       next = database->next;
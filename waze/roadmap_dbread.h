@@ -77,6 +77,13 @@ int  roadmap_db_open_mem (int fips, int tile_index, roadmap_db_model *model,
 
 void roadmap_db_activate (int fips, int tile_index);
 
+/* Validates and uncompresses the data of a tile. This does not touch any
+ * state, so it may be called from any thread. On failure, the reason is
+ * written to error.
+ */
+int  roadmap_db_uncompress (const void *base, size_t size, void **raw, size_t *raw_size,
+                            char *error, size_t error_size);
+
 int	roadmap_db_exists (const roadmap_db_data_file *file, const roadmap_db_sector *sector);
 
 int	roadmap_db_get_data (const roadmap_db_data_file *file, 
@@ -226,6 +226,9 @@ int prepare_for_upload ()
    char year[5], month[5], day[5];
 #ifdef RIMAPI
    timeStruct time_s;
+#else
+   char log_name[64];
+   int i;
 #endif
    sprintf (warning_message,"%s",roadmap_lang_get("Preparing files for upload..."));
    ssd_progress_msg_dialog_show(warning_message);
@@ -239,6 +242,12 @@ int prepare_for_upload ()
    for (cursor = files; *cursor != NULL; ++cursor) {
       count++;
    }
+#ifndef RIMAPI
+   for (i = 1; i <= ROADMAP_LOG_ROTATE_COUNT; ++i) {
+      snprintf (log_name, sizeof(log_name), "%s.%d", roadmap_log_filename(), i);
+      if (roadmap_file_exists (roadmap_log_path(), log_name)) count++;
+   }
+#endif
 
    total = count;
    count = 0;
@@ -277,6 +286,27 @@ int prepare_for_upload ()
       return 0;
    }
 
+#ifndef RIMAPI
+   //Prepare the older logs, rotated out of the postmortem
+   for (i = 1; i <= ROADMAP_LOG_ROTATE_COUNT; ++i) {
+      snprintf (log_name, sizeof(log_name), "%s.%d", roadmap_log_filename(), i);
+      if (!roadmap_file_exists (roadmap_log_path(), log_name)) continue;
+
+      count++;
+      sprintf (warning_message,"%s %d/%d",roadmap_lang_get("Preparing files for upload..."),count, total);
+      ssd_progress_msg_dialog_show(warning_message);
+      roadmap_main_flush();
+
+      snprintf(out_filename,256, "%s%s%s__%d_%d__%s_%d_%s__%s.gz", day, month, year,
+              tms->tm_hour, tms->tm_min, RealTime_GetUserName(), RT_DEVICE_ID, roadmap_start_version(), log_name);
+      res = roadmap_zlib_compress(roadmap_log_path(), log_name, roadmap_path_debug(), out_filename, COMPRESSION_LEVEL,FALSE);
+      if (res != Z_OK) {
+         ssd_progress_msg_dialog_hide();
+         return 0;
+      }
+   }
+#endif
+
 
    //Prepare CSV files
    for (cursor = files; *cursor != NULL; ++cursor) {
@@ -37,6 +37,7 @@
 #include "roadmap_prompts.h"
 #include "roadmap_splash.h"
 #include "roadmap_tile_storage.h"
+#include "roadmap_tile_decode.h"
 #include "roadmap_locator.h"
 #include "Realtime/Realtime.h"
 #include "ssd/ssd_progress_msg_dialog.h"
@@ -312,6 +313,7 @@ static void on_recieved_completed (void) {
       roadmap_splash_reset_check_time();
       roadmap_config_save(FALSE);
 #if (defined (IPHONE) || defined (ANDROID))
+      roadmap_tile_decode_cancel_all(roadmap_locator_active());
       roadmap_tile_remove_all(roadmap_locator_active());
 #endif
       roadmap_messagebox_cb(roadmap_lang_get("Please restart Waze"), roadmap_lang_get(updateText), restart_msg_cb);
@@ -30,6 +30,9 @@
 
 #define HTTPCOPY_FLAG_NONE                               0x00000000
 #define HTTPCOPY_FLAG_IGNORE_CONTENT_LEN                 0x00000001
+/* The response is passed to the progress callback as it arrives, and the
+ * size callback may not be called */
+#define HTTPCOPY_FLAG_STREAM                             0x00000002
 
 
 typedef int  (*RoadMapHttpAsyncCallbackSize)     (void *context, size_t size);
@@ -1382,6 +1382,10 @@ void roadmap_label_clear (int square) {
 
    RoadMapListItem *item, *tmp;
    int west, east, south, north;
+
+   /* the labels of the square will not be drawn again */
+   roadmap_canvas_trim_text_cache (0);
+
    return;//AVIR - this function is wrong, comparing coord to lon/lat.
 	roadmap_tile_edges (square, &west, &east, &south, &north);
 
@@ -1418,4 +1422,5 @@ void roadmap_label_clear (int square) {
 
 void roadmap_label_clear_all (void) {
    ROADMAP_LIST_SPLICE (&RoadMapLabelSpares, &RoadMapLabelCache);
+   roadmap_canvas_trim_text_cache (1);
 }
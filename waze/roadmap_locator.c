@@ -100,6 +100,7 @@ static void roadmap_locator_configure (void) {
 
    roadmap_config_declare
        ("preferences", &RoadMapConfigStaticCounty, "0", NULL);
+   roadmap_square_configure ();
 
    if (RoadMapCountyCache == NULL) {
 
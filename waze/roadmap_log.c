@@ -30,6 +30,15 @@
  * printed by the roadmap program. The goals are (1) to produce a uniform
  * look, (2) have a central point of control for error management and
  * (3) have a centralized control for routing messages.
+ *
+ * The messages are formatted by the caller into a ring of records, and a
+ * writer thread appends them to the log file. Nobody waits for the disk,
+ * and when the ring is full the messages are dropped and counted. Fatal
+ * errors are written directly, after the pending records. The log file is
+ * rotated when it grows too large.
+ *
+ * A message is at most LOG_RECORD_SIZE bytes long, with its time and
+ * source. A longer one is cut, and ends with " ...[truncated]".
  */
 
 #include <stdio.h>
@@ -45,7 +54,14 @@
 #include "roadmap_file.h"
 #include "roadmap_messagebox.h"
 #include "Realtime/Realtime.h"
+
+#if !defined(_WIN32) && !defined(J2ME) && !defined(__SYMBIAN32__)
+#define LOG_ASYNC
+#include <pthread.h>
+#endif
+
 static FILE *sgLogFile = NULL;
+static long  sgLogFileSize = 0;
 
 #if defined(IPHONE) || defined(unix) && !defined(J2ME) && !defined(QTMOBILITY)
 #include <sys/timeb.h>
@@ -59,6 +75,12 @@ static FILE *sgLogFile = NULL;
 #define MAX_SIZE_LOG_FILE 10000 // 10 megabytes for now
 #define TO_KEEP_LOG_SIZE 1000 // keep the last megabyte
 
+#define LOG_RECORD_SIZE       1024     /* longer messages are truncated */
+#define LOG_RING_SIZE         256      /* must be a power of 2 */
+#define LOG_ROTATE_SIZE       (2 * 1024 * 1024)
+#define LOG_ROTATE_COUNT      ROADMAP_LOG_ROTATE_COUNT
+#define LOG_MAX_MODULES       32
+
 #define GET_2_DIGIT_STRING( num_in, str_out ) \
 { \
 str_out[0] = '0'; \
@@ -68,6 +90,50 @@ sprintf( str_out, "%1d", (uint8_t)(num_in%100)); \
 static const char *RoadMapLogStack[ROADMAP_LOG_STACK_SIZE];
 static int         RoadMapLogStackCursor = 0;
 
+/* Levels of the modules that do not use the global level */
+typedef struct {
+   char source[64];
+   int  level;
+} RoadMapLogModule;
+
+static RoadMapLogModule sgLogModules[LOG_MAX_MODULES];
+static int sgLogModulesCount = 0;
+static int sgLogGlobalLevel = DEFAULT_LOG_LEVEL;
+
+int RoadMapLogLevel = DEFAULT_LOG_LEVEL;
+
+#ifdef LOG_ASYNC
+/* A record is free for the producer at position p when its sequence is p,
+ * and ready for the writer when its sequence is p + 1.
+ */
+typedef struct {
+   volatile unsigned int sequence;
+   int   length;
+   short saved_at;
+   char  to_file;
+   char  to_stderr;
+   char  text[LOG_RECORD_SIZE];
+} RoadMapLogRecord;
+
+static RoadMapLogRecord sgLogRing[LOG_RING_SIZE];
+static volatile unsigned int sgLogHead = 0;
+static unsigned int sgLogTail = 0;   /* protected by sgLogLock */
+static volatile unsigned int sgLogDropped = 0;
+
+static pthread_mutex_t sgLogLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t sgLogOwner;           /* valid while sgLogLocked */
+static volatile int sgLogLocked = 0;
+
+/* The writer sleeps until a message is published */
+static pthread_mutex_t sgLogWakeLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sgLogWake = PTHREAD_COND_INITIALIZER;
+static int sgLogPending = 0;          /* protected by sgLogWakeLock */
+
+static pthread_once_t sgLogOnce = PTHREAD_ONCE_INIT;
+static pthread_t sgLogThread;
+static int sgLogStarted = 0;
+#endif
+
 static struct roadmap_message_descriptor {
    int   level;
    int   show_stack;
@@ -135,8 +201,10 @@ void roadmap_log_save_none (void) {
 }
 
 
+static int roadmap_log_module_level (const char *source);
+
 int  roadmap_log_enabled (int level, char *source, int line) {
-   return (level >= roadmap_verbosity());
+   return (level >= roadmap_log_module_level (source));
 }
 
 #if(defined WIN32PC && defined _DEBUG)
@@ -201,20 +269,59 @@ const char *roadmap_log_filename()
 #endif
 }
 
-static void roadmap_log_one (struct roadmap_message_descriptor *category,
-                             FILE *file,
-                             char  saved,
-                             const char *source,
-                             int line,
-                             const char *format,
-                             va_list ap) {
+static int roadmap_log_append (char *buffer, int size, int length, const char *format, ...) {
+
+   va_list ap;
+   int count;
+
+   if (length >= size - 1) return length;
+
+   va_start (ap, format);
+   count = vsnprintf (buffer + length, size - length, format, ap);
+   va_end (ap);
+
+   if (count < 0) return length;
+
+   length += count;
+   if (length > size - 1) length = size - 1;
+
+   return length;
+}
+
+/* Marks a message cut to the size of the buffer, and returns its length.
+ * A message that fills the buffer exactly is taken as cut too.
+ */
+static int roadmap_log_truncated (char *buffer, int size) {
+
+   static const char marker[] = " ...[truncated]\n";
+
+   memcpy (buffer + size - sizeof(marker), marker, sizeof(marker));
+
+   return size - 1;
+}
+
+/* Formats a message in the buffer and returns its length. The position of
+ * the saved marker, set when the message also went to the log file, is
+ * returned in saved_at (-1 if there is none).
+ */
+static int roadmap_log_one (struct roadmap_message_descriptor *category,
+                            char *buffer,
+                            int size,
+                            int *saved_at,
+                            const char *source,
+                            int line,
+                            const char *format,
+                            va_list ap) {
 
 #if (defined (_WIN32) && !defined (__SYMBIAN32__) && !defined(QTMOBILITY))
 SYSTEMTIME st;
 #endif
 
-#ifndef USE_QT
+int length = 0;
+int count;
 int i;
+
+#ifndef USE_QT
 struct tm *tms;
 time_t now;
 char year[5], month[5], day[5];
@@ -225,16 +332,15 @@ GET_2_DIGIT_STRING( tms->tm_mon+1, month );	// Zero based from January
 GET_2_DIGIT_STRING( tms->tm_year-100, year ); // Year from 1900
 #endif // QTMOBILITY
 
+   *saved_at = -1;
+
 #ifdef J2ME
-   fprintf (file, "%d %c%s %s, line %d ",
-         time(NULL), saved, category->prefix, source, line);
+   length = roadmap_log_append (buffer, size, length, "%d ", time(NULL));
 #elif defined(USE_QT)
-    int i;
     time_s time = roadmap_time_get_current();
 
-    fprintf (file, "%02d:%02d:%02d.%03d %c%s %s, line %d ",
-          time.hour, time.min, time.sec, time.msec,
-          saved, category->prefix, source, line);
+    length = roadmap_log_append (buffer, size, length, "%02d:%02d:%02d.%03d ",
+          time.hour, time.min, time.sec, time.msec);
 #elif defined (__SYMBIAN32__)
 
 
@@ -242,9 +348,8 @@ GET_2_DIGIT_STRING( tms->tm_year-100, year ); // Year from 1900
    time (&now);
    tms = localtime (&now);
 
-   fprintf (file, "%02d:%02d:%02d %c%s %s, line %d ",
-         tms->tm_hour, tms->tm_min, tms->tm_sec,
-         saved, category->prefix, source, line);
+   length = roadmap_log_append (buffer, size, length, "%02d:%02d:%02d ",
+         tms->tm_hour, tms->tm_min, tms->tm_sec);
 #elif defined(ANDROID)
 
 
@@ -254,76 +359,411 @@ GET_2_DIGIT_STRING( tms->tm_year-100, year ); // Year from 1900
    tms = localtime (&now);
    strftime( date_buf, sizeof( date_buf ), "%d/%m/%y", tms );
 
-   fprintf (file, "%s %02d:%02d:%02d %c%s %s, line %d ",
-		   date_buf, tms->tm_hour, tms->tm_min, tms->tm_sec,
-         saved, category->prefix, source, line);
+   length = roadmap_log_append (buffer, size, length, "%s %02d:%02d:%02d ",
+		   date_buf, tms->tm_hour, tms->tm_min, tms->tm_sec);
 
 #elif defined (_WIN32) && !defined(QTMOBILITY)
    GetLocalTime(&st);
 
-   fprintf (file, "%02d/%02d %02d:%02d:%02d %s\t",
+   length = roadmap_log_append (buffer, size, length, "%02d/%02d %02d:%02d:%02d %s\t",
          st.wDay, st.wMonth, st.wHour, st.wMinute, st.wSecond,
          category->prefix);
 #else
-   //struct tm *tms;
    struct timeb tp;
 
-   clock_gettime(CLOCK_REALTIME, &tp)
+   ftime (&tp);
    tms = localtime (&tp.time);
 
-   fprintf (file, "%02d:%02d:%02d.%03d %c%s %s, line %d ",
-         tms->tm_hour, tms->tm_min, tms->tm_sec, tp.millitm,
-         saved, category->prefix, source, line);
+   length = roadmap_log_append (buffer, size, length, "%02d:%02d:%02d.%03d ",
+         tms->tm_hour, tms->tm_min, tms->tm_sec, tp.millitm);
+#endif
+
+#if !(defined (_WIN32) && !defined (__SYMBIAN32__) && !defined(QTMOBILITY))
+   *saved_at = length;
+   length = roadmap_log_append (buffer, size, length, " %s %s, line %d ",
+         category->prefix, source, line);
 #endif
 
    if (!category->show_stack && (RoadMapLogStackCursor > 0)) {
-      fprintf (file, "(%s): ", RoadMapLogStack[RoadMapLogStackCursor-1]);
+      length = roadmap_log_append (buffer, size, length, "(%s): ",
+            RoadMapLogStack[RoadMapLogStackCursor-1]);
    }
 
-#ifdef _DEBUG
-  // if( format && (*format) && ('\n' == format[strlen(format)-1]))
-#endif   // _DEBUG
-
-   vfprintf(file, format, ap);
-   fprintf( file, " \t[File: '%s'; Line: %d]\n", source, line);
+   if (length < size - 1) {
+      count = vsnprintf (buffer + length, size - length, format, ap);
+      if (count > 0) {
+         length += count;
+         if (length > size - 1) length = size - 1;
+      }
+   }
+   length = roadmap_log_append (buffer, size, length,
+         " \t[File: '%s'; Line: %d]\n", source, line);
 
    if (category->show_stack && RoadMapLogStackCursor > 0) {
 
       int indent = 8;
 
-      fprintf (file, "   Call stack:\n");
+      length = roadmap_log_append (buffer, size, length, "   Call stack:\n");
 
       for (i = 0; i < RoadMapLogStackCursor; ++i) {
-          fprintf (file, "%*.*s %s\n", indent, indent, "", RoadMapLogStack[i]);
+          length = roadmap_log_append (buffer, size, length,
+                "%*.*s %s\n", indent, indent, "", RoadMapLogStack[i]);
           indent += 3;
       }
    }
 
-   if (RoadmapLogMsgBox && category->do_exit) {
-      char str[500];
-      char msg[256];
-#ifdef   FREEZE_ON_FATAL_ERROR
-      const char* title = "Fatal Error - Process awaits debugger";
+   if (length >= size - 1) {
+      length = roadmap_log_truncated (buffer, size);
+   }
+
+   return length;
+}
+
+
+static void roadmap_log_open (void) {
+
+   static int open_file_attemped = 0;
+
+   if ((sgLogFile != NULL) || open_file_attemped) return;
+
+   open_file_attemped = 1;
+
+   sgLogFile = roadmap_file_fopen (roadmap_log_path(),
+                                   roadmap_log_filename(),
+                                   roadmap_log_access_mode());
+
+   if (sgLogFile) {
+      fseek (sgLogFile, 0, SEEK_END);
+      sgLogFileSize = ftell (sgLogFile);
+      sgLogFileSize += fprintf (sgLogFile, "*** Starting log file %d ***\n", (int)time(NULL));
+   }
+}
+
+
+static void roadmap_log_rotated_name (char *name, int size, int index) {
+
+   if (index == 0) {
+      snprintf (name, size, "%s", roadmap_log_filename());
+   } else {
+      snprintf (name, size, "%s.%d", roadmap_log_filename(), index);
+   }
+}
+
+
+/* postmortem becomes postmortem.1, postmortem.1 becomes postmortem.2, etc. */
+static void roadmap_log_rotate (void) {
+
+   const char *path = roadmap_log_path();
+   char from[64];
+   char to[64];
+   int i;
+
+   fclose (sgLogFile);
+   sgLogFile = NULL;
+
+   roadmap_log_rotated_name (to, sizeof(to), LOG_ROTATE_COUNT);
+   roadmap_file_remove (path, to);
+
+   for (i = LOG_ROTATE_COUNT - 1; i >= 0; --i) {
+
+      char *full_from;
+      char *full_to;
+
+      roadmap_log_rotated_name (from, sizeof(from), i);
+      roadmap_log_rotated_name (to, sizeof(to), i + 1);
+
+      if (!roadmap_file_exists (path, from)) continue;
+
+      full_from = roadmap_path_join (path, from);
+      full_to = roadmap_path_join (path, to);
+      roadmap_file_rename (full_from, full_to);
+      roadmap_path_free (full_from);
+      roadmap_path_free (full_to);
+   }
+
+   sgLogFileSize = 0;
+   sgLogFile = roadmap_file_fopen (path, roadmap_log_filename(), roadmap_log_access_mode());
+}
+
+
+static void roadmap_log_output (char *text, int length, int saved_at,
+                                int to_file, int to_stderr) {
+
+   if (to_file) {
+
+      roadmap_log_open ();
+
+      if (sgLogFile != NULL) {
+         fwrite (text, 1, length, sgLogFile);
+         sgLogFileSize += length;
+
+         if (saved_at >= 0) text[saved_at] = 's';
+      }
+   }
+
+#ifndef __SYMBIAN32__
+   if (to_stderr) {
+      fwrite (text, 1, length, stderr);
+   }
+#endif
+}
+
+
+static void roadmap_log_sync_file (void) {
+
+   if (sgLogFile == NULL) return;
+
+   fflush (sgLogFile);
+
+   if (sgLogFileSize > LOG_ROTATE_SIZE) {
+      roadmap_log_rotate ();
+   }
+}
+
+
+#ifdef LOG_ASYNC
+
+/* Returns 0, without locking, if this thread already holds the lock: a
+ * fatal error (e.g. no more memory) while the records are being written.
+ */
+static int roadmap_log_lock (void) {
+
+   if (sgLogLocked && pthread_equal (sgLogOwner, pthread_self ())) return 0;
+
+   pthread_mutex_lock (&sgLogLock);
+   sgLogOwner = pthread_self ();
+   __sync_synchronize ();
+   sgLogLocked = 1;
+
+   return 1;
+}
+
+
+static void roadmap_log_unlock (void) {
+
+   sgLogLocked = 0;
+   pthread_mutex_unlock (&sgLogLock);
+}
+
+
+static void roadmap_log_drain (void) {
+
+   unsigned int dropped;
+   int written = 0;
+
+   for (;;) {
+
+      RoadMapLogRecord *record = sgLogRing + (sgLogTail & (LOG_RING_SIZE - 1));
+
+      if (record->sequence != sgLogTail + 1) break;
+
+      __sync_synchronize ();
+      roadmap_log_output (record->text, record->length, record->saved_at,
+                          record->to_file, record->to_stderr);
+      __sync_synchronize ();
+
+      record->sequence = sgLogTail + LOG_RING_SIZE;
+      sgLogTail++;
+      written = 1;
+   }
+
+   dropped = __sync_lock_test_and_set (&sgLogDropped, 0);
+   if (dropped > 0) {
+
+      char text[64];
+      int length = snprintf (text, sizeof(text), "*** %u log messages dropped ***\n", dropped);
+
+      roadmap_log_output (text, length, -1, 1, 1);
+      written = 1;
+   }
+
+   if (written) {
+      roadmap_log_sync_file ();
+   }
+}
+
+
+static void *roadmap_log_writer (void *params) {
+
+   for (;;) {
+
+      pthread_mutex_lock (&sgLogWakeLock);
+      while (!sgLogPending) {
+         pthread_cond_wait (&sgLogWake, &sgLogWakeLock);
+      }
+      sgLogPending = 0;
+      pthread_mutex_unlock (&sgLogWakeLock);
+
+      roadmap_log_flush ();
+   }
+
+   return NULL;
+}
+
+
+static void roadmap_log_start (void) {
+
+   pthread_attr_t attr;
+   int i;
+
+   for (i = 0; i < LOG_RING_SIZE; ++i) {
+      sgLogRing[i].sequence = i;
+   }
+
+   pthread_attr_init (&attr);
+   pthread_attr_setdetachstate (&attr, PTHREAD_CREATE_DETACHED);
+   sgLogStarted = (pthread_create (&sgLogThread, &attr, roadmap_log_writer, NULL) == 0);
+   pthread_attr_destroy (&attr);
+
+   /* the messages still in the ring are written when the program exits */
+   atexit (roadmap_log_flush);
+}
+
+
+/* Reserves the next record of the ring, or returns NULL if it is full */
+static RoadMapLogRecord *roadmap_log_claim (unsigned int *position) {
+
+   unsigned int pos = sgLogHead;
+
+   for (;;) {
+
+      RoadMapLogRecord *record = sgLogRing + (pos & (LOG_RING_SIZE - 1));
+      int diff = (int)(record->sequence - pos);
+
+      if (diff == 0) {
+         if (__sync_bool_compare_and_swap (&sgLogHead, pos, pos + 1)) {
+            *position = pos;
+            return record;
+         }
+      } else if (diff < 0) {
+         __sync_fetch_and_add (&sgLogDropped, 1);
+         return NULL;
+      }
+
+      pos = sgLogHead;
+   }
+}
+
 
+static void roadmap_log_publish (RoadMapLogRecord *record, unsigned int position) {
+
+   __sync_synchronize ();
+   record->sequence = position + 1;
+
+   pthread_mutex_lock (&sgLogWakeLock);
+   sgLogPending = 1;
+   pthread_cond_signal (&sgLogWake);
+   pthread_mutex_unlock (&sgLogWakeLock);
+}
+
+#endif // LOG_ASYNC
+
+
+void roadmap_log_flush (void) {
+
+#ifdef LOG_ASYNC
+   if (roadmap_log_lock ()) {
+      roadmap_log_drain ();
+      roadmap_log_unlock ();
+   }
 #else
-      const char* title = "Fatal Error";
+   if (sgLogFile != NULL) fflush (sgLogFile);
+#endif
+}
 
-#endif   // FREEZE_ON_FATAL_ERROR
-      vsprintf(msg, format, ap);
-      sprintf (str, "%c%s %s, line %d %s",
-         saved, category->prefix, source, line, msg);
-      RoadmapLogMsgBox(title, str);
+
+static const char *roadmap_log_basename (const char *source) {
+
+   const char *name = strrchr (source, '/');
+
+   if (name == NULL) name = strrchr (source, '\\');
+
+   return (name != NULL) ? name + 1 : source;
+}
+
+
+static int roadmap_log_module_level (const char *source) {
+
+   int i;
+
+   if (sgLogModulesCount > 0) {
+
+      const char *name = roadmap_log_basename (source);
+
+      for (i = 0; i < sgLogModulesCount; ++i) {
+         if (strcmp (sgLogModules[i].source, name) == 0) {
+            return sgLogModules[i].level;
+         }
+      }
    }
+
+   return sgLogGlobalLevel;
 }
 
-void roadmap_log (int level, const char *source, int line, const char *format, ...) {
+
+static void roadmap_log_update_level (void) {
+
+   int i;
+
+   RoadMapLogLevel = sgLogGlobalLevel;
+
+   for (i = 0; i < sgLogModulesCount; ++i) {
+      if (sgLogModules[i].level < RoadMapLogLevel) {
+         RoadMapLogLevel = sgLogModules[i].level;
+      }
+   }
+}
+
+
+void roadmap_log_set_level (int level) {
+
+   sgLogGlobalLevel = level;
+   roadmap_log_update_level ();
+}
+
+
+/* A level of 0 or less removes the override of the source */
+void roadmap_log_set_module_level (const char *source, int level) {
+
+   const char *name = roadmap_log_basename (source);
+   int i;
+
+   for (i = 0; i < sgLogModulesCount; ++i) {
+      if (strcmp (sgLogModules[i].source, name) == 0) break;
+   }
+
+   if (level <= 0) {
+      if (i < sgLogModulesCount) {
+         sgLogModules[i] = sgLogModules[--sgLogModulesCount];
+      }
+   } else if (i < sgLogModulesCount) {
+      sgLogModules[i].level = level;
+   } else if (sgLogModulesCount < LOG_MAX_MODULES) {
+      strncpy (sgLogModules[i].source, name, sizeof(sgLogModules[i].source) - 1);
+      sgLogModules[i].source[sizeof(sgLogModules[i].source) - 1] = 0;
+      sgLogModules[i].level = level;
+      sgLogModulesCount++;
+   } else {
+      roadmap_log (ROADMAP_ERROR, "too many log modules, %s ignored", name);
+   }
+
+   roadmap_log_update_level ();
+}
+
+
+void roadmap_log_write (int level, const char *source, int line, const char *format, ...) {
 
    va_list ap;
-   char saved = ' ';
    struct roadmap_message_descriptor *category;
    char *debug;
+   char text[LOG_RECORD_SIZE];
+   int length;
+   int saved_at;
+#ifdef LOG_ASYNC
+   int locked;
+#endif
 
-   if (level < roadmap_verbosity()) return;
+   if (level < roadmap_log_module_level (source)) return;
 
 #if(defined DEBUG && defined SKIP_DEBUG_LOGS)
    return;
@@ -339,44 +779,63 @@ void roadmap_log (int level, const char *source, int line, const char *format, .
 
    va_start(ap, format);
 
-   if (category->save_to_file) {
-      static int open_file_attemped = 0;
-
-      if ((sgLogFile == NULL) && (!open_file_attemped)) {
-         open_file_attemped = 1;
-         
-         sgLogFile = roadmap_file_fopen (roadmap_log_path(),
-                                         roadmap_log_filename(),
-                                         roadmap_log_access_mode());
+#ifdef LOG_ASYNC
+   pthread_once (&sgLogOnce, roadmap_log_start);
 
-         if (sgLogFile) fprintf (sgLogFile, "*** Starting log file %d ***\n", (int)time(NULL));
-      }
+   /* a fatal error is written before the program exits */
+   if (sgLogStarted && !category->do_exit) {
 
-      if (sgLogFile != NULL) {
+      unsigned int position;
+      RoadMapLogRecord *record = roadmap_log_claim (&position);
 
-         roadmap_log_one (category, sgLogFile, ' ', source, line, format, ap);
-         fflush (sgLogFile);
-         //fclose (file);
-
-         va_end(ap);
-         va_start(ap, format);
-
-         saved = 's';
+      if (record != NULL) {
+         record->length = roadmap_log_one (category, record->text, sizeof(record->text),
+                                           &saved_at, source, line, format, ap);
+         record->saved_at = saved_at;
+         record->to_file = category->save_to_file;
+         record->to_stderr = 1;
+         roadmap_log_publish (record, position);
       }
-   }
 
-#ifdef __SYMBIAN32__
-   //roadmap_log_one (category, __stderr(), saved, source, line, format, ap);
-#else
+      va_end(ap);
+      return;
+   }
+#endif
 
 #if(defined WIN32PC && defined _DEBUG)
    show_logs_in_debugger( category, format, ap);
+   va_end(ap);
+   va_start(ap, format);
 #endif   // WIN32PC Debug
 
-   roadmap_log_one (category, stderr, saved, source, line, format, ap);
+   length = roadmap_log_one (category, text, sizeof(text), &saved_at,
+                             source, line, format, ap);
+   va_end(ap);
+
+#ifdef LOG_ASYNC
+   locked = sgLogStarted && roadmap_log_lock ();
+   if (locked) {
+      roadmap_log_drain ();
+   }
+#endif
+   roadmap_log_output (text, length, saved_at, category->save_to_file, 1);
+   roadmap_log_sync_file ();
+#ifdef LOG_ASYNC
+   if (locked) {
+      roadmap_log_unlock ();
+   }
 #endif
 
-   va_end(ap);
+   if (RoadmapLogMsgBox && category->do_exit) {
+#ifdef   FREEZE_ON_FATAL_ERROR
+      const char* title = "Fatal Error - Process awaits debugger";
+
+#else
+      const char* title = "Fatal Error";
+
+#endif   // FREEZE_ON_FATAL_ERROR
+      RoadmapLogMsgBox(title, text);
+   }
 
    if( category->do_exit)
 #ifdef FREEZE_ON_FATAL_ERROR
@@ -410,7 +869,32 @@ void roadmap_log (int level, const char *source, int line, const char *format, .
 
 void roadmap_log_purge (void) {
 
-    roadmap_file_remove (roadmap_path_user(), "postmortem");
+    char name[64];
+    int i;
+#ifdef LOG_ASYNC
+    int locked = sgLogStarted && roadmap_log_lock ();
+#endif
+
+    /* the open file would keep writing to the removed one */
+    if (sgLogFile != NULL) {
+       fclose (sgLogFile);
+       sgLogFile = NULL;
+    }
+
+    for (i = 0; i <= LOG_ROTATE_COUNT; ++i) {
+       roadmap_log_rotated_name (name, sizeof(name), i);
+       roadmap_file_remove (roadmap_log_path(), name);
+    }
+
+    sgLogFileSize = 0;
+    sgLogFile = roadmap_file_fopen (roadmap_log_path(), roadmap_log_filename(),
+                                    roadmap_log_access_mode());
+
+#ifdef LOG_ASYNC
+    if (locked) {
+       roadmap_log_unlock ();
+    }
+#endif
 }
 
 
@@ -459,6 +943,30 @@ BOOL roadmap_log_raw_data_fmt( const char *format, ... )
 	if ( sgLogFile && format )
 	{
 		va_start( ap, format );
+#ifdef LOG_ASYNC
+		if ( sgLogStarted )
+		{
+			unsigned int position;
+			RoadMapLogRecord *record = roadmap_log_claim( &position );
+
+			if ( record )
+			{
+				int length = vsnprintf( record->text, sizeof( record->text ), format, ap );
+
+				if ( length < 0 ) length = 0;
+				if ( length > (int) sizeof( record->text ) - 1 )
+					length = roadmap_log_truncated( record->text, sizeof( record->text ) );
+
+				record->length = length;
+				record->saved_at = -1;
+				record->to_file = 1;
+				record->to_stderr = 0;
+				roadmap_log_publish( record, position );
+			}
+			va_end( ap );
+			return FALSE;
+		}
+#endif
 		vfprintf( sgLogFile, format, ap );
 		ret_val = TRUE;
 		va_end( ap );
@@ -517,9 +1025,16 @@ void roadmap_log_init(){
 #endif
 
 FILE * roadmap_log_get_log_file(){
+	roadmap_log_flush();
+#ifdef LOG_ASYNC
+	/* The writer may close its own file to rotate it: the caller gets its
+	 * own file, and closes it */
+	return roadmap_file_fopen (roadmap_log_path(), roadmap_log_filename(), "r");
+#else
 	if (sgLogFile){
 		fseek(sgLogFile,0,SEEK_SET);
 		return sgLogFile;
 	}
 	return NULL;
+#endif
 }
@@ -953,6 +953,24 @@ void roadmap_math_release_focus (void) {
 }
 
 
+/* Points outside of this area are never visible */
+void roadmap_math_get_focus (RoadMapArea *area) {
+
+   int visibility_distance;
+
+   if (!RoadMapMathTileMode) {
+      visibility_distance = ROADMAP_VISIBILITY_DISTANCE;
+   } else {
+      visibility_distance = ROADMAP_VISIBILITY_FACTOR * (int)RoadMapContext.zoom;
+   }
+
+   area->east  = RoadMapContext.focus.east + visibility_distance;
+   area->west  = RoadMapContext.focus.west - visibility_distance;
+   area->north = RoadMapContext.focus.north + visibility_distance;
+   area->south = RoadMapContext.focus.south - visibility_distance;
+}
+
+
 int roadmap_math_get_visible_coordinates (const RoadMapPosition *from,
                                           const RoadMapPosition *to,
                                           RoadMapGuiPoint *point0,
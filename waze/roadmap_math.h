@@ -321,6 +321,7 @@ void roadmap_math_set_horizon     (int horizon,int is_projection);
 
 void roadmap_math_set_focus     (const RoadMapArea *focus);
 void roadmap_math_release_focus (void);
+void roadmap_math_get_focus     (RoadMapArea *area);
 
 int  roadmap_math_declutter (int level, int area);
 int  roadmap_math_thickness (int base, int declutter, int zoom_level,
@@ -58,6 +58,7 @@
 #include "editor/editor_cleanup.h"
 
 #include "roadmap_navigate.h"
+#include "roadmap_navigate_hmm.h"
 #include "roadmap_plugin.h"
 
 static RoadMapConfigDescriptor RoadMapNavigateMinMobileSpeedCfg =
@@ -75,6 +76,38 @@ static RoadMapTileCallback 		TileCbNext = NULL;
 static RoadMapConfigDescriptor RoadMapNavigateFlag =
                         ROADMAP_CONFIG_ITEM("Navigation", "Enable");
 
+static RoadMapConfigDescriptor RoadMapNavigateMatcherCfg =
+                        ROADMAP_CONFIG_ITEM("Navigation", "Map Matcher");
+static BOOL RoadMapNavigateUseHmm = FALSE;
+
+/* Scores the map matcher. With the fuzzy matcher, the hmm matcher also
+ * runs in shadow on the same fixes and is scored apart, so both engines
+ * are compared on the same drive. The fuzzy matcher keeps its state in the
+ * navigation itself, so it cannot run in shadow of the hmm matcher.
+ */
+static RoadMapConfigDescriptor RoadMapNavigateMatcherScoreCfg =
+                        ROADMAP_CONFIG_ITEM("Navigation", "Map Matcher Score");
+static BOOL RoadMapNavigateScoring = FALSE;
+
+#define SCORE_REPORT_FIXES    300
+#define SCORE_RETURN_TIME     10 /* seconds */
+
+typedef struct {
+   const char  *name;
+   int         fixes;
+   int         matched;
+   int         changes;
+   int         returns;     /* back to the previous line, soon after leaving it */
+   double      distance;
+   PluginLine  current_line;
+   int         current_direction;
+   PluginLine  previous_line;
+   time_t      change_time;
+} RoadMapNavigateScoreStats;
+
+static RoadMapNavigateScoreStats RoadMapNavigateScore;
+static RoadMapNavigateScoreStats RoadMapNavigateShadowScore;
+
 #define MIN_SPEED_INIT_TIME   10
 #define HIGH_SPEED_FILTER     32 //32 knot = 60 kph
 
@@ -897,6 +930,238 @@ int roadmap_navigate_is_jammed (PluginLine *line, int *direction) {
 
 
 
+static void roadmap_navigate_score_init (RoadMapNavigateScoreStats *score, const char *name) {
+
+   memset (score, 0, sizeof (*score));
+   score->name = name;
+   INVALIDATE_PLUGIN(score->current_line);
+   INVALIDATE_PLUGIN(score->previous_line);
+}
+
+
+/* Scores the line matched to the latest fix, NULL if none */
+static void roadmap_navigate_score (RoadMapNavigateScoreStats *score,
+                                    const RoadMapNeighbour *line, int direction) {
+
+   score->fixes++;
+
+   if (line == NULL) {
+
+      INVALIDATE_PLUGIN(score->current_line);
+
+   } else {
+
+      score->matched++;
+      score->distance += line->distance;
+
+      if (!PLUGIN_VALID(score->current_line) ||
+          !roadmap_plugin_same_line (&line->line, &score->current_line) ||
+          direction != score->current_direction) {
+
+         score->changes++;
+
+         if (PLUGIN_VALID(score->previous_line) &&
+             roadmap_plugin_same_line (&line->line, &score->previous_line) &&
+             RoadMapLatestGpsTime - score->change_time <= SCORE_RETURN_TIME) {
+            score->returns++;
+         }
+
+         score->previous_line = score->current_line;
+         score->change_time = RoadMapLatestGpsTime;
+         score->current_line = line->line;
+         score->current_direction = direction;
+      }
+   }
+
+   if (score->fixes % SCORE_REPORT_FIXES == 0) {
+      roadmap_log (ROADMAP_INFO,
+                   "Map matcher score (%s): %d fixes, %d matched, %d line changes, %d returns, mean distance %d m",
+                   score->name,
+                   score->fixes,
+                   score->matched,
+                   score->changes,
+                   score->returns,
+                   score->matched ? (int) (score->distance / score->matched) : 0);
+   }
+}
+
+
+static void roadmap_navigate_set_confirmed (const RoadMapNeighbour *line,
+                                            const RoadMapTracking *tracking,
+                                            RoadMapFuzzy result,
+                                            PluginLine old_line,
+                                            int old_direction) {
+
+   RoadMapConfirmedLine   = *line;
+   RoadMapConfirmedStreet = *tracking;
+
+   RoadMapConfirmedStreet.valid = 1;
+   RoadMapConfirmedStreet.cur_fuzzyfied = result;
+   INVALIDATE_PLUGIN(RoadMapConfirmedStreet.intersection);
+
+
+
+   roadmap_display_activate ("Current Street",
+                             &RoadMapConfirmedLine.line,
+                             NULL,
+                             &RoadMapConfirmedStreet.street);
+
+   if (old_direction != RoadMapConfirmedStreet.line_direction ||
+         !roadmap_plugin_same_line(&RoadMapConfirmedLine.line, &old_line)) {
+      //AviR: is entry_fuzzyfied used anywhere?
+      RoadMapConfirmedStreet.entry_fuzzyfied = result;
+
+      if (PLUGIN_VALID(old_line)) {
+         roadmap_navigate_trace ("Quit street %N", &old_line);
+      }
+      roadmap_navigate_trace ("Enter street %N, %C|Enter street %N",
+                              &RoadMapConfirmedLine.line);
+
+      on_segment_changed_inform_clients(&RoadMapConfirmedLine.line, RoadMapConfirmedStreet.line_direction);
+
+      roadmap_display_hide ("Approach");
+
+      if (RoadMapRouteInfo.enabled) {
+
+         RoadMapRouteInfo.current_line = RoadMapConfirmedLine.line;
+
+         RoadMapRouteInfo.callbacks.get_next_line
+         (&RoadMapConfirmedLine.line,
+          RoadMapConfirmedStreet.line_direction,
+          &RoadMapRouteInfo.next_line);
+      }
+   }
+
+   if (!RoadMapRouteInfo.enabled) {
+      if (RoadMapLatestGpsPosition.speed > roadmap_gps_speed_accuracy()) {
+         PluginLine p_line;
+         roadmap_navigate_find_intersection (&RoadMapLatestGpsPosition, &p_line);
+      }
+   }
+}
+
+
+/* Returns FALSE if the lost line cannot be accessed */
+static BOOL roadmap_navigate_set_lost (void) {
+
+   if (PLUGIN_VALID(RoadMapConfirmedLine.line)) {
+
+      if (roadmap_plugin_activate_db
+          (&RoadMapConfirmedLine.line) == -1)
+         return FALSE;
+
+      roadmap_navigate_trace ("Lost street %N",
+                              &RoadMapConfirmedLine.line);
+      roadmap_display_hide ("Current Street");
+      roadmap_display_hide ("Approach");
+   }
+
+   INVALIDATE_PLUGIN(RoadMapConfirmedLine.line);
+   RoadMapConfirmedStreet.valid = 0;
+
+   roadmap_navigate_set_mobile(&RoadMapLatestGpsPosition, NULL, 0);
+
+   return TRUE;
+}
+
+
+/* Returns the index of the line the hmm matcher matches to the latest fix,
+ * among the neighbours it finds, or -1.
+ */
+static int roadmap_navigate_hmm_match (RoadMapNeighbour *neighbours, int *direction) {
+
+   int count;
+
+#ifndef J2ME
+   //FIXME remove when navigation will support plugin lines
+   if (RoadMapRouteInfo.enabled) {
+      editor_plugin_set_override (0);
+   }
+#endif
+   count = roadmap_navigate_get_neighbours (&RoadMapLatestPosition, 0, roadmap_fuzzy_max_distance(),
+                                            3, neighbours, ROADMAP_NEIGHBOURHOUD, LAYER_ALL_ROADS);
+#ifndef J2ME
+   if (RoadMapRouteInfo.enabled) {
+      editor_plugin_set_override (1);
+   }
+#endif
+
+   return roadmap_navigate_hmm_update (&RoadMapLatestGpsPosition, RoadMapLatestGpsTime,
+                                       neighbours, count, direction);
+}
+
+
+/* Runs the hmm matcher in shadow of the fuzzy matcher, only to score it */
+static void roadmap_navigate_shadow_hmm (void) {
+
+   static RoadMapNeighbour neighbours[ROADMAP_NEIGHBOURHOUD];
+   int direction = 0;
+   int index = roadmap_navigate_hmm_match (neighbours, &direction);
+
+   roadmap_navigate_score (&RoadMapNavigateShadowScore,
+                           index >= 0 ? neighbours + index : NULL, direction);
+}
+
+
+/* Matches the position using the whole recent track (see roadmap_navigate_hmm.c) */
+static void roadmap_navigate_locate_hmm (void) {
+
+   PluginLine old_line = RoadMapConfirmedLine.line;
+   int old_direction = RoadMapConfirmedStreet.line_direction;
+   RoadMapTracking tracking;
+   RoadMapNeighbour *line;
+   RoadMapFuzzy result;
+   int direction;
+   int index;
+
+   index = roadmap_navigate_hmm_match (RoadMapNeighbourhood, &direction);
+
+   if (index >= 0 &&
+       roadmap_plugin_activate_db (&RoadMapNeighbourhood[index].line) != -1) {
+
+      line = RoadMapNeighbourhood + index;
+
+      /* the fuzzy values are kept for the clients of the tracking */
+      result = roadmap_navigate_fuzzify_internal (&tracking,
+                                                  &RoadMapConfirmedStreet,
+                                                  &RoadMapConfirmedLine,
+                                                  line,
+                                                  0,
+                                                  RoadMapLatestGpsPosition.steering,
+                                                  0,
+                                                  RoadMapLatestGpsPosition.speed,
+                                                  RoadMapLatestGpsPosition.accuracy);
+
+      tracking.line_direction = direction;
+      if (direction == ROUTE_DIRECTION_WITH_LINE) {
+         tracking.azymuth = roadmap_math_azymuth (&line->from, &line->to);
+      } else {
+         tracking.azymuth = roadmap_math_azymuth (&line->to, &line->from);
+      }
+
+      roadmap_navigate_set_confirmed (line, &tracking, result, old_line, old_direction);
+
+      roadmap_navigate_set_mobile(&RoadMapLatestGpsPosition,
+                                  &RoadMapConfirmedLine.intersection,
+                                  roadmap_math_azymuth(&RoadMapConfirmedLine.from,
+                                                       &RoadMapConfirmedLine.to)
+                                  );
+
+   } else if (!roadmap_navigate_set_lost ()) {
+      return;
+   }
+
+   if (RoadMapRouteInfo.enabled) {
+
+      RoadMapRouteInfo.callbacks.update
+      (&RoadMapLatestPosition,
+       &RoadMapConfirmedLine.line,
+       RoadMapLatestGpsPosition.speed,
+       TRUE);
+   }
+}
+
+
 void roadmap_navigate_locate (const RoadMapGpsPosition *gps_position, time_t gps_time) {
 
    RoadMapNavCandidates candidates[ROADMAP_NEIGHBOURHOUD];
@@ -1070,6 +1335,11 @@ void roadmap_navigate_locate (const RoadMapGpsPosition *gps_position, time_t gps
    roadmap_trip_set_mobile ("GPS_LOCATE", &RoadMapLatestGpsPosition); //AviR: debug
 #endif
 
+   if (RoadMapNavigateUseHmm) {
+      roadmap_navigate_locate_hmm ();
+      goto ret;
+   }
+
    if (RoadMapConfirmedStreet.valid) {
 
       /* We have an existing street match: check it is still valid. */
@@ -1490,52 +1760,8 @@ void roadmap_navigate_locate (const RoadMapGpsPosition *gps_position, time_t gps
       }
 
 
-      RoadMapConfirmedLine   = RoadMapNeighbourhood[nominated_index];
-      RoadMapConfirmedStreet = nominated;
-
-      RoadMapConfirmedStreet.valid = 1;
-      RoadMapConfirmedStreet.cur_fuzzyfied = nominated_result;
-      INVALIDATE_PLUGIN(RoadMapConfirmedStreet.intersection);
-
-
-
-      roadmap_display_activate ("Current Street",
-                                &RoadMapConfirmedLine.line,
-                                NULL,
-                                &RoadMapConfirmedStreet.street);
-
-      if (old_direction != RoadMapConfirmedStreet.line_direction ||
-            !roadmap_plugin_same_line(&RoadMapConfirmedLine.line, &old_line)) {
-         //AviR: is entry_fuzzyfied used anywhere?
-         RoadMapConfirmedStreet.entry_fuzzyfied = nominated_result;
-
-         if (PLUGIN_VALID(old_line)) {
-            roadmap_navigate_trace ("Quit street %N", &old_line);
-         }
-         roadmap_navigate_trace ("Enter street %N, %C|Enter street %N",
-                                 &RoadMapConfirmedLine.line);
-
-         on_segment_changed_inform_clients(&RoadMapConfirmedLine.line, RoadMapConfirmedStreet.line_direction);
-
-         roadmap_display_hide ("Approach");
-
-         if (RoadMapRouteInfo.enabled) {
-
-            RoadMapRouteInfo.current_line = RoadMapConfirmedLine.line;
-
-            RoadMapRouteInfo.callbacks.get_next_line
-            (&RoadMapConfirmedLine.line,
-             RoadMapConfirmedStreet.line_direction,
-             &RoadMapRouteInfo.next_line);
-         }
-      }
-
-      if (!RoadMapRouteInfo.enabled) {
-         if (RoadMapLatestGpsPosition.speed > roadmap_gps_speed_accuracy()) {
-            PluginLine p_line;
-            roadmap_navigate_find_intersection (&RoadMapLatestGpsPosition, &p_line);
-         }
-      }
+      roadmap_navigate_set_confirmed (RoadMapNeighbourhood + nominated_index, &nominated,
+                                      nominated_result, old_line, old_direction);
 
       if (1 || candidates[0].in_route ||
           !roadmap_fuzzy_is_certain(candidates[1].result) ||
@@ -1559,22 +1785,7 @@ void roadmap_navigate_locate (const RoadMapGpsPosition *gps_position, time_t gps
 
    } else {
       confidence = roadmap_fuzzy_false();
-      if (PLUGIN_VALID(RoadMapConfirmedLine.line)) {
-
-         if (roadmap_plugin_activate_db
-             (&RoadMapConfirmedLine.line) == -1)
-            goto ret;
-
-         roadmap_navigate_trace ("Lost street %N",
-                                 &RoadMapConfirmedLine.line);
-         roadmap_display_hide ("Current Street");
-         roadmap_display_hide ("Approach");
-      }
-
-      INVALIDATE_PLUGIN(RoadMapConfirmedLine.line);
-      RoadMapConfirmedStreet.valid = 0;
-
-      roadmap_navigate_set_mobile(&RoadMapLatestGpsPosition, NULL, 0);
+      if (!roadmap_navigate_set_lost ()) goto ret;
    }
 
    if (RoadMapRouteInfo.enabled) {
@@ -1590,6 +1801,14 @@ ret:
 #ifdef DEBUG_PRINTS
    printf("confidence: %d\n==========\n", confidence);
 #endif
+   if (RoadMapNavigateScoring && RoadMapNavigateEnabled) {
+      roadmap_navigate_score (&RoadMapNavigateScore,
+                              RoadMapConfirmedStreet.valid ? &RoadMapConfirmedLine : NULL,
+                              RoadMapConfirmedStreet.line_direction);
+      if (!RoadMapNavigateUseHmm) {
+         roadmap_navigate_shadow_hmm ();
+      }
+   }
    confidence_time = now_ms;
    roadmap_math_set_context (&context_save_pos, context_save_zoom);
    if (RoadMapConfirmedStreet.valid)
@@ -1658,6 +1877,8 @@ void roadmap_navigate_check_alerts (RoadMapGpsPosition *gps_position) {
 
 static void on_tile_update( int tile_id )
 {
+	roadmap_navigate_hmm_tile_changed (tile_id);
+
 	if (RoadMapConfirmedStreet.valid &&
        RoadMapConfirmedLine.line.square == tile_id) {
       roadmap_log(ROADMAP_WARNING, "on_tile_update() - confirmed line is in updated tile (%d), invalidating...", tile_id);
@@ -1686,10 +1907,18 @@ void roadmap_navigate_initialize (void) {
         ("preferences", &RoadMapNavigateMaxJamSpeedCfg, "10", NULL);
     roadmap_config_declare
         ("preferences", &RoadMapNavigateMinJamDistanceFromEndCfg, "150", NULL);
+    roadmap_config_declare_enumeration
+        ("preferences", &RoadMapNavigateMatcherCfg, NULL, "fuzzy", "hmm", NULL);
+    roadmap_config_declare_enumeration
+        ("preferences", &RoadMapNavigateMatcherScoreCfg, NULL, "no", "yes", NULL);
 
 	RoadMapNavigateMinMobileSpeed = roadmap_config_get_integer (&RoadMapNavigateMinMobileSpeedCfg);
 	RoadMapNavigateMaxJamSpeed = roadmap_config_get_integer (&RoadMapNavigateMaxJamSpeedCfg);
    RoadMapNavigateMinJamDistanceFromEnd = roadmap_config_get_integer (&RoadMapNavigateMinJamDistanceFromEndCfg);
+   RoadMapNavigateUseHmm = roadmap_config_match (&RoadMapNavigateMatcherCfg, "hmm");
+   RoadMapNavigateScoring = roadmap_config_match (&RoadMapNavigateMatcherScoreCfg, "yes");
+   roadmap_navigate_score_init (&RoadMapNavigateScore, RoadMapNavigateUseHmm ? "hmm" : "fuzzy");
+   roadmap_navigate_score_init (&RoadMapNavigateShadowScore, "hmm shadow");
    
    TileCbNext = roadmap_tile_register_callback(on_tile_update);
 }
@@ -0,0 +1,399 @@
+/* roadmap_navigate_hmm.c - hidden Markov model map matching.
+ *
+ * LICENSE:
+ *
+ *   Copyright 2012 Assaf Paz
+ *
+ *   This file is part of RoadMap.
+ *
+ *   RoadMap is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   RoadMap is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with RoadMap; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * NOTES:
+ *
+ *   Each fix has a set of states: a candidate line with a direction.
+ *   The cost of a state is its distance from the fix and from the GPS
+ *   steering, plus the cheapest way to reach it from a state of the
+ *   previous fix. A transition costs the difference between the distance
+ *   driven along the road and the distance between the two fixes, so
+ *   a jump to a line that is not connected to the previous one is
+ *   expensive but still possible.
+ *
+ *   The lattice keeps the states of the last HMM_LAG + 1 fixes, each with
+ *   a pointer to its best predecessor. When a fix arrives, the best path is
+ *   followed back HMM_LAG fixes and the state it passes there is decided.
+ *   The states of the new fix whose path does not go through the decided
+ *   state are dropped, so the match never flips back to a history that was
+ *   already ruled out. The number of states is bounded, so each fix costs
+ *   at most HMM_MAX_STATES^2 transitions and HMM_MAX_STATES * HMM_LAG steps
+ *   back.
+ */
+
+#include <math.h>
+
+#include "roadmap.h"
+#include "roadmap_math.h"
+#include "roadmap_line.h"
+#include "roadmap_line_route.h"
+#include "roadmap_square.h"
+#include "roadmap_plugin.h"
+#include "navigate/navigate_graph.h"
+
+#include "roadmap_navigate_hmm.h"
+
+
+#define HMM_MAX_STATES           16
+#define HMM_MAX_SUCCESSORS       16
+
+/* Fixes between the latest one and the decided one */
+#define HMM_LAG                  4
+#define HMM_COLUMNS              (HMM_LAG + 1)
+
+/* Fixes further apart restart the matching */
+#define HMM_MAX_GAP              10
+
+#define HMM_MIN_SIGMA            5     /* meters */
+#define HMM_MAX_SIGMA            50
+#define HMM_HEADING_SIGMA        30.0  /* degrees */
+#define HMM_BETA                 10.0  /* meters */
+#define HMM_DISCONNECT_DISTANCE  150   /* meters */
+#define HMM_UTURN_DISTANCE       50
+
+typedef struct {
+
+   RoadMapNeighbour  neighbour;
+   int               index;
+   int               direction;
+   double            cost;
+   int               prev;    /* the best state of the previous fix */
+
+   /* the line ends, in the direction of the state */
+   int               known_ends;
+   RoadMapPosition   entry;
+   RoadMapPosition   exit;
+   int               exit_point;
+
+   int               successors_count;
+   struct successor  successors[HMM_MAX_SUCCESSORS];
+} HmmState;
+
+/* A ring of columns, one for each of the last fixes */
+static HmmState   HmmStates[HMM_COLUMNS][HMM_MAX_STATES];
+static int        HmmStatesCount[HMM_COLUMNS];
+static int        HmmCurrent = 0;
+static int        HmmColumns = 0;
+
+static RoadMapPosition  HmmLastFix;
+static time_t           HmmLastTime = 0;
+
+
+static void roadmap_navigate_hmm_set_ends (HmmState *state) {
+
+   const PluginLine *line = &state->neighbour.line;
+   RoadMapPosition from;
+   RoadMapPosition to;
+   int from_point;
+   int to_point;
+
+   state->known_ends = 0;
+   state->successors_count = 0;
+
+   if (line->plugin_id != ROADMAP_PLUGIN_ID) return;
+
+   roadmap_square_set_current (line->square);
+   roadmap_line_from (line->line_id, &from);
+   roadmap_line_to (line->line_id, &to);
+   roadmap_line_points (line->line_id, &from_point, &to_point);
+
+   if (state->direction == ROUTE_DIRECTION_WITH_LINE) {
+      state->entry = from;
+      state->exit = to;
+      state->exit_point = to_point;
+   } else {
+      state->entry = to;
+      state->exit = from;
+      state->exit_point = from_point;
+   }
+   state->known_ends = 1;
+}
+
+
+static void roadmap_navigate_hmm_set_successors (HmmState *state) {
+
+   if (!state->known_ends) return;
+
+   state->successors_count =
+      get_connected_segments (state->neighbour.line.square,
+                              state->neighbour.line.line_id,
+                              state->direction == ROUTE_DIRECTION_AGAINST_LINE,
+                              state->exit_point,
+                              state->successors, HMM_MAX_SUCCESSORS, 1, 1);
+}
+
+
+static double roadmap_navigate_hmm_emission (const HmmState *state,
+                                             const RoadMapGpsPosition *gps) {
+
+   int sigma = gps->accuracy;
+   double cost;
+
+   if (sigma < HMM_MIN_SIGMA) sigma = HMM_MIN_SIGMA;
+   if (sigma > HMM_MAX_SIGMA) sigma = HMM_MAX_SIGMA;
+
+   cost = (double) state->neighbour.distance / sigma;
+   cost = cost * cost / 2;
+
+   /* the steering is meaningless when standing */
+   if (gps->speed > roadmap_gps_speed_accuracy ()) {
+
+      int azymuth;
+      double delta;
+
+      if (state->direction == ROUTE_DIRECTION_WITH_LINE) {
+         azymuth = roadmap_math_azymuth (&state->neighbour.from, &state->neighbour.to);
+      } else {
+         azymuth = roadmap_math_azymuth (&state->neighbour.to, &state->neighbour.from);
+      }
+
+      delta = roadmap_math_delta_direction (azymuth, gps->steering) / HMM_HEADING_SIGMA;
+      cost += delta * delta / 2;
+   }
+
+   return cost;
+}
+
+
+static double roadmap_navigate_hmm_transition (const HmmState *from,
+                                               const HmmState *to,
+                                               int fix_distance) {
+
+   int road_distance;
+   int i;
+
+   if (roadmap_plugin_same_line (&from->neighbour.line, &to->neighbour.line)) {
+
+      road_distance = roadmap_math_distance (&from->neighbour.intersection,
+                                             &to->neighbour.intersection);
+      if (from->direction != to->direction) {
+         road_distance += HMM_UTURN_DISTANCE;
+      }
+
+   } else {
+
+      road_distance = fix_distance + HMM_DISCONNECT_DISTANCE;
+
+      if (to->known_ends) {
+
+         for (i = 0; i < from->successors_count; i++) {
+
+            const struct successor *next = from->successors + i;
+
+            if (next->square_id == to->neighbour.line.square &&
+                next->line_id == to->neighbour.line.line_id &&
+                next->reversed == (to->direction == ROUTE_DIRECTION_AGAINST_LINE)) {
+
+               road_distance =
+                  roadmap_math_distance (&from->neighbour.intersection, &from->exit) +
+                  roadmap_math_distance (&to->entry, &to->neighbour.intersection);
+               break;
+            }
+         }
+      }
+   }
+
+   return fabs ((double) (road_distance - fix_distance)) / HMM_BETA;
+}
+
+
+/* Adds a state in the new column, keeping the cheapest ones */
+static void roadmap_navigate_hmm_add (HmmState *states, int *count, const HmmState *state) {
+
+   int i;
+
+   if (*count == HMM_MAX_STATES) {
+      if (state->cost >= states[*count - 1].cost) return;
+      (*count)--;
+   }
+
+   for (i = *count; i > 0 && states[i - 1].cost > state->cost; i--) {
+      states[i] = states[i - 1];
+   }
+   states[i] = *state;
+   (*count)++;
+}
+
+
+/* Returns the state the path of a state goes through, back fixes earlier */
+static int roadmap_navigate_hmm_ancestor (int column, int index, int back) {
+
+   while (back-- > 0) {
+      index = HmmStates[column][index].prev;
+      column = (column + HMM_COLUMNS - 1) % HMM_COLUMNS;
+   }
+
+   return index;
+}
+
+
+/* Decides the state HMM_LAG fixes back on the best path, and drops the
+ * states of the latest fix which do not descend from it.
+ */
+static void roadmap_navigate_hmm_decide (void) {
+
+   HmmState *states = HmmStates[HmmCurrent];
+   int count = HmmStatesCount[HmmCurrent];
+   int decided;
+   int kept = 0;
+   int i;
+
+   if (HmmColumns < HMM_COLUMNS) return;
+
+   decided = roadmap_navigate_hmm_ancestor (HmmCurrent, 0, HMM_LAG);
+
+   for (i = 0; i < count; i++) {
+      if (roadmap_navigate_hmm_ancestor (HmmCurrent, i, HMM_LAG) == decided) {
+         if (kept != i) states[kept] = states[i];
+         kept++;
+      }
+   }
+
+   HmmStatesCount[HmmCurrent] = kept;
+}
+
+
+void roadmap_navigate_hmm_reset (void) {
+
+   HmmColumns = 0;
+   HmmLastTime = 0;
+}
+
+
+void roadmap_navigate_hmm_tile_changed (int square) {
+
+   int column;
+   int i;
+
+   for (column = 0; column < HmmColumns; column++) {
+
+      int index = (HmmCurrent + HMM_COLUMNS - column) % HMM_COLUMNS;
+      HmmState *states = HmmStates[index];
+
+      for (i = 0; i < HmmStatesCount[index]; i++) {
+         if (states[i].neighbour.line.square == square) {
+            roadmap_navigate_hmm_reset ();
+            return;
+         }
+      }
+   }
+}
+
+
+int roadmap_navigate_hmm_update (const RoadMapGpsPosition *gps,
+                                 time_t gps_time,
+                                 const RoadMapNeighbour *neighbours,
+                                 int count,
+                                 int *direction) {
+
+   int next = (HmmCurrent + 1) % HMM_COLUMNS;
+   HmmState *previous = HmmStates[HmmCurrent];
+   int previous_count = HmmColumns > 0 ? HmmStatesCount[HmmCurrent] : 0;
+   HmmState *states = HmmStates[next];
+   int states_count = 0;
+   RoadMapPosition fix;
+   int fix_distance = 0;
+   int i;
+   int j;
+   int k;
+
+   fix.longitude = gps->longitude;
+   fix.latitude = gps->latitude;
+
+   if (HmmLastTime == 0 || gps_time - HmmLastTime > HMM_MAX_GAP) {
+      previous_count = 0;
+      HmmColumns = 0;
+   } else {
+      fix_distance = roadmap_math_distance (&HmmLastFix, &fix);
+   }
+
+   for (i = 0; i < count; i++) {
+
+      int line_direction =
+         roadmap_plugin_get_direction ((PluginLine *) &neighbours[i].line, ROUTE_CAR_ALLOWED);
+
+      for (k = ROUTE_DIRECTION_WITH_LINE; k <= ROUTE_DIRECTION_AGAINST_LINE; k++) {
+
+         HmmState state;
+
+         if (line_direction != ROUTE_DIRECTION_ANY &&
+             line_direction != ROUTE_DIRECTION_NONE &&
+             line_direction != k) {
+            continue;
+         }
+
+         state.neighbour = neighbours[i];
+         state.index = i;
+         state.direction = k;
+         state.cost = roadmap_navigate_hmm_emission (&state, gps);
+         state.prev = -1;
+
+         if (previous_count > 0) {
+
+            double best = -1;
+
+            roadmap_navigate_hmm_set_ends (&state);
+            for (j = 0; j < previous_count; j++) {
+
+               double cost = previous[j].cost +
+                  roadmap_navigate_hmm_transition (previous + j, &state, fix_distance);
+
+               if (best < 0 || cost < best) {
+                  best = cost;
+                  state.prev = j;
+               }
+            }
+            state.cost += best;
+         }
+
+         roadmap_navigate_hmm_add (states, &states_count, &state);
+      }
+   }
+
+   HmmLastFix = fix;
+   HmmLastTime = gps_time;
+
+   if (states_count == 0) {
+      HmmColumns = 0;
+      return -1;
+   }
+
+   HmmCurrent = next;
+   HmmStatesCount[HmmCurrent] = states_count;
+   if (HmmColumns < HMM_COLUMNS) HmmColumns++;
+
+   roadmap_navigate_hmm_decide ();
+   states_count = HmmStatesCount[HmmCurrent];
+
+   /* keep the costs small, and prepare the next transitions */
+   for (i = states_count - 1; i >= 0; i--) {
+      states[i].cost -= states[0].cost;
+      if (previous_count == 0) {
+         roadmap_navigate_hmm_set_ends (states + i);
+      }
+      roadmap_navigate_hmm_set_successors (states + i);
+   }
+
+   *direction = states[0].direction;
+
+   return states[0].index;
+}
@@ -0,0 +1,47 @@
+/* roadmap_navigate_hmm.h - hidden Markov model map matching.
+ *
+ * LICENSE:
+ *
+ *   Copyright 2012 Assaf Paz
+ *
+ *   This file is part of RoadMap.
+ *
+ *   RoadMap is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   RoadMap is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with RoadMap; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef INCLUDE__ROADMAP_NAVIGATE_HMM__H
+#define INCLUDE__ROADMAP_NAVIGATE_HMM__H
+
+#include <time.h>
+
+#include "roadmap_gps.h"
+#include "roadmap_street.h"
+
+/* Forgets all the previous fixes */
+void roadmap_navigate_hmm_reset (void);
+
+/* Forgets the candidates on lines of an updated tile */
+void roadmap_navigate_hmm_tile_changed (int square);
+
+/* Adds a fix with its candidate lines. Returns the index of the matched
+ * candidate and sets its direction, or -1 if no candidate matches.
+ */
+int roadmap_navigate_hmm_update (const RoadMapGpsPosition *gps,
+                                 time_t gps_time,
+                                 const RoadMapNeighbour *neighbours,
+                                 int count,
+                                 int *direction);
+
+#endif // INCLUDE__ROADMAP_NAVIGATE_HMM__H
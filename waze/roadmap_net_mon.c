@@ -49,6 +49,15 @@ static time_t LastActivityTime = 0;
 static const char *LastErrorText = "";
 static ROADMAP_NET_MON_STATE CurrentState = NET_MON_DISABLED;
 
+/* The http requests, logged at shutdown */
+static struct {
+   int requests;
+   int reused;                /* sent on a connection that was already open */
+   long long first_byte_msec; /* total time until the response header */
+   long long total_msec;      /* total time until the end of the response */
+   int max_msec;
+} RequestStats;
+
 static RoadMapConfigDescriptor RoadMapConfigNetMonitorEnabled =
                         ROADMAP_CONFIG_ITEM("Network", "Monitor Enabled");
 static BOOL RoadMapNetMonEnabled = FALSE;
@@ -120,6 +129,13 @@ void roadmap_net_mon_destroy (void) {
    const char* netmon_cfg_value = RoadMapNetMonEnabled ? "yes" : "no";
   waze_assert (CurrentState != NET_MON_DISABLED);
    CurrentState = NET_MON_DISABLED;
+   if (RequestStats.requests > 0) {
+      roadmap_log (ROADMAP_INFO, "Net requests: %d, reused connections: %d, avg first byte: %d ms, avg total: %d ms, max: %d ms",
+                   RequestStats.requests, RequestStats.reused,
+                   (int)(RequestStats.first_byte_msec / RequestStats.requests),
+                   (int)(RequestStats.total_msec / RequestStats.requests),
+                   RequestStats.max_msec);
+   }
    // Network monitor enabled configuration value
    roadmap_config_set( &RoadMapConfigNetMonitorEnabled, netmon_cfg_value );
    //roadmap_screen_mark_redraw ();
@@ -187,6 +203,19 @@ void roadmap_net_mon_recv (size_t size) {
 }
 
 
+/* Called when an http request is complete. first_byte_msec is -1 if no
+ * response header was received.
+ */
+void roadmap_net_mon_request_done (BOOL reused, int first_byte_msec, int total_msec) {
+
+   RequestStats.requests++;
+   if (reused) RequestStats.reused++;
+   RequestStats.first_byte_msec += (first_byte_msec >= 0) ? first_byte_msec : total_msec;
+   RequestStats.total_msec += total_msec;
+   if (total_msec > RequestStats.max_msec) RequestStats.max_msec = total_msec;
+}
+
+
 /* Called if an error occures
 */
 void roadmap_net_mon_error (const char *text) {
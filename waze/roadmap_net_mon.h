@@ -51,5 +51,6 @@ void roadmap_net_mon_offline (void);
 BOOL roadmap_net_mon_get_enabled( void );
 void roadmap_net_mon_set_enabled( BOOL is_enabled );
 void roadmap_net_mon_initialize (void);
+void roadmap_net_mon_request_done (BOOL reused, int first_byte_msec, int total_msec);
 #endif // INCLUDE__ROADMAP_NET_MON__H
 
@@ -118,6 +118,14 @@ struct RoadMapObjectDescriptor {
    struct RoadMapObjectDescriptor *next;
    struct RoadMapObjectDescriptor *previous;
    struct RoadMapObjectDescriptor *child;
+   struct RoadMapObjectDescriptor *parent;
+
+   unsigned int stamp; /* Insertion order, within the priority. */
+
+   struct RoadMapObjectDescriptor *hash_next;
+
+   int cell; /* Grid bucket, -1 if not in the grid. */
+   struct RoadMapObjectDescriptor *cell_next;
    
    BOOL   check_overlapping;
 	int   scale_factor;
@@ -128,7 +136,48 @@ typedef struct RoadMapObjectDescriptor RoadMapObject;
 
 static BOOL short_click_enabled = TRUE;
 
+/* The objects, sorted by priority (highest first) and then by insertion
+ * (newest first). The first object of each priority in use is kept, in a
+ * table sorted the same way, so inserting does not need to walk the list.
+ * Any priority may be used (e.g. OBJECT_PRIORITY_HIGHEST plus the draw
+ * order of the external POIs).
+ */
+typedef struct {
+   int            priority;
+   RoadMapObject *first;
+} RoadMapObjectPriority;
+
 static RoadMapObject *RoadmapObjectList = NULL;
+static RoadMapObject *RoadmapObjectLast = NULL;
+static RoadMapObjectPriority *RoadmapObjectPriorities = NULL;
+static int RoadmapObjectPrioritiesCount = 0;
+static int RoadmapObjectPrioritiesSize = 0;
+static unsigned int RoadmapObjectStamp = 0;
+
+/* Objects (and children) by id. The ids are dynamic strings, so the
+ * pointer identifies the string.
+ */
+#define OBJECT_HASH_SIZE   512
+static RoadMapObject *RoadmapObjectHash[OBJECT_HASH_SIZE];
+
+/* Objects by position, on a uniform grid of OBJECT_GRID_CELL units
+ * (about 2Km). The cells are hashed into OBJECT_GRID_SIZE buckets, so a
+ * bucket may hold objects of several cells.
+ */
+#define OBJECT_GRID_CELL   20000
+#define OBJECT_GRID_SIZE   256
+static RoadMapObject *RoadmapObjectGrid[OBJECT_GRID_SIZE];
+static unsigned int RoadmapObjectGridMark[OBJECT_GRID_SIZE];
+static unsigned int RoadmapObjectGridQuery = 0;
+
+typedef struct {
+   RoadMapObject **objects;
+   int count;
+   int size;
+} RoadMapObjectSet;
+
+static RoadMapObjectSet RoadmapObjectDrawSet;
+static RoadMapObjectSet RoadmapObjectTouchSet;
 
 static BOOL initialized = FALSE;
 
@@ -623,18 +672,165 @@ static BOOL is_fully_visible(RoadMapObject *cursor) {
 }
 #endif
 
+static int object_hash_code (RoadMapDynamicString id) {
+
+   return (int)(((size_t)id >> 4) % OBJECT_HASH_SIZE);
+}
+
+static void object_hash_add (RoadMapObject *object) {
+
+   int code = object_hash_code (object->id);
+
+   object->hash_next = RoadmapObjectHash[code];
+   RoadmapObjectHash[code] = object;
+}
+
+static void object_hash_remove (RoadMapObject *object) {
+
+   RoadMapObject **cursor = &RoadmapObjectHash[object_hash_code (object->id)];
+
+   while (*cursor != NULL) {
+      if (*cursor == object) {
+         *cursor = object->hash_next;
+         return;
+      }
+      cursor = &(*cursor)->hash_next;
+   }
+}
+
 static RoadMapObject *roadmap_object_search (RoadMapDynamicString id) {
 
    RoadMapObject *cursor;
 
-   for (cursor = RoadmapObjectList; cursor != NULL; cursor = cursor->next) {
+   for (cursor = RoadmapObjectHash[object_hash_code (id)]; cursor != NULL; cursor = cursor->hash_next) {
       if (cursor->id == id) return cursor;
-      if (cursor->child && cursor->child->id == id) return cursor->child;
    }
 
    return NULL;
 }
 
+
+static int object_grid_coordinate (int value) {
+
+   if (value >= 0) return value / OBJECT_GRID_CELL;
+   return (value - OBJECT_GRID_CELL + 1) / OBJECT_GRID_CELL;
+}
+
+static int object_grid_bucket (int x, int y) {
+
+   return (int)(((unsigned int)x * 73856093U ^ (unsigned int)y * 19349663U) % OBJECT_GRID_SIZE);
+}
+
+static int object_grid_cell (const RoadMapObject *object) {
+
+   return object_grid_bucket (object_grid_coordinate (object->position.longitude),
+                              object_grid_coordinate (object->position.latitude));
+}
+
+static void object_grid_add (RoadMapObject *object) {
+
+   object->cell = object_grid_cell (object);
+   object->cell_next = RoadmapObjectGrid[object->cell];
+   RoadmapObjectGrid[object->cell] = object;
+}
+
+static void object_grid_remove (RoadMapObject *object) {
+
+   RoadMapObject **cursor;
+
+   if (object->cell < 0) return;
+
+   for (cursor = &RoadmapObjectGrid[object->cell]; *cursor != NULL; cursor = &(*cursor)->cell_next) {
+      if (*cursor == object) {
+         *cursor = object->cell_next;
+         break;
+      }
+   }
+   object->cell = -1;
+}
+
+
+static int object_compare_order (const void *a, const void *b) {
+
+   const RoadMapObject *object1 = *(RoadMapObject * const *)a;
+   const RoadMapObject *object2 = *(RoadMapObject * const *)b;
+
+   if (object1->priority != object2->priority) {
+      return object2->priority - object1->priority;
+   }
+
+   if (object1->stamp == object2->stamp) return 0;
+   return ((int)(object2->stamp - object1->stamp) < 0) ? -1 : 1;
+}
+
+static void object_set_add (RoadMapObjectSet *set, RoadMapObject *object) {
+
+   if (set->count == set->size) {
+      set->size = set->size ? 2 * set->size : 64;
+      set->objects = realloc (set->objects, set->size * sizeof(RoadMapObject *));
+      roadmap_check_allocated(set->objects);
+   }
+   set->objects[set->count++] = object;
+}
+
+static BOOL object_in_area (const RoadMapObject *object, const RoadMapArea *area) {
+
+   return (object->position.longitude <= area->east &&
+           object->position.longitude >= area->west &&
+           object->position.latitude  <= area->north &&
+           object->position.latitude  >= area->south);
+}
+
+/* Collects, in the list order, the objects whose position is in the area
+ * tested by roadmap_math_point_is_visible(). The other objects cannot be
+ * visible.
+ */
+static void object_collect_visible (RoadMapObjectSet *set) {
+
+   RoadMapArea area;
+   RoadMapObject *cursor;
+   int west, east, south, north;
+   int x, y;
+
+   set->count = 0;
+
+   roadmap_math_get_focus (&area);
+
+   west  = object_grid_coordinate (area.west);
+   east  = object_grid_coordinate (area.east);
+   south = object_grid_coordinate (area.south);
+   north = object_grid_coordinate (area.north);
+
+   if ((double)(east - west + 1) * (north - south + 1) > OBJECT_GRID_SIZE) {
+
+      /* Most buckets would be visited, the list is cheaper and sorted. */
+      for (cursor = RoadmapObjectList; cursor != NULL; cursor = cursor->next) {
+         if (object_in_area (cursor, &area)) object_set_add (set, cursor);
+      }
+      return;
+   }
+
+   RoadmapObjectGridQuery++;
+
+   for (x = west; x <= east; x++) {
+      for (y = south; y <= north; y++) {
+
+         int bucket = object_grid_bucket (x, y);
+
+         if (RoadmapObjectGridMark[bucket] == RoadmapObjectGridQuery) continue;
+         RoadmapObjectGridMark[bucket] = RoadmapObjectGridQuery;
+
+         for (cursor = RoadmapObjectGrid[bucket]; cursor != NULL; cursor = cursor->cell_next) {
+            if (object_in_area (cursor, &area)) object_set_add (set, cursor);
+         }
+      }
+   }
+
+   if (set->count > 1) {
+      qsort (set->objects, set->count, sizeof(RoadMapObject *), object_compare_order);
+   }
+}
+
 #ifdef OPENGL
 void set_animation (RoadMapObject *cursor) {
    uint32_t now = roadmap_time_get_millis();
@@ -766,29 +962,95 @@ void set_animation (RoadMapObject *cursor) {
 #endif
 
 
-static RoadMapObject *object_insert_sort (RoadMapObject *list_head, RoadMapObject *new_obj) {
-   RoadMapObject *prev = list_head;
-   RoadMapObject *curr = list_head;
+/* Returns the entry of the priority, or where it belongs */
+static int object_priority_find (int priority) {
+
+   int low = 0;
+   int high = RoadmapObjectPrioritiesCount;
+
+   while (low < high) {
+      int mid = (low + high) / 2;
+      if (RoadmapObjectPriorities[mid].priority > priority) {
+         low = mid + 1;
+      } else {
+         high = mid;
+      }
+   }
+
+   return low;
+}
+
+static void object_insert (RoadMapObject *new_obj) {
+
+   RoadMapObject *next = NULL;
+   int index = object_priority_find (new_obj->priority);
+
+   new_obj->stamp = ++RoadmapObjectStamp;
 
-   if (list_head == NULL || new_obj->priority >= list_head->priority) {
-      new_obj->next = list_head;
-      new_obj->previous = NULL;
-      if (new_obj->next != NULL) {
-         new_obj->next->previous = new_obj;
+   /* Insert before the first object of the same or of a lower priority. */
+   if (index < RoadmapObjectPrioritiesCount) {
+      next = RoadmapObjectPriorities[index].first;
+   }
+
+   if (index == RoadmapObjectPrioritiesCount ||
+       RoadmapObjectPriorities[index].priority != new_obj->priority) {
+
+      if (RoadmapObjectPrioritiesCount == RoadmapObjectPrioritiesSize) {
+         RoadmapObjectPrioritiesSize += 8;
+         RoadmapObjectPriorities =
+            realloc (RoadmapObjectPriorities,
+                     RoadmapObjectPrioritiesSize * sizeof (RoadMapObjectPriority));
+         roadmap_check_allocated (RoadmapObjectPriorities);
       }
-      return new_obj;
+
+      memmove (RoadmapObjectPriorities + index + 1, RoadmapObjectPriorities + index,
+               (RoadmapObjectPrioritiesCount - index) * sizeof (RoadMapObjectPriority));
+      RoadmapObjectPriorities[index].priority = new_obj->priority;
+      RoadmapObjectPrioritiesCount++;
+   }
+
+   new_obj->next = next;
+   if (next != NULL) {
+      new_obj->previous = next->previous;
+      next->previous = new_obj;
+   } else {
+      new_obj->previous = RoadmapObjectLast;
+      RoadmapObjectLast = new_obj;
+   }
+   if (new_obj->previous != NULL) {
+      new_obj->previous->next = new_obj;
    } else {
-      while (curr && curr->priority > new_obj->priority) {
-         prev = curr;
-         curr = curr->next;
+      RoadmapObjectList = new_obj;
+   }
+
+   RoadmapObjectPriorities[index].first = new_obj;
+}
+
+static void object_unlink (RoadMapObject *cursor) {
+
+   int index = object_priority_find (cursor->priority);
+
+   if (index < RoadmapObjectPrioritiesCount &&
+       RoadmapObjectPriorities[index].first == cursor) {
+      if (cursor->next != NULL && cursor->next->priority == cursor->priority) {
+         RoadmapObjectPriorities[index].first = cursor->next;
+      } else {
+         /* the last object of this priority */
+         RoadmapObjectPrioritiesCount--;
+         memmove (RoadmapObjectPriorities + index, RoadmapObjectPriorities + index + 1,
+                  (RoadmapObjectPrioritiesCount - index) * sizeof (RoadMapObjectPriority));
       }
+   }
 
-      prev-> next = new_obj;
-      new_obj->previous = prev;
-      new_obj->next = curr;
-      if (curr)
-         curr->previous = new_obj;
-      return list_head;
+   if (cursor->next != NULL) {
+      cursor->next->previous = cursor->previous;
+   } else {
+      RoadmapObjectLast = cursor->previous;
+   }
+   if (cursor->previous != NULL) {
+      cursor->previous->next = cursor->next;
+   } else {
+      RoadmapObjectList = cursor->next;
    }
 }
 
@@ -970,6 +1232,7 @@ static RoadMapObject *create_init_object () {
    cursor->glow = -1;
    cursor->check_overlapping = FALSE;
    cursor->rotation = 0;
+   cursor->cell = -1;
    
    return cursor;
 }
@@ -1030,7 +1293,9 @@ void roadmap_object_add_with_priority (RoadMapDynamicString origin,
       roadmap_string_lock(image);
       roadmap_string_lock(text);
 
-      RoadmapObjectList = object_insert_sort(RoadmapObjectList, cursor);
+      object_insert (cursor);
+      object_hash_add (cursor);
+      object_grid_add (cursor);
 
       if (position) {
 #ifdef OPENGL
@@ -1072,8 +1337,10 @@ static void roadmap_object_add_child (RoadMapDynamicString  parent_id,
          release_object(parent_object->child);
       }
       parent_object->child = cursor;
+      cursor->parent = parent_object;
       
       cursor->id     = id;
+      object_hash_add (cursor);
       if (image) {
          cursor->images[0] = image;
          cursor->image_count = 1;
@@ -1128,7 +1395,13 @@ void roadmap_object_move (RoadMapDynamicString id,
           (cursor->position.steering  != position->steering)  ||
           (cursor->position.speed     != position->speed)) {
 
-         cursor->position = *position;
+         if (cursor->cell >= 0) {
+            object_grid_remove (cursor);
+            cursor->position = *position;
+            object_grid_add (cursor);
+         } else {
+            cursor->position = *position;
+         }
          (*cursor->listener) (id, position);
       }
    }
@@ -1178,6 +1451,8 @@ void roadmap_object_stop_glow (RoadMapDynamicString id) {
 static void release_object (RoadMapObject *cursor) {
    int i;
    
+   object_hash_remove (cursor);
+
    roadmap_string_release(cursor->origin);
    roadmap_string_release(cursor->id);
    roadmap_string_release(cursor->name);
@@ -1198,14 +1473,15 @@ void roadmap_object_remove (RoadMapDynamicString id) {
 
    if (cursor != NULL) {
 
-      if (cursor->next != NULL) {
-          cursor->next->previous = cursor->previous;
-      }
-      if (cursor->previous != NULL) {
-         cursor->previous->next = cursor->next;
-      } else {
-         RoadmapObjectList = cursor->next;
+      if (cursor->parent != NULL) {
+         /* A child is not in the list */
+         cursor->parent->child = NULL;
+         release_object(cursor);
+         return;
       }
+
+      object_unlink (cursor);
+      object_grid_remove (cursor);
       
       if (cursor->child)
          release_object(cursor->child);
@@ -1229,10 +1505,14 @@ void roadmap_object_iterate (RoadMapObjectAction action) {
 
    RoadMapObject *cursor;
    int scale_factor;
+   int i;
+
+   /* The objects out of the visible area would be ignored by the action */
+   object_collect_visible (&RoadmapObjectDrawSet);
 
-   for (cursor = RoadmapObjectList; cursor->next != NULL; cursor = cursor->next);
+   for (i = RoadmapObjectDrawSet.count - 1; i >= 0; i--) {
 
-   for ( ; cursor != NULL ; cursor = cursor->previous) {
+      cursor = RoadmapObjectDrawSet.objects[i];
 #ifdef OPENGL
       if (is_visible(cursor)) {
          if (cursor->animation_state == animate_in_pending && cursor->animation & OBJECT_ANIMATION_WHEN_VISIBLE)
@@ -1380,14 +1660,20 @@ static RoadMapObject *roadmap_object_by_pos (RoadMapGuiPoint *point, BOOL action
 
    RoadMapObject *cursor;
    RoadMapGuiPoint touched_point = *point;
+   int i;
+
+   /* Only the objects drawn on the screen can be touched */
+   object_collect_visible (&RoadmapObjectTouchSet);
 
-   for (cursor = RoadmapObjectList; cursor != NULL; cursor = cursor->next) {
+   for (i = 0; i < RoadmapObjectTouchSet.count; i++) {
 	  int image_height;
 	  int image_width;
 	  RoadMapPosition cursor_position;
       RoadMapGuiPoint pos;
       RoadMapImage image;
 
+      cursor = RoadmapObjectTouchSet.objects[i];
+
 	  if ((!cursor->images[0]) ||
          (action_only && !cursor->action) ||
          out_of_zoom (cursor))
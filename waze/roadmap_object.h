@@ -145,6 +145,7 @@ void roadmap_object_set_action (RoadMapDynamicString id,
                                 RoadMapObjectAction action);
 void roadmap_object_set_zoom (RoadMapDynamicString id, int min_zoom, int max_zoom);
 
+/* Calls the action for the objects in the visible area, lowest priority first */
 void roadmap_object_iterate (RoadMapObjectAction action);
 
 
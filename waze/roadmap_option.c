@@ -62,6 +62,10 @@ static RoadMapConfigDescriptor RoadMapConfigMapCache =
 RoadMapConfigDescriptor RoadMapConfigGeneralLogLevel =
                         ROADMAP_CONFIG_ITEM("General", "Log level");
 
+/* Per source log levels, e.g. "roadmap_tile.c=1,roadmap_res.c=3" */
+static RoadMapConfigDescriptor RoadMapConfigGeneralLogModules =
+                        ROADMAP_CONFIG_ITEM("General", "Log modules");
+
 static int roadmap_option_verbose = DEFAULT_LOG_LEVEL;
 
 static int roadmap_option_no_area = 0;
@@ -274,6 +278,7 @@ static void roadmap_option_set_debug (const char *value) {
 
     if (roadmap_option_verbose > ROADMAP_MESSAGE_DEBUG) {
         roadmap_option_verbose = ROADMAP_MESSAGE_DEBUG;
+        roadmap_log_set_level (roadmap_option_verbose);
     }
     if (value != NULL && value[0] != 0) {
        roadmap_option_debug = strdup (value);
@@ -285,6 +290,7 @@ static void roadmap_option_set_verbose (const char *value) {
 
     if (roadmap_option_verbose > ROADMAP_MESSAGE_INFO) {
         roadmap_option_verbose = ROADMAP_MESSAGE_INFO;
+        roadmap_log_set_level (roadmap_option_verbose);
     }
 }
 
@@ -437,6 +443,34 @@ void roadmap_option (int argc, char **argv, RoadMapUsage usage) {
 }
 
 
+static void roadmap_option_set_log_modules (const char *value) {
+
+   char source[64];
+   const char *item = value;
+
+   while (item != NULL && *item != 0) {
+
+      const char *end = strchr (item, ',');
+      const char *equal = strchr (item, '=');
+      int length;
+
+      if (end == NULL) end = item + strlen (item);
+
+      if (equal != NULL && equal < end) {
+
+         length = equal - item;
+         if (length >= (int)sizeof(source)) length = sizeof(source) - 1;
+
+         strncpy (source, item, length);
+         source[length] = 0;
+
+         roadmap_log_set_module_level (source, atoi (equal + 1));
+      }
+
+      item = (*end == ',') ? end + 1 : end;
+   }
+}
+
 void roadmap_option_initialize (void) {
 
    roadmap_config_declare_enumeration
@@ -449,10 +483,14 @@ void roadmap_option_initialize (void) {
 
    roadmap_config_declare( "preferences", &RoadMapConfigGeneralLogLevel, OBJ2STR( DEFAULT_LOG_LEVEL ), NULL );
 
+   roadmap_config_declare( "preferences", &RoadMapConfigGeneralLogModules, "", NULL );
+
    roadmap_option_set_verbosity( roadmap_config_get_integer( &RoadMapConfigGeneralLogLevel ) );
+   roadmap_option_set_log_modules( roadmap_config_get( &RoadMapConfigGeneralLogModules ) );
 }
 
 void roadmap_option_set_verbosity( int verbosity_level )
 {
 	roadmap_option_verbose = verbosity_level;
+	roadmap_log_set_level( verbosity_level );
 }
@@ -43,10 +43,13 @@
 
 #if defined(__SYMBIAN32__) && !defined(TOUCH_SCREEN) && !defined(QTMOBILITY)
 #define RES_CACHE_SIZE 30	// Symbian non touch
+#define RES_CACHE_MEM  (1024*1024)
 #elif defined(ANDROID) || defined(IPHONE) || defined(USE_QT)
 #define RES_CACHE_SIZE 600	// Default
+#define RES_CACHE_MEM  (24*1024*1024)
 #else
 #define RES_CACHE_SIZE 150 // Default
+#define RES_CACHE_MEM  (6*1024*1024)
 #endif
 const char *ResourceName[] = {
    "bitmap_res",
@@ -58,6 +61,7 @@ struct resource_slot {
    char *name;
    void *data;
    unsigned int flags;
+   int mem;
 };
 
 typedef struct resource_cache_entry {
@@ -81,10 +85,28 @@ typedef struct roadmap_resource {
 } RoadMapResource;
 
 
+/* The files of a resource directory, so that looking for a resource does
+ * not probe each directory of the path on the disk. A directory is read
+ * once, the first time a resource is looked for in it.
+ */
+typedef struct roadmap_resource_directory {
+   char *path;
+   RoadMapHash *hash;
+   char **files;  /* with and without their extension */
+   int count;
+   int size;
+} RoadMapResDirectory;
+
+static RoadMapResDirectory *ResDirectories = NULL;
+static int ResDirectoriesCount = 0;
+static int ResDirectoriesSize = 0;
+
+
 static RoadMapResource Resources[MAX_RESOURCES];
 static void roadmap_res_cache_init( RoadMapResource* res );
 static int roadmap_res_cache_add( RoadMapResource* res, int hash_key );
 static void roadmap_res_cache_set_MRU( RoadMapResource* res, int slot );
+static void roadmap_res_cache_trim( RoadMapResource* res, int keep );
 
 static void dbg_cache( RoadMapResource* res, int slot, const char* name );
 #ifdef unused
@@ -99,7 +121,146 @@ static void allocate_resource (unsigned int type) {
    roadmap_res_cache_init( res );
 
    res->max = RES_CACHE_SIZE;
+   res->max_mem = RES_CACHE_MEM;
+
+}
+
+
+static void res_directory_add_file (RoadMapResDirectory *directory, const char *name) {
+
+   if (directory->count == directory->size) {
+      directory->size = directory->size ? 2 * directory->size : 64;
+      directory->files = realloc (directory->files, directory->size * sizeof(char *));
+      roadmap_check_allocated (directory->files);
+      roadmap_hash_resize (directory->hash, directory->size);
+   }
+
+   directory->files[directory->count] = strdup (name);
+   roadmap_check_allocated (directory->files[directory->count]);
+   roadmap_hash_add (directory->hash, roadmap_hash_string (name), directory->count);
+   directory->count++;
+}
+
+
+static void res_directory_add (RoadMapResDirectory *directory, const char *name) {
+
+   const char *extension = strrchr (name, '.');
+
+   res_directory_add_file (directory, name);
+
+   /* Some loaders add the extension themselves (e.g. sounds) */
+   if (extension != NULL && extension != name) {
+
+      char base[256];
+      size_t length = extension - name;
+
+      if (length < sizeof(base)) {
+         memcpy (base, name, length);
+         base[length] = 0;
+         res_directory_add_file (directory, base);
+      }
+   }
+}
+
+
+static RoadMapResDirectory *res_directory_get (const char *path) {
+
+   RoadMapResDirectory *directory;
+   char **files;
+   char **cursor;
+   int i;
+
+   for (i = 0; i < ResDirectoriesCount; i++) {
+      if (!strcmp (ResDirectories[i].path, path)) return ResDirectories + i;
+   }
+
+   if (ResDirectoriesCount == ResDirectoriesSize) {
+      ResDirectoriesSize = ResDirectoriesSize ? 2 * ResDirectoriesSize : 16;
+      ResDirectories = realloc (ResDirectories, ResDirectoriesSize * sizeof(RoadMapResDirectory));
+      roadmap_check_allocated (ResDirectories);
+   }
+
+   directory = ResDirectories + ResDirectoriesCount++;
+   directory->path = strdup (path);
+   roadmap_check_allocated (directory->path);
+   directory->hash = roadmap_hash_new ("res_directory", 64);
+   directory->files = NULL;
+   directory->count = 0;
+   directory->size = 0;
+
+   files = roadmap_path_list (path, "");
+   for (cursor = files; *cursor != NULL; ++cursor) {
+      res_directory_add (directory, *cursor);
+   }
+   roadmap_path_list_free (files);
+
+   roadmap_log (ROADMAP_DEBUG, "Indexed %d resource files in %s", directory->count, path);
+
+   return directory;
+}
+
+
+static BOOL res_directory_contains (const char *path, const char *name) {
+
+#ifdef ANDROID
+   /* The resources are not all files on Android */
+   return TRUE;
+#else
+   RoadMapResDirectory *directory = res_directory_get (path);
+   int i;
 
+   for (i = roadmap_hash_get_first (directory->hash, roadmap_hash_string (name));
+        i >= 0;
+        i = roadmap_hash_get_next (directory->hash, i)) {
+
+      if (!strcmp (name, directory->files[i])) return TRUE;
+   }
+
+   return FALSE;
+#endif
+}
+
+
+void roadmap_res_file_added (const char *path, const char *name) {
+
+   int i;
+
+   /* Only the directories already read may miss the new file */
+   for (i = 0; i < ResDirectoriesCount; i++) {
+      if (!strcmp (ResDirectories[i].path, path)) {
+         if (!res_directory_contains (path, name)) {
+            res_directory_add (ResDirectories + i, name);
+         }
+         return;
+      }
+   }
+}
+
+
+void roadmap_res_rescan (const char *path) {
+
+   int i = 0;
+
+   while (i < ResDirectoriesCount) {
+
+      RoadMapResDirectory *directory = ResDirectories + i;
+      int j;
+
+      if (path != NULL && strcmp (directory->path, path)) {
+         i++;
+         continue;
+      }
+
+      for (j = 0; j < directory->count; j++) {
+         free (directory->files[j]);
+      }
+      free (directory->files);
+      free (directory->path);
+      roadmap_hash_free (directory->hash);
+
+      /* It is read again the next time a resource is looked for in it */
+      *directory = ResDirectories[--ResDirectoriesCount];
+   }
 }
 
 
@@ -113,13 +274,18 @@ static void *load_resource (unsigned int type, unsigned int flags,
       for (cursor = roadmap_path_first ("skin");
             cursor != NULL && data == NULL;
             cursor = roadmap_path_next ("skin", cursor)) {
+         if (!res_directory_contains (cursor, name)) continue;
          switch (type) {
             case RES_BITMAP:
                *mem = 0;
 #ifdef ANDROID
                data = roadmap_canvas_load_image ( NULL, name );
 #else
-               data = roadmap_canvas_load_image (cursor, name);
+               if (flags & RES_NOCACHE) {
+                  data = roadmap_canvas_load_image (cursor, name);
+               } else {
+                  data = roadmap_canvas_load_image_async (cursor, name);
+               }
 #endif
                break;
 #ifdef OGL_TILE
@@ -149,17 +315,24 @@ static void *load_resource (unsigned int type, unsigned int flags,
              case RES_BITMAP:
                 *mem = 0;
                 roadmap_path_format (path, sizeof (path), cursor, "icons");
-                data = roadmap_canvas_load_image (path, name);
+                if (!res_directory_contains (path, name)) break;
+                if (flags & RES_NOCACHE) {
+                   data = roadmap_canvas_load_image (path, name);
+                } else {
+                   data = roadmap_canvas_load_image_async (path, name);
+                }
                 break;
              case RES_SOUND:
                 roadmap_path_format (path, sizeof (path), cursor, "sound");
                 roadmap_path_format (path, sizeof (path), path, roadmap_prompts_get_name());
+                if (!res_directory_contains (path, name)) break;
                 data = roadmap_sound_load (path, name, mem);
                 break;
     #ifdef IPHONE_NATIVE
              case RES_NATIVE_IMAGE:
                 *mem = 0;
                 roadmap_path_format (path, sizeof (path), cursor, "icons");
+                if (!res_directory_contains (path, name)) break;
                 data = roadmap_main_load_image (path, name);
                 break;
     #endif
@@ -193,6 +366,11 @@ static void free_resource ( RoadMapResource* res, int slot) {
    }
 
    free ( res->slots[slot].name);
+
+   res->slots[slot].data = NULL;
+   res->slots[slot].name = NULL;
+   res->used_mem -= res->slots[slot].mem;
+   res->slots[slot].mem = 0;
 }
 
 
@@ -240,6 +418,14 @@ void *roadmap_res_get (unsigned int type, unsigned int flags,
 	  {
     	  roadmap_res_cache_set_MRU( res, slot );
     	  data = res->slots[slot].data;
+    	  if ( type == RES_BITMAP && res->slots[slot].mem == 0 )
+    	  {
+    		  /* Unloaded to stay within the budget, it is loaded again when drawn */
+    		  res->slots[slot].mem = roadmap_canvas_image_width ((RoadMapImage)data) *
+    		                         roadmap_canvas_image_height ((RoadMapImage)data) * 4;
+    		  res->used_mem += res->slots[slot].mem;
+    		  roadmap_res_cache_trim( res, slot );
+    	  }
     	  return data;
 	  }
    }
@@ -291,6 +477,12 @@ void *roadmap_res_get (unsigned int type, unsigned int flags,
       data = load_resource (type, flags, name, &mem);
    }
 
+   if (data && type == RES_BITMAP) {
+      /* The decoded size, what the cache budget is about */
+      mem = roadmap_canvas_image_width ((RoadMapImage)data) *
+            roadmap_canvas_image_height ((RoadMapImage)data) * 4;
+   }
+
    if (!data) {
    	if (type != RES_SOUND)
    		roadmap_log (ROADMAP_DEBUG, "roadmap_res_get - resource %s type=%d not found.", name, type);
@@ -313,9 +505,15 @@ void *roadmap_res_get (unsigned int type, unsigned int flags,
    res->slots[slot].data = data;
    res->slots[slot].name = strdup(name);
    res->slots[slot].flags = flags;
+   res->slots[slot].mem = mem;
 
    res->used_mem += mem;
 
+   if ( type == RES_BITMAP )
+   {
+	   roadmap_res_cache_trim( res, slot );
+   }
+
    return data;
 }
 
@@ -373,6 +571,34 @@ static void roadmap_res_cache_set_MRU( RoadMapResource* res, int slot )
 }
 
 
+/*
+ * Unloads the pixels of the LRU bitmaps until the cache is within its memory
+ * budget. The entries stay in the cache, because the callers may still hold
+ * them, and the images are loaded again when they are used.
+ */
+static void roadmap_res_cache_trim( RoadMapResource* res, int keep )
+{
+	ResCacheEntry* cache = res->cache;
+	int slot = cache[res->cache_head].prev;
+
+	while ( res->used_mem > res->max_mem )
+	{
+		if ( slot != keep &&
+		     res->slots[slot].mem > 0 &&
+		     !( res->slots[slot].flags & RES_LOCK ) &&
+		     roadmap_canvas_image_unload( (RoadMapImage)res->slots[slot].data ) )
+		{
+			res->used_mem -= res->slots[slot].mem;
+			res->slots[slot].mem = 0;
+		}
+
+		if ( slot == res->cache_head )
+			break;
+		slot = cache[slot].prev;
+	}
+}
+
+
 static int roadmap_res_cache_add( RoadMapResource* res, int hash_key )
 {
 	ResCacheEntry* cache = res->cache;
@@ -469,7 +695,8 @@ void roadmap_res_invalidate( int type )
 	   {
 		   for ( i = 0; i < Resources[type].count; ++i )
 		   {
-			   roadmap_canvas_image_invalidate( res->slots[i].data );
+			   if ( res->slots[i].data )
+				   roadmap_canvas_image_invalidate( res->slots[i].data );
 		   }
 		   break;
 	   }
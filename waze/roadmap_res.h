@@ -39,6 +39,12 @@
 void *roadmap_res_get (unsigned int type, unsigned int flags,
                        const char *name);
 
+/* Tells that a resource file was written in a directory, e.g. downloaded */
+void roadmap_res_file_added (const char *path, const char *name);
+
+/* Reads a resource directory again, or all of them when path is NULL */
+void roadmap_res_rescan (const char *path);
+
 void roadmap_res_initialize( void );
 void roadmap_res_shutdown ();
 void roadmap_res_invalidate();
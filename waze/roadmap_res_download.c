@@ -670,6 +670,10 @@ static void download_done_callback (void *context_cb, char *last_modified, const
 
       roadmap_file_close(file);
 
+      directory = roadmap_path_parent (NULL, path);
+      roadmap_res_file_added (directory, roadmap_path_skip_directories (path));
+      roadmap_path_free (directory);
+
       if (context->res_data.on_loaded_cb)
          (*(context->res_data.on_loaded_cb))( context->res_data.name, 1,context->res_data.context, last_modified);
 
@@ -2744,6 +2744,10 @@ void roadmap_screen_repaint_now( void ) {
 #endif// GTK2_OGL
     if (!RoadMapScreenInitialized || RoadMapScreenBackgroundRun ) return;
 
+#ifdef USE_QT
+    roadmap_canvas_begin_frame ();
+#endif
+
 #ifdef SSD
     if (RoadMapScreenFrozen) {
 #ifdef GTK2_OGL
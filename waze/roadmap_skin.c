@@ -32,6 +32,7 @@
 #include "roadmap_messagebox.h"
 #include "roadmap_main.h"
 #include "roadmap_path.h"
+#include "roadmap_res.h"
 #include "roadmap_config.h"
 #include "roadmap_screen.h"
 #include "roadmap_plugin.h"
@@ -135,6 +136,7 @@ static void roadmap_skin_set_subskin_int (const char *sub_skin, BOOL save) {
    }
 
    roadmap_path_set ("skin", path);
+   roadmap_res_rescan (NULL);
    
    if (save && !auto_night_mode_cfg_on()) {
       roadmap_config_set(&RoadMapConfigMapSubSkin, CurrentSubSkin);
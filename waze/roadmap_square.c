@@ -59,9 +59,13 @@
 #include "roadmap_alert.h"
 #include "roadmap_metadata.h"
 #include "roadmap_hash.h"
+#include "roadmap_config.h"
 #include "roadmap_tile_manager.h"
 #include "roadmap_tile_status.h"
 #include "roadmap_tile_storage.h"
+#include "roadmap_tile_decode.h"
+
+#include "navigate/navigate_graph.h"
 
 #include "roadmap_square.h"
 
@@ -97,10 +101,15 @@ typedef struct {
 } RoadMapSquareData;
 
 
+/* The cache holds as many squares as fit in the configured memory
+ * budget, up to ROADMAP_SQUARE_CACHE_SIZE slots.
+ */
 #ifdef J2ME
 #define ROADMAP_SQUARE_CACHE_SIZE	64
+#define ROADMAP_SQUARE_CACHE_BYTES	"2097152"
 #else
-#define ROADMAP_SQUARE_CACHE_SIZE	512
+#define ROADMAP_SQUARE_CACHE_SIZE	2048
+#define ROADMAP_SQUARE_CACHE_BYTES	"33554432"
 #endif
 
 #define ROADMAP_SQUARE_UNAVAILABLE	((RoadMapSquareData *)-1)
@@ -110,6 +119,8 @@ typedef struct {
 	int	square;
 	int	next;
 	int	prev;
+	int	bytes;
+	int	view_stamp;
 } SquareCacheNode;
 
 typedef struct RoadMapSquareContext_t {
@@ -119,8 +130,9 @@ typedef struct RoadMapSquareContext_t {
    RoadMapGlobal     *SquareGlobal;
    RoadMapSquareData **Square;
 
-	SquareCacheNode	SquareCache[ROADMAP_SQUARE_CACHE_SIZE + 1];
+	SquareCacheNode	*SquareCache;
 	RoadMapHash			*SquareHash;
+	int					CacheBytes;
 } RoadMapSquareContext;
 
 
@@ -133,6 +145,14 @@ static int RoadMapSquareNextAvailableSlot = ROADMAP_SQUARE_CACHE_SIZE-1;
 
 static int RoadMapSquareForceUpdateMode = 0;
 
+/* Squares seen by the last two calls to roadmap_square_view are pinned */
+static int RoadMapSquareViewStamp = 2;
+
+static RoadMapSquareCacheStats RoadMapSquareStats;
+
+static RoadMapConfigDescriptor RoadMapConfigSquareCacheBytes =
+                        ROADMAP_CONFIG_ITEM("Map", "Tile cache bytes");
+
 static void *roadmap_square_map (const roadmap_db_data_file *file) {
 
    RoadMapSquareContext *context;
@@ -158,11 +178,15 @@ static void *roadmap_square_map (const roadmap_db_data_file *file) {
    context->Square = calloc (ROADMAP_SQUARE_CACHE_SIZE, sizeof (RoadMapSquareData *));
    roadmap_check_allocated(context->Square);
 
+   context->SquareCache = calloc (ROADMAP_SQUARE_CACHE_SIZE + 1, sizeof (SquareCacheNode));
+   roadmap_check_allocated(context->SquareCache);
+
 	for (i = 0; i <= ROADMAP_SQUARE_CACHE_SIZE; i++) {
 		context->SquareCache[i].square = -1;
 		context->SquareCache[i].next = (i + 1) % (ROADMAP_SQUARE_CACHE_SIZE + 1);
 		context->SquareCache[i].prev = (i + ROADMAP_SQUARE_CACHE_SIZE) % (ROADMAP_SQUARE_CACHE_SIZE + 1);
 	}
+	context->CacheBytes = 0;
 
 	context->SquareHash = roadmap_hash_new ("tiles", ROADMAP_SQUARE_CACHE_SIZE);
 
@@ -201,7 +225,12 @@ static void roadmap_square_unmap (void *context) {
       RoadMapSquareActive = NULL;
    }
 
+   roadmap_log (ROADMAP_DEBUG, "Tile cache: %d hits, %d misses, %d evictions (%d pinned skipped)",
+   				 RoadMapSquareStats.hits, RoadMapSquareStats.misses,
+   				 RoadMapSquareStats.evictions, RoadMapSquareStats.pinned_skips);
+
    roadmap_hash_free (square_context->SquareHash);
+   free (square_context->SquareCache);
    free (square_context->Square);
    free (square_context);
 }
@@ -310,9 +339,10 @@ void roadmap_square_unload_all (void) {
 
 	int i;
 
-	for (i = 1; i <= ROADMAP_SQUARE_CACHE_SIZE; i++) {
+	for (i = 0; i <= ROADMAP_SQUARE_CACHE_SIZE; i++) {
 
-		if (RoadMapSquareActive->SquareCache[i].square >= 0) {
+		if (i < ROADMAP_SQUARE_CACHE_SIZE &&
+			 RoadMapSquareActive->SquareCache[i].square >= 0) {
 			roadmap_square_unload (i);
 			RoadMapSquareActive->SquareCache[i].square = -1;
 		}
@@ -322,15 +352,84 @@ void roadmap_square_unload_all (void) {
 }
 
 
-static int roadmap_square_cache (int square) {
+static int roadmap_square_is_pinned (int slot) {
+
+	SquareCacheNode *node = RoadMapSquareActive->SquareCache + slot;
+	int *status;
+
+	if (node->view_stamp + 1 >= RoadMapSquareViewStamp) return 1;
+
+	status = roadmap_tile_status_get (node->square);
+	return status != NULL && ((*status) & ROADMAP_TILE_STATUS_FLAG_ROUTE);
+}
+
+
+/* Finds the least recently used loaded square which may be unloaded.
+ * Squares in view or on the route are skipped unless allow_pinned is set.
+ */
+static int roadmap_square_cache_victim (int allow_pinned) {
+
+	SquareCacheNode *cache = RoadMapSquareActive->SquareCache;
+	int slot;
+
+	for (slot = cache[ROADMAP_SQUARE_CACHE_SIZE].prev;
+		  slot != ROADMAP_SQUARE_CACHE_SIZE;
+		  slot = cache[slot].prev) {
+
+		if (slot == RoadMapSquareCurrentSlot ||
+			 RoadMapSquareActive->Square[slot] == ROADMAP_SQUARE_NOT_LOADED) {
+			continue;
+		}
+
+		if (!allow_pinned && roadmap_square_is_pinned (slot)) {
+			RoadMapSquareStats.pinned_skips++;
+			continue;
+		}
+
+		return slot;
+	}
+
+	return -1;
+}
+
+
+static int roadmap_square_cache (int square, int bytes) {
 
 	SquareCacheNode *node;
 	SquareCacheNode *cache = RoadMapSquareActive->SquareCache;
-	int slot = RoadMapSquareNextAvailableSlot;
+	int slot;
+	int max_bytes = roadmap_config_get_integer (&RoadMapConfigSquareCacheBytes);
+
+	/* make room for the new square within the memory budget */
+	while (RoadMapSquareActive->CacheBytes + bytes > max_bytes) {
+
+		slot = roadmap_square_cache_victim (0);
+		if (slot < 0) break;
+
+		RoadMapSquareStats.evictions++;
+		roadmap_square_unload (slot);
+	}
+
+	slot = RoadMapSquareNextAvailableSlot;
 
 	if ( slot < 0 )
 	{
-		slot = cache[ROADMAP_SQUARE_CACHE_SIZE].prev;
+		/* reuse the least recently used slot, preferring one which is
+		 * already unloaded
+		 */
+		for (slot = cache[ROADMAP_SQUARE_CACHE_SIZE].prev;
+			  slot != ROADMAP_SQUARE_CACHE_SIZE;
+			  slot = cache[slot].prev) {
+
+			if (slot != RoadMapSquareCurrentSlot &&
+				 RoadMapSquareActive->Square[slot] == ROADMAP_SQUARE_NOT_LOADED) break;
+		}
+
+		if (slot == ROADMAP_SQUARE_CACHE_SIZE) {
+			slot = roadmap_square_cache_victim (0);
+			if (slot < 0) slot = roadmap_square_cache_victim (1);
+			RoadMapSquareStats.evictions++;
+		}
 	}
 	else
 	{
@@ -340,12 +439,6 @@ static int roadmap_square_cache (int square) {
 		RoadMapSquareNextAvailableSlot--;
 	}
 
-	// make sure not to unload the current tile
-	if ( slot == RoadMapSquareCurrentSlot )
-	{
-		slot = cache[slot].prev;
-	}
-
 	node = cache + slot;
 	//printf ("Putting square %d in slot %d\n", square, slot);
 	if ( node->square >= 0 )	// Over checking - if RoadMapSquareNextAvailableSlot > 0 - there are still unfilled slots available
@@ -354,10 +447,61 @@ static int roadmap_square_cache (int square) {
 	}
 
 	node->square = square;
+	node->bytes = bytes;
+	node->view_stamp = 0;
+	RoadMapSquareActive->CacheBytes += bytes;
 	return slot;
 }
 
 
+int roadmap_square_is_cached (int square) {
+
+	int slot = roadmap_square_find (square);
+
+	return slot >= 0 && RoadMapSquareActive->Square[slot] != ROADMAP_SQUARE_NOT_LOADED;
+}
+
+
+/* Moves a square to the end of the cache order, so it is the first to be
+ * unloaded. Background work which loads squares nobody looks at releases
+ * them, and keeps reusing one slot instead of pushing out the squares in use.
+ */
+void roadmap_square_release (int square) {
+
+	SquareCacheNode *cache;
+	int slot = roadmap_square_find (square);
+
+	if (slot < 0) return;
+
+	cache = RoadMapSquareActive->SquareCache;
+	if (cache[ROADMAP_SQUARE_CACHE_SIZE].prev == slot) return;
+
+	cache[cache[slot].next].prev = cache[slot].prev;
+	cache[cache[slot].prev].next = cache[slot].next;
+
+	cache[slot].prev = cache[ROADMAP_SQUARE_CACHE_SIZE].prev;
+	cache[slot].next = ROADMAP_SQUARE_CACHE_SIZE;
+
+	cache[cache[ROADMAP_SQUARE_CACHE_SIZE].prev].next = slot;
+	cache[ROADMAP_SQUARE_CACHE_SIZE].prev = slot;
+}
+
+
+void roadmap_square_get_cache_stats (RoadMapSquareCacheStats *stats) {
+
+	*stats = RoadMapSquareStats;
+	stats->bytes = RoadMapSquareActive ? RoadMapSquareActive->CacheBytes : 0;
+}
+
+
+void roadmap_square_configure (void) {
+
+   roadmap_config_declare
+       ("preferences", &RoadMapConfigSquareCacheBytes, ROADMAP_SQUARE_CACHE_BYTES, NULL);
+   roadmap_tile_decode_configure ();
+}
+
+
 
 
 //static int TotalSquares = 0;
@@ -387,7 +531,11 @@ static void *roadmap_square_map_one (const roadmap_db_data_file *file) {
 							  &context->edges.north);
 
 	RoadMapSquareCurrent = index;
-    slot = roadmap_square_cache (index);
+    slot = roadmap_square_cache (index,
+    										sizeof (roadmap_data_header) +
+    										file->header->num_sections * sizeof (roadmap_data_entry) +
+    										(file->header->num_sections ?
+    										 file->index[file->header->num_sections - 1].end_offset : 0));
 	RoadMapSquareActive->Square[slot] = context;
 	RoadMapSquareCurrentSlot = slot;
 
@@ -395,6 +543,9 @@ static void *roadmap_square_map_one (const roadmap_db_data_file *file) {
 
 	roadmap_hash_add (RoadMapSquareActive->SquareHash, index, slot);
 
+	navigate_graph_square_loaded (index, context->square->timestamp);
+	roadmap_tile_square_loaded (index, context->square->timestamp);
+
 
    for (j = 0; j < NUM_SUB_HANDLERS; j++) {
    	if (roadmap_db_exists (file, &(SquareHandlers[j].sector))) {
@@ -424,6 +575,8 @@ void roadmap_square_delete_reference (int square) {
 
 		roadmap_hash_remove (RoadMapSquareActive->SquareHash, square, slot);
 		RoadMapSquareActive->Square[slot] = ROADMAP_SQUARE_NOT_LOADED;
+		RoadMapSquareActive->CacheBytes -= RoadMapSquareActive->SquareCache[slot].bytes;
+		RoadMapSquareActive->SquareCache[slot].bytes = 0;
 	}
 }
 
@@ -773,6 +926,29 @@ void roadmap_square_force_next_update (void) {
 }
 
 
+/* Returns FALSE while the square is being decoded in the background,
+ * in which case it is drawn once it is ready.
+ */
+static BOOL roadmap_square_prepare (int square, int priority) {
+
+	int *status = roadmap_tile_status_get (square);
+
+	if (status != NULL) {
+
+		if (((*status) & ROADMAP_TILE_STATUS_FLAG_CHECKED) &&
+				!((*status) & ROADMAP_TILE_STATUS_FLAG_EXISTS)) {
+			return TRUE;
+		}
+		if (((*status) & ROADMAP_TILE_STATUS_MASK_PRIORITY) > priority) {
+			priority = (*status) & ROADMAP_TILE_STATUS_MASK_PRIORITY;
+		}
+	}
+
+	return roadmap_tile_decode_request (roadmap_locator_active (), square, priority) !=
+				ROADMAP_US_INPROGRESS;
+}
+
+
 int roadmap_square_view (int *square, RoadMapGuiRect *rect, int size) {
 
    RoadMapPosition origin;
@@ -788,6 +964,8 @@ int roadmap_square_view (int *square, RoadMapGuiRect *rect, int size) {
 
    if (RoadMapSquareActive == NULL) return 0;
 
+   RoadMapSquareViewStamp++;
+
    if (!rect) {
       roadmap_math_screen_edges (&screen);
    } else {
@@ -870,13 +1048,16 @@ int roadmap_square_view (int *square, RoadMapGuiRect *rect, int size) {
 
 			if (slot < 0) {
 				roadmap_tile_request (index, ROADMAP_TILE_STATUS_PRIORITY_ON_SCREEN, 0, NULL);
-				if (roadmap_square_set_current (index)) {
+				if (roadmap_square_prepare (index, ROADMAP_TILE_STATUS_PRIORITY_ON_SCREEN) &&
+						roadmap_square_set_current (index)) {
 					slot = roadmap_square_find (index);
 				}
 			}
 
 			if (slot >= 0) {
 
+				RoadMapSquareActive->SquareCache[slot].view_stamp = RoadMapSquareViewStamp;
+
 				if (RoadMapSquareForceUpdateMode ||
 						((*roadmap_tile_status_get (index)) & ROADMAP_TILE_STATUS_FLAG_ROUTE)) {
 					// force new version of route tiles when on screen
@@ -980,6 +1161,8 @@ int roadmap_square_set_current_internal (int square) {
 		int res;
 		int *status = roadmap_tile_status_get (square);
 
+		RoadMapSquareStats.misses++;
+
 		if (status != NULL) {
 
 			if ((*status) & ROADMAP_TILE_STATUS_FLAG_CHECKED) {
@@ -1016,6 +1199,10 @@ int roadmap_square_set_current_internal (int square) {
 		}
 	}
 
+	else {
+		RoadMapSquareStats.hits++;
+	}
+
 	if (slot >= 0) {
 		roadmap_square_promote (slot);
 
@@ -1116,7 +1303,7 @@ int roadmap_square_refresh( int fips, int max_num_tiles, RoadMapCallback tile_lo
    int *tile_status;
    int i, tile_count = 0;
 
-   for ( i = 1; i <= ROADMAP_SQUARE_CACHE_SIZE; i++ )
+   for ( i = 0; i < ROADMAP_SQUARE_CACHE_SIZE; i++ )
    {
       if (RoadMapSquareActive->SquareCache[i].square >= 0)
       {
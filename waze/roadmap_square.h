@@ -109,6 +109,19 @@ int 	roadmap_square_current_scale_factor (void);
 int	roadmap_square_scale (int square);
 int 	roadmap_square_at_current_scale (int square);
 void  roadmap_square_unload_all (void);
+int   roadmap_square_is_cached (int square);
+void  roadmap_square_release (int square);
+
+typedef struct {
+	int hits;
+	int misses;
+	int evictions;
+	int pinned_skips;	/* squares in view or on the route kept on eviction */
+	int bytes;
+} RoadMapSquareCacheStats;
+
+void	roadmap_square_configure (void);
+void	roadmap_square_get_cache_stats (RoadMapSquareCacheStats *stats);
 int roadmap_square_refresh( int fips, int max_num_tiles, RoadMapCallback tile_loaded_cb );
 
 extern roadmap_db_handler RoadMapSquareHandler;
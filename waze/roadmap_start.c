@@ -70,6 +70,8 @@
 #include "roadmap_label.h"
 #include "roadmap_display.h"
 #include "roadmap_locator.h"
+#include "roadmap_tile_storage.h"
+#include "roadmap_tile_manager.h"
 #include "roadmap_copy.h"
 #include "roadmap_httpcopy.h"
 #include "roadmap_download.h"
@@ -3395,6 +3397,8 @@ void roadmap_start_exit (void) {
     roadmap_config_save (0);
 #endif
     editor_main_shutdown ();
+    roadmap_tile_manager_shutdown ();
+    roadmap_tile_storage_shutdown ();
 #if !defined(__SYMBIAN32__) || defined(USE_QT)
     roadmap_db_end ();
 #endif
@@ -62,6 +62,29 @@ typedef struct {
 
 } StreetSearchContext;
 
+/* Bounding boxes of the lines of a square, built on the first search in it.
+ * The lines area is split into a grid, and each cell lists the lines that
+ * cross it, in line order.
+ */
+#define ROADMAP_STREET_INDEX_GRID   8
+
+typedef struct {
+
+   RoadMapArea    edges;
+   int            cell_width;
+   int            cell_height;
+
+   int            lines_count;
+   RoadMapArea   *line_edges;
+   int           *cell_first;
+   int           *cell_lines;
+
+   /* Lines found in more than one cell are only checked once */
+   unsigned int  *line_stamp;
+   unsigned int   stamp;
+   int           *candidates;
+} RoadMapStreetIndex;
+
 typedef struct {
 
    char *type;
@@ -78,6 +101,8 @@ typedef struct {
 	RoadMapDictionary RoadMapText2Speech;
 	RoadMapDictionary RoadMapStreetType;
 	RoadMapDictionary RoadMapStreetSuffix;
+
+	RoadMapStreetIndex *LineIndex;
 } RoadMapStreetContext;
 
 typedef struct {
@@ -101,6 +126,7 @@ enum t2s_types_tag {
 };
 
 static const char *roadmap_street_get_street_name_from_id (int street);
+static void roadmap_street_index_free (RoadMapStreetIndex *index);
 
 static void *roadmap_street_map (const roadmap_db_data_file *file) {
 
@@ -115,6 +141,7 @@ static void *roadmap_street_map (const roadmap_db_data_file *file) {
    context->RoadMapStreetType   = NULL;
    context->RoadMapStreetSuffix = NULL;
    context->RoadMapCityNames    = NULL;
+   context->LineIndex           = NULL;
 
    if (!roadmap_db_get_data (file,
    								  model__tile_street_name,
@@ -184,6 +211,9 @@ static void roadmap_street_unmap (void *context) {
    if (RoadMapStreetActive == this) {
       RoadMapStreetActive = NULL;
    }
+   if (this->LineIndex != NULL) {
+      roadmap_street_index_free (this->LineIndex);
+   }
    free (this);
 }
 
@@ -835,6 +865,203 @@ int roadmap_street_get_distance
 }
 
 
+static void roadmap_street_index_free (RoadMapStreetIndex *index) {
+
+   free (index->line_edges);
+   free (index->cell_first);
+   free (index->cell_lines);
+   free (index->line_stamp);
+   free (index->candidates);
+   free (index);
+}
+
+
+static void roadmap_street_index_cells (const RoadMapStreetIndex *index,
+                                        const RoadMapArea *area,
+                                        int *x0, int *y0, int *x1, int *y1) {
+
+   *x0 = (area->west - index->edges.west) / index->cell_width;
+   *x1 = (area->east - index->edges.west) / index->cell_width;
+   *y0 = (area->south - index->edges.south) / index->cell_height;
+   *y1 = (area->north - index->edges.south) / index->cell_height;
+
+   if (*x0 < 0) *x0 = 0;
+   if (*y0 < 0) *y0 = 0;
+   if (*x1 >= ROADMAP_STREET_INDEX_GRID) *x1 = ROADMAP_STREET_INDEX_GRID - 1;
+   if (*y1 >= ROADMAP_STREET_INDEX_GRID) *y1 = ROADMAP_STREET_INDEX_GRID - 1;
+}
+
+
+static RoadMapStreetIndex *roadmap_street_index_build (int has_shapes) {
+
+   RoadMapStreetIndex *index;
+   int count = roadmap_line_count ();
+   int cells = ROADMAP_STREET_INDEX_GRID * ROADMAP_STREET_INDEX_GRID;
+   int line;
+   int first_shape;
+   int last_shape;
+   int i;
+   int x0, y0, x1, y1, x, y;
+
+   index = roadmap_allocate_and_check (sizeof (RoadMapStreetIndex));
+   index->lines_count = count;
+   index->line_edges = roadmap_allocate_and_check ((count + 1) * sizeof (RoadMapArea));
+   index->line_stamp = calloc (count + 1, sizeof (unsigned int));
+   roadmap_check_allocated (index->line_stamp);
+   index->candidates = roadmap_allocate_and_check ((count + 1) * sizeof (int));
+   index->cell_first = calloc (cells + 1, sizeof (int));
+   roadmap_check_allocated (index->cell_first);
+   index->stamp = 0;
+   memset (&index->edges, 0, sizeof (index->edges));
+
+   for (line = 0; line < count; line++) {
+
+      RoadMapArea *edges = index->line_edges + line;
+      RoadMapPosition position;
+
+      roadmap_line_from (line, &position);
+      edges->west = edges->east = position.longitude;
+      edges->south = edges->north = position.latitude;
+
+      /* shape positions are relative to the previous point */
+      if (has_shapes && roadmap_line_shapes (line, &first_shape, &last_shape) > 0) {
+
+         for (i = first_shape; i <= last_shape; i++) {
+
+            roadmap_shape_get_position (i, &position);
+            if (position.longitude < edges->west) edges->west = position.longitude;
+            if (position.longitude > edges->east) edges->east = position.longitude;
+            if (position.latitude < edges->south) edges->south = position.latitude;
+            if (position.latitude > edges->north) edges->north = position.latitude;
+         }
+      }
+
+      roadmap_line_to (line, &position);
+      if (position.longitude < edges->west) edges->west = position.longitude;
+      if (position.longitude > edges->east) edges->east = position.longitude;
+      if (position.latitude < edges->south) edges->south = position.latitude;
+      if (position.latitude > edges->north) edges->north = position.latitude;
+
+      if (line == 0) {
+         index->edges = *edges;
+      } else {
+         if (edges->west < index->edges.west) index->edges.west = edges->west;
+         if (edges->east > index->edges.east) index->edges.east = edges->east;
+         if (edges->south < index->edges.south) index->edges.south = edges->south;
+         if (edges->north > index->edges.north) index->edges.north = edges->north;
+      }
+   }
+
+   index->cell_width = (index->edges.east - index->edges.west) / ROADMAP_STREET_INDEX_GRID + 1;
+   index->cell_height = (index->edges.north - index->edges.south) / ROADMAP_STREET_INDEX_GRID + 1;
+
+   /* count the lines of each cell, then fill the cells in line order */
+   for (line = 0; line < count; line++) {
+
+      roadmap_street_index_cells (index, index->line_edges + line, &x0, &y0, &x1, &y1);
+      for (y = y0; y <= y1; y++) {
+         for (x = x0; x <= x1; x++) {
+            index->cell_first[y * ROADMAP_STREET_INDEX_GRID + x + 1]++;
+         }
+      }
+   }
+
+   for (i = 0; i < cells; i++) {
+      index->cell_first[i + 1] += index->cell_first[i];
+   }
+
+   index->cell_lines = roadmap_allocate_and_check ((index->cell_first[cells] + 1) * sizeof (int));
+
+   for (line = 0; line < count; line++) {
+
+      roadmap_street_index_cells (index, index->line_edges + line, &x0, &y0, &x1, &y1);
+      for (y = y0; y <= y1; y++) {
+         for (x = x0; x <= x1; x++) {
+            index->cell_lines[index->cell_first[y * ROADMAP_STREET_INDEX_GRID + x]++] = line;
+         }
+      }
+   }
+
+   /* the fill moved each start to the next cell */
+   for (i = cells; i > 0; i--) {
+      index->cell_first[i] = index->cell_first[i - 1];
+   }
+   index->cell_first[0] = 0;
+
+   return index;
+}
+
+
+static int roadmap_street_compare_lines (const void *a, const void *b) {
+
+   return *(const int *)a - *(const int *)b;
+}
+
+
+/* Returns the lines of the range that may be visible, in line order */
+static int roadmap_street_index_search (RoadMapStreetIndex *index,
+                                        int first_line, int last_line,
+                                        const RoadMapArea *focus) {
+
+   int x0, y0, x1, y1, x, y;
+   int count = 0;
+
+   if (focus->west > index->edges.east || focus->east < index->edges.west ||
+       focus->south > index->edges.north || focus->north < index->edges.south) {
+      return 0;
+   }
+
+   if (++index->stamp == 0) {
+      memset (index->line_stamp, 0, index->lines_count * sizeof (unsigned int));
+      index->stamp = 1;
+   }
+
+   roadmap_street_index_cells (index, focus, &x0, &y0, &x1, &y1);
+
+   for (y = y0; y <= y1; y++) {
+      for (x = x0; x <= x1; x++) {
+
+         int cell = y * ROADMAP_STREET_INDEX_GRID + x;
+         int low = index->cell_first[cell];
+         int high = index->cell_first[cell + 1];
+
+         /* the lines of a cell are sorted, skip to the range */
+         while (low < high) {
+            int mid = (low + high) / 2;
+            if (index->cell_lines[mid] < first_line) {
+               low = mid + 1;
+            } else {
+               high = mid;
+            }
+         }
+
+         for (; low < index->cell_first[cell + 1] &&
+                index->cell_lines[low] <= last_line; low++) {
+
+            int line = index->cell_lines[low];
+            const RoadMapArea *edges = index->line_edges + line;
+
+            if (index->line_stamp[line] == index->stamp) continue;
+            index->line_stamp[line] = index->stamp;
+
+            if (edges->west > focus->east || edges->east < focus->west ||
+                edges->south > focus->north || edges->north < focus->south) {
+               continue;
+            }
+
+            index->candidates[count++] = line;
+         }
+      }
+   }
+
+   if (count > 1) {
+      qsort (index->candidates, count, sizeof (int), roadmap_street_compare_lines);
+   }
+
+   return count;
+}
+
+
 static int roadmap_street_get_closest_in_square
               (const RoadMapPosition *position, int square, int cfcc,
                int max_shapes, RoadMapNeighbour *neighbours,
@@ -846,8 +1073,13 @@ static int roadmap_street_get_closest_in_square
    int last_line;
    int first_shape;
    int last_shape;
+   int has_shapes;
+   int candidates_count;
    int i;
+   int j;
    int fips;
+   RoadMapArea focus;
+   RoadMapStreetIndex *index;
    RoadMapNeighbour this[3];
    int max_possible_shapes = (int)(sizeof(this) / sizeof(this[0]));
 
@@ -860,9 +1092,25 @@ static int roadmap_street_get_closest_in_square
 
    if (roadmap_line_in_square (square, cfcc, &first_line, &last_line) > 0) {
 
-      if (roadmap_square_has_shapes (square)) {
+      has_shapes = roadmap_square_has_shapes (square);
 
-         for (line = first_line; line <= last_line; line++) {
+      if (RoadMapStreetActive == NULL) return count;
+
+      /* Only lines crossing the focus can have visible segments */
+      if (RoadMapStreetActive->LineIndex == NULL) {
+         RoadMapStreetActive->LineIndex = roadmap_street_index_build (has_shapes);
+      }
+      index = RoadMapStreetActive->LineIndex;
+
+      roadmap_math_get_focus (&focus);
+      candidates_count =
+         roadmap_street_index_search (index, first_line, last_line, &focus);
+
+      for (j = 0; j < candidates_count; j++) {
+
+         line = index->candidates[j];
+
+         if (has_shapes) {
 
             if (roadmap_plugin_override_line (line, cfcc, fips)) continue;
 
@@ -880,16 +1128,10 @@ static int roadmap_street_get_closest_in_square
             for (i = 0; i < found; i++) {
                count = roadmap_street_replace (neighbours, count, max, this + i);
             }
-         }
-
-      } else {
 
-         for (line = first_line; line <= last_line; line++) {
-
-            if (roadmap_street_get_distance_no_shape
+         } else if (roadmap_street_get_distance_no_shape
                         (position, line, cfcc, this)) {
-               count = roadmap_street_replace (neighbours, count, max, this);
-            }
+            count = roadmap_street_replace (neighbours, count, max, this);
          }
       }
    }
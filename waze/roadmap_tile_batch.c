@@ -0,0 +1,384 @@
+/* roadmap_tile_batch.c - Framing of multi-tile download requests
+ *
+ * LICENSE:
+ *
+ *   Copyright 2012 Assaf Paz
+ *
+ *   This file is part of RoadMap.
+ *
+ *   RoadMap is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   RoadMap is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with RoadMap; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * NOTES:
+ *
+ *   The request body has one line per tile: the tile id and the timestamp
+ *   of the version we have, in seconds, or 0 if we have none:
+ *
+ *      <tile id>,<timestamp>\n
+ *
+ *   The response is a sequence of frames, in any order. Each frame starts
+ *   with a header of three 32 bit integers in network order: the tile id,
+ *   its status (200, 304 or 404, as for a single tile request) and the size
+ *   of the data that follows. Only loaded tiles have data.
+ *
+ *   The manifest of a map lists the current version of each of its tiles,
+ *   as pairs of 32 bit integers in network order: the tile id and the
+ *   timestamp of the tile.
+ *
+ *   When serving, the version of a tile is the one the storage has for it
+ *   (roadmap_tile_enumerate_versions), and the given default otherwise.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "roadmap.h"
+#include "roadmap_tile_storage.h"
+#include "roadmap_tile_batch.h"
+
+
+typedef struct {
+
+   int                           tiles[ROADMAP_TILE_BATCH_MAX];
+   int                           found[ROADMAP_TILE_BATCH_MAX];
+   int                           count;
+   roadmap_tile_batch_write_cb   write;
+   void                          *context;
+} RoadMapTileBatchServe;
+
+typedef struct {
+
+   int   tile_index;
+   int   version;
+} RoadMapTileBatchVersion;
+
+/* The enumeration callbacks have no context */
+static roadmap_tile_batch_write_cb  ManifestWrite;
+static void                         *ManifestContext;
+static int                          ManifestVersion;
+
+/* The versions known to the storage, sorted by tile id */
+static RoadMapTileBatchVersion      *BatchVersions;
+static int                          BatchVersionsCount;
+static int                          BatchVersionsCapacity;
+
+
+static unsigned int batch_get_int (const unsigned char *data) {
+
+   return ((unsigned int)data[0] << 24) |
+          ((unsigned int)data[1] << 16) |
+          ((unsigned int)data[2] << 8) |
+          (unsigned int)data[3];
+}
+
+
+static void batch_put_int (unsigned char *data, unsigned int value) {
+
+   data[0] = (unsigned char)(value >> 24);
+   data[1] = (unsigned char)(value >> 16);
+   data[2] = (unsigned char)(value >> 8);
+   data[3] = (unsigned char)value;
+}
+
+
+static void batch_write_frame (roadmap_tile_batch_write_cb write, void *context,
+                               int tile_index, int status,
+                               const void *data, size_t size) {
+
+   unsigned char header[ROADMAP_TILE_BATCH_HEADER_SIZE];
+
+   batch_put_int (header, (unsigned int)tile_index);
+   batch_put_int (header + 4, (unsigned int)status);
+   batch_put_int (header + 8, (unsigned int)size);
+
+   write (header, sizeof (header), context);
+   if (size > 0) {
+      write (data, size, context);
+   }
+}
+
+
+int roadmap_tile_batch_add_request (char *body, int length, int capacity,
+                                    int tile_index, time_t timestamp) {
+
+   int added = snprintf (body + length, capacity - length, "%d,%ld\n",
+                         tile_index, (long)timestamp);
+
+   if (added < 0 || added >= capacity - length) {
+      body[length] = '\0';
+      return -1;
+   }
+
+   return length + added;
+}
+
+
+void roadmap_tile_batch_reader_init (RoadMapTileBatchReader *reader) {
+
+   memset (reader, 0, sizeof (*reader));
+}
+
+
+void roadmap_tile_batch_reader_free (RoadMapTileBatchReader *reader) {
+
+   if (reader->data) {
+      free (reader->data);
+      reader->data = NULL;
+   }
+}
+
+
+int roadmap_tile_batch_read (RoadMapTileBatchReader *reader,
+                             const char *data, size_t size,
+                             roadmap_tile_batch_frame_cb cb, void *context) {
+
+   if (reader->broken) return -1;
+
+   while (size > 0) {
+
+      size_t chunk;
+
+      if (reader->header_size < ROADMAP_TILE_BATCH_HEADER_SIZE) {
+
+         chunk = ROADMAP_TILE_BATCH_HEADER_SIZE - reader->header_size;
+         if (chunk > size) chunk = size;
+
+         memcpy (reader->header + reader->header_size, data, chunk);
+         reader->header_size += chunk;
+         data += chunk;
+         size -= chunk;
+
+         if (reader->header_size < ROADMAP_TILE_BATCH_HEADER_SIZE) break;
+
+         reader->tile_index = (int)batch_get_int (reader->header);
+         reader->status = (int)batch_get_int (reader->header + 4);
+         reader->size = batch_get_int (reader->header + 8);
+         reader->received = 0;
+
+         if (reader->size > ROADMAP_TILE_BATCH_MAX_TILE ||
+             (reader->size > 0 && reader->status != ROADMAP_TILE_BATCH_LOADED)) {
+            roadmap_log (ROADMAP_ERROR, "Bad frame for tile %d: status %d, size %u",
+                         reader->tile_index, reader->status, (unsigned int)reader->size);
+            reader->broken = 1;
+            return -1;
+         }
+
+         if (reader->size > 0) {
+            reader->data = malloc (reader->size);
+            if (!reader->data) {
+               roadmap_log (ROADMAP_ERROR, "No memory for tile %d (%u bytes)",
+                            reader->tile_index, (unsigned int)reader->size);
+               reader->broken = 1;
+               return -1;
+            }
+         }
+      } else {
+
+         chunk = reader->size - reader->received;
+         if (chunk > size) chunk = size;
+
+         memcpy (reader->data + reader->received, data, chunk);
+         reader->received += chunk;
+         data += chunk;
+         size -= chunk;
+      }
+
+      if (reader->received == reader->size) {
+
+         cb (reader->tile_index, reader->status, reader->data, reader->size, context);
+
+         roadmap_tile_batch_reader_free (reader);
+         reader->header_size = 0;
+         reader->size = 0;
+         reader->received = 0;
+      }
+   }
+
+   return 0;
+}
+
+
+static void batch_add_version (int tile_index, int version) {
+
+   if (BatchVersionsCount == BatchVersionsCapacity) {
+
+      int capacity = BatchVersionsCapacity ? BatchVersionsCapacity * 2 : 1024;
+      RoadMapTileBatchVersion *grown =
+         realloc (BatchVersions, capacity * sizeof (RoadMapTileBatchVersion));
+
+      if (!grown) return;
+      BatchVersions = grown;
+      BatchVersionsCapacity = capacity;
+   }
+
+   BatchVersions[BatchVersionsCount].tile_index = tile_index;
+   BatchVersions[BatchVersionsCount].version = version;
+   BatchVersionsCount++;
+}
+
+
+static int batch_compare_version (const void *a, const void *b) {
+
+   int ta = ((const RoadMapTileBatchVersion *)a)->tile_index;
+   int tb = ((const RoadMapTileBatchVersion *)b)->tile_index;
+
+   return ta < tb ? -1 : ta > tb;
+}
+
+
+static void batch_load_versions (int fips) {
+
+   BatchVersionsCount = 0;
+
+   if (roadmap_tile_enumerate_versions (fips, batch_add_version) < 0) {
+      BatchVersionsCount = 0;
+   }
+
+   qsort (BatchVersions, BatchVersionsCount, sizeof (RoadMapTileBatchVersion),
+          batch_compare_version);
+}
+
+
+static int batch_get_version (int tile_index, int default_version) {
+
+   RoadMapTileBatchVersion key;
+   const RoadMapTileBatchVersion *found;
+
+   if (!BatchVersionsCount) return default_version;
+
+   key.tile_index = tile_index;
+   found = bsearch (&key, BatchVersions, BatchVersionsCount,
+                    sizeof (RoadMapTileBatchVersion), batch_compare_version);
+
+   return found && found->version > 0 ? found->version : default_version;
+}
+
+
+static void batch_serve_tile (int tile_index, const void *data, size_t size, void *context) {
+
+   RoadMapTileBatchServe *serve = (RoadMapTileBatchServe *)context;
+   int i;
+
+   for (i = 0; i < serve->count; i++) {
+      if (serve->tiles[i] == tile_index) {
+         serve->found[i] = 1;
+         break;
+      }
+   }
+
+   batch_write_frame (serve->write, serve->context, tile_index, ROADMAP_TILE_BATCH_LOADED, data, size);
+}
+
+
+int roadmap_tile_batch_serve (int fips, const char *body, time_t tiles_time,
+                              roadmap_tile_batch_write_cb write, void *context) {
+
+   RoadMapTileBatchServe serve;
+   int frames = 0;
+   int i;
+
+   serve.count = 0;
+   serve.write = write;
+   serve.context = context;
+
+   batch_load_versions (fips);
+
+   while (*body) {
+
+      int tile_index;
+      long timestamp;
+      const char *end = strchr (body, '\n');
+
+      if (sscanf (body, "%d,%ld", &tile_index, &timestamp) != 2) {
+         roadmap_log (ROADMAP_ERROR, "Bad tile batch request line: %.*s",
+                      end ? (int)(end - body) : (int)strlen (body), body);
+         return -1;
+      }
+
+      if (timestamp > 0 &&
+          (time_t)timestamp >= (time_t)batch_get_version (tile_index, (int)tiles_time)) {
+         batch_write_frame (write, context, tile_index, ROADMAP_TILE_BATCH_NOT_MODIFIED, NULL, 0);
+         frames++;
+      } else if (serve.count < ROADMAP_TILE_BATCH_MAX) {
+         serve.tiles[serve.count] = tile_index;
+         serve.found[serve.count] = 0;
+         serve.count++;
+      } else {
+         roadmap_log (ROADMAP_ERROR, "Too many tiles in batch request");
+         return -1;
+      }
+
+      if (!end) break;
+      body = end + 1;
+   }
+
+   /* the tiles that could not be loaded are reported missing */
+   if (serve.count > 0) {
+      roadmap_tile_load_batch (fips, serve.tiles, serve.count, batch_serve_tile, &serve);
+   }
+
+   for (i = 0; i < serve.count; i++) {
+      if (!serve.found[i]) {
+         batch_write_frame (write, context, serve.tiles[i], ROADMAP_TILE_BATCH_MISSING, NULL, 0);
+      }
+      frames++;
+   }
+
+   return frames;
+}
+
+
+int roadmap_tile_batch_read_manifest (const char *data, size_t size,
+                                      roadmap_tile_manifest_cb cb, void *context) {
+
+   const unsigned char *record = (const unsigned char *)data;
+   int count = (int)(size / ROADMAP_TILE_MANIFEST_RECORD_SIZE);
+   int i;
+
+   if (size % ROADMAP_TILE_MANIFEST_RECORD_SIZE) {
+      roadmap_log (ROADMAP_ERROR, "Bad tile manifest size %u", (unsigned int)size);
+      return -1;
+   }
+
+   for (i = 0; i < count; i++, record += ROADMAP_TILE_MANIFEST_RECORD_SIZE) {
+      cb ((int)batch_get_int (record), (int)batch_get_int (record + 4), context);
+   }
+
+   return count;
+}
+
+
+static void batch_serve_manifest_tile (int tile_index) {
+
+   unsigned char record[ROADMAP_TILE_MANIFEST_RECORD_SIZE];
+
+   batch_put_int (record, (unsigned int)tile_index);
+   batch_put_int (record + 4, (unsigned int)batch_get_version (tile_index, ManifestVersion));
+
+   ManifestWrite (record, sizeof (record), ManifestContext);
+}
+
+
+int roadmap_tile_batch_serve_manifest (int fips, int default_version,
+                                       roadmap_tile_batch_write_cb write, void *context) {
+
+   ManifestWrite = write;
+   ManifestContext = context;
+   ManifestVersion = default_version;
+
+   batch_load_versions (fips);
+
+   return roadmap_tile_enumerate (fips, batch_serve_manifest_tile);
+}
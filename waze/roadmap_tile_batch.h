@@ -0,0 +1,101 @@
+/* roadmap_tile_batch.h - Framing of multi-tile download requests
+ *
+ * LICENSE:
+ *
+ *   Copyright 2012 Assaf Paz
+ *
+ *   This file is part of RoadMap.
+ *
+ *   RoadMap is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   RoadMap is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with RoadMap; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#ifndef ROADMAP_TILE_BATCH_H_
+#define ROADMAP_TILE_BATCH_H_
+
+#include <stdlib.h>
+#include <time.h>
+
+#define ROADMAP_TILE_BATCH_MAX            32
+#define ROADMAP_TILE_BATCH_HEADER_SIZE    12
+#define ROADMAP_TILE_BATCH_MAX_TILE       (4 * 1024 * 1024)
+#define ROADMAP_TILE_MANIFEST_RECORD_SIZE 8
+
+/* The status of a tile in the response */
+#define ROADMAP_TILE_BATCH_LOADED         200
+#define ROADMAP_TILE_BATCH_NOT_MODIFIED   304
+#define ROADMAP_TILE_BATCH_MISSING        404
+
+/* The data passed to the callback is only valid during the call */
+typedef void (*roadmap_tile_batch_frame_cb) (int tile_index, int status,
+                                             const void *data, size_t size,
+                                             void *context);
+
+typedef struct {
+
+   unsigned char  header[ROADMAP_TILE_BATCH_HEADER_SIZE];
+   size_t         header_size;
+
+   int            tile_index;
+   int            status;
+   char           *data;
+   size_t         size;
+   size_t         received;
+   int            broken;
+} RoadMapTileBatchReader;
+
+typedef void (*roadmap_tile_batch_write_cb) (const void *data, size_t size, void *context);
+
+typedef void (*roadmap_tile_manifest_cb) (int tile_index, int version, void *context);
+
+/* Adds a tile to a request body. Returns the new length of the body, or -1
+ * if it does not fit.
+ */
+int roadmap_tile_batch_add_request (char *body, int length, int capacity,
+                                    int tile_index, time_t timestamp);
+
+void roadmap_tile_batch_reader_init (RoadMapTileBatchReader *reader);
+
+void roadmap_tile_batch_reader_free (RoadMapTileBatchReader *reader);
+
+/* Takes the response as it arrives, and calls the callback for each
+ * complete frame. Returns -1 if the response is not well formed, and
+ * ignores the rest of it.
+ */
+int roadmap_tile_batch_read (RoadMapTileBatchReader *reader,
+                             const char *data, size_t size,
+                             roadmap_tile_batch_frame_cb cb, void *context);
+
+/* Answers a request body from the local tile storage, which is how the stub
+ * server in tile_stub/ serves a tiles database. Tiles whose timestamp is not
+ * older than their stored version, or than tiles_time when the storage has
+ * none, are reported as not modified. Returns the number of frames written,
+ * or -1 if the request is not well formed.
+ */
+int roadmap_tile_batch_serve (int fips, const char *body, time_t tiles_time,
+                              roadmap_tile_batch_write_cb write, void *context);
+
+/* Calls the callback for each tile of a manifest. Returns the number of
+ * tiles, or -1 if the manifest is not well formed.
+ */
+int roadmap_tile_batch_read_manifest (const char *data, size_t size,
+                                      roadmap_tile_manifest_cb cb, void *context);
+
+/* Writes the manifest of the local tile storage, for the stub server. Each
+ * tile is given its stored version, or default_version when the storage has
+ * none. Returns the number of tiles, or -1.
+ */
+int roadmap_tile_batch_serve_manifest (int fips, int default_version,
+                                       roadmap_tile_batch_write_cb write, void *context);
+
+#endif /*ROADMAP_TILE_BATCH_H_*/
@@ -0,0 +1,487 @@
+/* roadmap_tile_decode.c - Background decoding of map tiles
+ *
+ * LICENSE:
+ *
+ *   Copyright 2012 Assaf Paz
+ *
+ *   This file is part of RoadMap.
+ *
+ *   RoadMap is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   RoadMap is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with RoadMap; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * NOTES:
+ *
+ *   The tile storage is not thread safe, so the compressed tile is read on
+ *   the main thread. The workers validate and uncompress it, which is where
+ *   opening a tile spends its time.
+ *
+ *   Finished jobs are pushed by the workers on a lock free list, which is
+ *   drained by a timer on the main thread. The decoded data is kept until
+ *   roadmap_db_open() takes it, so the tile is still mapped and activated
+ *   on the main thread, like any other tile.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "roadmap.h"
+#include "roadmap_config.h"
+#include "roadmap_main.h"
+#include "roadmap_screen.h"
+#include "roadmap_locator.h"
+#include "roadmap_dbread.h"
+#include "roadmap_tile_storage.h"
+#include "roadmap_tile_decode.h"
+
+
+#define DECODE_MAX_JOBS          32
+#define DECODE_MAX_THREADS       4
+#define DECODE_POLL_INTERVAL     20
+#define DECODE_ERROR_SIZE        128
+
+typedef enum {
+   DECODE_FREE,
+   DECODE_PENDING,   /* queued, or owned by a worker until it is on the done list */
+   DECODE_READY
+} RoadMapDecodeState;
+
+typedef struct RoadMapDecodeJob_s {
+
+   int            fips;
+   int            tile_index;
+   int            priority;
+   int            state;
+   int            canceled;
+   unsigned int   stamp;
+
+   void           *data;   /* compressed data, freed by the worker */
+   size_t         size;
+
+   void           *raw;    /* NULL if the tile could not be decoded */
+   size_t         raw_size;
+   char           error[DECODE_ERROR_SIZE];
+
+   struct RoadMapDecodeJob_s *next_done;
+} RoadMapDecodeJob;
+
+static RoadMapConfigDescriptor RoadMapConfigDecodeThreads =
+                        ROADMAP_CONFIG_ITEM("Map", "Decode threads");
+
+/* The jobs table is only used by the main thread */
+static RoadMapDecodeJob sgJobs[DECODE_MAX_JOBS];
+static int sgJobsPending = 0;
+static unsigned int sgJobsStamp = 0;
+
+/* Pending jobs, as a heap on priority */
+static RoadMapDecodeJob *sgQueue[DECODE_MAX_JOBS];
+static int sgQueueCount = 0;
+static int sgStopping = 0;
+static pthread_mutex_t sgQueueLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sgQueueCond = PTHREAD_COND_INITIALIZER;
+
+static pthread_t sgThreads[DECODE_MAX_THREADS];
+static int sgThreadsCount = 0;
+static int sgStarted = 0;
+
+/* Finished jobs, pushed by the workers and taken all at once by the main thread */
+static RoadMapDecodeJob *volatile sgDoneList = NULL;
+
+
+static int decode_queue_before (const RoadMapDecodeJob *a, const RoadMapDecodeJob *b) {
+
+   if (a->priority != b->priority) {
+      return a->priority > b->priority;
+   }
+
+   return (int)(a->stamp - b->stamp) < 0;
+}
+
+
+static void decode_queue_up (int i) {
+
+   while (i > 0) {
+
+      int parent = (i - 1) / 2;
+      RoadMapDecodeJob *tmp;
+
+      if (!decode_queue_before (sgQueue[i], sgQueue[parent])) break;
+
+      tmp = sgQueue[i];
+      sgQueue[i] = sgQueue[parent];
+      sgQueue[parent] = tmp;
+      i = parent;
+   }
+}
+
+
+static void decode_queue_down (int i) {
+
+   for (;;) {
+
+      int best = i;
+      int child = 2 * i + 1;
+      RoadMapDecodeJob *tmp;
+
+      if (child < sgQueueCount && decode_queue_before (sgQueue[child], sgQueue[best])) {
+         best = child;
+      }
+      child++;
+      if (child < sgQueueCount && decode_queue_before (sgQueue[child], sgQueue[best])) {
+         best = child;
+      }
+      if (best == i) break;
+
+      tmp = sgQueue[i];
+      sgQueue[i] = sgQueue[best];
+      sgQueue[best] = tmp;
+      i = best;
+   }
+}
+
+
+static RoadMapDecodeJob *decode_queue_pop (void) {
+
+   RoadMapDecodeJob *job = sgQueue[0];
+
+   sgQueueCount--;
+   if (sgQueueCount > 0) {
+      sgQueue[0] = sgQueue[sgQueueCount];
+      decode_queue_down (0);
+   }
+
+   return job;
+}
+
+
+static void decode_push_done (RoadMapDecodeJob *job) {
+
+   RoadMapDecodeJob *head;
+
+   do {
+      head = sgDoneList;
+      job->next_done = head;
+   } while (!__sync_bool_compare_and_swap (&sgDoneList, head, job));
+}
+
+
+static void *decode_worker (void *params) {
+
+   for (;;) {
+
+      RoadMapDecodeJob *job;
+
+      pthread_mutex_lock (&sgQueueLock);
+      while (sgQueueCount == 0 && !sgStopping) {
+         pthread_cond_wait (&sgQueueCond, &sgQueueLock);
+      }
+      if (sgStopping) {
+         pthread_mutex_unlock (&sgQueueLock);
+         break;
+      }
+      job = decode_queue_pop ();
+      pthread_mutex_unlock (&sgQueueLock);
+
+      if (!roadmap_db_uncompress (job->data, job->size, &job->raw, &job->raw_size,
+                                  job->error, sizeof (job->error))) {
+         job->raw = NULL;
+      }
+      free (job->data);
+      job->data = NULL;
+
+      decode_push_done (job);
+   }
+
+   return NULL;
+}
+
+
+static void decode_start (void) {
+
+   int count;
+
+   sgStarted = 1;
+
+#ifndef NO_MAP_COMPRESSION
+   count = roadmap_config_get_integer (&RoadMapConfigDecodeThreads);
+   if (count > DECODE_MAX_THREADS) count = DECODE_MAX_THREADS;
+
+   while (sgThreadsCount < count) {
+
+      if (pthread_create (&sgThreads[sgThreadsCount], NULL, decode_worker, NULL) != 0) {
+         roadmap_log (ROADMAP_ERROR, "Cannot start tile decode thread %d", sgThreadsCount);
+         break;
+      }
+      sgThreadsCount++;
+   }
+
+   roadmap_log (ROADMAP_INFO, "Started %d tile decode threads", sgThreadsCount);
+#endif
+}
+
+
+static RoadMapDecodeJob *decode_find (int fips, int tile_index) {
+
+   int i;
+
+   for (i = 0; i < DECODE_MAX_JOBS; i++) {
+      if (sgJobs[i].state != DECODE_FREE &&
+          !sgJobs[i].canceled &&
+          sgJobs[i].tile_index == tile_index &&
+          sgJobs[i].fips == fips) {
+         return sgJobs + i;
+      }
+   }
+
+   return NULL;
+}
+
+
+static void decode_release (RoadMapDecodeJob *job) {
+
+   if (job->raw) {
+      free (job->raw);
+      job->raw = NULL;
+   }
+   job->state = DECODE_FREE;
+}
+
+
+/* Returns a free job, dropping the oldest decoded tile nobody took if needed */
+static RoadMapDecodeJob *decode_allocate (void) {
+
+   RoadMapDecodeJob *oldest = NULL;
+   int i;
+
+   for (i = 0; i < DECODE_MAX_JOBS; i++) {
+
+      RoadMapDecodeJob *job = sgJobs + i;
+
+      if (job->state == DECODE_FREE) return job;
+
+      if (job->state == DECODE_READY &&
+          (!oldest || (int)(job->stamp - oldest->stamp) < 0)) {
+         oldest = job;
+      }
+   }
+
+   if (oldest) {
+      decode_release (oldest);
+   }
+
+   return oldest;
+}
+
+
+static void decode_poll (void) {
+
+   RoadMapDecodeJob *list = __sync_lock_test_and_set (&sgDoneList, NULL);
+   RoadMapDecodeJob *done = NULL;
+   int redraw = 0;
+
+   /* the list was built backwards */
+   while (list) {
+      RoadMapDecodeJob *next = list->next_done;
+      list->next_done = done;
+      done = list;
+      list = next;
+   }
+
+   while (done) {
+
+      RoadMapDecodeJob *job = done;
+      done = job->next_done;
+
+      sgJobsPending--;
+
+      if (job->canceled || job->fips != roadmap_locator_active ()) {
+         decode_release (job);
+         continue;
+      }
+
+      if (!job->raw) {
+         /* the synchronous open reports the error and removes the tile */
+         roadmap_log (ROADMAP_DEBUG, "tile %d (fips %d) decode failed: %s",
+                      job->tile_index, job->fips, job->error);
+      }
+
+      job->state = DECODE_READY;
+      redraw = 1;
+   }
+
+   if (sgJobsPending == 0) {
+      roadmap_main_remove_periodic (decode_poll);
+   }
+
+   if (redraw) {
+      roadmap_screen_redraw ();
+   }
+}
+
+
+void roadmap_tile_decode_configure (void) {
+
+   roadmap_config_declare
+       ("preferences", &RoadMapConfigDecodeThreads, "2", NULL);
+}
+
+
+int roadmap_tile_decode_request (int fips, int tile_index, int priority) {
+
+   RoadMapDecodeJob *job;
+
+   if (!sgStarted) {
+      decode_start ();
+   }
+
+   if (sgThreadsCount == 0) {
+      return ROADMAP_US_OK;
+   }
+
+   job = decode_find (fips, tile_index);
+
+   if (job) {
+
+      if (job->state == DECODE_READY) {
+         return ROADMAP_US_OK;
+      }
+
+      if (priority > job->priority) {
+
+         int i;
+
+         pthread_mutex_lock (&sgQueueLock);
+         for (i = 0; i < sgQueueCount; i++) {
+            if (sgQueue[i] == job) {
+               job->priority = priority;
+               decode_queue_up (i);
+               break;
+            }
+         }
+         pthread_mutex_unlock (&sgQueueLock);
+      }
+
+      return ROADMAP_US_INPROGRESS;
+   }
+
+   job = decode_allocate ();
+   if (!job) {
+      return ROADMAP_US_OK;
+   }
+
+   if (roadmap_tile_load (fips, tile_index, &job->data, &job->size) != 0) {
+      return ROADMAP_US_NOMAP;
+   }
+
+   job->fips = fips;
+   job->tile_index = tile_index;
+   job->priority = priority;
+   job->canceled = 0;
+   job->stamp = ++sgJobsStamp;
+   job->raw = NULL;
+   job->raw_size = 0;
+   job->error[0] = '\0';
+   job->state = DECODE_PENDING;
+
+   pthread_mutex_lock (&sgQueueLock);
+   sgQueue[sgQueueCount] = job;
+   decode_queue_up (sgQueueCount++);
+   pthread_cond_signal (&sgQueueCond);
+   pthread_mutex_unlock (&sgQueueLock);
+
+   if (sgJobsPending++ == 0) {
+      roadmap_main_set_periodic (DECODE_POLL_INTERVAL, decode_poll);
+   }
+
+   return ROADMAP_US_INPROGRESS;
+}
+
+
+int roadmap_tile_decode_take (int fips, int tile_index, void **raw, size_t *raw_size) {
+
+   RoadMapDecodeJob *job = decode_find (fips, tile_index);
+
+   if (!job || job->state != DECODE_READY) {
+      return 0;
+   }
+
+   if (!job->raw) {
+      decode_release (job);
+      return 0;
+   }
+
+   *raw = job->raw;
+   *raw_size = job->raw_size;
+   job->raw = NULL;
+   decode_release (job);
+
+   return 1;
+}
+
+
+void roadmap_tile_decode_cancel (int fips, int tile_index) {
+
+   RoadMapDecodeJob *job = decode_find (fips, tile_index);
+
+   if (!job) return;
+
+   if (job->state == DECODE_READY) {
+      decode_release (job);
+   } else {
+      /* a worker may still have it, it is released when it is done */
+      job->canceled = 1;
+   }
+}
+
+
+void roadmap_tile_decode_cancel_all (int fips) {
+
+   int i;
+
+   for (i = 0; i < DECODE_MAX_JOBS; i++) {
+
+      RoadMapDecodeJob *job = sgJobs + i;
+
+      if (job->state == DECODE_FREE || job->canceled) continue;
+      if (fips >= 0 && job->fips != fips) continue;
+
+      if (job->state == DECODE_READY) {
+         decode_release (job);
+      } else {
+         job->canceled = 1;
+      }
+   }
+}
+
+
+void roadmap_tile_decode_shutdown (void) {
+
+   int i;
+
+   if (sgThreadsCount == 0) return;
+
+   pthread_mutex_lock (&sgQueueLock);
+   sgStopping = 1;
+   pthread_cond_broadcast (&sgQueueCond);
+   pthread_mutex_unlock (&sgQueueLock);
+
+   for (i = 0; i < sgThreadsCount; i++) {
+      pthread_join (sgThreads[i], NULL);
+   }
+   sgThreadsCount = 0;
+
+   if (sgJobsPending > 0) {
+      roadmap_main_remove_periodic (decode_poll);
+   }
+}
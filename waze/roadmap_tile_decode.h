@@ -0,0 +1,54 @@
+/* roadmap_tile_decode.h - Background decoding of map tiles
+ *
+ * LICENSE:
+ *
+ *   Copyright 2012 Assaf Paz
+ *
+ *   This file is part of RoadMap.
+ *
+ *   RoadMap is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   RoadMap is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with RoadMap; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#ifndef ROADMAP_TILE_DECODE_H_
+#define ROADMAP_TILE_DECODE_H_
+
+#include <stdlib.h>
+
+void roadmap_tile_decode_configure (void);
+
+void roadmap_tile_decode_shutdown (void);
+
+/* Starts decoding the tile in the background. Returns ROADMAP_US_INPROGRESS
+ * while it is being decoded, ROADMAP_US_NOMAP if the tile is not stored, and
+ * ROADMAP_US_OK when the tile can be opened now (decoded, or no worker is
+ * available so it should be opened synchronously).
+ */
+int roadmap_tile_decode_request (int fips, int tile_index, int priority);
+
+/* Hands over the decoded data of the tile, which the caller must free.
+ * Returns 0 if there is no decoded data for the tile.
+ */
+int roadmap_tile_decode_take (int fips, int tile_index, void **raw, size_t *raw_size);
+
+/* Drops a pending or decoded result, e.g. when a new version of the tile
+ * was downloaded.
+ */
+void roadmap_tile_decode_cancel (int fips, int tile_index);
+
+/* Drops the pending and decoded results of all the tiles of the map, or of
+ * all the maps if fips is -1, when the stored tiles are removed.
+ */
+void roadmap_tile_decode_cancel_all (int fips);
+
+#endif /*ROADMAP_TILE_DECODE_H_*/
@@ -28,8 +28,12 @@
 
 #include "roadmap_tile_manager.h"
 #include "roadmap_tile_storage.h"
+#include "roadmap_tile_decode.h"
+#include "roadmap_tile_batch.h"
 #include "roadmap_math.h"
 #include "roadmap.h"
+#include "roadmap_time.h"
+#include "roadmap_gps.h"
 #include "roadmap_tile_status.h"
 #include "roadmap_httpcopy_async.h"
 #include "roadmap_file.h"
@@ -41,6 +45,7 @@
 #include "roadmap_main.h"
 #include "roadmap_config.h"
 #include "navigate/navigate_graph.h"
+#include "navigate/navigate_overlay.h"
 #include "Realtime/Realtime.h"
 #include "roadmap_street.h"
 #include "roadmap_tile.h"
@@ -71,6 +76,11 @@
 
 #define TM_RETRY_CONNECTION_SECONDS	20
 #define TM_HTTP_TIMEOUT_SECONDS		20
+#define TM_BATCH_BODY_SIZE				(ROADMAP_TILE_BATCH_MAX * 40)
+
+#define TM_MANIFEST_INTERVAL			100	// milliseconds between checks of stored tiles
+#define TM_MANIFEST_RETRY_SECONDS	60		// doubled after each failure
+#define TM_MANIFEST_MAX_RETRIES		5
 
 typedef struct {
 
@@ -97,16 +107,113 @@ static int					  		 	NumOpenConnections = 0;
 static RoadMapConfigDescriptor 	RoadMapConfigTilesUrl =
                                   ROADMAP_CONFIG_ITEM("Download", "Tiles");
 
+/* Several tiles are requested at once when the batch url is set. A batch
+ * takes the place of a connection.
+ */
+typedef struct {
+
+	int					tile_index;
+	int					*tile_status;	// NULL once the tile was received
+	RoadMapCallback	callback;
+} BatchTile;
+
+typedef struct {
+
+	time_t						time_out;
+	int							abandoned;	// timed out, freed by the last http callback
+	char							url[512];
+	char							body[TM_BATCH_BODY_SIZE];
+	int							count;
+	BatchTile					tiles[ROADMAP_TILE_BATCH_MAX];
+	RoadMapTileBatchReader	reader;
+	int							loaded;
+	int							not_modified;
+	int							missing;
+} BatchContext;
+
+static BatchContext					*Batches[TM_MAX_CONCURRENT];
+static int								BatchDisabled = 0;
+
+static RoadMapConfigDescriptor 	RoadMapConfigTilesBatchUrl =
+                                  ROADMAP_CONFIG_ITEM("Download", "Tiles batch");
+
+/* A map refresh only downloads the stored tiles that are older than in the
+ * manifest, when the manifest url is set. The stored versions are taken from
+ * the tile storage, so the tiles are not opened.
+ */
+typedef struct {
+
+	int					tile_index;
+	int					version;
+	int					stored;
+	int					stored_version;	// 0 when not known
+} ManifestTile;
+
+static struct {
+
+	int					active;
+	int					fips;
+	char					url[512];
+	char					*data;
+	size_t				size;
+	size_t				capacity;
+	ManifestTile		*tiles;		// sorted by tile id
+	int					count;
+	int					*waiting;	// the changed tiles that are not downloaded yet
+	int					waiting_count;
+	int					next;
+	int					checked;
+	int					requested;
+	int					retries;		// failed requests of the current refresh
+	int					retry_pending;
+} Manifest;
+
+static RoadMapConfigDescriptor 	RoadMapConfigTilesManifestUrl =
+                                  ROADMAP_CONFIG_ITEM("Download", "Tiles manifest");
+
+#define TM_WAIT_BUCKETS					8
+
+enum {
+	TM_QUEUE_GPS,
+	TM_QUEUE_ROUTE,
+	TM_QUEUE_SCREEN,
+	TM_QUEUE_OTHER,
+	TM_QUEUE_KINDS
+};
+
+/* How long the tile requests waited in the queue, for each kind of request,
+ * logged at shutdown. The buckets are up to 100ms, 250ms, 500ms, 1s, 2.5s,
+ * 5s, 10s and longer.
+ */
+typedef struct {
+
+	int	wait[TM_QUEUE_KINDS][TM_WAIT_BUCKETS];
+	int	cancelled;
+	int	dropped;
+} QueueStatistics;
+
 typedef struct {
 
 	int					tile_index;
 	int					priority;
+	int					distance;		// from the view center, in meters
+	int					view;				// requested to draw the view, dropped when off screen
+	int					*queue_slot;	// kept up to date with the position in the heap
+	unsigned int		stamp;
+	uint32_t				queued_time;
 	RoadMapCallback	callback;
 } TileData;
 
+/* A heap on priority, then distance, then order of arrival */
 static TileData						RequestQueue[TM_MAX_QUEUE];
-static int								QueueHead = 0;
 static int								QueueSize = 0;
+static unsigned int					QueueStamp = 0;
+static QueueStatistics				QueueStats;
+
+/* Where the queue was last updated for */
+static RoadMapPosition				QueueViewCenter;
+static zoom_t							QueueViewZoom;
+static RoadMapPosition				QueueGpsFix;
 static RoadMapCallback				NextLoginCallback = NULL;
 static RoadMapTileCallback			TileCallback = NULL;
 static int								ActiveLoadingSession = 0;
@@ -121,9 +228,11 @@ static RoadMapConfigDescriptor 	LoadingSessionLifetimeCfg =
 
 
 static void load_next_tile (void);
-static void queue_tile (int index, int push, RoadMapCallback on_loaded);
+static int queue_tile (int index, int priority, int view, RoadMapCallback on_loaded);
+static void requeue (int index, int *tile_status, RoadMapCallback on_loaded);
 static void roadmap_tile_manager_login_cb (void);
 static void on_connection_failure (ConnectionContext *conn);
+static void connection_failed (void);
 #ifndef INLINE_DEC
 #define INLINE_DEC static
 #endif //INLINE_DEC
@@ -237,14 +346,25 @@ static void http_cb_error (void *context, int connection_failure, const char *fo
    load_next_tile ();
 }
 
+void roadmap_tile_square_loaded (int tile_index, int version) {
+
+	int *tile_status = roadmap_tile_status_get (tile_index);
+
+	if (!tile_status || version <= 0 ||
+		 ((*tile_status) & ROADMAP_TILE_STATUS_FLAG_VERSION)) {
+		return;
+	}
+
+	*tile_status |= ROADMAP_TILE_STATUS_FLAG_VERSION;
+	roadmap_tile_set_version (roadmap_locator_active (), tile_index, version);
+}
+
 #ifndef J2ME
 #define NOPH_System_currentTimeMillis() time(NULL)
 #endif
-static void http_cb_done (void *context,char *last_modified, const char *format, ... ) {
+/* Stores a downloaded tile and opens it. Returns the result of opening it. */
+static int tile_received (int tile_index, int *tile_status, void *data, size_t size) {
 
-   ConnectionContext *conn = (ConnectionContext *)context;
-	int *tile_status = conn->tile_status;
-   int tile_index = conn->tile_index;
    int unloaded;
 	time_t t1;
 	time_t t2;
@@ -255,44 +375,47 @@ static void http_cb_done (void *context,char *last_modified, const char *format,
    t2 = NOPH_System_currentTimeMillis();
    //printf("http_cb_done: unload %dms\n", t2 - t1);
 
-   roadmap_tile_store(roadmap_locator_active(), tile_index, conn->tile_data, conn->tile_size);
+	roadmap_tile_decode_cancel (roadmap_locator_active (), tile_index);
+   roadmap_tile_store(roadmap_locator_active(), tile_index, data, size);
 
    t2 = NOPH_System_currentTimeMillis();
    //printf("http_cb_done: save %dms\n", t2 - t1);
    *tile_status = ((*tile_status) |
 						 (ROADMAP_TILE_STATUS_FLAG_EXISTS | ROADMAP_TILE_STATUS_FLAG_UPTODATE)) &
 						~ROADMAP_TILE_STATUS_FLAG_ACTIVE;
-   conn->tile_status = NULL;
-   NumOpenConnections--;
 
   	roadmap_label_clear (tile_index);
   	navigate_graph_clear (tile_index);
+  	navigate_overlay_tile_changed (tile_index);
    if (!unloaded) {
    	roadmap_square_delete_reference (tile_index);
    }
 
-	rc = roadmap_locator_load_tile_mem (tile_index, conn->tile_data, conn->tile_size);
-	free (conn->tile_data);
-	conn->tile_data = NULL;
+	// Opening the new data records its version
+	*tile_status &= ~ROADMAP_TILE_STATUS_FLAG_VERSION;
+	rc = roadmap_locator_load_tile_mem (tile_index, data, size);
+
+	if (rc == ROADMAP_US_OK) {
+		roadmap_tile_square_loaded (tile_index, roadmap_square_version (tile_index));
+	} else {
+		roadmap_tile_set_version (roadmap_locator_active (), tile_index, 0);
+	}
 
    t2 = NOPH_System_currentTimeMillis();
    //printf("http_cb_done: load %dms\n", t2 - t1);
 
-   // Tiles refresh progress (if active)
-   tile_refresh_cb( tile_index );
-
-   load_next_tile ();
+   return rc;
+}
 
-   if (rc != ROADMAP_US_OK) {
-		return;
-	}
+/* Notifies that a downloaded tile was opened */
+static void tile_opened (int tile_index, int *tile_status, RoadMapCallback callback) {
 
   	if (roadmap_tile_get_scale (tile_index) == 0) {
 		roadmap_street_update_city_index ();
   	}
 
-   if (conn->callback) {
-   	conn->callback ();
+   if (callback) {
+   	callback ();
    }
 
 	roadmap_log (ROADMAP_DEBUG, "Download of tile %d complete", tile_index);
@@ -321,279 +444,912 @@ static void http_cb_done (void *context,char *last_modified, const char *format,
    }
 }
 
-static void init_url (void) {
-
-   roadmap_config_declare
-      ("preferences",
-      &RoadMapConfigTilesUrl, "", NULL);
-}
+/* Marks a tile the server could not send, so it is not requested again */
+static void tile_failed (int tile_index, int *tile_status, RoadMapCallback callback) {
 
-static const char *get_url_prefix (void) {
+	tile_refresh_cb (tile_index);
 
-	return roadmap_config_get (&RoadMapConfigTilesUrl);
+   *tile_status = ((*tile_status) |
+   							 (ROADMAP_TILE_STATUS_FLAG_ERROR | ROADMAP_TILE_STATUS_FLAG_UPTODATE)) &
+   							~ROADMAP_TILE_STATUS_FLAG_ACTIVE;
+   if (callback) {
+   	callback ();
+   }
 }
 
-static void get_url (ConnectionContext *context) {
+static void http_cb_done (void *context,char *last_modified, const char *format, ... ) {
 
-	int fips = roadmap_locator_active ();
-	int tile_id = context->tile_index;
+   ConnectionContext *conn = (ConnectionContext *)context;
+	int *tile_status = conn->tile_status;
+   int tile_index = conn->tile_index;
+   RoadMapCallback callback = conn->callback;
+	int rc;
 
-	snprintf (context->url,
-				 sizeof (context->url),
-				 "%s/%05d_%02x/%05d_%04x/%05d_%06x/%05d_%08x%s?sessionid=%d",
-				 get_url_prefix (),
-				 fips, tile_id >> 24,
-				 fips, tile_id >> 16,
-				 fips, tile_id >> 8,
-				 fips, tile_id, ROADMAP_DATA_TYPE,Realtime_GetServerId());
-}
+   conn->tile_status = NULL;
+   NumOpenConnections--;
 
+	rc = tile_received (tile_index, tile_status, conn->tile_data, conn->tile_size);
+	free (conn->tile_data);
+	conn->tile_data = NULL;
 
-static void next_to_load (int *tile_index, int *priority, RoadMapCallback *callback) {
+   // Tiles refresh progress (if active)
+   tile_refresh_cb( tile_index );
 
-	if (QueueSize <= 0) {
-		*tile_index = -1;
+   load_next_tile ();
+
+   if (rc != ROADMAP_US_OK) {
 		return;
 	}
 
-	*tile_index = RequestQueue[QueueHead].tile_index;
-	*callback = RequestQueue[QueueHead].callback;
-	*priority = RequestQueue[QueueHead].priority;
-	QueueHead = (QueueHead + 1) % TM_MAX_QUEUE;
-	QueueSize--;
+   tile_opened (tile_index, tile_status, callback);
 }
 
+static void batch_release (BatchContext *batch) {
 
-static void load_next_tile (void) {
-
-	static RoadMapHttpAsyncCallbacks callbacks = { http_cb_size, http_cb_progress, http_cb_error, http_cb_done };
-	int conn;
-	time_t tile_time;
-	int tile_index;
-	int priority;
-	int *tile_status;
-	RoadMapCallback tile_callback;
-
-   roadmap_log(ROADMAP_DEBUG, "load_next_tile - status:%d", Status);
-
-	if (NumOpenConnections >= TM_MAX_CONCURRENT || Status != stat_Active) {
-		return;
-	}
+	int i;
 
-	do {
-		next_to_load (&tile_index, &priority, &tile_callback);
-		if (tile_index == -1) {
-			return;
-		}
-		tile_status = roadmap_tile_status_get (tile_index);
-    waze_assert (tile_status != NULL);
-		if (((*tile_status) & ROADMAP_TILE_STATUS_FLAG_UPTODATE ) && tile_callback) {
-			tile_callback ();
+	for (i = 0; i < TM_MAX_CONCURRENT; i++) {
+		if (Batches[i] == batch) {
+			Batches[i] = NULL;
+			NumOpenConnections--;
+			break;
 		}
-		*tile_status &= ~ROADMAP_TILE_STATUS_FLAG_QUEUED;
 	}
-	while ((*tile_status) & (ROADMAP_TILE_STATUS_FLAG_ACTIVE | ROADMAP_TILE_STATUS_FLAG_UPTODATE));
+}
 
-	roadmap_log (ROADMAP_DEBUG, "Loading tile %d -- priority %d",
-						tile_index, priority);
+static void batch_free (BatchContext *batch) {
 
-	for (conn = 0; conn < TM_MAX_CONCURRENT; conn++) {
+	roadmap_tile_batch_reader_free (&batch->reader);
+	free (batch);
+}
 
-		if (Connections[conn].tile_status == NULL) break;
-	}
+static void batch_requeue (BatchContext *batch) {
 
-waze_assert (conn < TM_MAX_CONCURRENT);
+	int i;
 
-	Connections[conn].tile_index = tile_index;
-	Connections[conn].tile_status = tile_status;
-	Connections[conn].callback = tile_callback;
-	Connections[conn].time_out = 0;
-	Connections[conn].tile_data = NULL;
-	Connections[conn].tile_size = 0;
-	get_url (&Connections[conn]);
+	for (i = 0; i < batch->count; i++) {
 
-	//printf ("Requesting %s\n", Connections[conn].url);
+		BatchTile *tile = batch->tiles + i;
 
-	*tile_status |= ROADMAP_TILE_STATUS_FLAG_ACTIVE;
+		if (tile->tile_status == NULL) continue;
 
-	NumOpenConnections++;
-	tile_time = roadmap_square_timestamp (tile_index);
+		requeue (tile->tile_index, tile->tile_status, tile->callback);
+		tile->tile_status = NULL;
+	}
+}
 
-	Connections[conn].http_context =
-        roadmap_http_async_copy (&callbacks,
-										 &Connections[conn],
-										 Connections[conn].url,
-										 tile_time);
+static void batch_frame (int tile_index, int status, const void *data, size_t size, void *context) {
 
-	// failure is handled by http_cb_error
-}
+	BatchContext *batch = (BatchContext *)context;
+	BatchTile *tile = NULL;
+	int *tile_status;
+	int rc;
+	int i;
 
-static void requeue_tile (ConnectionContext *conn) {
+	for (i = 0; i < batch->count; i++) {
+		if (batch->tiles[i].tile_index == tile_index && batch->tiles[i].tile_status != NULL) {
+			tile = batch->tiles + i;
+			break;
+		}
+	}
 
-   *conn->tile_status = (*conn->tile_status) & ~ROADMAP_TILE_STATUS_FLAG_ACTIVE;
-	queue_tile (conn->tile_index, (*conn->tile_status) & ROADMAP_TILE_STATUS_MASK_PRIORITY, conn->callback);
-   conn->tile_status = NULL;
-   NumOpenConnections--;
-}
+	if (tile == NULL) {
+		roadmap_log (ROADMAP_WARNING, "Tile %d was not requested in this batch", tile_index);
+		return;
+	}
 
-static void roadmap_tile_manager_check_timeouts (void) {
+	tile_status = tile->tile_status;
+	tile->tile_status = NULL;
 
-	int i;
-	time_t time_now = time (NULL);
+	switch (status) {
 
-	for (i = 0; i < TM_MAX_CONCURRENT; i++) {
-		ConnectionContext *conn = Connections + i;
-		if (conn->tile_status != NULL && conn->time_out && conn->time_out < time_now) {
-			roadmap_log (ROADMAP_ERROR, "Timed out waiting for tile %d", conn->tile_index);
-			roadmap_http_async_copy_abort (conn->http_context);
-			requeue_tile (conn);
+	case ROADMAP_TILE_BATCH_LOADED:
+		batch->loaded++;
+		rc = tile_received (tile_index, tile_status, (void *)data, size);
+		tile_refresh_cb (tile_index);
+		if (rc == ROADMAP_US_OK) {
+			tile_opened (tile_index, tile_status, tile->callback);
+		}
+		break;
+
+	case ROADMAP_TILE_BATCH_NOT_MODIFIED:
+		batch->not_modified++;
+		roadmap_log (ROADMAP_DEBUG, "Tile %d is not modified", tile_index);
+		tile_refresh_cb (tile_index);
+		// The tile was opened for the request, and may have no recorded version yet
+		roadmap_tile_square_loaded (tile_index, roadmap_square_version (tile_index));
+		*tile_status = ((*tile_status) | ROADMAP_TILE_STATUS_FLAG_UPTODATE) &
+							~ROADMAP_TILE_STATUS_FLAG_ACTIVE;
+		if (tile->callback) {
+			tile->callback ();
 		}
+		break;
+
+	default:
+		batch->missing++;
+		roadmap_log (ROADMAP_DEBUG, "Download error on tile %d: status %d", tile_index, status);
+		tile_failed (tile_index, tile_status, tile->callback);
+		break;
 	}
 }
 
-static void start_network (void) {
-   init_url ();
-	Status = stat_Active;
-	load_next_tile ();
+static int  batch_cb_size (void *context, size_t size) {
+
+	// The frames are read as they arrive
+	return 1;
 }
 
-static void roadmap_tile_manager_login_cb (void) {
+static void batch_cb_progress (void *context, const char *data, size_t size) {
 
-   roadmap_log(ROADMAP_DEBUG, "roadmap_tile_manager_login_cb called!");
-	start_network ();
-	roadmap_main_set_periodic (TM_HTTP_TIMEOUT_SECONDS * 1000, roadmap_tile_manager_check_timeouts);
-	if (NextLoginCallback) {
-		NextLoginCallback ();
-		NextLoginCallback = NULL;
-	}
-}
+	BatchContext *batch = (BatchContext *)context;
 
-static void on_connection_failure (ConnectionContext *conn) {
+	if (batch->abandoned) return;
 
-	requeue_tile (conn);
-	if (Status != stat_Active) return;
-	Status = stat_Waiting;
-	roadmap_main_set_periodic (TM_RETRY_CONNECTION_SECONDS * 1000, start_network);
+	batch->time_out = time (NULL) + TM_HTTP_TIMEOUT_SECONDS;
+	roadmap_tile_batch_read (&batch->reader, data, size, batch_frame, batch);
 }
 
-static void queue_tile (int index, int priority, RoadMapCallback on_loaded) {
+static void batch_cb_error (void *context, int connection_failure, const char *format, ...) {
 
-	int slot;
+	va_list ap;
+	BatchContext *batch = (BatchContext *)context;
+	char err_string[1024];
 
-	if (priority) {
-		int pos;
-		int test_slot;
-
-		QueueHead = (QueueHead + TM_MAX_QUEUE - 1) % TM_MAX_QUEUE;
-
-		// Note{ID}:
-		// This is a safety against removing callback items from queue
-		// assuming there is only one callback item at a time.
-		// if things change (more than one possible callback item)
-		// change it to call the callback (it will work but will demand more CPU)
-		if (QueueSize == TM_MAX_QUEUE) {
-			if (RequestQueue[QueueHead].priority > priority) {
-				roadmap_log (ROADMAP_WARNING, "Tile request queue is full with prioritized items");
-				return;
-			}
-			if (RequestQueue[QueueHead].callback != NULL) {
+	if (batch->abandoned) {
+		batch_free (batch);
+		return;
+	}
 
-				int before_last = (QueueHead + TM_MAX_QUEUE - 1) % TM_MAX_QUEUE;
-            waze_assert (RequestQueue[before_last].callback == NULL);
-				*roadmap_tile_status_get (RequestQueue[before_last].tile_index) &= ~ROADMAP_TILE_STATUS_FLAG_QUEUED;
-				RequestQueue[before_last] = RequestQueue[QueueHead];
-			}
-			QueueSize--;
-		}
+	va_start (ap, format);
+	vsnprintf (err_string, 1024, format, ap);
+	va_end (ap);
 
-		for (slot = QueueHead, pos = 1; pos <= QueueSize; pos++) {
-			test_slot = (QueueHead + pos) % TM_MAX_QUEUE;
-			if (RequestQueue[test_slot].priority <= priority) break;
-			RequestQueue[slot] = RequestQueue[test_slot];
-			slot = test_slot;
-		}
+	batch_release (batch);
+	batch_requeue (batch);
+	batch_free (batch);
 
-		if (QueueSize < TM_MAX_QUEUE) {
-			QueueSize++;
-		}
-	} else {
-		if (QueueSize >= TM_MAX_QUEUE) {
-			roadmap_log (ROADMAP_INFO, "Tile request queue is full");
-			return;
-		}
-		slot = (QueueHead + QueueSize) % TM_MAX_QUEUE;
-		if (QueueSize < TM_MAX_QUEUE) {
-			QueueSize++;
-		}
+	if (connection_failure) {
+		roadmap_log (ROADMAP_ERROR, "Connection error on tile batch: %s", err_string);
+		connection_failed ();
+		return;
 	}
 
-	RequestQueue[slot].tile_index = index;
-	RequestQueue[slot].callback = on_loaded;
-	RequestQueue[slot].priority = priority;
-	roadmap_log (ROADMAP_DEBUG, "Queued tile %d at slot %d (position %d) with priority %d Status:%d",
-						index, slot, (slot + 1 + TM_MAX_QUEUE - QueueHead) % TM_MAX_QUEUE, priority, Status);
-}
+	// The server does not know batches, the tiles are requested one by one
+	roadmap_log (ROADMAP_WARNING, "Tile batch failed, not using batches: %s", err_string);
+	BatchDisabled = 1;
 
-void roadmap_tile_request (int index, int priority, int force_update, RoadMapCallback on_loaded) {
+	load_next_tile ();
+}
 
-	int *tile_status = roadmap_tile_status_get (index);
+static void batch_cb_done (void *context, char *last_modified, const char *format, ... ) {
 
-   if (!tile_status)
-      return;
+	BatchContext *batch = (BatchContext *)context;
+	int i;
 
-	if ((*tile_status) & (ROADMAP_TILE_STATUS_FLAG_ACTIVE | ROADMAP_TILE_STATUS_FLAG_UPTODATE)) {
+	if (batch->abandoned) {
+		batch_free (batch);
 		return;
 	}
 
-	if (((*tile_status) & ROADMAP_TILE_STATUS_FLAG_QUEUED) &&
-		 ((*tile_status) & ROADMAP_TILE_STATUS_MASK_PRIORITY) > priority) {
-		return;
-	}
+	batch_release (batch);
 
-	if (!force_update) {
-		if ((*tile_status) & ROADMAP_TILE_STATUS_FLAG_UNFORCE) return;
+	for (i = 0; i < batch->count; i++) {
 
-		init_loading_session ();
-		if ((!ActiveLoadingSession) &&
-		 	 roadmap_square_timestamp (index) > 0) {
+		BatchTile *tile = batch->tiles + i;
 
-			*tile_status |= ROADMAP_TILE_STATUS_FLAG_UNFORCE;
-			roadmap_log (ROADMAP_DEBUG, "Tile %d is not forced and already has a version - not requesting", index);
-			return;
-		}
+		if (tile->tile_status == NULL) continue;
+
+		roadmap_log (ROADMAP_ERROR, "Tile %d is missing from its batch", tile->tile_index);
+		batch->missing++;
+		tile_failed (tile->tile_index, tile->tile_status, tile->callback);
+		tile->tile_status = NULL;
 	}
 
-	queue_tile (index, priority, on_loaded);
-	*tile_status = ((*tile_status) & ~ROADMAP_TILE_STATUS_MASK_PRIORITY) | ROADMAP_TILE_STATUS_FLAG_QUEUED | priority;
+	roadmap_log (ROADMAP_INFO, "Tile batch of %d: %d loaded, %d not modified, %d missing",
+					 batch->count, batch->loaded, batch->not_modified, batch->missing);
 
-	init_connections ();
-	if (Status == stat_First) {
+	batch_free (batch);
 
-		Status = stat_Waiting;
-		NextLoginCallback = Realtime_NotifyOnLogin (roadmap_tile_manager_login_cb);
-	}
+	load_next_tile ();
+}
 
-	if (Status == stat_Active) {
-		load_next_tile ();
-	}
+static void init_url (void) {
 
-#ifdef J2ME
-	start_network();
-#endif
-}
+	static int initialized = 0;
 
-RoadMapTileCallback roadmap_tile_register_callback (RoadMapTileCallback cb) {
+	if (initialized) return;
+	initialized = 1;
 
-	RoadMapTileCallback prev = TileCallback;
-	TileCallback = cb;
-	return prev;
+   roadmap_config_declare
+      ("preferences",
+      &RoadMapConfigTilesUrl, "", NULL);
+   roadmap_config_declare
+      ("preferences",
+      &RoadMapConfigTilesBatchUrl, "", NULL);
+   roadmap_config_declare
+      ("preferences",
+      &RoadMapConfigTilesManifestUrl, "", NULL);
 }
 
-void roadmap_tile_reset_session (void) {
-	init_loading_session ();
-	roadmap_config_set_integer (&LastLoadingSessionCfg, (int)time (NULL));
-	roadmap_config_save (0);
-	ActiveLoadingSession = 0;
+static const char *get_url_prefix (void) {
+
+	return roadmap_config_get (&RoadMapConfigTilesUrl);
+}
+
+static void get_url (ConnectionContext *context) {
+
+	int fips = roadmap_locator_active ();
+	int tile_id = context->tile_index;
+
+	snprintf (context->url,
+				 sizeof (context->url),
+				 "%s/%05d_%02x/%05d_%04x/%05d_%06x/%05d_%08x%s?sessionid=%d",
+				 get_url_prefix (),
+				 fips, tile_id >> 24,
+				 fips, tile_id >> 16,
+				 fips, tile_id >> 8,
+				 fips, tile_id, ROADMAP_DATA_TYPE,Realtime_GetServerId());
+}
+
+
+static int batch_enabled (void) {
+
+	return !BatchDisabled && roadmap_config_get (&RoadMapConfigTilesBatchUrl)[0] != '\0';
+}
+
+
+static int queue_before (const TileData *a, const TileData *b) {
+
+	if (a->priority != b->priority) {
+		return a->priority > b->priority;
+	}
+
+	if (a->distance != b->distance) {
+		return a->distance < b->distance;
+	}
+
+	return (int)(a->stamp - b->stamp) < 0;
+}
+
+
+static void queue_set (int slot, const TileData *entry) {
+
+	RequestQueue[slot] = *entry;
+	*entry->queue_slot = slot;
+}
+
+
+static void queue_up (int slot) {
+
+	TileData entry = RequestQueue[slot];
+
+	while (slot > 0) {
+
+		int parent = (slot - 1) / 2;
+
+		if (!queue_before (&entry, RequestQueue + parent)) break;
+
+		queue_set (slot, RequestQueue + parent);
+		slot = parent;
+	}
+
+	queue_set (slot, &entry);
+}
+
+
+static void queue_down (int slot) {
+
+	TileData entry = RequestQueue[slot];
+
+	for (;;) {
+
+		int child = 2 * slot + 1;
+
+		if (child >= QueueSize) break;
+		if (child + 1 < QueueSize && queue_before (RequestQueue + child + 1, RequestQueue + child)) {
+			child++;
+		}
+		if (!queue_before (RequestQueue + child, &entry)) break;
+
+		queue_set (slot, RequestQueue + child);
+		slot = child;
+	}
+
+	queue_set (slot, &entry);
+}
+
+
+/* Takes an entry out of the queue. The tile status is left to the caller. */
+static void queue_remove (int slot) {
+
+	*RequestQueue[slot].queue_slot = -1;
+
+	QueueSize--;
+	if (slot < QueueSize) {
+		queue_set (slot, RequestQueue + QueueSize);
+		queue_up (slot);
+		queue_down (*RequestQueue[QueueSize].queue_slot);
+	}
+}
+
+
+static int queue_kind (int priority) {
+
+	switch (priority) {
+	case ROADMAP_TILE_STATUS_PRIORITY_GPS:
+	case ROADMAP_TILE_STATUS_PRIORITY_NEIGHBOURS:
+		return TM_QUEUE_GPS;
+	case ROADMAP_TILE_STATUS_PRIORITY_PREFETCH:
+	case ROADMAP_TILE_STATUS_PRIORITY_NEXT_TURN:
+	case ROADMAP_TILE_STATUS_PRIORITY_NAV_RESOLVE:
+		return TM_QUEUE_ROUTE;
+	case ROADMAP_TILE_STATUS_PRIORITY_ON_SCREEN:
+		return TM_QUEUE_SCREEN;
+	default:
+		return TM_QUEUE_OTHER;
+	}
+}
+
+
+static void queue_count_wait (const TileData *entry) {
+
+	static const uint32_t bounds[TM_WAIT_BUCKETS - 1] = {
+		100, 250, 500, 1000, 2500, 5000, 10000
+	};
+	uint32_t wait = roadmap_time_get_millis () - entry->queued_time;
+	int bucket;
+
+	for (bucket = 0; bucket < TM_WAIT_BUCKETS - 1; bucket++) {
+		if (wait < bounds[bucket]) break;
+	}
+
+	QueueStats.wait[queue_kind (entry->priority)][bucket]++;
+}
+
+
+static void tile_center (int tile_index, RoadMapPosition *center) {
+
+	int west, east, south, north;
+
+	roadmap_tile_edges (tile_index, &west, &east, &south, &north);
+	center->longitude = west + (east - west) / 2;
+	center->latitude = south + (north - south) / 2;
+}
+
+
+static int tile_view_distance (int tile_index) {
+
+	RoadMapPosition center;
+	RoadMapPosition view;
+	zoom_t zoom;
+
+	tile_center (tile_index, &center);
+	roadmap_math_get_context (&view, &zoom);
+
+	return roadmap_math_distance (&center, &view);
+}
+
+
+static void next_to_load (int *tile_index, int *priority, RoadMapCallback *callback) {
+
+	if (QueueSize <= 0) {
+		*tile_index = -1;
+		return;
+	}
+
+	*tile_index = RequestQueue[0].tile_index;
+	*callback = RequestQueue[0].callback;
+	*priority = RequestQueue[0].priority;
+	queue_count_wait (RequestQueue);
+	queue_remove (0);
+}
+
+
+/* Takes the next queued tile that needs to be downloaded. Returns 0 if there is none. */
+static int next_tile (int *tile_index, int **tile_status, RoadMapCallback *tile_callback) {
+
+	int priority;
+
+	do {
+		next_to_load (tile_index, &priority, tile_callback);
+		if (*tile_index == -1) {
+			return 0;
+		}
+		*tile_status = roadmap_tile_status_get (*tile_index);
+    waze_assert (*tile_status != NULL);
+		if (((**tile_status) & ROADMAP_TILE_STATUS_FLAG_UPTODATE ) && *tile_callback) {
+			(*tile_callback) ();
+		}
+		**tile_status &= ~ROADMAP_TILE_STATUS_FLAG_QUEUED;
+	}
+	while ((**tile_status) & (ROADMAP_TILE_STATUS_FLAG_ACTIVE | ROADMAP_TILE_STATUS_FLAG_UPTODATE));
+
+	roadmap_log (ROADMAP_DEBUG, "Loading tile %d -- priority %d",
+						*tile_index, priority);
+
+	return 1;
+}
+
+
+static void load_tile_batch (int tile_index, int *tile_status, RoadMapCallback tile_callback) {
+
+	static RoadMapHttpAsyncCallbacks callbacks = { batch_cb_size, batch_cb_progress, batch_cb_error, batch_cb_done };
+	BatchContext *batch;
+	int length = 0;
+	int slot;
+
+	for (slot = 0; slot < TM_MAX_CONCURRENT; slot++) {
+
+		if (Batches[slot] == NULL) break;
+	}
+
+waze_assert (slot < TM_MAX_CONCURRENT);
+
+	batch = (BatchContext *) calloc (1, sizeof (BatchContext));
+	roadmap_tile_batch_reader_init (&batch->reader);
+
+	// The slot is taken first, as the callbacks of skipped tiles may load tiles
+	Batches[slot] = batch;
+	NumOpenConnections++;
+
+	do {
+		BatchTile *tile = batch->tiles + batch->count++;
+
+		tile->tile_index = tile_index;
+		tile->tile_status = tile_status;
+		tile->callback = tile_callback;
+		*tile_status |= ROADMAP_TILE_STATUS_FLAG_ACTIVE;
+
+		length = roadmap_tile_batch_add_request (batch->body, length, sizeof (batch->body),
+															  tile_index, roadmap_square_timestamp (tile_index));
+	}
+	while (batch->count < ROADMAP_TILE_BATCH_MAX &&
+			 next_tile (&tile_index, &tile_status, &tile_callback));
+
+	snprintf (batch->url,
+				 sizeof (batch->url),
+				 "%s?fips=%d&sessionid=%d",
+				 roadmap_config_get (&RoadMapConfigTilesBatchUrl),
+				 roadmap_locator_active (), Realtime_GetServerId());
+
+	roadmap_log (ROADMAP_DEBUG, "Requesting a batch of %d tiles", batch->count);
+
+	roadmap_http_async_post (&callbacks, batch, batch->url,
+									 roadmap_http_async_get_simple_header ("text/plain", length),
+									 batch->body, length, HTTPCOPY_FLAG_STREAM);
+
+	// failure is handled by batch_cb_error
+}
+
+
+static void load_next_tile (void) {
+
+	static RoadMapHttpAsyncCallbacks callbacks = { http_cb_size, http_cb_progress, http_cb_error, http_cb_done };
+	int conn;
+	time_t tile_time;
+	int tile_index;
+	int *tile_status;
+	RoadMapCallback tile_callback;
+
+   roadmap_log(ROADMAP_DEBUG, "load_next_tile - status:%d", Status);
+
+	if (NumOpenConnections >= TM_MAX_CONCURRENT || Status != stat_Active) {
+		return;
+	}
+
+	roadmap_tile_update_requests ();
+
+	if (!next_tile (&tile_index, &tile_status, &tile_callback)) {
+		return;
+	}
+
+	if (QueueSize > 0 && batch_enabled ()) {
+		load_tile_batch (tile_index, tile_status, tile_callback);
+		return;
+	}
+
+	for (conn = 0; conn < TM_MAX_CONCURRENT; conn++) {
+
+		if (Connections[conn].tile_status == NULL) break;
+	}
+
+waze_assert (conn < TM_MAX_CONCURRENT);
+
+	Connections[conn].tile_index = tile_index;
+	Connections[conn].tile_status = tile_status;
+	Connections[conn].callback = tile_callback;
+	Connections[conn].time_out = 0;
+	Connections[conn].tile_data = NULL;
+	Connections[conn].tile_size = 0;
+	get_url (&Connections[conn]);
+
+	//printf ("Requesting %s\n", Connections[conn].url);
+
+	*tile_status |= ROADMAP_TILE_STATUS_FLAG_ACTIVE;
+
+	NumOpenConnections++;
+	tile_time = roadmap_square_timestamp (tile_index);
+
+	Connections[conn].http_context =
+        roadmap_http_async_copy (&callbacks,
+										 &Connections[conn],
+										 Connections[conn].url,
+										 tile_time);
+
+	// failure is handled by http_cb_error
+}
+
+static void requeue_tile (ConnectionContext *conn) {
+
+	requeue (conn->tile_index, conn->tile_status, conn->callback);
+   conn->tile_status = NULL;
+   NumOpenConnections--;
+}
+
+static void roadmap_tile_manager_check_timeouts (void) {
+
+	int i;
+	time_t time_now = time (NULL);
+
+	for (i = 0; i < TM_MAX_CONCURRENT; i++) {
+		ConnectionContext *conn = Connections + i;
+		if (conn->tile_status != NULL && conn->time_out && conn->time_out < time_now) {
+			roadmap_log (ROADMAP_ERROR, "Timed out waiting for tile %d", conn->tile_index);
+			roadmap_http_async_copy_abort (conn->http_context);
+			requeue_tile (conn);
+		}
+	}
+
+	for (i = 0; i < TM_MAX_CONCURRENT; i++) {
+		BatchContext *batch = Batches[i];
+		if (batch != NULL && batch->time_out && batch->time_out < time_now) {
+			// A post cannot be aborted, the batch is freed when it ends
+			roadmap_log (ROADMAP_ERROR, "Timed out waiting for a tile batch");
+			batch_release (batch);
+			batch_requeue (batch);
+			batch->abandoned = 1;
+		}
+	}
+
+	load_next_tile ();
+}
+
+static void start_network (void) {
+   init_url ();
+	Status = stat_Active;
+	load_next_tile ();
+}
+
+static void roadmap_tile_manager_login_cb (void) {
+
+   roadmap_log(ROADMAP_DEBUG, "roadmap_tile_manager_login_cb called!");
+	start_network ();
+	roadmap_main_set_periodic (TM_HTTP_TIMEOUT_SECONDS * 1000, roadmap_tile_manager_check_timeouts);
+	if (NextLoginCallback) {
+		NextLoginCallback ();
+		NextLoginCallback = NULL;
+	}
+}
+
+static void connection_failed (void) {
+
+	if (Status != stat_Active) return;
+	Status = stat_Waiting;
+	roadmap_main_set_periodic (TM_RETRY_CONNECTION_SECONDS * 1000, start_network);
+}
+
+static void on_connection_failure (ConnectionContext *conn) {
+
+	requeue_tile (conn);
+	connection_failed ();
+}
+
+/* Returns the entry that is dropped first when the queue is full, or -1 */
+static int queue_worst (void) {
+
+	int worst = -1;
+	int i;
+
+	// the worst entry is a leaf
+	for (i = QueueSize / 2; i < QueueSize; i++) {
+
+		if (RequestQueue[i].callback != NULL) continue;
+
+		if (worst < 0 || queue_before (RequestQueue + worst, RequestQueue + i)) {
+			worst = i;
+		}
+	}
+
+	return worst;
+}
+
+static void queue_unmark (const TileData *entry) {
+
+	int *tile_status = roadmap_tile_status_get (entry->tile_index);
+
+	*tile_status &= ~(ROADMAP_TILE_STATUS_FLAG_QUEUED | ROADMAP_TILE_STATUS_MASK_PRIORITY);
+	*entry->queue_slot = -1;
+}
+
+static void queue_drop (int slot) {
+
+	queue_unmark (RequestQueue + slot);
+	queue_remove (slot);
+}
+
+/* Restores the heap after the entries were changed in place */
+static void queue_heapify (void) {
+
+	int i;
+
+	for (i = QueueSize / 2 - 1; i >= 0; i--) {
+		queue_down (i);
+	}
+}
+
+/* Returns 1 if the tile is queued, 0 if it was dropped */
+static int queue_tile (int index, int priority, int view, RoadMapCallback on_loaded) {
+
+	int *queue_slot = roadmap_tile_status_get_queue_slot (index);
+	TileData entry;
+
+	if (queue_slot == NULL) {
+		roadmap_log (ROADMAP_ERROR, "Cannot queue tile %d - no status", index);
+		return 0;
+	}
+
+	if (*queue_slot >= 0) {
+
+		// Already queued, only move it up
+		TileData *queued = RequestQueue + *queue_slot;
+
+		if (on_loaded != NULL) {
+			if (queued->callback != NULL && queued->callback != on_loaded) {
+				roadmap_log (ROADMAP_ERROR, "Tile %d is queued with another callback", index);
+			} else {
+				queued->callback = on_loaded;
+			}
+		}
+		queued->view = queued->view && view;
+		if (priority > queued->priority) {
+			queued->priority = priority;
+			queue_up (*queue_slot);
+		}
+		return 1;
+	}
+
+	entry.tile_index = index;
+	entry.priority = priority;
+	entry.distance = tile_view_distance (index);
+	entry.view = view;
+	entry.queue_slot = queue_slot;
+	entry.stamp = ++QueueStamp;
+	entry.queued_time = roadmap_time_get_millis ();
+	entry.callback = on_loaded;
+
+	if (QueueSize == TM_MAX_QUEUE) {
+
+		int worst = queue_worst ();
+
+		if (worst < 0 || !queue_before (&entry, RequestQueue + worst)) {
+			roadmap_log (ROADMAP_INFO, "Tile request queue is full");
+			QueueStats.dropped++;
+			return 0;
+		}
+
+		roadmap_log (ROADMAP_DEBUG, "Tile request queue is full, dropping tile %d", RequestQueue[worst].tile_index);
+		QueueStats.dropped++;
+		queue_drop (worst);
+	}
+
+	queue_set (QueueSize, &entry);
+	queue_up (QueueSize++);
+
+	roadmap_log (ROADMAP_DEBUG, "Queued tile %d at slot %d with priority %d Status:%d",
+						index, *queue_slot, priority, Status);
+	return 1;
+}
+
+/* Queues again a tile whose download did not complete */
+static void requeue (int index, int *tile_status, RoadMapCallback on_loaded) {
+
+	int priority = (*tile_status) & ROADMAP_TILE_STATUS_MASK_PRIORITY;
+
+	*tile_status &= ~(ROADMAP_TILE_STATUS_FLAG_ACTIVE | ROADMAP_TILE_STATUS_MASK_PRIORITY);
+
+	if (queue_tile (index, priority, 0, on_loaded)) {
+		*tile_status |= ROADMAP_TILE_STATUS_FLAG_QUEUED | priority;
+	}
+}
+
+/* Tells whether a request is still needed at the current view and GPS position */
+static int queue_is_needed (const TileData *entry, const RoadMapArea *screen, const RoadMapPosition *gps) {
+
+	RoadMapArea edges;
+
+	if (entry->callback != NULL) return 1;
+
+	roadmap_tile_edges (entry->tile_index, &edges.west, &edges.east, &edges.south, &edges.north);
+
+	if (entry->view) {
+		return edges.east >= screen->west && edges.west <= screen->east &&
+				 edges.north >= screen->south && edges.south <= screen->north;
+	}
+
+	if (gps != NULL && queue_kind (entry->priority) == TM_QUEUE_GPS) {
+
+		// the tile of the position, or one of its neighbours
+		int width = edges.east - edges.west;
+		int height = edges.north - edges.south;
+
+		return gps->longitude >= edges.west - width && gps->longitude <= edges.east + width &&
+				 gps->latitude >= edges.south - height && gps->latitude <= edges.north + height;
+	}
+
+	return 1;
+}
+
+void roadmap_tile_request (int index, int priority, int force_update, RoadMapCallback on_loaded) {
+
+	int *tile_status = roadmap_tile_status_get (index);
+
+   if (!tile_status)
+      return;
+
+	if ((*tile_status) & (ROADMAP_TILE_STATUS_FLAG_ACTIVE | ROADMAP_TILE_STATUS_FLAG_UPTODATE)) {
+		return;
+	}
+
+	if (((*tile_status) & ROADMAP_TILE_STATUS_FLAG_QUEUED) &&
+		 ((*tile_status) & ROADMAP_TILE_STATUS_MASK_PRIORITY) > priority) {
+		return;
+	}
+
+	if (!force_update) {
+		if ((*tile_status) & ROADMAP_TILE_STATUS_FLAG_UNFORCE) return;
+
+		init_loading_session ();
+		if ((!ActiveLoadingSession) &&
+		 	 roadmap_square_timestamp (index) > 0) {
+
+			*tile_status |= ROADMAP_TILE_STATUS_FLAG_UNFORCE;
+			roadmap_log (ROADMAP_DEBUG, "Tile %d is not forced and already has a version - not requesting", index);
+			return;
+		}
+	}
+
+	if (!queue_tile (index, priority,
+						  !force_update && priority <= ROADMAP_TILE_STATUS_PRIORITY_ON_SCREEN,
+						  on_loaded)) {
+		return;
+	}
+	*tile_status = ((*tile_status) & ~ROADMAP_TILE_STATUS_MASK_PRIORITY) | ROADMAP_TILE_STATUS_FLAG_QUEUED | priority;
+
+	init_connections ();
+	if (Status == stat_First) {
+
+		Status = stat_Waiting;
+		NextLoginCallback = Realtime_NotifyOnLogin (roadmap_tile_manager_login_cb);
+	}
+
+	if (Status == stat_Active) {
+		load_next_tile ();
+	}
+
+#ifdef J2ME
+	start_network();
+#endif
+}
+
+void roadmap_tile_update_requests (void) {
+
+	RoadMapPosition view;
+	zoom_t zoom;
+	const RoadMapPosition *gps = roadmap_gps_get_fix ();
+	RoadMapArea screen;
+	int cancelled;
+	int kept = 0;
+	int i;
+
+	roadmap_math_get_context (&view, &zoom);
+
+	if (view.longitude == QueueViewCenter.longitude &&
+		 view.latitude == QueueViewCenter.latitude &&
+		 zoom == QueueViewZoom &&
+		 (gps == NULL ||
+		  (gps->longitude == QueueGpsFix.longitude && gps->latitude == QueueGpsFix.latitude))) {
+		return;
+	}
+
+	QueueViewCenter = view;
+	QueueViewZoom = zoom;
+	if (gps != NULL) {
+		QueueGpsFix = *gps;
+	}
+
+	if (QueueSize == 0) return;
+
+	roadmap_math_screen_edges (&screen);
+
+	for (i = 0; i < QueueSize; i++) {
+
+		TileData *entry = RequestQueue + i;
+
+		if (queue_is_needed (entry, &screen, gps)) {
+			entry->distance = tile_view_distance (entry->tile_index);
+			queue_set (kept++, entry);
+		} else {
+			queue_unmark (entry);
+		}
+	}
+
+	cancelled = QueueSize - kept;
+	QueueSize = kept;
+	queue_heapify ();
+
+	if (cancelled) {
+		QueueStats.cancelled += cancelled;
+		roadmap_log (ROADMAP_DEBUG, "Cancelled %d tile requests, %d left", cancelled, QueueSize);
+	}
+}
+
+void roadmap_tile_route_changed (void) {
+
+	int cancelled;
+	int kept = 0;
+	int i;
+
+	for (i = 0; i < QueueSize; i++) {
+
+		TileData *entry = RequestQueue + i;
+
+		if (entry->callback == NULL &&
+			 entry->priority == ROADMAP_TILE_STATUS_PRIORITY_PREFETCH) {
+			queue_unmark (entry);
+		} else {
+			queue_set (kept++, entry);
+		}
+	}
+
+	cancelled = QueueSize - kept;
+	QueueSize = kept;
+	queue_heapify ();
+
+	if (cancelled) {
+		QueueStats.cancelled += cancelled;
+		roadmap_log (ROADMAP_DEBUG, "Cancelled %d route prefetch requests", cancelled);
+	}
+}
+
+void roadmap_tile_manager_shutdown (void) {
+
+	static const char *kinds[TM_QUEUE_KINDS] = { "gps", "route", "screen", "other" };
+	int kind;
+
+	for (kind = 0; kind < TM_QUEUE_KINDS; kind++) {
+
+		const int *wait = QueueStats.wait[kind];
+
+		roadmap_log (ROADMAP_INFO, "Tile queue wait (%s): <100ms %d, <250ms %d, <500ms %d, <1s %d, <2.5s %d, <5s %d, <10s %d, longer %d",
+						 kinds[kind], wait[0], wait[1], wait[2], wait[3], wait[4], wait[5], wait[6], wait[7]);
+	}
+
+	roadmap_log (ROADMAP_INFO, "Tile queue: %d requests cancelled, %d dropped when full",
+					 QueueStats.cancelled, QueueStats.dropped);
+}
+
+RoadMapTileCallback roadmap_tile_register_callback (RoadMapTileCallback cb) {
+
+	RoadMapTileCallback prev = TileCallback;
+	TileCallback = cb;
+	return prev;
+}
+
+void roadmap_tile_reset_session (void) {
+	init_loading_session ();
+	roadmap_config_set_integer (&LastLoadingSessionCfg, (int)time (NULL));
+	roadmap_config_save (0);
+	ActiveLoadingSession = 0;
 }
 
 
@@ -655,6 +1411,7 @@ static void refresh_all_tiles( void )
    wzm_file = roadmap_map_download_build_file_name( fips );
    roadmap_file_remove( wzm_file, NULL );
 
+   roadmap_tile_decode_cancel_all( fips );
    roadmap_tile_remove_all( fips );
    ssd_progress_msg_dialog_hide();
    roadmap_screen_refresh();
@@ -672,22 +1429,334 @@ static void refresh_all_tiles( void )
    TilesRefreshTotalCount = roadmap_square_refresh( fips, TM_MAX_QUEUE, NULL );
    roadmap_log( ROADMAP_WARNING, "Going to update %d tiles", TilesRefreshTotalCount );
 }
+
+static void refresh_all_tiles_start( void )
+{
+   ssd_progress_msg_dialog_show( roadmap_lang_get( "Removing old tiles..." ) );
+   if ( !roadmap_screen_refresh() )
+      roadmap_screen_redraw();
+
+   roadmap_main_set_periodic( 100, refresh_all_tiles );
+}
+
+
+/*
+ * Delta refresh from the manifest of the map
+ */
+static void manifest_free( void )
+{
+   free( Manifest.data );
+   free( Manifest.tiles );
+   free( Manifest.waiting );
+   Manifest.data = NULL;
+   Manifest.size = 0;
+   Manifest.capacity = 0;
+   Manifest.tiles = NULL;
+   Manifest.count = 0;
+   Manifest.waiting = NULL;
+   Manifest.waiting_count = 0;
+   Manifest.active = 0;
+}
+
+static int manifest_compare( const void *a, const void *b )
+{
+   int tile_a = ((const ManifestTile *)a)->tile_index;
+   int tile_b = ((const ManifestTile *)b)->tile_index;
+
+   return (tile_a > tile_b) - (tile_a < tile_b);
+}
+
+static void manifest_add_tile( int tile_index, int version, void *context )
+{
+   ManifestTile *tile = Manifest.tiles + Manifest.count++;
+
+   tile->tile_index = tile_index;
+   tile->version = version;
+   tile->stored = 0;
+   tile->stored_version = 0;
+}
+
+static ManifestTile *manifest_find( int tile_index )
+{
+   ManifestTile key;
+
+   key.tile_index = tile_index;
+   return (ManifestTile *)bsearch( &key, Manifest.tiles, Manifest.count, sizeof( ManifestTile ), manifest_compare );
+}
+
+static void manifest_mark_stored( int tile_index )
+{
+   ManifestTile *tile = manifest_find( tile_index );
+
+   if ( tile )
+      tile->stored = 1;
+}
+
+static void manifest_mark_version( int tile_index, int version )
+{
+   ManifestTile *tile = manifest_find( tile_index );
+
+   if ( tile )
+      tile->stored_version = version;
+}
+
+static void manifest_finish( void )
+{
+   roadmap_log( ROADMAP_WARNING, "Map refresh: %d of %d stored tiles changed",
+                Manifest.requested, Manifest.checked );
+
+   manifest_free();
+}
+
+/*
+ * Requests a changed tile, unless it is already queued or being downloaded.
+ * A request that finds no room in the queue is made again by the next check.
+ */
+static void manifest_request( ManifestTile *tile, int *tile_status )
+{
+   if ( (*tile_status) & (ROADMAP_TILE_STATUS_FLAG_ACTIVE | ROADMAP_TILE_STATUS_FLAG_QUEUED) )
+      return;
+
+   *tile_status &= ~(ROADMAP_TILE_STATUS_FLAG_UPTODATE | ROADMAP_TILE_STATUS_FLAG_UNFORCE);
+   roadmap_tile_request( tile->tile_index, ROADMAP_TILE_STATUS_PRIORITY_NONE, 1, NULL );
+}
+
+/*
+ * Forgets the changed tiles that were downloaded, and requests again the
+ * ones that were dropped from the queue
+ */
+static void manifest_check_waiting( void )
+{
+   int kept = 0;
+   int i;
+
+   for ( i = 0; i < Manifest.waiting_count; i++ )
+   {
+      ManifestTile *tile = Manifest.tiles + Manifest.waiting[i];
+      int *tile_status = roadmap_tile_status_get( tile->tile_index );
+
+      if ( !tile_status || ((*tile_status) & ROADMAP_TILE_STATUS_FLAG_UPTODATE) )
+         continue;
+
+      if ( QueueSize <= TM_MAX_QUEUE / 2 )
+         manifest_request( tile, tile_status );
+
+      Manifest.waiting[kept++] = Manifest.waiting[i];
+   }
+
+   Manifest.waiting_count = kept;
+}
+
+/*
+ * Compares the stored tiles with the manifest, at a pace that leaves room
+ * in the request queue for the tiles that are needed now. The refresh ends
+ * when all the changed tiles were downloaded.
+ */
+static void manifest_check_tiles( void )
+{
+   if ( Manifest.fips != roadmap_locator_active() )
+   {
+      roadmap_log( ROADMAP_WARNING, "Map refresh stopped, the map was changed" );
+      roadmap_main_remove_periodic( manifest_check_tiles );
+      manifest_free();
+      return;
+   }
+
+   manifest_check_waiting();
+
+   while ( Manifest.next < Manifest.count && QueueSize <= TM_MAX_QUEUE / 2 )
+   {
+      ManifestTile *tile = Manifest.tiles + Manifest.next++;
+      int *tile_status;
+
+      if ( !tile->stored )
+         continue;
+
+      Manifest.checked++;
+
+      if ( tile->stored_version >= tile->version )
+         continue;
+
+      tile_status = roadmap_tile_status_get( tile->tile_index );
+      if ( !tile_status )
+         continue;
+
+      roadmap_log( ROADMAP_DEBUG, "Tile %d changed: version %d, current %d",
+                   tile->tile_index, tile->stored_version, tile->version );
+
+      // The progress counts the tiles requested so far
+      if ( TilesRefreshTotalCount < 0 )
+      {
+         TilesRefreshProgressCount = 0;
+         TilesRefreshTotalCount = 0;
+         roadmap_warning_register( tile_load_progress_warn, "refreshmap" );
+      }
+      TilesRefreshTotalCount++;
+
+      // A tile that is already queued or downloaded is kept until it gets the current version
+      Manifest.waiting[Manifest.waiting_count++] = (int)(tile - Manifest.tiles);
+      manifest_request( tile, tile_status );
+      Manifest.requested++;
+   }
+
+   if ( Manifest.next >= Manifest.count && Manifest.waiting_count == 0 )
+   {
+      roadmap_main_remove_periodic( manifest_check_tiles );
+      manifest_finish();
+   }
+}
+
+static int manifest_cb_size( void *context, size_t size )
+{
+   if ( size > Manifest.capacity )
+   {
+      char *data = (char *)realloc( Manifest.data, size );
+      if ( !data )
+         return 0;
+      Manifest.data = data;
+      Manifest.capacity = size;
+   }
+
+   return 1;
+}
+
+static void manifest_cb_progress( void *context, const char *data, size_t size )
+{
+   if ( !size )
+      return;
+
+   if ( Manifest.size + size > Manifest.capacity &&
+        !manifest_cb_size( context, (Manifest.size + size) * 2 ) )
+   {
+      return;
+   }
+
+   memcpy( Manifest.data + Manifest.size, data, size );
+   Manifest.size += size;
+}
+
+static void manifest_retry( void );
+
+static void manifest_cb_error( void *context, int connection_failure, const char *format, ... )
+{
+   va_list ap;
+   char err_string[1024];
+
+   va_start( ap, format );
+   vsnprintf( err_string, sizeof( err_string ), format, ap );
+   va_end( ap );
+
+   manifest_free();
+
+   // Downloading all the tiles again costs more than waiting for the server
+   if ( Manifest.retries >= TM_MANIFEST_MAX_RETRIES )
+   {
+      roadmap_log( ROADMAP_ERROR, "Cannot get the tile manifest, giving up after %d attempts: %s",
+                   Manifest.retries + 1, err_string );
+      Manifest.retries = 0;
+      return;
+   }
+
+   roadmap_log( ROADMAP_WARNING, "Cannot get the tile manifest, retrying in %d seconds: %s",
+                TM_MANIFEST_RETRY_SECONDS << Manifest.retries, err_string );
+
+   Manifest.retry_pending = 1;
+   roadmap_main_set_periodic( (TM_MANIFEST_RETRY_SECONDS << Manifest.retries) * 1000, manifest_retry );
+   Manifest.retries++;
+}
+
+static void manifest_cb_done( void *context, char *last_modified, const char *format, ... )
+{
+   int count = (int)(Manifest.size / ROADMAP_TILE_MANIFEST_RECORD_SIZE);
+   int versions;
+
+   Manifest.tiles = (ManifestTile *)malloc( (count > 0 ? count : 1) * sizeof( ManifestTile ) );
+   Manifest.waiting = (int *)malloc( (count > 0 ? count : 1) * sizeof( int ) );
+   Manifest.count = 0;
+   Manifest.waiting_count = 0;
+   if ( !Manifest.tiles || !Manifest.waiting ||
+        roadmap_tile_batch_read_manifest( Manifest.data, Manifest.size, manifest_add_tile, NULL ) < 0 )
+   {
+      manifest_cb_error( context, 0, "bad manifest" );
+      return;
+   }
+
+   free( Manifest.data );
+   Manifest.data = NULL;
+   Manifest.size = 0;
+   Manifest.capacity = 0;
+
+   Manifest.retries = 0;
+   qsort( Manifest.tiles, Manifest.count, sizeof( ManifestTile ), manifest_compare );
+   roadmap_tile_enumerate( Manifest.fips, manifest_mark_stored );
+   versions = roadmap_tile_enumerate_versions( Manifest.fips, manifest_mark_version );
+
+   roadmap_log( ROADMAP_INFO, "Tile manifest has %d tiles, checking the stored ones (%d versions known)",
+                Manifest.count, versions );
+
+   Manifest.next = 0;
+   Manifest.checked = 0;
+   Manifest.requested = 0;
+   roadmap_main_set_periodic( TM_MANIFEST_INTERVAL, manifest_check_tiles );
+}
+
+static void manifest_refresh_start( void )
+{
+   static RoadMapHttpAsyncCallbacks callbacks = { manifest_cb_size, manifest_cb_progress, manifest_cb_error, manifest_cb_done };
+
+   Manifest.active = 1;
+   Manifest.fips = roadmap_locator_active();
+   snprintf( Manifest.url, sizeof( Manifest.url ), "%s?fips=%d&sessionid=%d",
+             roadmap_config_get( &RoadMapConfigTilesManifestUrl ),
+             Manifest.fips, Realtime_GetServerId() );
+
+   roadmap_log( ROADMAP_DEBUG, "Requesting the tile manifest: %s", Manifest.url );
+
+   roadmap_http_async_copy( &callbacks, NULL, Manifest.url, 0 );
+}
+
+static void manifest_retry( void )
+{
+   roadmap_main_remove_periodic( manifest_retry );
+   Manifest.retry_pending = 0;
+
+   if ( Manifest.fips != roadmap_locator_active() )
+   {
+      roadmap_log( ROADMAP_WARNING, "Map refresh stopped, the map was changed" );
+      Manifest.retries = 0;
+      return;
+   }
+
+   manifest_refresh_start();
+}
+
 /*
  * Tiles refresh interface
  */
 void roadmap_tile_refresh_all( void )
 {
-   if ( TilesRefreshTotalCount >= 0 )
+   if ( TilesRefreshTotalCount >= 0 || Manifest.active )
    {
       roadmap_log( ROADMAP_WARNING, "Previous 'refresh tiles' request still in progress." );
       return;
    }
 
    roadmap_log( ROADMAP_DEBUG, "Refreshing all the tiles" );
-   ssd_progress_msg_dialog_show( roadmap_lang_get( "Removing old tiles..." ) );
-   if ( !roadmap_screen_refresh() )
-      roadmap_screen_redraw();
 
-   roadmap_main_set_periodic( 100, refresh_all_tiles );
+   // A new request does not wait for the retry of the previous one
+   if ( Manifest.retry_pending )
+   {
+      roadmap_main_remove_periodic( manifest_retry );
+      Manifest.retry_pending = 0;
+   }
+   Manifest.retries = 0;
+
+   init_url();
+   if ( roadmap_config_get( &RoadMapConfigTilesManifestUrl )[0] != '\0' )
+   {
+      manifest_refresh_start();
+      return;
+   }
 
+   refresh_all_tiles_start();
 }
@@ -33,4 +33,23 @@ void roadmap_tile_request (int index, int priority, int force_update, RoadMapCal
 void roadmap_tile_reset_session (void);
 void roadmap_tile_refresh_all( void );
 
+/* Records the version of an opened tile in the storage, once per session, so
+ * that tiles stored before versions were recorded are not downloaded again
+ * by the next refresh.
+ */
+void roadmap_tile_square_loaded (int tile_index, int version);
+
+/* Reorders the queued tile requests when the view or the GPS position moved,
+ * and drops the ones that are no longer on screen or near the GPS position.
+ */
+void roadmap_tile_update_requests (void);
+
+/* Drops the queued prefetch requests of the previous route */
+void roadmap_tile_route_changed (void);
+
+/* Logs how long the tile requests waited in the queue. Called once, when the
+ * application exits.
+ */
+void roadmap_tile_manager_shutdown (void);
+
 #endif // _ROADMAP_TILE_MANAGER__H
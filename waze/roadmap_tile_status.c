@@ -40,6 +40,7 @@ typedef struct {
 	
 	int tile_index;
 	int status;
+	int queue_slot;
 } TileStatus;
 	
 
@@ -54,7 +55,7 @@ waze_assert (position >= 0 && position < NumTiles);
 	return Tiles[position / TS_BLOCK_SIZE] + (position % TS_BLOCK_SIZE);
 }
 
-static int *roadmap_tile_status_add (int index) {
+static TileStatus *roadmap_tile_status_add (int index) {
 	
 	TileStatus *tile;
 	
@@ -79,14 +80,15 @@ static int *roadmap_tile_status_add (int index) {
 	tile = Tiles[NumTiles / TS_BLOCK_SIZE] + NumTiles % TS_BLOCK_SIZE;
 	tile->status = 0;
 	tile->tile_index = index;
+	tile->queue_slot = -1;
 	
 	roadmap_hash_add (TileHash, index, NumTiles);
 	
 	NumTiles++;
-	return &tile->status;
+	return tile;
 }
 
-int *roadmap_tile_status_get (int index) {
+static TileStatus *roadmap_tile_status_find (int index) {
 
 	TileStatus *tile;
 	int i;
@@ -99,7 +101,7 @@ int *roadmap_tile_status_get (int index) {
 	while (i >= 0) {
 		tile = tile_status (i);
 		if (tile->tile_index == index) {
-			return &tile->status;
+			return tile;
 		}
 		i = roadmap_hash_get_next (TileHash, i);	
 	}
@@ -107,3 +109,17 @@ int *roadmap_tile_status_get (int index) {
 	return roadmap_tile_status_add (index);
 }
 
+int *roadmap_tile_status_get (int index) {
+
+	TileStatus *tile = roadmap_tile_status_find (index);
+
+	return tile ? &tile->status : NULL;
+}
+
+int *roadmap_tile_status_get_queue_slot (int index) {
+
+	TileStatus *tile = roadmap_tile_status_find (index);
+
+	return tile ? &tile->queue_slot : NULL;
+}
+
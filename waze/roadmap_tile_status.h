@@ -33,6 +33,7 @@
 #define	ROADMAP_TILE_STATUS_FLAG_QUEUED		0x00000040
 #define	ROADMAP_TILE_STATUS_FLAG_UNFORCE		0x00000080
 #define	ROADMAP_TILE_STATUS_FLAG_ROUTE		0x00000100
+#define	ROADMAP_TILE_STATUS_FLAG_VERSION	0x00000200
 
 #define	ROADMAP_TILE_STATUS_MASK_PRIORITY			0x00FF0000
 #define	ROADMAP_TILE_STATUS_PRIORITY_NONE			0x00000000
@@ -50,4 +51,7 @@
 
 int *roadmap_tile_status_get (int index);
 
+/* The position of the tile in the download queue, -1 when it is not queued */
+int *roadmap_tile_status_get_queue_slot (int index);
+
 #endif // _ROADMAP_TILE_STATUS__H
@@ -202,6 +202,10 @@ void roadmap_tile_remove_all( int fips )
    roadmap_file_rmdir( path, NULL );
 }
 
+void roadmap_tile_storage_shutdown (void)
+{
+}
+
 
 int roadmap_tile_load (int fips, int tile_index, void **base, size_t *size) {
 
@@ -44,8 +44,44 @@ void roadmap_tile_remove (int fips, int tile_index);
 
 void roadmap_tile_remove_all ( int fips );
 
+/* Releases the storage. Called once, when the application exits. */
+void roadmap_tile_storage_shutdown (void);
+
 int roadmap_tile_store_context( TileContext* context );
 
 int roadmap_tile_load (int fips, int tile_index, void **data, size_t *size);
 
+/* Loads the tile into *buffer, which is grown as needed and kept by the
+ * caller across calls. *capacity holds the allocated size.
+ */
+int roadmap_tile_load_buffer (int fips, int tile_index, void **buffer, size_t *capacity, size_t *size);
+
+/* Returns the tile data without copying when the storage keeps it mapped.
+ * The data is valid until the next change of the storage.
+ * Returns -1 when the tile is not available this way.
+ */
+int roadmap_tile_map (int fips, int tile_index, const void **data, size_t *size);
+
+/* Records the version of a stored tile, which is the timestamp of its square,
+ * so that the stored tiles can be compared with the server without opening
+ * them. A version of 0 means it is not known.
+ */
+void roadmap_tile_set_version (int fips, int tile_index, int version);
+
+typedef void (*roadmap_tile_version_cb) (int tile_index, int version);
+
+/* Calls the callback for each stored tile whose version is known.
+ * Returns the number of tiles, or -1 on failure.
+ */
+int roadmap_tile_enumerate_versions (int fips, roadmap_tile_version_cb cb);
+
+/* The data passed to the callback is only valid during the call */
+typedef void (*roadmap_tile_load_cb) (int tile_index, const void *data, size_t size, void *context);
+
+/* Loads several tiles in one query. Missing tiles are skipped.
+ * Returns the number of tiles found, or -1 on failure.
+ */
+int roadmap_tile_load_batch (int fips, const int *tile_indexes, int count,
+                             roadmap_tile_load_cb cb, void *context);
+
 #endif /*ROADMAP_TILE_STORAGE_H_*/
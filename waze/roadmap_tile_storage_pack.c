@@ -0,0 +1,1625 @@
+/* roadmap_tile_storage_pack.c - Tiles storage management using a memory mapped pack file
+ *
+ * LICENSE:
+ *
+ *   Copyright 2012 Assaf Paz
+ *
+ *   This file is part of RoadMap.
+ *
+ *   RoadMap is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   RoadMap is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with RoadMap; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * NOTES:
+ *
+ *   All the tiles of a fips are kept in tiles_<fips>.pack:
+ *
+ *     [header page] [tile payloads, each starting on a page] [index]
+ *
+ *   The index is sorted by tile id and the whole file is mapped read only,
+ *   so loading a tile is a binary search and no copy.
+ *
+ *   Stores and removals are appended to tiles_<fips>.log. Once it grows and
+ *   no tile was stored for a while, a thread merges the pack and the log into
+ *   a new pack file. The main thread keeps using the mapped pack meanwhile,
+ *   and switches to the new one at the next store or removal, when the log
+ *   records merged into it are dropped.
+ *
+ *   An existing tiles_<fips>.db is converted to a pack file the first time
+ *   the fips is opened. The database itself is never changed.
+ *
+ *   The versions of the tiles are appended to tiles_<fips>.ver, which is read
+ *   whole when the fips is opened, and rewritten then once most of its
+ *   records are outdated.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <sqlite3.h>
+
+#include "roadmap.h"
+#include "roadmap_tile_storage.h"
+#include "roadmap_locator.h"
+#include "roadmap_file.h"
+#include "roadmap_path.h"
+#include "roadmap_main.h"
+#include "roadmap_hash.h"
+
+
+#define	  RM_TILE_STORAGE_DB_NAME_SIZE 			32
+#define	  RM_TILE_STORAGE_DB_PATH_MAXSIZE 		512
+#define   RM_TILE_STORAGE_DB_PREFIX 			"tiles_"
+#define   RM_TILE_STORAGE_DB_SUFFIX 			".db"
+#define   RM_TILE_STORAGE_PACK_SUFFIX 			".pack"
+#define   RM_TILE_STORAGE_LOG_SUFFIX 			".log"
+#define   RM_TILE_STORAGE_TMP_SUFFIX 			".tmp"
+#define   RM_TILE_STORAGE_LOG_TMP_SUFFIX 		".logtmp"
+#define   RM_TILE_STORAGE_VERSION_SUFFIX 		".ver"
+#define   RM_TILE_STORAGE_VERSION_TMP_SUFFIX 	".vertmp"
+#define   RM_TILE_STORAGE_STMT_CONVERT	        "SELECT id, data FROM tiles_table ORDER BY id;"
+
+#define   RM_TILE_PACK_SIGNATURE				"WZPK"
+#define   RM_TILE_PACK_VERSION					2					// 2: 64 bit offsets
+#define   RM_TILE_PACK_PAGE_SIZE				4096
+#define   RM_TILE_PACK_COMPACT_BYTES			(4 * 1024 * 1024)	// Log size triggering the compaction
+#define   RM_TILE_PACK_COMPACT_DELAY			5000L				// Idle time before compaction in msec
+#define   RM_TILE_PACK_REMOVED					-1					// Log record size of a removed tile
+#define   RM_TILE_PACK_COPY_SIZE				65536				// Buffer size for copying the log
+#define   RM_TILE_PACK_VERSION_SLACK			1024				// Outdated version records before a rewrite
+
+typedef struct
+{
+	char			signature[4];
+	unsigned int	version;
+	unsigned int	page_size;
+	unsigned int	count;
+	uint64_t		index_offset;
+} RMTilePackHeader;
+
+typedef struct
+{
+	int				tile_id;
+	unsigned int	size;
+	uint64_t		offset;
+} RMTilePackEntry;
+
+typedef struct
+{
+	int				tile_id;
+	int				size;		// RM_TILE_PACK_REMOVED for a removed tile
+} RMTileLogRecord;
+
+typedef struct
+{
+	int				tile_id;
+	int				size;
+	off_t			offset;		// Offset of the data in the log
+} RMTileLogEntry;
+
+typedef struct
+{
+	int				tile_id;
+	int				version;	// 0 once the version is not known
+} RMTileVersionRecord;
+
+typedef struct
+{
+	int				fd;
+	off_t			offset;
+	RMTilePackEntry	*index;
+	int				count;
+	int				size;
+} RMTilePackWriter;
+
+/*
+ * The state of a compaction. The thread only reads the snapshot taken when it
+ * started, and the main thread does not unmap the pack until it is joined
+ */
+typedef struct
+{
+	const unsigned char		*pack_base;
+	const RMTilePackEntry	*pack_index;
+	int						pack_count;
+	RMTileLogEntry			*log_entries;		// Sorted copy of the log entries
+	int						log_count;
+	off_t					log_size;			// The log records merged into the new pack
+	int						log_fd;
+	char					tmp_path[RM_TILE_STORAGE_DB_PATH_MAXSIZE];
+	int						tiles;
+	BOOL					result;
+	BOOL					done;				// Set by the thread under sgCompactLock
+} RMTilePackCompaction;
+
+static int sgCurrentFips	= -1;			// The fips of the open pack
+
+static int sgPackFd = -1;
+static unsigned char *sgPackBase = NULL;	// The mapped pack file
+static size_t sgPackSize = 0;
+static const RMTilePackEntry *sgPackIndex = NULL;
+static int sgPackCount = 0;
+
+static int sgLogFd = -1;
+static off_t sgLogSize = 0;
+static RMTileLogEntry *sgLogEntries = NULL;	// Latest log record of each tile in the log
+static int sgLogCount = 0;
+static int sgLogAlloc = 0;
+static RoadMapHash *sgLogHash = NULL;
+
+static int sgVersionFd = -1;
+static RMTileVersionRecord *sgVersions = NULL;	// Latest version of each tile
+static int sgVersionCount = 0;
+static int sgVersionAlloc = 0;
+static int sgVersionRecords = 0;			// Records in the versions file
+static RoadMapHash *sgVersionHash = NULL;
+
+static BOOL sgCompactScheduled = FALSE;
+
+static RMTilePackCompaction sgCompaction;
+static pthread_t sgCompactThread;
+static pthread_mutex_t sgCompactLock = PTHREAD_MUTEX_INITIALIZER;
+static BOOL sgCompactRunning = FALSE;
+
+static void compact_timeout( void );
+static void compact_finish( BOOL wait, BOOL apply );
+
+
+/***********************************************************/
+/*  Name        : get_file_name()
+ *  Purpose     : Auxiliary function. Returns the full path of the storage file of the fips
+ *                  Pointer to the statically allocated memory is returned
+ *  Params		: [in] fips
+ *  			: [in] suffix - the file type
+ *				:
+ */
+static const char* get_file_name( int fips, const char *suffix )
+{
+	static char full_path[RM_TILE_STORAGE_DB_PATH_MAXSIZE];
+#ifndef IPHONE_NATIVE
+	const char *map_path = roadmap_db_map_path ();
+#else
+	const char *map_path = roadmap_path_preferred("maps");
+#endif //!IPHONE_NATIVE
+	char name[RM_TILE_STORAGE_DB_NAME_SIZE];
+
+	snprintf( name, sizeof( name ), "%s%d%s", RM_TILE_STORAGE_DB_PREFIX, fips, suffix );
+	roadmap_path_format( full_path, sizeof( full_path ), map_path, name );
+
+	return full_path;
+}
+
+/***********************************************************/
+/*  Name        : get_global_filename()
+ *  Purpose     : Auxiliary function. Returns the full path of the global tile file.
+ *                  Pointer to the statically allocated memory is returned
+ *  Params		: [in] fips
+ *				:
+ */
+static const char * get_global_filename( int fips ) {
+
+   const char *map_path = roadmap_db_map_path ();
+   char name[30];
+   static char filename[RM_TILE_STORAGE_DB_PATH_MAXSIZE] = {0};
+
+     /* Global square id */
+   if ( !filename[0])
+   {
+	   const char *suffix = "index";
+	   snprintf (name, sizeof (name), "%05d_%s%s", fips, suffix,
+            ROADMAP_DATA_TYPE );
+	   roadmap_path_format (filename, sizeof (filename), map_path, name);
+   }
+   return filename;
+}
+
+/***********************************************************/
+/*  Name        : write_all()
+ *  Purpose     : Auxiliary function. Writes the whole block at the given offset
+ *  Params		: [in] fd
+ *  			: [in] data, size - the block
+ *  			: [in] offset - file offset
+ *				: Returns TRUE on success
+ */
+static BOOL write_all( int fd, const void *data, size_t size, off_t offset )
+{
+	const unsigned char *ptr = (const unsigned char *) data;
+
+	while ( size > 0 )
+	{
+		ssize_t res = pwrite( fd, ptr, size, offset );
+		if ( res <= 0 )
+		{
+			return FALSE;
+		}
+		ptr += res;
+		size -= res;
+		offset += res;
+	}
+	return TRUE;
+}
+
+/***********************************************************/
+/*  Name        : read_all()
+ *  Purpose     : Auxiliary function. Reads the whole block from the given offset
+ *  Params		: [in] fd
+ *  			: [out] data, size - the block
+ *  			: [in] offset - file offset
+ *				: Returns TRUE on success
+ */
+static BOOL read_all( int fd, void *data, size_t size, off_t offset )
+{
+	unsigned char *ptr = (unsigned char *) data;
+
+	while ( size > 0 )
+	{
+		ssize_t res = pread( fd, ptr, size, offset );
+		if ( res <= 0 )
+		{
+			return FALSE;
+		}
+		ptr += res;
+		size -= res;
+		offset += res;
+	}
+	return TRUE;
+}
+
+/***********************************************************/
+/*  Name        : pack_writer_open()
+ *  Purpose     : Auxiliary function. Starts writing a new pack file.
+ *                  Tiles must be added in ascending id order
+ *  Params		: [out] writer
+ *  			: [in] path
+ *				: Returns TRUE on success
+ */
+static BOOL pack_writer_open( RMTilePackWriter *writer, const char *path )
+{
+	writer->fd = open( path, O_RDWR | O_CREAT | O_TRUNC, 0644 );
+	if ( writer->fd < 0 )
+	{
+		roadmap_log( ROADMAP_ERROR, "Cannot create tile pack file %s", path );
+		return FALSE;
+	}
+	writer->offset = RM_TILE_PACK_PAGE_SIZE;
+	writer->index = NULL;
+	writer->count = 0;
+	writer->size = 0;
+	return TRUE;
+}
+
+/***********************************************************/
+/*  Name        : pack_writer_add()
+ *  Purpose     : Auxiliary function. Writes the tile on the next page of the pack
+ *  Params		: [in] writer
+ *  			: [in] tile_id
+ *  			: [in] data, size - the tile data
+ *				: Returns TRUE on success
+ */
+static BOOL pack_writer_add( RMTilePackWriter *writer, int tile_id, const void *data, size_t size )
+{
+	RMTilePackEntry *entry;
+
+	if ( writer->count == writer->size )
+	{
+		int new_size = writer->size ? writer->size * 2 : 1024;
+		RMTilePackEntry *index = realloc( writer->index, new_size * sizeof( RMTilePackEntry ) );
+		if ( !index )
+		{
+			return FALSE;
+		}
+		writer->index = index;
+		writer->size = new_size;
+	}
+
+	if ( !write_all( writer->fd, data, size, writer->offset ) )
+	{
+		return FALSE;
+	}
+
+	entry = writer->index + writer->count++;
+	entry->tile_id = tile_id;
+	entry->offset = writer->offset;
+	entry->size = size;
+
+	writer->offset += ( size + RM_TILE_PACK_PAGE_SIZE - 1 ) & ~( RM_TILE_PACK_PAGE_SIZE - 1 );
+
+	return TRUE;
+}
+
+/***********************************************************/
+/*  Name        : pack_writer_close()
+ *  Purpose     : Auxiliary function. Writes the index and the header and closes the pack
+ *  Params		: [in] writer
+ *  			: [in] commit - FALSE to abandon the file
+ *				: Returns TRUE on success
+ */
+static BOOL pack_writer_close( RMTilePackWriter *writer, BOOL commit )
+{
+	RMTilePackHeader header;
+	BOOL res = commit;
+
+	if ( res )
+	{
+		memcpy( header.signature, RM_TILE_PACK_SIGNATURE, sizeof( header.signature ) );
+		header.version = RM_TILE_PACK_VERSION;
+		header.page_size = RM_TILE_PACK_PAGE_SIZE;
+		header.count = writer->count;
+		header.index_offset = writer->offset;
+
+		res = write_all( writer->fd, writer->index, writer->count * sizeof( RMTilePackEntry ), writer->offset ) &&
+				ftruncate( writer->fd, writer->offset + writer->count * sizeof( RMTilePackEntry ) ) == 0 &&
+				write_all( writer->fd, &header, sizeof( header ), 0 ) &&
+				fsync( writer->fd ) == 0;
+	}
+
+	close( writer->fd );
+	free( writer->index );
+	writer->index = NULL;
+
+	return res;
+}
+
+/***********************************************************/
+/*  Name        : pack_unmap()
+ *  Purpose     : Auxiliary function. Unmaps and closes the pack file
+ *  Params		: void
+ */
+static void pack_unmap( void )
+{
+	if ( sgPackBase )
+	{
+		munmap( sgPackBase, sgPackSize );
+		sgPackBase = NULL;
+	}
+	if ( sgPackFd >= 0 )
+	{
+		close( sgPackFd );
+		sgPackFd = -1;
+	}
+	sgPackSize = 0;
+	sgPackIndex = NULL;
+	sgPackCount = 0;
+}
+
+/***********************************************************/
+/*  Name        : pack_map()
+ *  Purpose     : Auxiliary function. Maps the pack file of the fips and validates its header
+ *  Params		: [in] fips
+ *				: Returns TRUE if the pack is available
+ */
+static BOOL pack_map( int fips )
+{
+	const char *path = get_file_name( fips, RM_TILE_STORAGE_PACK_SUFFIX );
+	const RMTilePackHeader *header;
+	struct stat st;
+
+	sgPackFd = open( path, O_RDONLY );
+	if ( sgPackFd < 0 )
+	{
+		return FALSE;
+	}
+
+	if ( fstat( sgPackFd, &st ) != 0 || st.st_size < (off_t) sizeof( RMTilePackHeader ) )
+	{
+		roadmap_log( ROADMAP_ERROR, "Invalid tile pack file %s", path );
+		pack_unmap();
+		return FALSE;
+	}
+
+	if ( (uint64_t) st.st_size > (uint64_t) (size_t) -1 )
+	{
+		roadmap_log( ROADMAP_ERROR, "Tile pack file %s is too large to map", path );
+		pack_unmap();
+		return FALSE;
+	}
+
+	sgPackSize = st.st_size;
+	sgPackBase = mmap( NULL, sgPackSize, PROT_READ, MAP_SHARED, sgPackFd, 0 );
+	if ( sgPackBase == MAP_FAILED )
+	{
+		roadmap_log( ROADMAP_ERROR, "Cannot map tile pack file %s", path );
+		sgPackBase = NULL;
+		pack_unmap();
+		return FALSE;
+	}
+
+	header = (const RMTilePackHeader *) sgPackBase;
+	if ( memcmp( header->signature, RM_TILE_PACK_SIGNATURE, sizeof( header->signature ) ) ||
+		  header->version != RM_TILE_PACK_VERSION ||
+		  header->index_offset > sgPackSize ||
+		  header->count > ( sgPackSize - header->index_offset ) / sizeof( RMTilePackEntry ) )
+	{
+		roadmap_log( ROADMAP_ERROR, "Invalid tile pack file header %s", path );
+		pack_unmap();
+		return FALSE;
+	}
+
+	sgPackIndex = (const RMTilePackEntry *) ( sgPackBase + header->index_offset );
+	sgPackCount = header->count;
+
+	return TRUE;
+}
+
+/***********************************************************/
+/*  Name        : pack_find()
+ *  Purpose     : Auxiliary function. Binary search of the tile in the pack index
+ *  Params		: [in] tile_index
+ *				: Returns the index entry or NULL
+ */
+static const RMTilePackEntry* pack_find( int tile_index )
+{
+	int low = 0;
+	int high = sgPackCount;
+
+	while ( low < high )
+	{
+		int mid = ( low + high ) / 2;
+		if ( sgPackIndex[mid].tile_id < tile_index )
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	if ( low < sgPackCount && sgPackIndex[low].tile_id == tile_index &&
+		  sgPackIndex[low].offset + sgPackIndex[low].size <= sgPackSize )
+	{
+		return sgPackIndex + low;
+	}
+	return NULL;
+}
+
+/***********************************************************/
+/*  Name        : log_find()
+ *  Purpose     : Auxiliary function. Finds the latest log record of the tile
+ *  Params		: [in] tile_index
+ *				: Returns the log entry or NULL
+ */
+static RMTileLogEntry* log_find( int tile_index )
+{
+	int i;
+
+	if ( !sgLogHash )
+		return NULL;
+
+	for ( i = roadmap_hash_get_first( sgLogHash, tile_index ); i >= 0; i = roadmap_hash_get_next( sgLogHash, i ) )
+	{
+		if ( sgLogEntries[i].tile_id == tile_index )
+			return sgLogEntries + i;
+	}
+	return NULL;
+}
+
+/***********************************************************/
+/*  Name        : log_add()
+ *  Purpose     : Auxiliary function. Records the log position of the tile
+ *  Params		: [in] tile_index
+ *  			: [in] size - data size or RM_TILE_PACK_REMOVED
+ *  			: [in] offset - data offset in the log
+ */
+static void log_add( int tile_index, int size, off_t offset )
+{
+	RMTileLogEntry *entry = log_find( tile_index );
+
+	if ( !entry )
+	{
+		if ( sgLogCount == sgLogAlloc )
+		{
+			sgLogAlloc = sgLogAlloc ? sgLogAlloc * 2 : 256;
+			sgLogEntries = realloc( sgLogEntries, sgLogAlloc * sizeof( RMTileLogEntry ) );
+			roadmap_check_allocated( sgLogEntries );
+
+			if ( !sgLogHash )
+				sgLogHash = roadmap_hash_new( "tile_log", sgLogAlloc );
+			else
+				roadmap_hash_resize( sgLogHash, sgLogAlloc );
+		}
+		entry = sgLogEntries + sgLogCount;
+		entry->tile_id = tile_index;
+		roadmap_hash_add( sgLogHash, tile_index, sgLogCount );
+		sgLogCount++;
+	}
+
+	entry->size = size;
+	entry->offset = offset;
+}
+
+/***********************************************************/
+/*  Name        : log_reset()
+ *  Purpose     : Auxiliary function. Forgets all the log records and closes the log
+ *  Params		: void
+ */
+static void log_reset( void )
+{
+	if ( sgLogFd >= 0 )
+	{
+		close( sgLogFd );
+		sgLogFd = -1;
+	}
+	if ( sgLogHash )
+	{
+		roadmap_hash_clean( sgLogHash );
+	}
+	sgLogCount = 0;
+	sgLogSize = 0;
+}
+
+/***********************************************************/
+/*  Name        : log_open()
+ *  Purpose     : Auxiliary function. Opens the log of the fips and reads its records.
+ *                  An incomplete record at the end is dropped
+ *  Params		: [in] fips
+ *				: Returns TRUE on success
+ */
+static BOOL log_open( int fips )
+{
+	const char *path = get_file_name( fips, RM_TILE_STORAGE_LOG_SUFFIX );
+	RMTileLogRecord record;
+	struct stat st;
+	off_t offset = 0;
+
+	sgLogFd = open( path, O_RDWR | O_CREAT, 0644 );
+	if ( sgLogFd < 0 )
+	{
+		roadmap_log( ROADMAP_ERROR, "Cannot open tile log file %s", path );
+		return FALSE;
+	}
+
+	if ( fstat( sgLogFd, &st ) != 0 )
+	{
+		return FALSE;
+	}
+
+	while ( offset + (off_t) sizeof( record ) <= st.st_size &&
+			  read_all( sgLogFd, &record, sizeof( record ), offset ) )
+	{
+		off_t data_size = record.size == RM_TILE_PACK_REMOVED ? 0 : record.size;
+
+		if ( record.size < RM_TILE_PACK_REMOVED ||
+			  offset + (off_t) sizeof( record ) + data_size > st.st_size )
+		{
+			break;
+		}
+
+		log_add( record.tile_id, record.size, offset + sizeof( record ) );
+		offset += sizeof( record ) + data_size;
+	}
+
+	if ( offset != st.st_size )
+	{
+		roadmap_log( ROADMAP_WARNING, "Tile log %s truncated from %d to %d bytes", path, (int) st.st_size, (int) offset );
+		if ( ftruncate( sgLogFd, offset ) != 0 )
+		{
+			roadmap_log( ROADMAP_ERROR, "Cannot truncate tile log %s", path );
+		}
+	}
+	sgLogSize = offset;
+
+	return TRUE;
+}
+
+/***********************************************************/
+/*  Name        : log_append()
+ *  Purpose     : Auxiliary function. Appends a store or removal record to the log
+ *  Params		: [in] tile_index
+ *  			: [in] data, size - the tile data, size is RM_TILE_PACK_REMOVED for removal
+ *				: Returns TRUE on success
+ */
+static BOOL log_append( int tile_index, const void *data, int size )
+{
+	RMTileLogRecord record;
+	off_t offset = sgLogSize;
+
+	record.tile_id = tile_index;
+	record.size = size;
+
+	if ( !write_all( sgLogFd, &record, sizeof( record ), offset ) ||
+		  ( size > 0 && !write_all( sgLogFd, data, size, offset + sizeof( record ) ) ) )
+	{
+		roadmap_log( ROADMAP_ERROR, "Cannot write to the tile log - tile %d", tile_index );
+		if ( ftruncate( sgLogFd, sgLogSize ) != 0 )
+		{
+			roadmap_log( ROADMAP_ERROR, "Cannot truncate the tile log" );
+		}
+		return FALSE;
+	}
+
+	sgLogSize = offset + sizeof( record ) + ( size > 0 ? size : 0 );
+	log_add( tile_index, size, offset + sizeof( record ) );
+
+	if ( sgLogSize >= RM_TILE_PACK_COMPACT_BYTES )
+	{
+		/* Compact when no tile is stored for a while */
+		if ( sgCompactScheduled )
+		{
+			roadmap_main_remove_periodic( compact_timeout );
+		}
+		roadmap_main_set_periodic( RM_TILE_PACK_COMPACT_DELAY, compact_timeout );
+		sgCompactScheduled = TRUE;
+	}
+
+	return TRUE;
+}
+
+/***********************************************************/
+/*  Name        : version_find()
+ *  Purpose     : Auxiliary function. Finds the version record of the tile
+ *  Params		: [in] tile_index
+ *				: Returns the record or NULL
+ */
+static RMTileVersionRecord* version_find( int tile_index )
+{
+	int i;
+
+	if ( !sgVersionHash )
+		return NULL;
+
+	for ( i = roadmap_hash_get_first( sgVersionHash, tile_index ); i >= 0; i = roadmap_hash_get_next( sgVersionHash, i ) )
+	{
+		if ( sgVersions[i].tile_id == tile_index )
+			return sgVersions + i;
+	}
+	return NULL;
+}
+
+/***********************************************************/
+/*  Name        : version_add()
+ *  Purpose     : Auxiliary function. Records the version of the tile in memory
+ *  Params		: [in] tile_index
+ *  			: [in] version
+ */
+static void version_add( int tile_index, int version )
+{
+	RMTileVersionRecord *record = version_find( tile_index );
+
+	if ( !record )
+	{
+		if ( !version )
+			return;
+
+		if ( sgVersionCount == sgVersionAlloc )
+		{
+			sgVersionAlloc = sgVersionAlloc ? sgVersionAlloc * 2 : 1024;
+			sgVersions = realloc( sgVersions, sgVersionAlloc * sizeof( RMTileVersionRecord ) );
+			roadmap_check_allocated( sgVersions );
+
+			if ( !sgVersionHash )
+				sgVersionHash = roadmap_hash_new( "tile_version", sgVersionAlloc );
+			else
+				roadmap_hash_resize( sgVersionHash, sgVersionAlloc );
+		}
+		record = sgVersions + sgVersionCount;
+		record->tile_id = tile_index;
+		roadmap_hash_add( sgVersionHash, tile_index, sgVersionCount );
+		sgVersionCount++;
+	}
+
+	record->version = version;
+}
+
+/***********************************************************/
+/*  Name        : version_reset()
+ *  Purpose     : Auxiliary function. Forgets all the versions and closes the versions file
+ *  Params		: void
+ */
+static void version_reset( void )
+{
+	if ( sgVersionFd >= 0 )
+	{
+		close( sgVersionFd );
+		sgVersionFd = -1;
+	}
+	if ( sgVersionHash )
+	{
+		roadmap_hash_clean( sgVersionHash );
+	}
+	sgVersionCount = 0;
+	sgVersionRecords = 0;
+}
+
+/***********************************************************/
+/*  Name        : version_rewrite()
+ *  Purpose     : Auxiliary function. Replaces the versions file by the known versions only
+ *  Params		: [in] fips
+ *				: Returns TRUE on success
+ */
+static BOOL version_rewrite( int fips )
+{
+	char path[RM_TILE_STORAGE_DB_PATH_MAXSIZE];
+	char tmp_path[RM_TILE_STORAGE_DB_PATH_MAXSIZE];
+	int records = 0;
+	int fd;
+	int i;
+
+	strncpy_safe( path, get_file_name( fips, RM_TILE_STORAGE_VERSION_SUFFIX ), sizeof( path ) );
+	strncpy_safe( tmp_path, get_file_name( fips, RM_TILE_STORAGE_VERSION_TMP_SUFFIX ), sizeof( tmp_path ) );
+
+	fd = open( tmp_path, O_RDWR | O_CREAT | O_TRUNC, 0644 );
+	if ( fd < 0 )
+	{
+		return FALSE;
+	}
+
+	for ( i = 0; i < sgVersionCount; i++ )
+	{
+		if ( !sgVersions[i].version )
+			continue;
+
+		if ( !write_all( fd, sgVersions + i, sizeof( RMTileVersionRecord ), records * sizeof( RMTileVersionRecord ) ) )
+		{
+			close( fd );
+			unlink( tmp_path );
+			return FALSE;
+		}
+		records++;
+	}
+
+	if ( rename( tmp_path, path ) != 0 )
+	{
+		close( fd );
+		unlink( tmp_path );
+		return FALSE;
+	}
+
+	close( sgVersionFd );
+	sgVersionFd = fd;
+	sgVersionRecords = records;
+
+	return TRUE;
+}
+
+/***********************************************************/
+/*  Name        : version_open()
+ *  Purpose     : Auxiliary function. Opens the versions file of the fips and reads its records.
+ *                  An incomplete record at the end is dropped
+ *  Params		: [in] fips
+ *				: Returns TRUE on success
+ */
+static BOOL version_open( int fips )
+{
+	const char *path = get_file_name( fips, RM_TILE_STORAGE_VERSION_SUFFIX );
+	RMTileVersionRecord record;
+	struct stat st;
+	off_t offset = 0;
+
+	sgVersionFd = open( path, O_RDWR | O_CREAT, 0644 );
+	if ( sgVersionFd < 0 )
+	{
+		roadmap_log( ROADMAP_ERROR, "Cannot open tile versions file %s", path );
+		return FALSE;
+	}
+
+	if ( fstat( sgVersionFd, &st ) != 0 )
+	{
+		return FALSE;
+	}
+
+	while ( offset + (off_t) sizeof( record ) <= st.st_size &&
+			  read_all( sgVersionFd, &record, sizeof( record ), offset ) )
+	{
+		version_add( record.tile_id, record.version );
+		offset += sizeof( record );
+	}
+	sgVersionRecords = (int) ( offset / sizeof( record ) );
+
+	if ( offset != st.st_size && ftruncate( sgVersionFd, offset ) != 0 )
+	{
+		roadmap_log( ROADMAP_ERROR, "Cannot truncate tile versions file %s", path );
+	}
+
+	if ( sgVersionRecords > 2 * sgVersionCount + RM_TILE_PACK_VERSION_SLACK &&
+		  !version_rewrite( fips ) )
+	{
+		roadmap_log( ROADMAP_WARNING, "Cannot rewrite tile versions file %s", path );
+	}
+
+	return TRUE;
+}
+
+/***********************************************************/
+/*  Name        : version_append()
+ *  Purpose     : Auxiliary function. Appends the version of the tile to the versions file
+ *  Params		: [in] tile_index
+ *  			: [in] version - 0 when it is not known anymore
+ */
+static void version_append( int tile_index, int version )
+{
+	RMTileVersionRecord record;
+
+	if ( sgVersionFd < 0 )
+		return;
+
+	record.tile_id = tile_index;
+	record.version = version;
+
+	if ( !write_all( sgVersionFd, &record, sizeof( record ), sgVersionRecords * sizeof( record ) ) )
+	{
+		roadmap_log( ROADMAP_ERROR, "Cannot write the version of tile %d", tile_index );
+		return;
+	}
+
+	sgVersionRecords++;
+	version_add( tile_index, version );
+}
+
+/***********************************************************/
+/*  Name        : convert_db()
+ *  Purpose     : Converts the sqlite tiles database of the fips to a pack file.
+ *                  The database itself is kept
+ *  Params		: [in] fips
+ *				: Returns TRUE on success
+ */
+static BOOL convert_db( int fips )
+{
+	char db_path[RM_TILE_STORAGE_DB_PATH_MAXSIZE];
+	char pack_path[RM_TILE_STORAGE_DB_PATH_MAXSIZE];
+	char tmp_path[RM_TILE_STORAGE_DB_PATH_MAXSIZE];
+	sqlite3* db = NULL;
+	sqlite3_stmt *stmt = NULL;
+	RMTilePackWriter writer;
+	BOOL res = TRUE;
+	int ret_val;
+
+	strncpy_safe( db_path, get_file_name( fips, RM_TILE_STORAGE_DB_SUFFIX ), sizeof( db_path ) );
+	if ( !roadmap_file_exists( NULL, db_path ) )
+	{
+		return FALSE;
+	}
+	strncpy_safe( pack_path, get_file_name( fips, RM_TILE_STORAGE_PACK_SUFFIX ), sizeof( pack_path ) );
+	strncpy_safe( tmp_path, get_file_name( fips, RM_TILE_STORAGE_TMP_SUFFIX ), sizeof( tmp_path ) );
+
+	if ( sqlite3_open_v2( db_path, &db, SQLITE_OPEN_READONLY, NULL ) != SQLITE_OK ||
+		  sqlite3_prepare_v2( db, RM_TILE_STORAGE_STMT_CONVERT, -1, &stmt, NULL ) != SQLITE_OK )
+	{
+		roadmap_log( ROADMAP_ERROR, "Cannot read tiles database %s: %s", db_path, db ? sqlite3_errmsg( db ) : "" );
+		sqlite3_close( db );
+		return FALSE;
+	}
+
+	if ( !pack_writer_open( &writer, tmp_path ) )
+	{
+		sqlite3_finalize( stmt );
+		sqlite3_close( db );
+		return FALSE;
+	}
+
+	while ( res && ( ret_val = sqlite3_step( stmt ) ) == SQLITE_ROW )
+	{
+		const void* data = sqlite3_column_blob( stmt, 1 );
+		int size = sqlite3_column_bytes( stmt, 1 );
+
+		res = pack_writer_add( &writer, sqlite3_column_int( stmt, 0 ), data, size );
+	}
+
+	if ( res && ret_val != SQLITE_DONE )
+	{
+		roadmap_log( ROADMAP_ERROR, "Cannot read tiles database %s: %s", db_path, sqlite3_errmsg( db ) );
+		res = FALSE;
+	}
+
+	sqlite3_finalize( stmt );
+	sqlite3_close( db );
+
+	res = pack_writer_close( &writer, res ) && rename( tmp_path, pack_path ) == 0;
+	if ( !res )
+	{
+		roadmap_log( ROADMAP_ERROR, "Converting %s to a tile pack failed", db_path );
+		unlink( tmp_path );
+		return FALSE;
+	}
+
+	roadmap_log( ROADMAP_INFO, "Converted %s to a tile pack of %d tiles", db_path, writer.count );
+	return TRUE;
+}
+
+/***********************************************************/
+/*  Name        : storage_open()
+ *  Purpose     : Auxiliary function. Opens the pack and the log of the fips
+ *  Params		: [in] fips
+ *				: Returns TRUE on success
+ */
+static BOOL storage_open( int fips )
+{
+	if ( fips == sgCurrentFips && sgLogFd >= 0 )
+	{
+		return TRUE;
+	}
+
+	if ( sgCompactScheduled )
+	{
+		roadmap_main_remove_periodic( compact_timeout );
+		sgCompactScheduled = FALSE;
+	}
+	compact_finish( TRUE, TRUE );
+	pack_unmap();
+	log_reset();
+	version_reset();
+
+	sgCurrentFips = fips;
+
+	if ( !pack_map( fips ) && convert_db( fips ) )
+	{
+		pack_map( fips );
+	}
+
+	if ( !log_open( fips ) )
+	{
+		return FALSE;
+	}
+
+	/* Without the versions the tiles are still available */
+	version_open( fips );
+
+	return TRUE;
+}
+
+/***********************************************************/
+/*  Name        : compare_log_entries()
+ *  Purpose     : Auxiliary function. qsort comparator of the log entries by tile id
+ */
+static int compare_log_entries( const void *a, const void *b )
+{
+	int id_a = ( (const RMTileLogEntry *) a )->tile_id;
+	int id_b = ( (const RMTileLogEntry *) b )->tile_id;
+
+	return id_a < id_b ? -1 : id_a > id_b;
+}
+
+/***********************************************************/
+/*  Name        : compact_thread()
+ *  Purpose     : Auxiliary function. Merges the pack and the log snapshot into a new pack
+ *                  in the temporary file. Runs on the compaction thread
+ *  Params		: [in] data - the compaction state
+ */
+static void* compact_thread( void *data )
+{
+	RMTilePackCompaction *compaction = (RMTilePackCompaction *) data;
+	const RMTilePackEntry *pack_index = compaction->pack_index;
+	const RMTileLogEntry *log_entries = compaction->log_entries;
+	RMTilePackWriter writer;
+	void *buffer = NULL;
+	size_t buffer_size = 0;
+	int pack_pos = 0;
+	int log_pos = 0;
+	BOOL res = TRUE;
+
+	if ( !pack_writer_open( &writer, compaction->tmp_path ) )
+	{
+		pthread_mutex_lock( &sgCompactLock );
+		compaction->done = TRUE;
+		pthread_mutex_unlock( &sgCompactLock );
+		return NULL;
+	}
+
+	while ( res && ( pack_pos < compaction->pack_count || log_pos < compaction->log_count ) )
+	{
+		if ( log_pos == compaction->log_count ||
+			  ( pack_pos < compaction->pack_count && pack_index[pack_pos].tile_id < log_entries[log_pos].tile_id ) )
+		{
+			const RMTilePackEntry *entry = pack_index + pack_pos++;
+			res = pack_writer_add( &writer, entry->tile_id, compaction->pack_base + entry->offset, entry->size );
+		}
+		else
+		{
+			const RMTileLogEntry *entry = log_entries + log_pos++;
+
+			if ( pack_pos < compaction->pack_count && pack_index[pack_pos].tile_id == entry->tile_id )
+			{
+				pack_pos++;
+			}
+			if ( entry->size == RM_TILE_PACK_REMOVED )
+			{
+				continue;
+			}
+			if ( buffer_size < (size_t) entry->size )
+			{
+				free( buffer );
+				buffer_size = entry->size;
+				buffer = malloc( buffer_size );
+				if ( !buffer )
+				{
+					buffer_size = 0;
+					res = FALSE;
+					break;
+				}
+			}
+			res = read_all( compaction->log_fd, buffer, entry->size, entry->offset ) &&
+					pack_writer_add( &writer, entry->tile_id, buffer, entry->size );
+		}
+	}
+	free( buffer );
+
+	compaction->tiles = writer.count;
+	res = pack_writer_close( &writer, res );
+
+	pthread_mutex_lock( &sgCompactLock );
+	compaction->result = res;
+	compaction->done = TRUE;
+	pthread_mutex_unlock( &sgCompactLock );
+
+	return NULL;
+}
+
+/***********************************************************/
+/*  Name        : compact_start()
+ *  Purpose     : Auxiliary function. Takes a snapshot of the log and starts the compaction thread
+ *  Params		: void
+ */
+static void compact_start( void )
+{
+	RMTilePackCompaction *compaction = &sgCompaction;
+
+	if ( sgCompactRunning || sgCurrentFips < 0 || sgLogFd < 0 )
+	{
+		return;
+	}
+
+	compaction->pack_base = sgPackBase;
+	compaction->pack_index = sgPackIndex;
+	compaction->pack_count = sgPackCount;
+	compaction->log_count = sgLogCount;
+	compaction->log_size = sgLogSize;
+	compaction->tiles = 0;
+	compaction->result = FALSE;
+	compaction->done = FALSE;
+	strncpy_safe( compaction->tmp_path, get_file_name( sgCurrentFips, RM_TILE_STORAGE_TMP_SUFFIX ), sizeof( compaction->tmp_path ) );
+
+	/*
+	 * The thread sorts nothing in place - the log hash indexes the original entries
+	 */
+	compaction->log_entries = malloc( ( sgLogCount ? sgLogCount : 1 ) * sizeof( RMTileLogEntry ) );
+	roadmap_check_allocated( compaction->log_entries );
+	memcpy( compaction->log_entries, sgLogEntries, sgLogCount * sizeof( RMTileLogEntry ) );
+	qsort( compaction->log_entries, compaction->log_count, sizeof( RMTileLogEntry ), compare_log_entries );
+
+	compaction->log_fd = dup( sgLogFd );
+	if ( compaction->log_fd < 0 ||
+		  pthread_create( &sgCompactThread, NULL, compact_thread, compaction ) != 0 )
+	{
+		roadmap_log( ROADMAP_ERROR, "Cannot start the tile pack compaction" );
+		if ( compaction->log_fd >= 0 )
+		{
+			close( compaction->log_fd );
+		}
+		free( compaction->log_entries );
+		return;
+	}
+
+	sgCompactRunning = TRUE;
+}
+
+/***********************************************************/
+/*  Name        : log_drop_merged()
+ *  Purpose     : Auxiliary function. Replaces the log with the records written after the given
+ *                  offset, through a temporary file so a crash leaves either log in place
+ *  Params		: [in] merged - the size of the merged log records
+ *				: Returns TRUE on success
+ */
+static BOOL log_drop_merged( off_t merged )
+{
+	char log_path[RM_TILE_STORAGE_DB_PATH_MAXSIZE];
+	char tmp_path[RM_TILE_STORAGE_DB_PATH_MAXSIZE];
+	unsigned char *buffer;
+	off_t offset = merged;
+	BOOL res = TRUE;
+	int fd;
+
+	strncpy_safe( log_path, get_file_name( sgCurrentFips, RM_TILE_STORAGE_LOG_SUFFIX ), sizeof( log_path ) );
+	strncpy_safe( tmp_path, get_file_name( sgCurrentFips, RM_TILE_STORAGE_LOG_TMP_SUFFIX ), sizeof( tmp_path ) );
+
+	fd = open( tmp_path, O_RDWR | O_CREAT | O_TRUNC, 0644 );
+	if ( fd < 0 )
+	{
+		return FALSE;
+	}
+
+	buffer = malloc( RM_TILE_PACK_COPY_SIZE );
+	roadmap_check_allocated( buffer );
+
+	while ( res && offset < sgLogSize )
+	{
+		size_t chunk = sgLogSize - offset < RM_TILE_PACK_COPY_SIZE ? (size_t) ( sgLogSize - offset ) : RM_TILE_PACK_COPY_SIZE;
+
+		res = read_all( sgLogFd, buffer, chunk, offset ) &&
+				write_all( fd, buffer, chunk, offset - merged );
+		offset += chunk;
+	}
+	free( buffer );
+
+	res = res && fsync( fd ) == 0;
+	close( fd );
+
+	if ( !res || rename( tmp_path, log_path ) != 0 )
+	{
+		unlink( tmp_path );
+		return FALSE;
+	}
+
+	log_reset();
+	return log_open( sgCurrentFips );
+}
+
+/***********************************************************/
+/*  Name        : compact_finish()
+ *  Purpose     : Auxiliary function. Joins a completed compaction and switches to the new pack.
+ *                  The mapped data of the old pack is released here
+ *  Params		: [in] wait - wait for a compaction which is still running
+ *  			: [in] apply - FALSE to drop the result
+ */
+static void compact_finish( BOOL wait, BOOL apply )
+{
+	RMTilePackCompaction *compaction = &sgCompaction;
+	char pack_path[RM_TILE_STORAGE_DB_PATH_MAXSIZE];
+	BOOL done;
+
+	if ( !sgCompactRunning )
+	{
+		return;
+	}
+
+	pthread_mutex_lock( &sgCompactLock );
+	done = compaction->done;
+	pthread_mutex_unlock( &sgCompactLock );
+
+	if ( !wait && !done )
+	{
+		return;
+	}
+
+	pthread_join( sgCompactThread, NULL );
+	sgCompactRunning = FALSE;
+	close( compaction->log_fd );
+	free( compaction->log_entries );
+	compaction->log_entries = NULL;
+
+	strncpy_safe( pack_path, get_file_name( sgCurrentFips, RM_TILE_STORAGE_PACK_SUFFIX ), sizeof( pack_path ) );
+
+	if ( !apply || !compaction->result || rename( compaction->tmp_path, pack_path ) != 0 )
+	{
+		if ( apply )
+		{
+			roadmap_log( ROADMAP_ERROR, "Tile pack compaction failed" );
+		}
+		unlink( compaction->tmp_path );
+		return;
+	}
+
+	pack_unmap();
+	pack_map( sgCurrentFips );
+
+	/*
+	 * Until the log is replaced, its merged records override the same tiles in the new pack
+	 */
+	if ( !log_drop_merged( compaction->log_size ) )
+	{
+		roadmap_log( ROADMAP_ERROR, "Cannot drop the merged records from the tile log" );
+	}
+
+	roadmap_log( ROADMAP_INFO, "Compacted tile pack: %d tiles", compaction->tiles );
+}
+
+/***********************************************************/
+/*  Name        : compact_timeout( void )
+ *  Purpose     : Auxiliary function. Starts the compaction on timer timeout
+ *  Params		:
+ */
+static void compact_timeout( void )
+{
+	roadmap_main_remove_periodic( compact_timeout );
+	sgCompactScheduled = FALSE;
+	compact_start();
+}
+
+/***********************************************************/
+/*  Name        : roadmap_tile_store()
+ *  Purpose     : Interface function. Appends the tile to the log
+ *  Params		: [in] fips
+ *  			: [in] tile_index - primary key
+ *  			: [in] data - the pointer to the blob data
+ *  			: [in] data - the size of the blob data block
+ *				:
+ */
+int roadmap_tile_store (int fips, int tile_index, void *data, size_t size)
+{
+	if ( !storage_open( fips ) )
+	{
+		roadmap_log( ROADMAP_ERROR, "Tile storage failed - cannot open tile pack" );
+		return -1;
+	}
+
+	compact_finish( FALSE, TRUE );
+
+	return log_append( tile_index, data, size ) ? 0 : -1;
+}
+
+/***********************************************************/
+/*  Name        : roadmap_tile_remove
+ *  Purpose     : Interface function. Appends the removal of the tile to the log
+ *  Params		: [in] fips
+ *  			: [in] tile_index - primary key
+ *  			:
+ *				:
+ */
+void roadmap_tile_remove (int fips, int tile_index)
+{
+	const RMTileLogEntry *log_entry;
+
+	if ( !storage_open( fips ) )
+	{
+		roadmap_log( ROADMAP_ERROR, "Tile remove failed - cannot open tile pack" );
+		return;
+	}
+
+	compact_finish( FALSE, TRUE );
+
+	log_entry = log_find( tile_index );
+	if ( log_entry ? log_entry->size != RM_TILE_PACK_REMOVED : pack_find( tile_index ) != NULL )
+	{
+		log_append( tile_index, NULL, RM_TILE_PACK_REMOVED );
+	}
+
+	if ( version_find( tile_index ) )
+	{
+		version_append( tile_index, 0 );
+	}
+}
+
+/***********************************************************/
+/*  Name        : roadmap_tile_set_version
+ *  Purpose     : Interface function. Appends the version of the tile to the versions file
+ *  Params		: [in] fips
+ *  			: [in] tile_index - primary key
+ *  			: [in] version - the timestamp of the tile square
+ */
+void roadmap_tile_set_version (int fips, int tile_index, int version)
+{
+	RMTileVersionRecord *record;
+
+	if ( !storage_open( fips ) )
+	{
+		roadmap_log( ROADMAP_ERROR, "Tile version update failed - cannot open tile pack" );
+		return;
+	}
+
+	record = version_find( tile_index );
+	if ( record ? record->version != version : version != 0 )
+	{
+		version_append( tile_index, version );
+	}
+}
+
+static int roadmap_tile_file_load ( const char *full_name, void **base, size_t *size) {
+
+   RoadMapFile		file;
+   int				res;
+
+   file = roadmap_file_open (full_name, "r");
+
+   if (!ROADMAP_FILE_IS_VALID(file)) {
+      return -1;
+   }
+
+   *size = roadmap_file_length (NULL, full_name);
+   *base = malloc (*size);
+
+	   res = roadmap_file_read (file, *base, *size);
+	   roadmap_file_close (file);
+
+   if (res != (int)*size) {
+      free (*base);
+      return -1;
+   }
+
+   return 0;
+}
+
+/***********************************************************/
+/*  Name        : roadmap_tile_map
+ *  Purpose     : Interface function. Returns the tile data in the mapped pack.
+ *                 The data is valid until the next store or removal, which is
+ *                 the only time a compacted pack replaces the mapped one
+ *  Params		: [in] fips
+ *  			: [in] tile_index - primary key
+ *  			: [out] data - the mapped data
+ *				: [out] size - the size of the data block
+ */
+int roadmap_tile_map (int fips, int tile_index, const void **data, size_t *size)
+{
+	const RMTilePackEntry *entry;
+
+	if ( tile_index == -1 || !storage_open( fips ) || log_find( tile_index ) )
+	{
+		return -1;
+	}
+
+	entry = pack_find( tile_index );
+	if ( !entry )
+	{
+		return -1;
+	}
+
+	*data = sgPackBase + entry->offset;
+	*size = entry->size;
+	return 0;
+}
+
+/***********************************************************/
+/*  Name        : roadmap_tile_load_buffer
+ *  Purpose     : Interface function. Loads the tile data into the buffer kept
+ *                 by the caller. Reallocates the buffer if too small
+ *  Params		: [in] fips
+ *  			: [in] tile_index - primary key
+ *  			: [in/out] buffer - the data storage address
+ *  			: [in/out] capacity - the allocated size of the buffer
+ *				: [out] size - the size of the data block
+ */
+int roadmap_tile_load_buffer (int fips, int tile_index, void **buffer, size_t *capacity, size_t *size)
+{
+	const RMTileLogEntry *log_entry;
+	const void *data = NULL;
+
+	if ( tile_index == -1 )
+	{
+		void *base;
+		const char* file_name = get_global_filename( fips );
+		int res = roadmap_tile_file_load( file_name, &base, size );
+		if ( res == 0 )
+		{
+			free( *buffer );
+			*buffer = base;
+			*capacity = *size;
+		}
+		return res;
+	}
+
+	if ( !storage_open( fips ) )
+	{
+		roadmap_log( ROADMAP_ERROR, "Tile loading failed - cannot open tile pack" );
+		return -1;
+	}
+
+	log_entry = log_find( tile_index );
+	if ( log_entry )
+	{
+		if ( log_entry->size == RM_TILE_PACK_REMOVED )
+			return -1;
+		*size = log_entry->size;
+	}
+	else if ( roadmap_tile_map( fips, tile_index, &data, size ) != 0 )
+	{
+		return -1;
+	}
+
+	if ( *capacity < *size || !*buffer )
+	{
+		free( *buffer );
+		*buffer = malloc( *size ? *size : 1 );
+		roadmap_check_allocated( *buffer );
+		*capacity = *size;
+	}
+
+	if ( log_entry )
+	{
+		if ( !read_all( sgLogFd, *buffer, *size, log_entry->offset ) )
+		{
+			roadmap_log( ROADMAP_ERROR, "Cannot read tile %d from the tile log", tile_index );
+			return -1;
+		}
+	}
+	else
+	{
+		memcpy( *buffer, data, *size );
+	}
+
+	return 0;
+}
+
+/***********************************************************/
+/*  Name        : roadmap_tile_load
+ *  Purpose     : Interface function. Loads the tile data.
+ *                 Allocates the necessar heap space
+ *  Params		: [in] fips
+ *  			: [in] tile_index - primary key
+ *  			: [out] base - the data storage address
+ *				: [out] size - the size of the data block
+ */
+int roadmap_tile_load (int fips, int tile_index, void **base, size_t *size)
+{
+	size_t capacity = 0;
+
+	*base = NULL;
+	if ( roadmap_tile_load_buffer( fips, tile_index, base, &capacity, size ) != 0 )
+	{
+		free( *base );
+		*base = NULL;
+		return -1;
+	}
+
+	return 0;
+}
+
+/***********************************************************/
+/*  Name        : roadmap_tile_load_batch
+ *  Purpose     : Interface function. Passes each of the requested tiles to the callback.
+ *                 Tiles in the pack are passed without copying
+ *  Params		: [in] fips
+ *  			: [in] tile_indexes - primary keys
+ *  			: [in] count - number of tiles
+ *				: [in] cb - called for each tile found
+ *				: [in] context - passed to the callback
+ *				: Returns the number of tiles found or -1 on failure
+ */
+int roadmap_tile_load_batch (int fips, const int *tile_indexes, int count,
+                             roadmap_tile_load_cb cb, void *context)
+{
+	void *buffer = NULL;
+	size_t capacity = 0;
+	int found = 0;
+	int i;
+
+	if ( !storage_open( fips ) )
+	{
+		roadmap_log( ROADMAP_ERROR, "Tile batch loading failed - cannot open tile pack" );
+		return -1;
+	}
+
+	for ( i = 0; i < count; i++ )
+	{
+		const void *data;
+		size_t size;
+
+		if ( roadmap_tile_map( fips, tile_indexes[i], &data, &size ) == 0 )
+		{
+			cb( tile_indexes[i], data, size, context );
+			found++;
+		}
+		else if ( roadmap_tile_load_buffer( fips, tile_indexes[i], &buffer, &capacity, &size ) == 0 )
+		{
+			cb( tile_indexes[i], buffer, size, context );
+			found++;
+		}
+	}
+
+	free( buffer );
+	return found;
+}
+
+/***********************************************************/
+/*  Name        : roadmap_tile_remove_all
+ *  Purpose     : Removes the tiles of the fips. The sqlite database is left
+ *                 alone, and an empty pack is written so it is not converted again
+ *
+ *  Params     : [in] fips
+ */
+void roadmap_tile_remove_all( int fips )
+{
+	RMTilePackWriter writer;
+
+	if ( sgCompactScheduled )
+	{
+		roadmap_main_remove_periodic( compact_timeout );
+		sgCompactScheduled = FALSE;
+	}
+
+	if ( fips == sgCurrentFips )
+	{
+		compact_finish( TRUE, FALSE );
+		pack_unmap();
+		log_reset();
+		version_reset();
+		sgCurrentFips = -1;
+	}
+
+	roadmap_file_remove( get_file_name( fips, RM_TILE_STORAGE_LOG_SUFFIX ), NULL );
+	roadmap_file_remove( get_file_name( fips, RM_TILE_STORAGE_VERSION_SUFFIX ), NULL );
+
+	if ( !pack_writer_open( &writer, get_file_name( fips, RM_TILE_STORAGE_PACK_SUFFIX ) ) ||
+		  !pack_writer_close( &writer, TRUE ) )
+	{
+		roadmap_log( ROADMAP_ERROR, "Cannot write an empty tile pack for %d", fips );
+	}
+}
+
+/***********************************************************/
+/*  Name        : roadmap_tile_storage_shutdown
+ *  Purpose     : Interface function. Completes a running compaction, unmaps the pack
+ *                 and closes the log
+ *  Params		: void
+ */
+void roadmap_tile_storage_shutdown( void )
+{
+	if ( sgCompactScheduled )
+	{
+		roadmap_main_remove_periodic( compact_timeout );
+		sgCompactScheduled = FALSE;
+	}
+
+	compact_finish( TRUE, TRUE );
+	pack_unmap();
+	log_reset();
+	version_reset();
+	sgCurrentFips = -1;
+}
+
+/***********************************************************/
+/*  Name        : roadmap_tile_enumerate
+ *  Purpose     : Interface function. Calls the callback for each tile stored
+ *  Params		: [in] fips
+ *  			: [in] cb - called with the id of each tile
+ *				: Returns the number of tiles or -1 on failure
+ */
+int roadmap_tile_enumerate (int fips, roadmap_tile_enum_cb cb)
+{
+	int count = 0;
+	int i;
+
+	if ( !storage_open( fips ) )
+	{
+		roadmap_log( ROADMAP_ERROR, "Tile enumeration failed - cannot open tile pack" );
+		return -1;
+	}
+
+	for ( i = 0; i < sgPackCount; i++ )
+	{
+		if ( !log_find( sgPackIndex[i].tile_id ) )
+		{
+			cb( sgPackIndex[i].tile_id );
+			count++;
+		}
+	}
+
+	for ( i = 0; i < sgLogCount; i++ )
+	{
+		if ( sgLogEntries[i].size != RM_TILE_PACK_REMOVED )
+		{
+			cb( sgLogEntries[i].tile_id );
+			count++;
+		}
+	}
+
+	return count;
+}
+
+/***********************************************************/
+/*  Name        : roadmap_tile_enumerate_versions
+ *  Purpose     : Interface function. Calls the callback for each tile whose version is known
+ *  Params		: [in] fips
+ *  			: [in] cb - called with the id and the version of each tile
+ *				: Returns the number of tiles or -1 on failure
+ */
+int roadmap_tile_enumerate_versions (int fips, roadmap_tile_version_cb cb)
+{
+	int count = 0;
+	int i;
+
+	if ( !storage_open( fips ) )
+	{
+		roadmap_log( ROADMAP_ERROR, "Tile versions enumeration failed - cannot open tile pack" );
+		return -1;
+	}
+
+	for ( i = 0; i < sgVersionCount; i++ )
+	{
+		if ( sgVersions[i].version )
+		{
+			cb( sgVersions[i].tile_id, sgVersions[i].version );
+			count++;
+		}
+	}
+
+	return count;
+}
@@ -28,6 +28,7 @@
 #include <sqlite3.h>
 
 #include "roadmap.h"
+#include "roadmap_tile_storage.h"
 #include "roadmap_locator.h"
 #include "roadmap_performance.h"
 #include "roadmap_file.h"
@@ -53,9 +54,16 @@ typedef enum
 #define   RM_TILE_STORAGE_TILES_TABLE_DATA		"data"
 
 #define   RM_TILE_STORAGE_STMT_CREATE_TABLE		"CREATE TABLE IF NOT EXISTS tiles_table(id INTEGER PRIMARY KEY, data BLOB)"
-#define   RM_TILE_STORAGE_STMT_STORE		    "INSERT OR REPLACE INTO tiles_table values (%d,?);"
+#define   RM_TILE_STORAGE_STMT_STORE		    "INSERT OR REPLACE INTO tiles_table values (?,?);"
 #define   RM_TILE_STORAGE_STMT_LOAD		        "SELECT data FROM tiles_table WHERE id=?;"
 #define   RM_TILE_STORAGE_STMT_REMOVE	        "DELETE FROM tiles_table WHERE id=?;"
+#define   RM_TILE_STORAGE_STMT_ENUMERATE	    "SELECT id FROM tiles_table;"
+#define   RM_TILE_STORAGE_STMT_LOAD_BATCH	    "SELECT id, data FROM tiles_table WHERE id IN (%s);"
+#define   RM_TILE_STORAGE_STMT_CREATE_VERSIONS	"CREATE TABLE IF NOT EXISTS tiles_version(id INTEGER PRIMARY KEY, version INTEGER)"
+#define   RM_TILE_STORAGE_STMT_SET_VERSION	    "INSERT OR REPLACE INTO tiles_version values (?,?);"
+#define   RM_TILE_STORAGE_STMT_REMOVE_VERSION	"DELETE FROM tiles_version WHERE id=?;"
+#define   RM_TILE_STORAGE_STMT_ENUM_VERSIONS	"SELECT id, version FROM tiles_version;"
+#define   RM_TILE_STORAGE_BATCH_SIZE			32			// Tile ids bound to the batch load statement
 #define   RM_TILE_STORAGE_STMT_SYNC_OFF 		"PRAGMA synchronous = OFF"
 #define   RM_TILE_STORAGE_STMT_CNT_OFF			"PRAGMA count_changes = OFF"
 #define   RM_TILE_STORAGE_STMT_TMP_STORE_MEM	"PRAGMA temp_store = MEMORY"
@@ -65,16 +73,28 @@ typedef enum
 static int sgCurrentFips	= -1;			// Current fips - used to avoid database
 static BOOL sgTableExists   = FALSE;		// Indicates if the table exits ( in order to avoid unnecessary queries)
 static sqlite3* sgSQLiteDb  = NULL;			// The current db handle
-static RMTileStorageConLifetime sgConLifetime = _con_lifetime_session;		// The type of connection lifetime
+static RMTileStorageConLifetime sgConLifetime = _con_lifetime_application;		// The type of connection lifetime
+static int sgDbFips = -1;				// The fips of the open connection
 
 static BOOL sgIsInTransaction = FALSE;
 static int  sgTransStmtsCount = 0;
 
+/*
+ * Prepared statements and the blob handle are kept while the connection is open
+ */
+static sqlite3_stmt* sgStmtStore = NULL;
+static sqlite3_stmt* sgStmtRemove = NULL;
+static sqlite3_stmt* sgStmtLoadBatch = NULL;
+static sqlite3_stmt* sgStmtSetVersion = NULL;
+static sqlite3_stmt* sgStmtRemoveVersion = NULL;
+static sqlite3_blob* sgLoadBlob = NULL;
+
 #define check_sqlite_error( errstr, code ) \
 	check_sqlite_error_line( errstr, code, __LINE__ )
 
 static void trans_timeout( void );
 static void trans_commit( void );
+static void close_db( void );
 
 /***********************************************************/
 /*  Name        : roadmap_camera_image_capture()
@@ -158,6 +178,14 @@ static sqlite3* get_db( int fips )
 
 	sgCurrentFips = fips;
 
+	/*
+	 * The connection is kept open, until the fips changes or the storage is shut down
+	 */
+	if ( sgSQLiteDb && sgDbFips != fips && !sgIsInTransaction )
+	{
+		close_db();
+		sgTableExists = FALSE;
+	}
 
 	if ( ( sgConLifetime == _con_lifetime_application || sgIsInTransaction ) && sgSQLiteDb )
 		return sgSQLiteDb;
@@ -169,6 +197,7 @@ static sqlite3* get_db( int fips )
 	}
 
 	check_sqlite_error( "opening database", sqlite3_open( full_path, &sgSQLiteDb ) );
+	sgDbFips = fips;
 
 	check_sqlite_error( "pragma synchronous off", sqlite3_exec( sgSQLiteDb, RM_TILE_STORAGE_STMT_SYNC_OFF, NULL, 0, &error_msg ) );
 
@@ -182,7 +211,8 @@ static sqlite3* get_db( int fips )
 	{
 		check_sqlite_error( "pragma page size", sqlite3_exec( sgSQLiteDb, RM_TILE_STORAGE_STMT_PAGE_SIZE, NULL, 0, &error_msg ) );
 
-		if ( check_sqlite_error( "creating table", sqlite3_exec( sgSQLiteDb, RM_TILE_STORAGE_STMT_CREATE_TABLE, NULL, 0, &error_msg ) ) )
+		if ( check_sqlite_error( "creating table", sqlite3_exec( sgSQLiteDb, RM_TILE_STORAGE_STMT_CREATE_TABLE, NULL, 0, &error_msg ) ) &&
+			  check_sqlite_error( "creating the versions table", sqlite3_exec( sgSQLiteDb, RM_TILE_STORAGE_STMT_CREATE_VERSIONS, NULL, 0, &error_msg ) ) )
 		{
 			sgTableExists = TRUE;
 		}
@@ -191,6 +221,88 @@ static sqlite3* get_db( int fips )
 	return sgSQLiteDb;
 }
 
+/***********************************************************/
+/*  Name        : get_stmt()
+ *  Purpose     : Auxiliary function. Returns the cached prepared statement.
+ *                  The statement is prepared on the first use of the connection
+ *  Params		: [in] db
+ *  			: [in/out] stmt - the statement cache
+ *  			: [in] sql - the statement string
+ */
+static sqlite3_stmt* get_stmt( sqlite3* db, sqlite3_stmt** stmt, const char* sql )
+{
+	if ( !*stmt )
+	{
+		if ( !check_sqlite_error( "preparing the SQLITE statement", sqlite3_prepare_v2( db, sql, -1, stmt, NULL ) ) )
+		{
+			*stmt = NULL;
+		}
+	}
+	return *stmt;
+}
+
+/***********************************************************/
+/*  Name        : release_stmt()
+ *  Purpose     : Auxiliary function. Resets the cached statement for the next use
+ *  Params		: [in] stmt
+ */
+static void release_stmt( sqlite3_stmt* stmt )
+{
+	sqlite3_reset( stmt );
+	sqlite3_clear_bindings( stmt );
+}
+
+/***********************************************************/
+/*  Name        : finalize_stmts()
+ *  Purpose     : Auxiliary function. Finalizes the cached statements and the blob handle.
+ *                  Must be called before closing the connection
+ *  Params		: void
+ */
+static void finalize_stmts( void )
+{
+	if ( sgLoadBlob )
+	{
+		sqlite3_blob_close( sgLoadBlob );
+		sgLoadBlob = NULL;
+	}
+	sqlite3_finalize( sgStmtStore );
+	sqlite3_finalize( sgStmtRemove );
+	sqlite3_finalize( sgStmtLoadBatch );
+	sqlite3_finalize( sgStmtSetVersion );
+	sqlite3_finalize( sgStmtRemoveVersion );
+	sgStmtStore = NULL;
+	sgStmtRemove = NULL;
+	sgStmtLoadBatch = NULL;
+	sgStmtSetVersion = NULL;
+	sgStmtRemoveVersion = NULL;
+}
+
+/***********************************************************/
+/*  Name        : get_batch_stmt_string()
+ *  Purpose     : Auxiliary function. Returns the batch load statement with
+ *                  RM_TILE_STORAGE_BATCH_SIZE parameters
+ *  Params		: void
+ */
+static const char* get_batch_stmt_string( void )
+{
+	static char stmt_string[RM_TILE_STORAGE_QUERY_MAXSIZE] = {0};
+
+	if ( !stmt_string[0] )
+	{
+		char params[RM_TILE_STORAGE_BATCH_SIZE * 2];
+		int i;
+
+		for ( i = 0; i < RM_TILE_STORAGE_BATCH_SIZE; i++ )
+		{
+			params[i*2] = '?';
+			params[i*2+1] = ',';
+		}
+		params[RM_TILE_STORAGE_BATCH_SIZE * 2 - 1] = '\0';
+		snprintf( stmt_string, sizeof( stmt_string ), RM_TILE_STORAGE_STMT_LOAD_BATCH, params );
+	}
+	return stmt_string;
+}
+
 /***********************************************************/
 /*  Name        : close_db()
  *  Purpose     : Auxiliary function. Closes the database
@@ -202,8 +314,10 @@ static void close_db( void )
 {
 	if ( sgSQLiteDb )
 	{
+		finalize_stmts();
 		check_sqlite_error( "Close DB", sqlite3_close( sgSQLiteDb ) );
 		sgSQLiteDb = NULL;
+		sgDbFips = -1;
 	}
 }
 /***********************************************************/
@@ -346,7 +460,6 @@ int roadmap_tile_store( int fips, int tile_index, void *data, size_t size )
 	sqlite3* db = NULL;
 	sqlite3_stmt *stmt = NULL;
 	int ret_val;
-	char stmt_string[RM_TILE_STORAGE_QUERY_MAXSIZE];
 
 	// db = get_db( fips );
 	db = trans_open( fips );
@@ -356,42 +469,48 @@ int roadmap_tile_store( int fips, int tile_index, void *data, size_t size )
 		roadmap_log( ROADMAP_ERROR, "Tile storage failed - cannot open database" );
 		return -1;
 	}
-	/*
-	 * Prepare the string
-	 */
-	sprintf( stmt_string, RM_TILE_STORAGE_STMT_STORE, tile_index );
 
 	/*
-	 * Prepare the sqlite statement
+	 * Get the prepared sqlite statement
 	 */
-	ret_val = sqlite3_prepare( db, stmt_string, -1, &stmt, NULL );
-	if ( !check_sqlite_error( "preparing the SQLITE statement", ret_val ) )
+	stmt = get_stmt( db, &sgStmtStore, RM_TILE_STORAGE_STMT_STORE );
+	if ( !stmt )
 	{
 		return -1;
 	}
 	/*
 	 * Binding the data
 	 */
-	ret_val = sqlite3_bind_blob( stmt, 1, data, size, NULL );
-	if ( !check_sqlite_error( "binding the blob statement", ret_val ) )
+	ret_val = sqlite3_bind_int( stmt, 1, tile_index );
+	if ( check_sqlite_error( "binding int parameter", ret_val ) )
 	{
-		return -1;
+		ret_val = sqlite3_bind_blob( stmt, 2, data, size, SQLITE_STATIC );
+		check_sqlite_error( "binding the blob statement", ret_val );
 	}
 	/*
 	 * Evaluate
 	 */
-	sqlite3_step( stmt );
-	if ( !check_sqlite_error( "finishing", sqlite3_finalize( stmt ) ) )
+	if ( ret_val == SQLITE_OK )
 	{
-		return -1;
+		ret_val = sqlite3_step( stmt );
+		if ( ret_val != SQLITE_DONE )
+		{
+			check_sqlite_error( "statement evaluation", ret_val );
+			res = -1;
+		}
+	}
+	else
+	{
+		res = -1;
 	}
+	release_stmt( stmt );
 
 	/*
 	 * Close the database
 	 */
 	if ( sgConLifetime == _con_lifetime_session && !sgIsInTransaction )
 	{
-		sqlite3_close( db );
+		close_db();
 	}
 
 	return res;
@@ -418,13 +537,14 @@ void roadmap_tile_remove( int fips, int tile_index )
 	if ( !db )
 	{
 		roadmap_log( ROADMAP_ERROR, "Tile remove failed - cannot open database" );
+		return;
 	}
 
 	/*
-	 * Prepare the sqlite statement
+	 * Get the prepared sqlite statement
 	 */
-	ret_val = sqlite3_prepare( db, RM_TILE_STORAGE_STMT_REMOVE, -1, &stmt, NULL );
-	if ( !check_sqlite_error( "preparing the SQLITE statement", ret_val ) )
+	stmt = get_stmt( db, &sgStmtRemove, RM_TILE_STORAGE_STMT_REMOVE );
+	if ( !stmt )
 	{
 		return;
 	}
@@ -434,6 +554,7 @@ void roadmap_tile_remove( int fips, int tile_index )
 	ret_val = sqlite3_bind_int( stmt, 1, tile_index );
 	if ( !check_sqlite_error( "binding int parameter", ret_val ) )
 	{
+		release_stmt( stmt );
 		return;
 	}
 
@@ -446,16 +567,72 @@ void roadmap_tile_remove( int fips, int tile_index )
 		check_sqlite_error( "statement evaluation", ret_val );
 	}
 
+	release_stmt( stmt );
 	/*
-	 * Finalize
+	 * Close the database
 	 */
-	sqlite3_finalize( stmt );
+	if ( sgConLifetime == _con_lifetime_session  && !sgIsInTransaction )
+	{
+		close_db();
+	}
+
+	roadmap_tile_set_version( fips, tile_index, 0 );
+}
+
+
+/***********************************************************/
+/*  Name        : roadmap_tile_set_version
+ *  Purpose     : Interface function. Records the version of the tile in the versions table.
+ *                 The record is removed when the version is 0
+ *  Params		: [in] fips
+ *  			: [in] tile_index - primary key
+ *  			: [in] version - the timestamp of the tile square
+ */
+void roadmap_tile_set_version( int fips, int tile_index, int version )
+{
+	sqlite3* db = NULL;
+	sqlite3_stmt *stmt = NULL;
+	int ret_val;
+
+	db = trans_open( fips );
+
+	if ( !db )
+	{
+		roadmap_log( ROADMAP_ERROR, "Tile version update failed - cannot open database" );
+		return;
+	}
+
+	if ( version )
+		stmt = get_stmt( db, &sgStmtSetVersion, RM_TILE_STORAGE_STMT_SET_VERSION );
+	else
+		stmt = get_stmt( db, &sgStmtRemoveVersion, RM_TILE_STORAGE_STMT_REMOVE_VERSION );
+	if ( !stmt )
+	{
+		return;
+	}
+
+	ret_val = sqlite3_bind_int( stmt, 1, tile_index );
+	if ( version && ret_val == SQLITE_OK )
+	{
+		ret_val = sqlite3_bind_int( stmt, 2, version );
+	}
+
+	if ( check_sqlite_error( "binding int parameter", ret_val ) )
+	{
+		ret_val = sqlite3_step( stmt );
+		if ( ret_val != SQLITE_DONE )
+		{
+			check_sqlite_error( "statement evaluation", ret_val );
+		}
+	}
+
+	release_stmt( stmt );
 	/*
 	 * Close the database
 	 */
 	if ( sgConLifetime == _con_lifetime_session  && !sgIsInTransaction )
 	{
-		sqlite3_close( db );
+		close_db();
 	}
 }
 
@@ -490,29 +667,112 @@ static int roadmap_tile_file_load ( const char *full_name, void **base, size_t *
 }
 
 /***********************************************************/
-/*  Name        : roadmap_tile_load
- *  Purpose     : Interface function. Loads the tile data from the database.
- *                 Allocates the necessar heap space
+/*  Name        : load_blob
+ *  Purpose     : Auxiliary function. Reads the tile blob directly into the buffer
+ *                 using the incremental blob I/O. The buffer is grown as necessary
+ *  Params		: [in] db
+ *  			: [in] tile_index - primary key
+ *  			: [in/out] buffer - the data storage address
+ *  			: [in/out] capacity - the allocated size of the buffer
+ *				: [out] size - the size of the data block
+ */
+static int load_blob( sqlite3* db, int tile_index, void **buffer, size_t *capacity, size_t *size )
+{
+	int ret_val;
+	int bytes;
+
+#if SQLITE_VERSION_NUMBER >= 3007004
+	if ( sgLoadBlob )
+	{
+		ret_val = sqlite3_blob_reopen( sgLoadBlob, tile_index );
+	}
+	else
+#endif
+	{
+		if ( sgLoadBlob )
+		{
+			sqlite3_blob_close( sgLoadBlob );
+			sgLoadBlob = NULL;
+		}
+		ret_val = sqlite3_blob_open( db, "main", RM_TILE_STORAGE_TILES_TABLE, RM_TILE_STORAGE_TILES_TABLE_DATA,
+				tile_index, 0, &sgLoadBlob );
+	}
+
+	/*
+	 * Missing tile - no row for this id
+	 */
+	if ( ret_val != SQLITE_OK )
+	{
+		if ( sgLoadBlob )
+		{
+			sqlite3_blob_close( sgLoadBlob );
+			sgLoadBlob = NULL;
+		}
+		return -1;
+	}
+
+	bytes = sqlite3_blob_bytes( sgLoadBlob );
+	if ( *capacity < (size_t) bytes || !*buffer )
+	{
+		free( *buffer );
+		*buffer = malloc( bytes ? bytes : 1 );
+		roadmap_check_allocated( *buffer );
+		*capacity = bytes;
+	}
+
+	ret_val = sqlite3_blob_read( sgLoadBlob, *buffer, bytes, 0 );
+	if ( !check_sqlite_error( "blob read", ret_val ) )
+	{
+		return -1;
+	}
+
+	*size = bytes;
+	return 0;
+}
+
+/***********************************************************/
+/*  Name        : roadmap_tile_map
+ *  Purpose     : Interface function. The database is not mapped -
+ *                 the tiles are loaded by roadmap_tile_load_buffer
  *  Params		: [in] fips
  *  			: [in] tile_index - primary key
- *  			: [out] base - the data storage address
+ *  			: [out] data - the mapped data
  *				: [out] size - the size of the data block
  */
-int roadmap_tile_load (int fips, int tile_index, void **base, size_t *size)
+int roadmap_tile_map (int fips, int tile_index, const void **data, size_t *size)
+{
+	return -1;
+}
+
+/***********************************************************/
+/*  Name        : roadmap_tile_load_buffer
+ *  Purpose     : Interface function. Loads the tile data from the database
+ *                 into the buffer kept by the caller. Reallocates the buffer if too small
+ *  Params		: [in] fips
+ *  			: [in] tile_index - primary key
+ *  			: [in/out] buffer - the data storage address
+ *  			: [in/out] capacity - the allocated size of the buffer
+ *				: [out] size - the size of the data block
+ */
+int roadmap_tile_load_buffer (int fips, int tile_index, void **buffer, size_t *capacity, size_t *size)
 {
 	int res = -1;
 	sqlite3* db = NULL;
-	sqlite3_stmt *stmt = NULL;
-	int ret_val;
 
 	if ( tile_index == -1 )
 	{
+		void *base;
 		const char* file_name = get_global_filename( fips );
-		res = roadmap_tile_file_load( file_name, base, size );
+		res = roadmap_tile_file_load( file_name, &base, size );
+		if ( res == 0 )
+		{
+			free( *buffer );
+			*buffer = base;
+			*capacity = *size;
+		}
 		return res;
 	}
 
-//	db = get_db( fips );
 	db = trans_open( fips );
 
 	if ( !db )
@@ -521,61 +781,124 @@ int roadmap_tile_load (int fips, int tile_index, void **base, size_t *size)
 		return -1;
 	}
 
+	res = load_blob( db, tile_index, buffer, capacity, size );
+
 	/*
-	 * Prepare the sqlite statement
+	 * Close the database
 	 */
-	ret_val = sqlite3_prepare( db, RM_TILE_STORAGE_STMT_LOAD, -1, &stmt, NULL );
-	if ( !check_sqlite_error( "preparing the SQLITE statement", ret_val ) )
+	if ( sgConLifetime == _con_lifetime_session && !sgIsInTransaction )
 	{
-		return -1;
+		close_db();
 	}
-	/*
-	 * Binding the parameter
-	 */
-	ret_val = sqlite3_bind_int( stmt, 1, tile_index );
-	if ( !check_sqlite_error( "binding int parameter", ret_val ) )
+
+   return res;
+}
+
+/***********************************************************/
+/*  Name        : roadmap_tile_load
+ *  Purpose     : Interface function. Loads the tile data from the database.
+ *                 Allocates the necessar heap space
+ *  Params		: [in] fips
+ *  			: [in] tile_index - primary key
+ *  			: [out] base - the data storage address
+ *				: [out] size - the size of the data block
+ */
+int roadmap_tile_load (int fips, int tile_index, void **base, size_t *size)
+{
+	size_t capacity = 0;
+
+	*base = NULL;
+	if ( roadmap_tile_load_buffer( fips, tile_index, base, &capacity, size ) != 0 )
 	{
+		free( *base );
+		*base = NULL;
 		return -1;
 	}
 
-	/*
-	 * Evaluate
-	 */
-	ret_val = sqlite3_step( stmt );
+	return 0;
+}
+
+
+/***********************************************************/
+/*  Name        : roadmap_tile_load_batch
+ *  Purpose     : Interface function. Loads several tiles in one query per
+ *                 RM_TILE_STORAGE_BATCH_SIZE ids. The blob is passed to the callback
+ *                 without copying
+ *  Params		: [in] fips
+ *  			: [in] tile_indexes - primary keys
+ *  			: [in] count - number of tiles
+ *				: [in] cb - called for each tile found
+ *				: [in] context - passed to the callback
+ *				: Returns the number of tiles found or -1 on failure
+ */
+int roadmap_tile_load_batch (int fips, const int *tile_indexes, int count,
+                             roadmap_tile_load_cb cb, void *context)
+{
+	sqlite3* db = NULL;
+	sqlite3_stmt *stmt = NULL;
+	int ret_val;
+	int found = 0;
+	int first;
+	int i;
+
+	if ( count <= 0 )
+		return 0;
 
-	if ( ret_val == SQLITE_ROW )
+	db = trans_open( fips );
+
+	if ( !db )
 	{
-		const void* data;
-		*size = sqlite3_column_bytes( stmt, 0 );
-		*base = malloc( *size );
-		roadmap_check_allocated( *base );
-		data = sqlite3_column_blob( stmt, 0 );
+		roadmap_log( ROADMAP_ERROR, "Tile batch loading failed - cannot open database" );
+		return -1;
+	}
 
-		memcpy( *base, data, *size );
-		res = 0;
+	stmt = get_stmt( db, &sgStmtLoadBatch, get_batch_stmt_string() );
+	if ( !stmt )
+	{
+		return -1;
 	}
-	else
+
+	for ( first = 0; first < count && found >= 0; first += RM_TILE_STORAGE_BATCH_SIZE )
 	{
-		res = -1;
+		int num = count - first;
+		if ( num > RM_TILE_STORAGE_BATCH_SIZE )
+			num = RM_TILE_STORAGE_BATCH_SIZE;
+
+		/*
+		 * Unused parameters repeat the last id
+		 */
+		for ( i = 0; i < RM_TILE_STORAGE_BATCH_SIZE; i++ )
+		{
+			sqlite3_bind_int( stmt, i + 1, tile_indexes[first + ( i < num ? i : num - 1 )] );
+		}
+
+		while ( ( ret_val = sqlite3_step( stmt ) ) == SQLITE_ROW )
+		{
+			const void* data = sqlite3_column_blob( stmt, 1 );
+			int size = sqlite3_column_bytes( stmt, 1 );
+
+			cb( sqlite3_column_int( stmt, 0 ), data, size, context );
+			found++;
+		}
+
 		if ( ret_val != SQLITE_DONE )
 		{
 			check_sqlite_error( "select evaluation", ret_val );
+			found = -1;
 		}
+		sqlite3_reset( stmt );
 	}
 
-	/*
-	 * Finalize
-	 */
-	sqlite3_finalize( stmt );
+	release_stmt( stmt );
 	/*
 	 * Close the database
 	 */
 	if ( sgConLifetime == _con_lifetime_session && !sgIsInTransaction )
 	{
-		sqlite3_close( db );
+		close_db();
 	}
 
-   return res;
+	return found;
 }
 
 
@@ -597,10 +920,7 @@ void roadmap_tile_remove_all( int fips )
    {
       trans_rollback();
    }
-   else
-   {
-      close_db();
-   }
+   close_db();
 
 
    // Reset state
@@ -613,5 +933,130 @@ void roadmap_tile_remove_all( int fips )
 }
 
 
+/***********************************************************/
+/*  Name        : roadmap_tile_storage_shutdown
+ *  Purpose     : Interface function. Commits the open transaction and closes the database
+ *  Params		: void
+ */
+void roadmap_tile_storage_shutdown( void )
+{
+	if ( sgIsInTransaction )
+	{
+		roadmap_main_remove_periodic( trans_timeout );
+		trans_commit();
+	}
+	close_db();
+}
+
+
+/***********************************************************/
+/*  Name        : roadmap_tile_enumerate
+ *  Purpose     : Interface function. Calls the callback for each tile stored in the database
+ *  Params		: [in] fips
+ *  			: [in] cb - called with the id of each tile
+ *				: Returns the number of tiles or -1 on failure
+ */
+int roadmap_tile_enumerate (int fips, roadmap_tile_enum_cb cb)
+{
+	sqlite3* db = NULL;
+	sqlite3_stmt *stmt = NULL;
+	int ret_val;
+	int count = 0;
+
+	db = trans_open( fips );
+
+	if ( !db )
+	{
+		roadmap_log( ROADMAP_ERROR, "Tile enumeration failed - cannot open database" );
+		return -1;
+	}
+
+	/*
+	 * Prepare the sqlite statement
+	 */
+	ret_val = sqlite3_prepare( db, RM_TILE_STORAGE_STMT_ENUMERATE, -1, &stmt, NULL );
+	if ( !check_sqlite_error( "preparing the SQLITE statement", ret_val ) )
+	{
+		return -1;
+	}
+
+	/*
+	 * Evaluate
+	 */
+	while ( ( ret_val = sqlite3_step( stmt ) ) == SQLITE_ROW )
+	{
+		cb( sqlite3_column_int( stmt, 0 ) );
+		count++;
+	}
+
+	if ( ret_val != SQLITE_DONE )
+	{
+		check_sqlite_error( "select evaluation", ret_val );
+	}
+
+	/*
+	 * Finalize
+	 */
+	sqlite3_finalize( stmt );
+	/*
+	 * Close the database
+	 */
+	if ( sgConLifetime == _con_lifetime_session && !sgIsInTransaction )
+	{
+		close_db();
+	}
+
+	return count;
+}
+
+
+/***********************************************************/
+/*  Name        : roadmap_tile_enumerate_versions
+ *  Purpose     : Interface function. Calls the callback for each tile in the versions table
+ *  Params		: [in] fips
+ *  			: [in] cb - called with the id and the version of each tile
+ *				: Returns the number of tiles or -1 on failure
+ */
+int roadmap_tile_enumerate_versions (int fips, roadmap_tile_version_cb cb)
+{
+	sqlite3* db = NULL;
+	sqlite3_stmt *stmt = NULL;
+	int ret_val;
+	int count = 0;
+
+	db = trans_open( fips );
+
+	if ( !db )
+	{
+		roadmap_log( ROADMAP_ERROR, "Tile versions enumeration failed - cannot open database" );
+		return -1;
+	}
 
- 
+	ret_val = sqlite3_prepare( db, RM_TILE_STORAGE_STMT_ENUM_VERSIONS, -1, &stmt, NULL );
+	if ( !check_sqlite_error( "preparing the SQLITE statement", ret_val ) )
+	{
+		return -1;
+	}
+
+	while ( ( ret_val = sqlite3_step( stmt ) ) == SQLITE_ROW )
+	{
+		cb( sqlite3_column_int( stmt, 0 ), sqlite3_column_int( stmt, 1 ) );
+		count++;
+	}
+
+	if ( ret_val != SQLITE_DONE )
+	{
+		check_sqlite_error( "select evaluation", ret_val );
+	}
+
+	sqlite3_finalize( stmt );
+	/*
+	 * Close the database
+	 */
+	if ( sgConLifetime == _con_lifetime_session && !sgIsInTransaction )
+	{
+		close_db();
+	}
+
+	return count;
+}
@@ -68,6 +68,8 @@ int roadmap_zlib_compress (const char* in_path, const char* in_file, const char*
    else
    		source = roadmap_file_fopen (in_path, in_file, "r");
 #else
+   if (isLogFile)
+   		roadmap_log_flush();
    source = roadmap_file_fopen (in_path, in_file, "r");
 
 #endif
@@ -0,0 +1,513 @@
+/* tile_stub.c - A stub server for the batch tile download
+ *
+ * LICENSE:
+ *
+ *   Copyright 2012 Assaf Paz
+ *
+ *   This file is part of RoadMap.
+ *
+ *   RoadMap is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   RoadMap is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with RoadMap; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * DESCRIPTION:
+ *
+ *   Serves the tiles database of a map (tiles_<fips>.db, as written by
+ *   roadmap_tile_storage_sqlite.c) through roadmap_tile_batch_serve() and
+ *   roadmap_tile_batch_serve_manifest():
+ *
+ *      POST <any path>?fips=<fips>      answers a batch request
+ *      GET  <path ending in manifest>   returns the manifest of the map
+ *
+ *   The requests are served one at a time. The version of a tile is the one
+ *   recorded in tiles_version, or else the timestamp of its square. Tiles
+ *   that have neither use --time, or the time the database was last changed.
+ *
+ * SYNOPSIS:
+ *
+ *   tile_stub [--port <port>] [--dir <maps dir>] [--time <timestamp>] <fips>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include <sqlite3.h>
+#include <zlib.h>
+
+#include "roadmap.h"
+#include "roadmap_data_format.h"
+#include "roadmap_db_square.h"
+#include "roadmap_tile_model.h"
+#include "roadmap_tile_storage.h"
+#include "roadmap_tile_batch.h"
+
+#define TILE_STUB_MAX_HEADER  4096
+#define TILE_STUB_MAX_BODY    (ROADMAP_TILE_BATCH_MAX * 64)
+
+typedef struct {
+
+   char     *data;
+   size_t   size;
+   size_t   capacity;
+} TileStubResponse;
+
+int RoadMapLogLevel = ROADMAP_MESSAGE_WARNING;
+
+static const char *TileStubDir = ".";
+static int        TileStubFips;
+static sqlite3    *TileStubDb;
+static time_t     TileStubDbTime;
+
+/* The versions of the open database, read once as most need a tile decoded */
+static int        *TileStubVersions;
+static int        TileStubVersionsCount = -1;
+
+
+void roadmap_log_write (int level, const char *source, int line, const char *format, ...) {
+
+   va_list ap;
+
+   fprintf (stderr, "%s:%d ", source, line);
+
+   va_start (ap, format);
+   vfprintf (stderr, format, ap);
+   va_end (ap);
+
+   fprintf (stderr, "\n");
+
+   if (level >= ROADMAP_MESSAGE_FATAL) exit (1);
+}
+
+
+static sqlite3 *tile_stub_open (int fips) {
+
+   char path[512];
+   struct stat db_stat;
+
+   snprintf (path, sizeof (path), "%s/tiles_%d.db", TileStubDir, fips);
+   if (stat (path, &db_stat) != 0) db_stat.st_mtime = 0;
+
+   if (TileStubDb) {
+      if (fips == TileStubFips && db_stat.st_mtime == TileStubDbTime) return TileStubDb;
+      sqlite3_close (TileStubDb);
+      TileStubDb = NULL;
+   }
+
+   free (TileStubVersions);
+   TileStubVersions = NULL;
+   TileStubVersionsCount = -1;
+
+   if (sqlite3_open_v2 (path, &TileStubDb, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK) {
+      roadmap_log (ROADMAP_ERROR, "Cannot open %s: %s", path, sqlite3_errmsg (TileStubDb));
+      sqlite3_close (TileStubDb);
+      TileStubDb = NULL;
+      return NULL;
+   }
+
+   TileStubFips = fips;
+   TileStubDbTime = db_stat.st_mtime;
+   return TileStubDb;
+}
+
+
+/* Returns the timestamp of the square of a stored tile, or 0 */
+static int tile_stub_square_timestamp (const void *data, size_t size) {
+
+   const roadmap_tile_file_header *tile_header = (const roadmap_tile_file_header *)data;
+   const roadmap_data_header *header;
+   const roadmap_data_entry *index;
+   unsigned char *raw;
+   unsigned long raw_size;
+   unsigned int offset;
+   unsigned int alignment;
+   int timestamp = 0;
+
+   if (size < sizeof (roadmap_tile_file_header) ||
+       memcmp (tile_header->general_header.signature, ROADMAP_DATA_SIGNATURE, 4) ||
+       tile_header->general_header.endianness != ROADMAP_DATA_ENDIAN_CORRECT ||
+       tile_header->compressed_data_size != size - sizeof (roadmap_tile_file_header)) {
+      return 0;
+   }
+
+   raw_size = tile_header->raw_data_size;
+   raw = malloc (raw_size ? raw_size : 1);
+   if (!raw) return 0;
+
+   if (uncompress (raw, &raw_size, (const unsigned char *)(tile_header + 1),
+                   tile_header->compressed_data_size) == Z_OK &&
+       raw_size >= sizeof (roadmap_data_header)) {
+
+      header = (const roadmap_data_header *)raw;
+      index = (const roadmap_data_entry *)(header + 1);
+      alignment = (1 << header->byte_alignment_bits) - 1;
+
+      if (header->num_sections > model__tile_square_data &&
+          raw_size >= sizeof (roadmap_data_header) +
+                      header->num_sections * sizeof (roadmap_data_entry)) {
+
+         offset = model__tile_square_data > 0 ?
+                     (index[model__tile_square_data - 1].end_offset + alignment) & ~alignment : 0;
+         offset += sizeof (roadmap_data_header) + header->num_sections * sizeof (roadmap_data_entry);
+
+         if (offset + sizeof (RoadMapSquare) <= raw_size) {
+            timestamp = (int)((const RoadMapSquare *)(raw + offset))->timestamp;
+         }
+      }
+   }
+
+   free (raw);
+   return timestamp;
+}
+
+
+static int tile_stub_read_versions (sqlite3 *db) {
+
+   sqlite3_stmt *stmt;
+   int capacity = 0;
+   int count = 0;
+
+   /* the versions table is missing from the databases of older clients */
+   if (sqlite3_prepare_v2 (db,
+            "SELECT tiles_table.id, tiles_version.version, tiles_table.data "
+            "FROM tiles_table LEFT JOIN tiles_version ON tiles_table.id = tiles_version.id;",
+            -1, &stmt, NULL) != SQLITE_OK &&
+       sqlite3_prepare_v2 (db, "SELECT id, 0, data FROM tiles_table;",
+            -1, &stmt, NULL) != SQLITE_OK) {
+      roadmap_log (ROADMAP_ERROR, "Cannot prepare the versions query: %s", sqlite3_errmsg (db));
+      return -1;
+   }
+
+   while (sqlite3_step (stmt) == SQLITE_ROW) {
+
+      int version = sqlite3_column_int (stmt, 1);
+
+      if (version <= 0) {
+         version = tile_stub_square_timestamp (sqlite3_column_blob (stmt, 2),
+                                               (size_t)sqlite3_column_bytes (stmt, 2));
+         if (version <= 0) continue;
+      }
+
+      if (count == capacity) {
+         int *grown;
+
+         capacity = capacity ? capacity * 2 : 1024;
+         grown = realloc (TileStubVersions, capacity * 2 * sizeof (int));
+         if (!grown) {
+            roadmap_log (ROADMAP_FATAL, "No memory for %d tile versions", capacity);
+         }
+         TileStubVersions = grown;
+      }
+
+      TileStubVersions[count * 2] = sqlite3_column_int (stmt, 0);
+      TileStubVersions[count * 2 + 1] = version;
+      count++;
+   }
+
+   sqlite3_finalize (stmt);
+   return count;
+}
+
+
+int roadmap_tile_load_batch (int fips, const int *tile_indexes, int count,
+                             roadmap_tile_load_cb cb, void *context) {
+
+   sqlite3 *db = tile_stub_open (fips);
+   sqlite3_stmt *stmt;
+   int found = 0;
+   int i;
+
+   if (!db) return -1;
+
+   if (sqlite3_prepare_v2 (db, "SELECT data FROM tiles_table WHERE id = ?;", -1, &stmt, NULL) != SQLITE_OK) {
+      roadmap_log (ROADMAP_ERROR, "Cannot prepare the tile query: %s", sqlite3_errmsg (db));
+      return -1;
+   }
+
+   for (i = 0; i < count; i++) {
+
+      sqlite3_bind_int (stmt, 1, tile_indexes[i]);
+
+      if (sqlite3_step (stmt) == SQLITE_ROW) {
+         cb (tile_indexes[i], sqlite3_column_blob (stmt, 0),
+             (size_t)sqlite3_column_bytes (stmt, 0), context);
+         found++;
+      }
+
+      sqlite3_reset (stmt);
+   }
+
+   sqlite3_finalize (stmt);
+   return found;
+}
+
+
+int roadmap_tile_enumerate (int fips, roadmap_tile_enum_cb cb) {
+
+   sqlite3 *db = tile_stub_open (fips);
+   sqlite3_stmt *stmt;
+   int count = 0;
+
+   if (!db) return -1;
+
+   if (sqlite3_prepare_v2 (db, "SELECT id FROM tiles_table;", -1, &stmt, NULL) != SQLITE_OK) {
+      roadmap_log (ROADMAP_ERROR, "Cannot prepare the tile query: %s", sqlite3_errmsg (db));
+      return -1;
+   }
+
+   while (sqlite3_step (stmt) == SQLITE_ROW) {
+      cb (sqlite3_column_int (stmt, 0));
+      count++;
+   }
+
+   sqlite3_finalize (stmt);
+   return count;
+}
+
+
+int roadmap_tile_enumerate_versions (int fips, roadmap_tile_version_cb cb) {
+
+   sqlite3 *db = tile_stub_open (fips);
+   int i;
+
+   if (!db) return -1;
+
+   if (TileStubVersionsCount < 0) {
+      TileStubVersionsCount = tile_stub_read_versions (db);
+      if (TileStubVersionsCount < 0) return -1;
+      roadmap_log (ROADMAP_INFO, "Found the versions of %d tiles", TileStubVersionsCount);
+   }
+
+   for (i = 0; i < TileStubVersionsCount; i++) {
+      cb (TileStubVersions[i * 2], TileStubVersions[i * 2 + 1]);
+   }
+
+   return TileStubVersionsCount;
+}
+
+
+static void tile_stub_write (const void *data, size_t size, void *context) {
+
+   TileStubResponse *response = (TileStubResponse *)context;
+
+   if (response->size + size > response->capacity) {
+
+      size_t capacity = response->capacity ? response->capacity * 2 : 64 * 1024;
+      char *grown;
+
+      while (capacity < response->size + size) capacity *= 2;
+
+      grown = realloc (response->data, capacity);
+      if (!grown) {
+         roadmap_log (ROADMAP_FATAL, "No memory for a response of %u bytes", (unsigned int)capacity);
+      }
+      response->data = grown;
+      response->capacity = capacity;
+   }
+
+   memcpy (response->data + response->size, data, size);
+   response->size += size;
+}
+
+
+static int tile_stub_send (int fd, const void *data, size_t size) {
+
+   const char *next = (const char *)data;
+
+   while (size > 0) {
+      ssize_t sent = send (fd, next, size, 0);
+      if (sent <= 0) return -1;
+      next += sent;
+      size -= (size_t)sent;
+   }
+
+   return 0;
+}
+
+
+static void tile_stub_reply (int fd, int status, const char *reason,
+                             const TileStubResponse *response) {
+
+   char header[256];
+   size_t size = response ? response->size : 0;
+
+   snprintf (header, sizeof (header),
+             "HTTP/1.1 %d %s\r\n"
+             "Content-Type: application/octet-stream\r\n"
+             "Content-Length: %u\r\n"
+             "Connection: close\r\n\r\n",
+             status, reason, (unsigned int)size);
+
+   if (tile_stub_send (fd, header, strlen (header)) == 0 && size > 0) {
+      tile_stub_send (fd, response->data, size);
+   }
+}
+
+
+static void tile_stub_serve (int fd, time_t tiles_time) {
+
+   char request[TILE_STUB_MAX_HEADER + TILE_STUB_MAX_BODY + 1];
+   size_t received = 0;
+   char *body = NULL;
+   char method[8];
+   char path[512];
+   const char *fips_arg;
+   const char *length_arg;
+   long length = 0;
+   int fips = TileStubFips;
+   TileStubResponse response;
+   int result;
+
+   /* read the header, then as much of the body as it announces */
+   while (received < sizeof (request) - 1) {
+
+      ssize_t count = recv (fd, request + received, sizeof (request) - 1 - received, 0);
+      if (count <= 0) break;
+
+      received += (size_t)count;
+      request[received] = '\0';
+
+      if (!body) {
+         body = strstr (request, "\r\n\r\n");
+         if (!body) continue;
+         body += 4;
+
+         length_arg = strstr (request, "Content-Length:");
+         if (length_arg && length_arg < body) {
+            length = atol (length_arg + strlen ("Content-Length:"));
+         }
+         if (length < 0 || length > TILE_STUB_MAX_BODY) {
+            tile_stub_reply (fd, 413, "Request Entity Too Large", NULL);
+            return;
+         }
+      }
+
+      if (body && request + received - body >= length) break;
+   }
+
+   if (!body || request + received - body < length ||
+       sscanf (request, "%7s %511s", method, path) != 2) {
+      tile_stub_reply (fd, 400, "Bad Request", NULL);
+      return;
+   }
+   body[length] = '\0';
+
+   fips_arg = strstr (path, "fips=");
+   if (fips_arg) fips = atoi (fips_arg + strlen ("fips="));
+   if (strchr (path, '?')) *strchr (path, '?') = '\0';
+
+   memset (&response, 0, sizeof (response));
+
+   if (!strcmp (method, "POST")) {
+
+      result = roadmap_tile_batch_serve (fips, body, tiles_time, tile_stub_write, &response);
+
+   } else if (!strcmp (method, "GET") &&
+              strlen (path) >= strlen ("manifest") &&
+              !strcmp (path + strlen (path) - strlen ("manifest"), "manifest")) {
+
+      result = roadmap_tile_batch_serve_manifest (fips, (int)tiles_time, tile_stub_write, &response);
+
+   } else {
+
+      tile_stub_reply (fd, 404, "Not Found", NULL);
+      return;
+   }
+
+   if (result < 0) {
+      tile_stub_reply (fd, 400, "Bad Request", NULL);
+   } else {
+      roadmap_log (ROADMAP_INFO, "%s %s (fips %d): %d items, %u bytes",
+                   method, path, fips, result, (unsigned int)response.size);
+      tile_stub_reply (fd, 200, "OK", &response);
+   }
+
+   free (response.data);
+}
+
+
+static void tile_stub_usage (const char *program) {
+
+   fprintf (stderr, "usage: %s [--port <port>] [--dir <maps dir>] [--time <timestamp>] [--verbose] <fips>\n",
+            program);
+   exit (1);
+}
+
+
+int main (int argc, char **argv) {
+
+   int port = 8080;
+   time_t tiles_time = 0;
+   char path[512];
+   struct stat db_stat;
+   struct sockaddr_in address;
+   int listener;
+   int on = 1;
+   int i;
+
+   for (i = 1; i < argc - 1; i++) {
+      if (!strcmp (argv[i], "--port")) {
+         port = atoi (argv[++i]);
+      } else if (!strcmp (argv[i], "--dir")) {
+         TileStubDir = argv[++i];
+      } else if (!strcmp (argv[i], "--time")) {
+         tiles_time = (time_t)atol (argv[++i]);
+      } else if (!strcmp (argv[i], "--verbose")) {
+         RoadMapLogLevel = ROADMAP_MESSAGE_INFO;
+      } else {
+         tile_stub_usage (argv[0]);
+      }
+   }
+
+   if (i != argc - 1) tile_stub_usage (argv[0]);
+   TileStubFips = atoi (argv[i]);
+
+   snprintf (path, sizeof (path), "%s/tiles_%d.db", TileStubDir, TileStubFips);
+   if (stat (path, &db_stat) != 0) {
+      roadmap_log (ROADMAP_ERROR, "Cannot find %s", path);
+      return 1;
+   }
+   if (!tiles_time) tiles_time = db_stat.st_mtime;
+
+   listener = socket (AF_INET, SOCK_STREAM, 0);
+   setsockopt (listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof (on));
+
+   memset (&address, 0, sizeof (address));
+   address.sin_family = AF_INET;
+   address.sin_addr.s_addr = htonl (INADDR_ANY);
+   address.sin_port = htons ((unsigned short)port);
+
+   if (bind (listener, (struct sockaddr *)&address, sizeof (address)) != 0 ||
+       listen (listener, 8) != 0) {
+      roadmap_log (ROADMAP_ERROR, "Cannot listen on port %d", port);
+      return 1;
+   }
+
+   fprintf (stderr, "Serving %s on port %d, tiles time %ld\n", path, port, (long)tiles_time);
+
+   for (;;) {
+
+      int fd = accept (listener, NULL, NULL);
+      if (fd < 0) continue;
+
+      tile_stub_serve (fd, tiles_time);
+      close (fd);
+   }
+
+   return 0;
+}
@@ -0,0 +1,20 @@
+# A stub tiles server, which serves a tiles database through the batch
+# download protocol of roadmap_tile_batch.c. Used to test the tile manager
+# without the real server:
+#
+#    tile_stub --port 8080 --dir ~/.waze/maps 77001
+#
+# and set "Download"/"Tiles batch" to http://localhost:8080/batch and
+# "Download"/"Tiles manifest" to http://localhost:8080/manifest.
+
+QT       -= core gui
+TEMPLATE = app
+TARGET = tile_stub
+CONFIG += console
+CONFIG -= app_bundle qt
+
+INCLUDEPATH += ..
+LIBS += -lsqlite3 -lz
+
+SOURCES += tile_stub.c \
+    ../roadmap_tile_batch.c
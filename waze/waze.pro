@@ -27,6 +27,11 @@ linux {
     LIBS += -ldl -lrt -lssl -lcrypto
 }
 
+tile_pack {
+    SOURCES += roadmap_tile_storage_pack.c
+    LIBS += -lsqlite3
+}
+
 QMAKE_CFLAGS += -Wno-unused-result -Wno-unused-but-set-variable -Wno-unused-parameter -Wno-unused-variable -Wno-unused-function -Wno-char-subscripts -Werror
 QMAKE_CXXFLAGS += -Wno-unused-result -Wno-unused-but-set-variable -Wno-unused-parameter -Wno-unused-variable -Wno-deprecated-copy -Wno-error=class-memaccess -Werror
 
@@ -82,6 +87,7 @@ SOURCES += \
     roadmap_nmea.c \
     roadmap_net_mon.c \
     roadmap_navigate.c \
+    roadmap_navigate_hmm.c \
     roadmap_mood.c \
     roadmap_metadata.c \
     roadmap_message.c \
@@ -172,6 +178,8 @@ SOURCES += \
     editor/track/editor_gps_data.c \
     md5.c \
     roadmap_tile_manager.c \
+    roadmap_tile_decode.c \
+    roadmap_tile_batch.c \
     roadmap_screen.c \
     ssd/ssd_dialog.c \
     ssd/ssd_widget_tab_order.c \
@@ -205,6 +213,7 @@ SOURCES += \
     Realtime/RealtimeTrafficInfo.c \
     Realtime/RealtimeSystemMessage.c \
     Realtime/RealtimePrivacy.c \
+    Realtime/RealtimePackedPath.c \
     Realtime/RealtimeOffline.c \
     Realtime/RealtimeNetRec.c \
     Realtime/RealtimeNetDefs.c \
@@ -229,6 +238,7 @@ SOURCES += \
     address_search/address_search.c \
     websvc_trans/websvc_trans_queue.c \
     websvc_trans/websvc_trans.c \
+    websvc_trans/websvc_trans_parsers.c \
     websvc_trans/websvc_address.c \
     websvc_trans/web_date_format.c \
     websvc_trans/string_parser.c \
@@ -246,7 +256,8 @@ SOURCES += \
     navigate/navigate_instr.c \
     navigate/navigate_graph.c \
     navigate/navigate_cost.c \
-    navigate/fib-1.1/fib.c \
+    navigate/navigate_heap.c \
+    navigate/navigate_overlay.c \
     roadmap_dialog.c \
     roadmap_device_array.c \
     roadmap_gpsd2.c \
@@ -295,6 +306,7 @@ HEADERS += \
     Realtime/RealtimeTrafficInfo.h \
     Realtime/RealtimeSystemMessage.h \
     Realtime/RealtimePrivacy.h \
+    Realtime/RealtimePackedPath.h \
     Realtime/RealtimeOffline.h \
     Realtime/RealtimeNetDefs.h \
     Realtime/RealtimeNet.h \
@@ -333,6 +345,7 @@ HEADERS += \
     websvc_trans/websvc_trans_queue.h \
     websvc_trans/websvc_trans_defs.h \
     websvc_trans/websvc_trans.h \
+    websvc_trans/websvc_trans_parsers.h \
     websvc_trans/websvc_address_defs.h \
     websvc_trans/websvc_address.h \
     websvc_trans/web_date_format_defs.h \
@@ -353,8 +366,8 @@ HEADERS += \
     navigate/navigate_graph.h \
     navigate/navigate_cost.h \
     navigate/navigate_bar.h \
-    navigate/fib-1.1/fibpriv.h \
-    navigate/fib-1.1/fib.h \
+    navigate/navigate_heap.h \
+    navigate/navigate_overlay.h \
     roadmap_login.h \
     roadmap_zlib.h \
     roadmap_welcome_wizard.h \
@@ -372,6 +385,8 @@ HEADERS += \
     roadmap_tile_status.h \
     roadmap_tile_model.h \
     roadmap_tile_manager.h \
+    roadmap_tile_decode.h \
+    roadmap_tile_batch.h \
     roadmap_ticker.h \
     roadmap_sunrise.h \
     roadmap_strings.h \
@@ -411,6 +426,7 @@ HEADERS += \
     roadmap_nmea.h \
     roadmap_net_mon.h \
     roadmap_navigate.h \
+    roadmap_navigate_hmm.h \
     roadmap_mood.h \
     roadmap_metadata.h \
     roadmap_message.h \
@@ -16,6 +16,7 @@ void cyclic_buffer_init( cyclic_buffer_ptr this)
    //   Internal usage:
    this->next_read      = this->buffer;
    this->free_size      = CYCLIC_BUFFER_SIZE;
+   this->line_scanned   = 0;
 }
 
 //   Recylce buffer before going into the next 'read' statement
@@ -33,6 +34,7 @@ void cyclic_buffer_recycle( cyclic_buffer_ptr this)
       //   Internal usage:
       this->next_read = this->buffer;
       this->free_size = CYCLIC_BUFFER_SIZE;
+      this->line_scanned = 0;
    }
    else
    {
@@ -47,6 +49,10 @@ void cyclic_buffer_recycle( cyclic_buffer_ptr this)
 
          this->buffer[remained]  = '\0';     // Terminate string with a NULL
          this->read_size         = remained; // Update buffer size to unprocessed-buffer size
+
+         this->line_scanned     -= this->read_processed;
+         if( this->line_scanned < 0)
+            this->line_scanned = 0;
       }
 
       //   Internal usage:
@@ -42,6 +42,9 @@ typedef struct tag_cyclic_buffer
    char* next_read;
    int   free_size;
 
+   //   No line end in the unprocessed data before this offset:
+   int   line_scanned;
+
 }  cyclic_buffer, *cyclic_buffer_ptr;
 
 // Remarks:
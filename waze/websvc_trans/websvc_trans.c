@@ -31,6 +31,7 @@
 #include "socket_async_receive.h"
 
 #include "websvc_trans.h"
+#include "websvc_trans_parsers.h"
 
 #define MAX_RETRIES 3
 
@@ -1157,18 +1158,19 @@ static transaction_result OnHTTPHeader( cyclic_buffer_ptr CB, http_parsing_state
 
 static transaction_result OnCustomResponse( wst_context_ptr session)
 {
-   char                 tag[WST_RESPONSE_TAG_MAXSIZE+1];
+   char                 tag_buffer[WST_RESPONSE_TAG_MAXSIZE+1];
+   const char*          tag               = "";     //   Points into the data, not terminated
+   int                  tag_size          = 0;
    cyclic_buffer_ptr    CB                = &(session->CB);
    wst_parser_ptr       parsers           = session->active_item.parsers;
    int                  parsers_count     = session->active_item.parsers_count;
+   const wst_parser_table* table;
    const char*          next              = NULL;
    const char*          last              = NULL;   //   For logging
+   const char*          line_end;
    CB_OnWSTResponse     parser            = NULL;
-   CB_OnWSTResponse     def_parser        = NULL;
-   BOOL                 have_tags         = FALSE;
    BOOL                 more_data_needed  = FALSE;
    int                  buffer_size;
-   int                  i;
    roadmap_result		rc						= succeeded;
 
   waze_assert(session);
@@ -1176,16 +1178,11 @@ static transaction_result OnCustomResponse( wst_context_ptr session)
   waze_assert(parsers);
   waze_assert(parsers_count);
 
-   // Select default parser:
-   for( i=0; i<parsers_count; i++)
+   table = wst_parser_table_get( parsers, parsers_count);
+   if( !table)
    {
-      if( parsers[i].tag && parsers[i].tag[0])
-         have_tags = TRUE;
-      else
-      {
-         def_parser= parsers[i].parser;
-         break;
-      }
+      session->rc = err_no_memory;
+      return trans_failed;
    }
    
    //   As long as we have data - keep on parsing:
@@ -1213,19 +1210,40 @@ static transaction_result OnCustomResponse( wst_context_ptr session)
 
       //   In order to parse a full statement we must have a full line:
       ///[BOOKMARK]:[NOTE]:[PAZ] - WEBSVC_TRANS - Assuming each command is terminated with '\n'
-      if( NULL == strchr( next, '\n'))
+      //   Data before 'line_scanned' was already searched by previous calls
+      if( CB->line_scanned < CB->read_processed)
+         CB->line_scanned = CB->read_processed;
+      line_end = memchr( CB->buffer + CB->line_scanned, '\n', CB->read_size - CB->line_scanned);
+      if( NULL == line_end)
+      {
+         CB->line_scanned = CB->read_size;
          return trans_in_progress;   //   Continue reading...
+      }
+      CB->line_scanned = (int)(line_end - CB->buffer);
 
-      if( have_tags)
+      if( table->have_tags)
       {
-         //   Read next tag:
-         buffer_size = WST_RESPONSE_TAG_MAXSIZE;
-         next        = ExtractNetworkString(
-                           next,          // [in]     Source string
-                           tag,           // [out,opt]Output buffer
-                           &buffer_size,  // [in,out] Buffer size / Size of extracted string
-                           ",\r\n",       // [in]     Array of chars to terminate the copy operation
-                           1);            // [in]     Remove additional termination chars
+         //   Read next tag in place:
+         tag      = next;
+         tag_size = strcspn( next, ",\r\n\\");
+
+         if( ESCAPE_SEQUENCE_TAG == next[tag_size])
+         {
+            //   Escaped tag - unescape it into the local buffer:
+            buffer_size = WST_RESPONSE_TAG_MAXSIZE;
+            next        = ExtractNetworkString(
+                              next,          // [in]     Source string
+                              tag_buffer,    // [out,opt]Output buffer
+                              &buffer_size,  // [in,out] Buffer size / Size of extracted string
+                              ",\r\n",       // [in]     Array of chars to terminate the copy operation
+                              1);            // [in]     Remove additional termination chars
+            tag      = tag_buffer;
+            tag_size = buffer_size;
+         }
+         else if( tag_size >= WST_RESPONSE_TAG_MAXSIZE)
+            next = NULL;
+         else
+            next = EatChars( next + tag_size, ",\r\n", 1);
 
          next = EatChars( next, "\r\n", TRIM_ALL_CHARS);
          if( !next || !(*next))
@@ -1235,19 +1253,7 @@ static transaction_result OnCustomResponse( wst_context_ptr session)
          }
 
          //   Find parser:
-         parser = NULL;
-         for( i=0; i<parsers_count; i++)
-         {
-            #ifdef _WIN32
-               if( parsers[i].tag && (0 ==   _stricmp( tag, parsers[i].tag)))
-            #else
-               if( parsers[i].tag && (0 ==   roadmap_string_compare_ignore_case( tag, parsers[i].tag)))
-            #endif
-            {
-               parser = parsers[i].parser;
-               break;
-            }
-         }
+         parser = wst_parser_table_find( table, tag, tag_size);
       }
 
       if( parser)
@@ -1255,18 +1261,18 @@ static transaction_result OnCustomResponse( wst_context_ptr session)
          cyclic_buffer_update_processed_data( CB, next, NULL);
       else
       {
-         if( def_parser)
+         if( table->def_parser)
          {
             // "tag" was not found, thus the string "tag" was not used.
             //    Go-back on the stream, and send "tag" as well:
             cyclic_buffer_update_processed_data( CB, last, NULL);
-            parser = def_parser;
+            parser = table->def_parser;
          }
          else
          {
             session->rc = err_parser_missing_tag_handler;
 
-            roadmap_log( ROADMAP_ERROR, "WST::OnCustomResponse() - Did not find parser for tag '%s'", tag);
+            roadmap_log( ROADMAP_ERROR, "WST::OnCustomResponse() - Did not find parser for tag '%.*s'", tag_size, tag);
             return trans_failed;   //   Quit the 'receive' loop
          }
       }
@@ -1288,7 +1294,7 @@ static transaction_result OnCustomResponse( wst_context_ptr session)
             rc = err_failed;
          }
          
-         roadmap_log( ROADMAP_ERROR, "WST::OnCustomResponse() - Failed to process server request '%s'; Error: '%s'", tag, roadmap_result_string( rc));
+         roadmap_log( ROADMAP_ERROR, "WST::OnCustomResponse() - Failed to process server request '%.*s'; Error: '%s'", tag_size, tag, roadmap_result_string( rc));
          //[SRUL] Instead of failing the transaction, move on to next line
          next = SkipChars( last, "\r\n", TRIM_ALL_CHARS);
          //return trans_failed;
@@ -1301,7 +1307,7 @@ static transaction_result OnCustomResponse( wst_context_ptr session)
 
       if( more_data_needed)
       {
-         roadmap_log( ROADMAP_DEBUG, "WST::OnCustomResponse() - Tag '%s' is asking for more data. Exiting method", tag);
+         roadmap_log( ROADMAP_DEBUG, "WST::OnCustomResponse() - Tag '%.*s' is asking for more data. Exiting method", tag_size, tag);
          return trans_in_progress;  // User is asking for more data...
       }
 
@@ -0,0 +1,201 @@
+/* websvc_trans_parsers.c - Lookup tables of the response parsers
+ *
+ * LICENSE:
+ *
+ *   Copyright 2012 Assaf Paz
+ *
+ *   This file is part of RoadMap.
+ *
+ *   RoadMap is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   RoadMap is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with RoadMap; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+#include "websvc_trans_parsers.h"
+
+#define  WST_PARSER_TABLES_MAXSIZE           (16)
+
+static   wst_parser_table  tables[WST_PARSER_TABLES_MAXSIZE];
+static   int               tables_next = 0;   //   Next table to replace, when all are used
+
+//   Case insensitive compare of two strings which are not null terminated
+static int compare_tags( const char* a, int a_size, const char* b, int b_size)
+{
+   int i;
+   int size = (a_size < b_size)? a_size: b_size;
+
+   for( i=0; i<size; i++)
+   {
+      int ca = tolower( (unsigned char)a[i]);
+      int cb = tolower( (unsigned char)b[i]);
+
+      if( ca != cb)
+         return ca - cb;
+   }
+
+   return a_size - b_size;
+}
+
+static int compare_entries( const void* a, const void* b)
+{
+   const wst_parser_entry* ea = (const wst_parser_entry*)a;
+   const wst_parser_entry* eb = (const wst_parser_entry*)b;
+   int res = compare_tags( ea->tag, ea->tag_size, eb->tag, eb->tag_size);
+
+   //   Keep the original order of equal tags; the first one wins
+   if( !res)
+      res = (ea < eb)? -1: (ea > eb);
+
+   return res;
+}
+
+static void table_free( wst_parser_table_ptr this)
+{
+   free( this->copy);
+   free( this->entries);
+   memset( this, 0, sizeof(wst_parser_table));
+}
+
+static BOOL table_build( wst_parser_table_ptr this, const wst_parser_ptr parsers, int parsers_count)
+{
+   int i;
+   int count = 0;
+
+   this->copy     = malloc( parsers_count * sizeof(wst_parser));
+   this->entries  = malloc( parsers_count * sizeof(wst_parser_entry));
+   if( !this->copy || !this->entries)
+   {
+      table_free( this);
+      return FALSE;
+   }
+
+   memcpy( this->copy, parsers, parsers_count * sizeof(wst_parser));
+   this->parsers        = parsers;
+   this->parsers_count  = parsers_count;
+
+   // Select default parser:
+   for( i=0; i<parsers_count; i++)
+   {
+      if( parsers[i].tag && parsers[i].tag[0])
+         this->have_tags = TRUE;
+      else
+      {
+         this->def_parser= parsers[i].parser;
+         break;
+      }
+   }
+
+   for( i=0; i<parsers_count; i++)
+   {
+      if( parsers[i].tag)
+      {
+         this->entries[count].tag      = parsers[i].tag;
+         this->entries[count].tag_size = strlen( parsers[i].tag);
+         this->entries[count].parser   = parsers[i].parser;
+         count++;
+      }
+   }
+
+   qsort( this->entries, count, sizeof(wst_parser_entry), compare_entries);
+
+   //   Drop duplicates, keeping the first parser of each tag:
+   this->entries_count = 0;
+   for( i=0; i<count; i++)
+   {
+      if( this->entries_count &&
+         !compare_tags( this->entries[i].tag, this->entries[i].tag_size,
+                        this->entries[this->entries_count-1].tag, this->entries[this->entries_count-1].tag_size))
+         continue;
+
+      this->entries[this->entries_count++] = this->entries[i];
+   }
+
+   return TRUE;
+}
+
+const wst_parser_table* wst_parser_table_get(
+                              const wst_parser_ptr parsers,
+                              int                  parsers_count)
+{
+   wst_parser_table_ptr table;
+   int i;
+
+   for( i=0; i<WST_PARSER_TABLES_MAXSIZE; i++)
+   {
+      table = tables + i;
+
+      if( (table->parsers == parsers) && (table->parsers_count == parsers_count))
+      {
+         if( !memcmp( table->copy, parsers, parsers_count * sizeof(wst_parser)))
+            return table;
+
+         //   Same address, other parsers - rebuild:
+         table_free( table);
+         break;
+      }
+   }
+
+   if( WST_PARSER_TABLES_MAXSIZE == i)
+   {
+      //   Use a free table, or replace the oldest:
+      for( i=0; i<WST_PARSER_TABLES_MAXSIZE; i++)
+         if( !tables[i].parsers)
+            break;
+
+      if( WST_PARSER_TABLES_MAXSIZE == i)
+      {
+         i = tables_next;
+         tables_next = (tables_next + 1) % WST_PARSER_TABLES_MAXSIZE;
+         table_free( tables + i);
+      }
+   }
+
+   table = tables + i;
+   if( !table_build( table, parsers, parsers_count))
+   {
+      roadmap_log( ROADMAP_ERROR, "wst_parser_table_get() - Failed to allocate a table of %d parsers", parsers_count);
+      return NULL;
+   }
+
+   return table;
+}
+
+CB_OnWSTResponse  wst_parser_table_find(
+                              const wst_parser_table* table,
+                              const char*             tag,
+                              int                     tag_size)
+{
+   int low  = 0;
+   int high = table->entries_count;
+
+   while( low < high)
+   {
+      int mid = (low + high) / 2;
+      int res = compare_tags( table->entries[mid].tag, table->entries[mid].tag_size, tag, tag_size);
+
+      if( !res)
+         return table->entries[mid].parser;
+
+      if( res < 0)
+         low = mid + 1;
+      else
+         high = mid;
+   }
+
+   return NULL;
+}
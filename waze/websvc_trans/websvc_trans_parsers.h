@@ -0,0 +1,67 @@
+/* websvc_trans_parsers.h - Lookup tables of the response parsers
+ *
+ * LICENSE:
+ *
+ *   Copyright 2012 Assaf Paz
+ *
+ *   This file is part of RoadMap.
+ *
+ *   RoadMap is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   RoadMap is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with RoadMap; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef	__HTTPTRANSPARSERS_H__
+#define	__HTTPTRANSPARSERS_H__
+
+#include "websvc_trans_defs.h"
+
+//   Lookup table of a set of response parsers.
+//   Tags are kept sorted (case insensitive) for a binary search.
+typedef struct tag_wst_parser_entry
+{
+   const char*       tag;
+   int               tag_size;
+   CB_OnWSTResponse  parser;
+
+}  wst_parser_entry;
+
+typedef struct tag_wst_parser_table
+{
+   wst_parser_ptr    parsers;       // The parser set the table was built for
+   wst_parser*       copy;          // Copy of the set, to detect a set that has changed
+   int               parsers_count;
+
+   wst_parser_entry* entries;       // Sorted tagged parsers
+   int               entries_count;
+
+   BOOL              have_tags;     // Tagged parsers precede the default parser
+   CB_OnWSTResponse  def_parser;    // First parser without a tag, or NULL
+
+}  wst_parser_table, *wst_parser_table_ptr;
+
+//   Returns the table of the parser set. Tables are built once and kept for
+//   the following responses of the same set.
+const wst_parser_table* wst_parser_table_get(
+                              const wst_parser_ptr parsers,
+                              int                  parsers_count);
+
+//   Returns the parser of the tag, or NULL.
+//   'tag' does not have to be null terminated.
+CB_OnWSTResponse  wst_parser_table_find(
+                              const wst_parser_table* table,
+                              const char*             tag,
+                              int                     tag_size);
+
+#endif   //   __HTTPTRANSPARSERS_H__